@@ -1,6 +1,14 @@
 // 03_layout_sizers.cpp - Layout Management with Sizers
 #include <wx/wx.h>
 
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "common/task_progress.h"
+#include "common/text_pipeline.h"
+
 class LayoutApp : public wxApp {
 public:
 	bool OnInit();
@@ -9,16 +17,41 @@ public:
 class LayoutFrame : public wxFrame {
 public:
 	LayoutFrame();
+	~LayoutFrame();
 
 private:
+	// One run of the Process button: pieces of output, filled in by the
+	// pool in any order and appended to the output control in order. The
+	// run holds its own copy of the pipeline, since a cancelled run can
+	// still be working after the frame is gone
+	struct ProcessRun {
+		std::string input;
+		TextPipeline pipeline;
+		std::mutex mutex;
+		std::vector<std::string> pieces;
+		std::vector<bool> ready;
+		size_t next = 0;
+		bool finished = false;
+	};
+
 	void OnExit(wxCommandEvent& event);
 	void OnAbout(wxCommandEvent& event);
 	void OnButtonClick(wxCommandEvent& event);
 
+	void StartProcessing();
+	void CancelProcessing();
+	void AppendProcessed(std::shared_ptr<ProcessRun> run);
+
 	wxTextCtrl* m_textInput;
 	wxTextCtrl* m_textOutput;
 	wxListBox* m_listBox;
 
+	// Upper case, then spaces to underscores, fused into one pass
+	TextPipeline m_pipeline;
+	TaskGroup m_processJob;
+	std::shared_ptr<ProcessRun> m_processRun;
+	std::shared_ptr<bool> m_alive;
+
 	enum {
 		ID_ProcessButton = 1000,
 		ID_ClearButton = 1001,
@@ -44,7 +77,10 @@ bool LayoutApp::OnInit() {
 	return true;
 }
 
-LayoutFrame::LayoutFrame() : wxFrame(nullptr, wxID_ANY, "Layout Management Tutorial") {
+LayoutFrame::LayoutFrame() : wxFrame(nullptr, wxID_ANY, "Layout Management Tutorial"),
+	m_alive(std::make_shared<bool>(true)) {
+	m_pipeline.Upper().Replace(U' ', "_");
+
 	// Set minimum size
 	SetMinSize(wxSize(500, 400));
 	SetSize(600, 500);
@@ -126,17 +162,102 @@ LayoutFrame::LayoutFrame() : wxFrame(nullptr, wxID_ANY, "Layout Management Tutor
 	mainSizer->Layout();
 }
 
+LayoutFrame::~LayoutFrame() {
+	*m_alive = false;
+	m_processJob.Cancel();
+	m_processJob.Wait();
+}
+
+void LayoutFrame::StartProcessing() {
+	CancelProcessing();
+	std::shared_ptr<ProcessRun> run = std::make_shared<ProcessRun>();
+	run->input = m_textInput->GetValue().utf8_str();
+	run->pipeline = m_pipeline;
+	m_processRun = run;
+	m_textOutput->SetValue("Processed: ");
+
+	// Pieces are transformed in parallel on the task pool; progress reports
+	// carry whatever is ready over to the output as it comes in
+	m_processJob = TaskGroup(TaskPool::Shared(), TaskPriority::Normal);
+	m_processJob.SetReporter(ReportOnUiThread(m_alive, [this, run](const TaskGroup::Progress& progress) {
+		if (run != m_processRun) return;
+		if (!progress.finished) SetStatusText(FormatProgress("Processing", progress));
+		AppendProcessed(run);
+	}));
+	TaskGroup job = m_processJob;
+	job.Run([job, run](const CancelToken& cancel) mutable {
+		std::vector<size_t> points = TextPipeline::SplitPoints(run->input.data(), run->input.size(),
+			TextPipeline::kPieceBytes);
+		{
+			std::lock_guard<std::mutex> lock(run->mutex);
+			run->pieces.resize(points.size() - 1);
+			run->ready.resize(points.size() - 1, false);
+		}
+		job.SetTotal((int64_t)points.size() - 1);
+		run->pipeline.ParallelApply(run->input.data(), run->input.size(), job.Pool(), &cancel,
+			[&](size_t index, size_t, std::string& out) {
+				{
+					std::lock_guard<std::mutex> lock(run->mutex);
+					run->pieces[index].swap(out);
+					run->ready[index] = true;
+				}
+				job.Advance();
+			});
+		std::lock_guard<std::mutex> lock(run->mutex);
+		run->finished = true;
+	});
+	job.Close();
+}
+
+void LayoutFrame::CancelProcessing() {
+	// The pool task keeps its own reference to the run; dropping ours stops
+	// anything more reaching the output
+	m_processJob.Cancel();
+	m_processRun.reset();
+}
+
+void LayoutFrame::AppendProcessed(std::shared_ptr<ProcessRun> run) {
+	// A few pieces per call keep the window responsive while a large output
+	// streams in; the rest follows in another call
+	const size_t kBytesPerCall = 2 * 1024 * 1024;
+	size_t appended = 0;
+	bool more = false;
+	bool done = false;
+	while (run == m_processRun) {
+		std::string piece;
+		{
+			std::lock_guard<std::mutex> lock(run->mutex);
+			done = run->finished && run->next == run->pieces.size();
+			if (done || run->next >= run->ready.size() || !run->ready[run->next]) break;
+			if (appended >= kBytesPerCall) {
+				more = true;
+				break;
+			}
+			piece.swap(run->pieces[run->next++]);
+		}
+		m_textOutput->AppendText(wxString::FromUTF8(piece.data(), piece.size()));
+		appended += piece.size();
+	}
+	if (more) {
+		std::weak_ptr<bool> alive = m_alive;
+		CallAfter([this, alive, run]() {
+			std::shared_ptr<bool> live = alive.lock();
+			if (live && *live) AppendProcessed(run);
+		});
+	} else if (done && run == m_processRun) {
+		m_textOutput->SetInsertionPoint(0);
+		m_processRun.reset();
+		SetStatusText("Text processed");
+	}
+}
+
 void LayoutFrame::OnButtonClick(wxCommandEvent& event) {
 	switch (event.GetId()) {
-		case ID_ProcessButton: {
-			wxString input = m_textInput->GetValue();
-			wxString processed = input.Upper(); // Convert to uppercase
-			processed.Replace(" ", "_"); // Replace spaces with underscores
-			m_textOutput->SetValue("Processed: " + processed);
-			SetStatusText("Text processed");
+		case ID_ProcessButton:
+			StartProcessing();
 			break;
-		}
 		case ID_ClearButton:
+			CancelProcessing();
 			m_textInput->Clear();
 			m_textOutput->Clear();
 			SetStatusText("Text cleared");
@@ -2,6 +2,11 @@
 #include <wx/wx.h>
 #include <wx/artprov.h>
 
+#include <memory>
+
+#include "common/task_progress.h"
+#include "common/text_file_stream.h"
+
 class MenuApp : public wxApp {
 public:
 	bool OnInit();
@@ -15,6 +20,8 @@ private:
 	void OnNew(wxCommandEvent& event);
 	void OnOpen(wxCommandEvent& event);
 	void OnSave(wxCommandEvent& event);
+	void OnStop(wxCommandEvent& event);
+	void OnUpdateStop(wxUpdateUIEvent& event);
 	void OnExit(wxCommandEvent& event);
 	void OnUndo(wxCommandEvent& event);
 	void OnRedo(wxCommandEvent& event);
@@ -30,6 +37,7 @@ private:
 
 	wxTextCtrl* m_textCtrl;
 	wxToolBar* m_toolbar;
+	std::unique_ptr<TextFileStream> m_fileStream;  // loads and saves in the background
 
 	enum {
 		ID_New = 1000,
@@ -38,7 +46,8 @@ private:
 		ID_Undo = 1003,
 		ID_Redo = 1004,
 		ID_ToggleToolbar = 1005,
-		ID_ToggleStatusbar = 1006
+		ID_ToggleStatusbar = 1006,
+		ID_Stop = 1007
 	};
 
 	wxDECLARE_EVENT_TABLE();
@@ -48,6 +57,8 @@ wxBEGIN_EVENT_TABLE(MenuFrame, wxFrame)
 	EVT_MENU(ID_New, MenuFrame::OnNew)
 	EVT_MENU(ID_Open, MenuFrame::OnOpen)
 	EVT_MENU(ID_Save, MenuFrame::OnSave)
+	EVT_MENU(ID_Stop, MenuFrame::OnStop)
+	EVT_UPDATE_UI(ID_Stop, MenuFrame::OnUpdateStop)
 	EVT_MENU(wxID_EXIT, MenuFrame::OnExit)
 	EVT_MENU(ID_Undo, MenuFrame::OnUndo)
 	EVT_MENU(ID_Redo, MenuFrame::OnRedo)
@@ -89,6 +100,9 @@ MenuFrame::MenuFrame() : wxFrame(nullptr, wxID_ANY, "Menus and Toolbars Tutorial
 		"Type some text here to test copy/cut/paste operations.",
 		wxDefaultPosition, wxDefaultSize, 
 		wxTE_MULTILINE | wxTE_RICH);
+	m_fileStream.reset(new TextFileStream(m_textCtrl, [this](const TaskGroup::Progress& progress) {
+		SetStatusText(FormatProgress(m_fileStream->IsLoading() ? "Opening" : "Saving", progress));
+	}));
 }
 
 void MenuFrame::CreateMenuBar() {
@@ -99,6 +113,7 @@ void MenuFrame::CreateMenuBar() {
 	fileMenu->Append(ID_New, "&New\tCtrl-N", "Create a new document");
 	fileMenu->Append(ID_Open, "&Open...\tCtrl-O", "Open an existing document");
 	fileMenu->Append(ID_Save, "&Save\tCtrl-S", "Save the current document");
+	fileMenu->Append(ID_Stop, "S&top\tEsc", "Stop opening or saving the document");
 	fileMenu->AppendSeparator();
 	fileMenu->Append(wxID_EXIT, "E&xit\tCtrl-Q", "Exit the application");
 
@@ -156,6 +171,8 @@ m_toolbar->AddTool(wxID_PASTE, "Paste", wxArtProvider::GetBitmap(wxART_PASTE), "
 }
 
 void MenuFrame::OnNew(wxCommandEvent& event) {
+	// A save in progress works from its own copy of the text and carries on
+	if (m_fileStream->IsLoading()) m_fileStream->Cancel();
 	m_textCtrl->Clear();
 	SetStatusText("New document created");
 }
@@ -170,14 +187,21 @@ void MenuFrame::OnOpen(wxCommandEvent& event) {
 		return;
 	}
 
+	// The text streams in while the window stays usable; the first
+	// screenful appears right away
 	wxString filename = openDialog.GetPath();
-	if (!m_textCtrl->LoadFile(filename)) {
-		wxMessageBox("Failed to open file: " + filename, "Error", 
-			wxOK | wxICON_ERROR);
-		SetStatusText("Failed to open file");
-	} else {
-		SetStatusText("Opened: " + filename);
-	}
+	auto done = [this, filename](TextFileStream::Outcome outcome) {
+		if (outcome == TextFileStream::Completed) {
+			SetStatusText("Opened: " + filename);
+		} else if (outcome == TextFileStream::Cancelled) {
+			SetStatusText("Open cancelled");
+		} else {
+			wxMessageBox("Failed to open file: " + filename, "Error", 
+				wxOK | wxICON_ERROR);
+			SetStatusText("Failed to open file");
+		}
+	};
+	if (!m_fileStream->Load(filename, done)) done(TextFileStream::Failed);
 }
 
 void MenuFrame::OnSave(wxCommandEvent& event) {
@@ -191,15 +215,31 @@ void MenuFrame::OnSave(wxCommandEvent& event) {
 	}
 
 	wxString filename = saveDialog.GetPath();
-	if (!m_textCtrl->SaveFile(filename)) {
-		wxMessageBox("Failed to save file: " + filename, "Error", 
-			wxOK | wxICON_ERROR);
-		SetStatusText("Failed to save file");
-	} else {
-		SetStatusText("Saved: " + filename);
+	auto done = [this, filename](TextFileStream::Outcome outcome) {
+		if (outcome == TextFileStream::Completed) {
+			SetStatusText("Saved: " + filename);
+		} else if (outcome == TextFileStream::Cancelled) {
+			SetStatusText("Save cancelled");
+		} else {
+			wxMessageBox("Failed to save file: " + filename, "Error", 
+				wxOK | wxICON_ERROR);
+			SetStatusText("Failed to save file");
+		}
+	};
+	if (!m_fileStream->Save(filename, done)) {
+		SetStatusText("Wait for the document to finish opening before saving");
 	}
 }
 
+void MenuFrame::OnStop(wxCommandEvent& event) {
+	m_fileStream->Cancel();
+}
+
+void MenuFrame::OnUpdateStop(wxUpdateUIEvent& event) {
+	// Only available while a file is being opened or saved
+	event.Enable(m_fileStream && m_fileStream->IsBusy());
+}
+
 void MenuFrame::OnUndo(wxCommandEvent& event) {
 	if (m_textCtrl->CanUndo()) {
 		m_textCtrl->Undo();
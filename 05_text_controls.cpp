@@ -2,6 +2,10 @@
 #include <wx/wx.h>
 #include <wx/spinctrl.h>
 
+#include <memory>
+
+#include "common/text_ctrl_stats.h"
+
 class TextApp : public wxApp {
 public:
 	bool OnInit();
@@ -27,6 +31,7 @@ private:
 	wxSpinCtrl* m_spinCtrl;
 	wxCheckBox* m_wordWrapCheck;
 	wxStaticText* m_statusLabel;
+	std::unique_ptr<TextCtrlStats> m_multiLineStats;
 
 	enum {
 		ID_SingleLine = 1000,
@@ -106,6 +111,10 @@ TextFrame::TextFrame() : wxFrame(nullptr, wxID_ANY, "Text Controls Tutorial") {
 		"This is a multi-line text control.\nYou can type multiple lines here.\n\nTry typing some text and see how it responds!",
 		wxDefaultPosition, wxSize(-1, 100), wxTE_MULTILINE | wxTE_WORDWRAP);
 	inputSection->Add(m_multiLineText, 0, wxEXPAND | wxALL, 5);
+	m_multiLineStats.reset(new TextCtrlStats(m_multiLineText, [this]() {
+		SetStatusText(wxString::Format("Multi-line text: %ld lines, %ld words (%ld min read)",
+			m_multiLineStats->Lines(), m_multiLineStats->Words(), m_multiLineStats->ReadingMinutes()), 1);
+	}));
 
 	// Read-only text
 	inputSection->Add(new wxStaticText(panel, wxID_ANY, "Read-Only Text:"), 0, wxALL, 5);
@@ -149,38 +158,48 @@ TextFrame::TextFrame() : wxFrame(nullptr, wxID_ANY, "Text Controls Tutorial") {
 	mainSizer->Add(outputSection, 1, wxEXPAND | wxALL, 10);
 
 	panel->SetSizer(mainSizer);
-	CreateStatusBar();
-	SetStatusText("Text Controls Tutorial - Ready");
+	// Messages on the left; the multi-line stats keep a field of their own so
+	// the messages do not overwrite them
+	CreateStatusBar(2);
+	int widths[] = {-1, 320};
+	GetStatusBar()->SetStatusWidths(2, widths);
+	SetStatusText("Text Controls Tutorial - Ready", 0);
+	// The initial text was never counted; the status bar it reports to exists now
+	m_multiLineStats->Recount();
 }
 
 void TextFrame::OnTextChanged(wxCommandEvent& event) {
 	wxString output;
 	
 	switch (event.GetId()) {
-		case ID_SingleLine:
+		case ID_SingleLine: {
+			wxString text = m_singleLineText->GetValue();
 			output = wxString::Format("Single line changed: \"%s\" (length: %lu)\n",
-				m_singleLineText->GetValue(), (unsigned long)m_singleLineText->GetValue().length());
+				text, (unsigned long)text.length());
 			break;
+		}
 		case ID_MultiLine:
-			output = wxString::Format("Multi-line changed: %lu lines, %lu characters\n",
-				(unsigned long)m_multiLineText->GetNumberOfLines(), (unsigned long)m_multiLineText->GetValue().length());
+			// Counted without copying the text; words follow once typing pauses
+			m_multiLineStats->Changed();
+			output = wxString::Format("Multi-line changed: %ld lines, %ld characters\n",
+				m_multiLineStats->Lines(), m_multiLineStats->Characters());
 			break;
 		case ID_Password:
 			output = wxString::Format("Password changed: %lu characters (hidden)\n",
-				(unsigned long)m_passwordText->GetValue().length());
+				(unsigned long)m_passwordText->GetLastPosition());
 			break;
 	}
 	
 	m_outputText->AppendText(output);
 	m_statusLabel->SetLabel("Status: Text modified");
-	SetStatusText("Text control modified");
+	SetStatusText("Text control modified", 0);
 }
 
 void TextFrame::OnTextEnter(wxCommandEvent& event) {
 	wxString text = m_singleLineText->GetValue();
 	m_outputText->AppendText(wxString::Format("ENTER pressed with text: \"%s\"\n", text));
 	m_statusLabel->SetLabel("Status: Enter key pressed");
-	SetStatusText("Enter key pressed in single line text");
+	SetStatusText("Enter key pressed in single line text", 0);
 }
 
 void TextFrame::OnFormatText(wxCommandEvent& event) {
@@ -210,7 +229,7 @@ void TextFrame::OnFormatText(wxCommandEvent& event) {
 	
 	m_outputText->AppendText("Text formatting applied!\n");
 	m_statusLabel->SetLabel("Status: Text formatted");
-	SetStatusText("Text formatting complete");
+	SetStatusText("Text formatting complete", 0);
 }
 
 void TextFrame::OnClearAll(wxCommandEvent& event) {
@@ -224,7 +243,7 @@ void TextFrame::OnClearAll(wxCommandEvent& event) {
 	m_outputText->AppendText("All text controls cleared and reset!\n");
 	
 	m_statusLabel->SetLabel("Status: All cleared");
-	SetStatusText("All text controls cleared");
+	SetStatusText("All text controls cleared", 0);
 }
 
 void TextFrame::OnSpinChanged(wxSpinEvent& event) {
@@ -7,6 +7,9 @@
 #include <wx/choicdlg.h>
 #include <wx/numdlg.h>
 
+#include "common/log_view.h"
+#include "common/task_progress.h"
+
 // Custom dialog class
 class CustomDialog : public wxDialog {
 public:
@@ -36,6 +39,7 @@ public:
 class DialogFrame : public wxFrame {
 public:
 	DialogFrame();
+	~DialogFrame();
 
 private:
 	void OnMessageDialog(wxCommandEvent& event);
@@ -47,11 +51,18 @@ private:
 	void OnChoiceDialog(wxCommandEvent& event);
 	void OnNumberDialog(wxCommandEvent& event);
 	void OnProgressDialog(wxCommandEvent& event);
+	void OnProgressReport(const TaskGroup::Progress& progress);
 	void OnCustomDialog(wxCommandEvent& event);
 	void OnAbout(wxCommandEvent& event);
 
-	wxTextCtrl* m_logText;
+	LogView* m_log;
 	wxPanel* m_colorPanel;
+	
+	// Background job behind the progress dialog; reports reach the frame
+	// only while m_alive is set
+	wxProgressDialog* m_progressDialog;
+	TaskGroup m_progressJob;
+	std::shared_ptr<bool> m_alive;
 	wxStaticText* m_fontLabel;
 
 	enum {
@@ -181,7 +192,8 @@ bool DialogApp::OnInit() {
 	return true;
 }
 
-DialogFrame::DialogFrame() : wxFrame(nullptr, wxID_ANY, "Dialog Boxes Tutorial") {
+DialogFrame::DialogFrame() : wxFrame(nullptr, wxID_ANY, "Dialog Boxes Tutorial"),
+	m_progressDialog(nullptr), m_alive(std::make_shared<bool>(true)) {
 	SetSize(800, 600);
 	Center();
 
@@ -240,10 +252,9 @@ DialogFrame::DialogFrame() : wxFrame(nullptr, wxID_ANY, "Dialog Boxes Tutorial")
 
 	// Log text
 	wxStaticBoxSizer* logSizer = new wxStaticBoxSizer(wxVERTICAL, panel, "Dialog Results Log");
-	m_logText = new wxTextCtrl(panel, wxID_ANY, "Dialog results will appear here...\n",
-		wxDefaultPosition, wxSize(-1, 150), wxTE_MULTILINE | wxTE_READONLY);
-	m_logText->SetBackgroundColour(wxColour(248, 248, 248));
-	logSizer->Add(m_logText, 1, wxEXPAND | wxALL, 5);
+	m_log = new LogView(panel, 10000, wxID_ANY, wxDefaultPosition, wxSize(-1, 150));
+	m_log->Log("Dialog results will appear here...");
+	logSizer->Add(m_log, 1, wxEXPAND | wxALL, 5);
 	
 	mainSizer->Add(logSizer, 1, wxEXPAND | wxALL, 20);
 
@@ -254,7 +265,7 @@ void DialogFrame::OnMessageDialog(wxCommandEvent& event) {
 	wxMessageBox("This is a simple message dialog.\n\nYou can display information to users this way!",
 		"Information", wxOK | wxICON_INFORMATION);
 	
-	m_logText->AppendText("Message dialog shown\n");
+	m_log->Log("Message dialog shown");
 	SetStatusText("Message dialog closed");
 }
 
@@ -263,7 +274,7 @@ void DialogFrame::OnConfirmDialog(wxCommandEvent& event) {
 		"Confirm Action", wxYES_NO | wxICON_QUESTION);
 	
 	wxString resultText = (result == wxYES) ? "User clicked YES" : "User clicked NO";
-	m_logText->AppendText("Confirm dialog: " + resultText + "\n");
+	m_log->Log("Confirm dialog: " + resultText);
 	SetStatusText("Confirm dialog: " + resultText);
 }
 
@@ -274,10 +285,10 @@ void DialogFrame::OnFileDialog(wxCommandEvent& event) {
 	
 	if (dialog.ShowModal() == wxID_OK) {
 		wxString path = dialog.GetPath();
-		m_logText->AppendText("File selected: " + path + "\n");
+		m_log->Log("File selected: " + path);
 		SetStatusText("File selected: " + dialog.GetFilename());
 	} else {
-		m_logText->AppendText("File dialog cancelled\n");
+		m_log->Log("File dialog cancelled");
 		SetStatusText("File selection cancelled");
 	}
 }
@@ -290,11 +301,11 @@ void DialogFrame::OnColorDialog(wxCommandEvent& event) {
 		m_colorPanel->SetBackgroundColour(color);
 		m_colorPanel->Refresh();
 		
-		m_logText->AppendText(wxString::Format("Color selected: RGB(%d, %d, %d)\n",
+		m_log->Log(wxString::Format("Color selected: RGB(%d, %d, %d)",
 			color.Red(), color.Green(), color.Blue()));
 		SetStatusText("Color selected and applied to preview panel");
 	} else {
-		m_logText->AppendText("Color dialog cancelled\n");
+		m_log->Log("Color dialog cancelled");
 		SetStatusText("Color selection cancelled");
 	}
 }
@@ -306,11 +317,11 @@ void DialogFrame::OnFontDialog(wxCommandEvent& event) {
 		wxFont font = dialog.GetFontData().GetChosenFont();
 		m_fontLabel->SetFont(font);
 		
-		m_logText->AppendText(wxString::Format("Font selected: %s, %d pt\n",
+		m_log->Log(wxString::Format("Font selected: %s, %d pt",
 			font.GetFaceName(), font.GetPointSize()));
 		SetStatusText("Font selected and applied to sample text");
 	} else {
-		m_logText->AppendText("Font dialog cancelled\n");
+		m_log->Log("Font dialog cancelled");
 		SetStatusText("Font selection cancelled");
 	}
 }
@@ -320,10 +331,10 @@ void DialogFrame::OnTextDialog(wxCommandEvent& event) {
 	
 	if (dialog.ShowModal() == wxID_OK) {
 		wxString text = dialog.GetValue();
-		m_logText->AppendText("Text entered: \"" + text + "\"\n");
+		m_log->Log("Text entered: \"" + text + "\"");
 		SetStatusText("Text input received");
 	} else {
-		m_logText->AppendText("Text input cancelled\n");
+		m_log->Log("Text input cancelled");
 		SetStatusText("Text input cancelled");
 	}
 }
@@ -341,10 +352,10 @@ void DialogFrame::OnChoiceDialog(wxCommandEvent& event) {
 	if (dialog.ShowModal() == wxID_OK) {
 		wxString choice = dialog.GetStringSelection();
 		int index = dialog.GetSelection();
-		m_logText->AppendText(wxString::Format("Choice selected: \"%s\" (index %d)\n", choice, index));
+		m_log->Log(wxString::Format("Choice selected: \"%s\" (index %d)", choice, index));
 		SetStatusText("Choice selected: " + choice);
 	} else {
-		m_logText->AppendText("Choice dialog cancelled\n");
+		m_log->Log("Choice dialog cancelled");
 		SetStatusText("Choice selection cancelled");
 	}
 }
@@ -354,32 +365,60 @@ void DialogFrame::OnNumberDialog(wxCommandEvent& event) {
 		"Number:", "Number Input Dialog", 50, 1, 100, this);
 	
 	if (number != -1) {
-		m_logText->AppendText(wxString::Format("Number entered: %ld\n", number));
+		m_log->Log(wxString::Format("Number entered: %ld", number));
 		SetStatusText(wxString::Format("Number entered: %ld", number));
 	} else {
-		m_logText->AppendText("Number input cancelled\n");
+		m_log->Log("Number input cancelled");
 		SetStatusText("Number input cancelled");
 	}
 }
 
+DialogFrame::~DialogFrame() {
+	*m_alive = false;
+	m_progressJob.Cancel();
+}
+
 void DialogFrame::OnProgressDialog(wxCommandEvent& event) {
-	wxProgressDialog dialog("Progress Dialog", "Working, please wait...", 100, this,
+	if (m_progressDialog) return;
+	m_progressDialog = new wxProgressDialog("Progress Dialog", "Working, please wait...", 100, this,
 		wxPD_CAN_ABORT | wxPD_ELAPSED_TIME | wxPD_REMAINING_TIME | wxPD_AUTO_HIDE);
 	
-	bool cancelled = false;
-	for (int i = 0; i <= 100 && !cancelled; i++) {
-		wxString message = wxString::Format("Processing step %d of 100...", i);
-		cancelled = !dialog.Update(i, message);
-		
-		// Simulate work
-		wxMilliSleep(50);
+	// The steps run on the shared thread pool; the dialog only shows the
+	// reports, so the window stays responsive while they work
+	m_progressJob = TaskGroup(TaskPool::Shared(), TaskPriority::Normal);
+	m_progressJob.SetTotal(100);
+	m_progressJob.SetReporter(ReportOnUiThread(m_alive,
+		[this](const TaskGroup::Progress& progress) { OnProgressReport(progress); }));
+	TaskGroup job = m_progressJob;
+	for (int i = 0; i < 100; i++) {
+		job.Run([job](const CancelToken& cancel) mutable {
+			// Simulate work
+			wxMilliSleep(50);
+			if (!cancel.IsCancelled()) job.Advance();
+		});
+	}
+	job.Close();
+	SetStatusText("Progress dialog running");
+}
+
+void DialogFrame::OnProgressReport(const TaskGroup::Progress& progress) {
+	if (!m_progressDialog) return;
+	
+	if (!progress.finished) {
+		// Reaching the maximum would end the dialog; the final report does
+		if (progress.done >= progress.total) return;
+		wxString message = wxString::Format("Processing step %lld of 100...", (long long)progress.done);
+		if (!m_progressDialog->Update((int)progress.done, message)) m_progressJob.Cancel();
+		return;
 	}
 	
-	if (cancelled) {
-		m_logText->AppendText("Progress dialog cancelled by user\n");
+	m_progressDialog->Destroy();
+	m_progressDialog = nullptr;
+	if (progress.cancelled) {
+		m_log->Log("Progress dialog cancelled by user");
 		SetStatusText("Progress cancelled");
 	} else {
-		m_logText->AppendText("Progress dialog completed successfully\n");
+		m_log->Log("Progress dialog completed successfully");
 		SetStatusText("Progress completed");
 	}
 }
@@ -389,10 +428,10 @@ void DialogFrame::OnCustomDialog(wxCommandEvent& event) {
 	
 	if (dialog.ShowModal() == wxID_OK) {
 		wxString userData = dialog.GetUserData();
-		m_logText->AppendText("Custom dialog data:\n" + userData + "\n\n");
+		m_log->Log("Custom dialog data:\n" + userData + "\n");
 		SetStatusText("Custom dialog completed");
 	} else {
-		m_logText->AppendText("Custom dialog cancelled\n");
+		m_log->Log("Custom dialog cancelled");
 		SetStatusText("Custom dialog cancelled");
 	}
 }
@@ -12,6 +12,13 @@
 #include <wx/artprov.h>
 #include <wx/filename.h>
 
+#include <memory>
+
+#include "common/log_view.h"
+#include "common/task_progress.h"
+#include "common/text_ctrl_stats.h"
+#include "common/text_file_stream.h"
+
 class ComprehensiveApp : public wxApp {
 public:
 	bool OnInit();
@@ -26,11 +33,14 @@ private:
 	void CreateToolBar();
 	void CreateStatusBar();
 	void CreateMainContent();
+	void UpdateDocumentStatus();
 
 	// Menu/toolbar event handlers
 	void OnNew(wxCommandEvent& event);
 	void OnOpen(wxCommandEvent& event);
 	void OnSave(wxCommandEvent& event);
+	void OnStop(wxCommandEvent& event);
+	void OnUpdateStop(wxUpdateUIEvent& event);
 	void OnExit(wxCommandEvent& event);
 	void OnCut(wxCommandEvent& event);
 	void OnCopy(wxCommandEvent& event);
@@ -47,16 +57,19 @@ private:
 	void OnAddListItem(wxCommandEvent& event);
 	void OnDeleteListItem(wxCommandEvent& event);
 	void OnClearLog(wxCommandEvent& event);
+	void OnLogToFile(wxCommandEvent& event);
 
 	// UI components
 	wxSplitterWindow* m_splitter;
 	wxNotebook* m_notebook;
 	wxTextCtrl* m_textEditor;
-	wxTextCtrl* m_logText;
+	LogView* m_log;
 	wxListCtrl* m_listCtrl;
 	wxTreeCtrl* m_treeCtrl;
 	wxPanel* m_drawingPanel;
 
+	std::unique_ptr<TextCtrlStats> m_stats;
+	std::unique_ptr<TextFileStream> m_fileStream;
 	wxString m_currentFile;
 	int m_listItemCounter;
 
@@ -69,7 +82,9 @@ private:
 		ID_ClearLog = 1005,
 		ID_TextEditor = 1006,
 		ID_Font = 1007,
-		ID_Color = 1008
+		ID_Color = 1008,
+		ID_LogToFile = 1009,
+		ID_Stop = 1010
 	};
 
 	wxDECLARE_EVENT_TABLE();
@@ -80,6 +95,8 @@ wxBEGIN_EVENT_TABLE(MainFrame, wxFrame)
 	EVT_MENU(ID_New, MainFrame::OnNew)
 	EVT_MENU(ID_Open, MainFrame::OnOpen)
 	EVT_MENU(ID_Save, MainFrame::OnSave)
+	EVT_MENU(ID_Stop, MainFrame::OnStop)
+	EVT_UPDATE_UI(ID_Stop, MainFrame::OnUpdateStop)
 	EVT_MENU(wxID_EXIT, MainFrame::OnExit)
 	
 	// Edit menu
@@ -102,6 +119,7 @@ wxBEGIN_EVENT_TABLE(MainFrame, wxFrame)
 	EVT_BUTTON(ID_AddListItem, MainFrame::OnAddListItem)
 	EVT_BUTTON(ID_DeleteListItem, MainFrame::OnDeleteListItem)
 	EVT_BUTTON(ID_ClearLog, MainFrame::OnClearLog)
+	EVT_BUTTON(ID_LogToFile, MainFrame::OnLogToFile)
 wxEND_EVENT_TABLE()
 
 wxIMPLEMENT_APP(ComprehensiveApp);
@@ -134,6 +152,7 @@ void MainFrame::CreateMenuBar() {
 	fileMenu->Append(ID_New, "&New\tCtrl-N", "Create new document");
 	fileMenu->Append(ID_Open, "&Open...\tCtrl-O", "Open existing document");
 	fileMenu->Append(ID_Save, "&Save\tCtrl-S", "Save current document");
+	fileMenu->Append(ID_Stop, "S&top\tEsc", "Stop opening or saving the document");
 	fileMenu->AppendSeparator();
 	fileMenu->Append(wxID_EXIT, "E&xit\tCtrl-Q", "Exit application");
 
@@ -176,11 +195,11 @@ void MainFrame::CreateToolBar() {
 
 void MainFrame::CreateStatusBar() {
 	wxStatusBar* statusBar = wxFrame::CreateStatusBar(3);
-	int widths[] = {-1, 100, 150};
+	int widths[] = {-1, 100, 260};
 	statusBar->SetStatusWidths(3, widths);
 	statusBar->SetStatusText("Ready", 0);
 	statusBar->SetStatusText("Lines: 0", 1);
-	statusBar->SetStatusText("Characters: 0", 2);
+	statusBar->SetStatusText("Characters: 0, Words: 0", 2);
 }
 
 void MainFrame::CreateMainContent() {
@@ -210,6 +229,11 @@ void MainFrame::CreateMainContent() {
 		"Try editing this text, using the menus, and exploring other tabs!",
 		wxDefaultPosition, wxDefaultSize, wxTE_MULTILINE | wxTE_RICH);
 	editorSizer->Add(m_textEditor, 1, wxEXPAND | wxALL, 5);
+	m_stats.reset(new TextCtrlStats(m_textEditor, [this]() { UpdateDocumentStatus(); }));
+	m_stats->Recount();  // the welcome text was set before there were stats to count it
+	m_fileStream.reset(new TextFileStream(m_textEditor, [this](const TaskGroup::Progress& progress) {
+		SetStatusText(FormatProgress(m_fileStream->IsLoading() ? "Opening" : "Saving", progress));
+	}));
 	
 	editorPanel->SetSizer(editorSizer);
 	m_notebook->AddPage(editorPanel, "Text Editor");
@@ -288,13 +312,16 @@ void MainFrame::CreateMainContent() {
 	wxStaticText* logLabel = new wxStaticText(logPanel, wxID_ANY, "Activity Log:");
 	logSizer->Add(logLabel, 0, wxALL, 5);
 	
-	m_logText = new wxTextCtrl(logPanel, wxID_ANY, "Application started...\n",
-		wxDefaultPosition, wxDefaultSize, wxTE_MULTILINE | wxTE_READONLY);
-	m_logText->SetBackgroundColour(wxColour(248, 248, 248));
-	logSizer->Add(m_logText, 1, wxEXPAND | wxALL, 5);
+	m_log = new LogView(logPanel);
+	m_log->Log("Application started...");
+	logSizer->Add(m_log, 1, wxEXPAND | wxALL, 5);
 	
+	wxBoxSizer* logButtonSizer = new wxBoxSizer(wxHORIZONTAL);
 	wxButton* clearLogBtn = new wxButton(logPanel, ID_ClearLog, "Clear Log");
-	logSizer->Add(clearLogBtn, 0, wxALL, 5);
+	logButtonSizer->Add(clearLogBtn, 0, wxRIGHT, 5);
+	wxButton* logToFileBtn = new wxButton(logPanel, ID_LogToFile, "Log to File...");
+	logButtonSizer->Add(logToFileBtn, 0);
+	logSizer->Add(logButtonSizer, 0, wxALL, 5);
 	
 	logPanel->SetSizer(logSizer);
 
@@ -303,8 +330,8 @@ void MainFrame::CreateMainContent() {
 	m_splitter->SetMinimumPaneSize(200);
 
 	// Log initial state
-	m_logText->AppendText("UI components initialized\n");
-	m_logText->AppendText("Ready for user interaction\n");
+	m_log->Log("UI components initialized");
+	m_log->Log("Ready for user interaction");
 }
 
 void MainFrame::OnNew(wxCommandEvent& event) {
@@ -312,10 +339,12 @@ void MainFrame::OnNew(wxCommandEvent& event) {
 		wxMessageBox("Current document has unsaved changes. Continue?", 
 			"Confirm", wxYES_NO | wxICON_QUESTION) == wxYES) {
 		
+		// A save in progress works from its own copy of the text and carries on
+		if (m_fileStream->IsLoading()) m_fileStream->Cancel();
 		m_textEditor->Clear();
 		m_currentFile.clear();
 		SetTitle("Comprehensive wxWidgets Application - [New Document]");
-		m_logText->AppendText("New document created\n");
+		m_log->Log("New document created");
 		SetStatusText("New document created");
 	}
 }
@@ -326,15 +355,32 @@ void MainFrame::OnOpen(wxCommandEvent& event) {
 		wxFD_OPEN | wxFD_FILE_MUST_EXIST);
 
 	if (dialog.ShowModal() == wxID_OK) {
-		m_currentFile = dialog.GetPath();
-		if (m_textEditor->LoadFile(m_currentFile)) {
-			SetTitle("Comprehensive wxWidgets Application - " + dialog.GetFilename());
-			m_logText->AppendText("Opened: " + m_currentFile + "\n");
-			SetStatusText("File opened: " + dialog.GetFilename());
+		// The text streams in with progress in the status bar; the document
+		// only takes the file's name once all of it has arrived
+		wxString path = dialog.GetPath();
+		wxString name = dialog.GetFilename();
+		auto done = [this, path, name](TextFileStream::Outcome outcome) {
+			if (outcome == TextFileStream::Completed) {
+				m_currentFile = path;
+				m_stats->Recount();
+				SetTitle("Comprehensive wxWidgets Application - " + name);
+				m_log->Log("Opened: " + path);
+				SetStatusText("File opened: " + name);
+			} else if (outcome == TextFileStream::Cancelled) {
+				m_currentFile.clear();
+				m_log->Log("Cancelled opening: " + path);
+				SetStatusText("Open cancelled");
+			} else {
+				m_currentFile.clear();
+				wxMessageBox("Failed to open file: " + path, "Error", 
+					wxOK | wxICON_ERROR);
+				m_log->Log("Failed to open: " + path);
+			}
+		};
+		if (m_fileStream->Load(path, done)) {
+			m_log->Log("Opening: " + path);
 		} else {
-			wxMessageBox("Failed to open file: " + m_currentFile, "Error", 
-				wxOK | wxICON_ERROR);
-			m_logText->AppendText("Failed to open: " + m_currentFile + "\n");
+			done(TextFileStream::Failed);
 		}
 	}
 }
@@ -352,21 +398,39 @@ void MainFrame::OnSave(wxCommandEvent& event) {
 		}
 	}
 
-	if (m_textEditor->SaveFile(m_currentFile)) {
-		SetTitle("Comprehensive wxWidgets Application - " + wxFileName(m_currentFile).GetFullName());
-		m_logText->AppendText("Saved: " + m_currentFile + "\n");
-		SetStatusText("File saved: " + wxFileName(m_currentFile).GetFullName());
-	} else {
-		wxMessageBox("Failed to save file: " + m_currentFile, "Error", 
-			wxOK | wxICON_ERROR);
-		m_logText->AppendText("Failed to save: " + m_currentFile + "\n");
+	wxString path = m_currentFile;
+	auto done = [this, path](TextFileStream::Outcome outcome) {
+		if (outcome == TextFileStream::Completed) {
+			SetTitle("Comprehensive wxWidgets Application - " + wxFileName(path).GetFullName());
+			m_log->Log("Saved: " + path);
+			SetStatusText("File saved: " + wxFileName(path).GetFullName());
+		} else if (outcome == TextFileStream::Cancelled) {
+			m_log->Log("Cancelled saving: " + path);
+			SetStatusText("Save cancelled");
+		} else {
+			wxMessageBox("Failed to save file: " + path, "Error", 
+				wxOK | wxICON_ERROR);
+			m_log->Log("Failed to save: " + path);
+		}
+	};
+	if (!m_fileStream->Save(path, done)) {
+		SetStatusText("Wait for the document to finish opening before saving");
 	}
 }
 
+void MainFrame::OnStop(wxCommandEvent& event) {
+	m_fileStream->Cancel();
+}
+
+void MainFrame::OnUpdateStop(wxUpdateUIEvent& event) {
+	// Only available while a file is being opened or saved
+	event.Enable(m_fileStream && m_fileStream->IsBusy());
+}
+
 void MainFrame::OnCut(wxCommandEvent& event) {
 	if (m_textEditor->HasFocus()) {
 		m_textEditor->Cut();
-		m_logText->AppendText("Text cut to clipboard\n");
+		m_log->Log("Text cut to clipboard");
 		SetStatusText("Text cut");
 	}
 }
@@ -374,7 +438,7 @@ void MainFrame::OnCut(wxCommandEvent& event) {
 void MainFrame::OnCopy(wxCommandEvent& event) {
 	if (m_textEditor->HasFocus()) {
 		m_textEditor->Copy();
-		m_logText->AppendText("Text copied to clipboard\n");
+		m_log->Log("Text copied to clipboard");
 		SetStatusText("Text copied");
 	}
 }
@@ -382,7 +446,7 @@ void MainFrame::OnCopy(wxCommandEvent& event) {
 void MainFrame::OnPaste(wxCommandEvent& event) {
 	if (m_textEditor->HasFocus()) {
 		m_textEditor->Paste();
-		m_logText->AppendText("Text pasted from clipboard\n");
+		m_log->Log("Text pasted from clipboard");
 		SetStatusText("Text pasted");
 	}
 }
@@ -394,7 +458,7 @@ void MainFrame::OnFont(wxCommandEvent& event) {
 	if (dialog.ShowModal() == wxID_OK) {
 		wxFont font = dialog.GetFontData().GetChosenFont();
 		m_textEditor->SetFont(font);
-		m_logText->AppendText(wxString::Format("Font changed to: %s, %d pt\n",
+		m_log->Log(wxString::Format("Font changed to: %s, %d pt",
 			font.GetFaceName(), font.GetPointSize()));
 		SetStatusText("Font changed");
 	}
@@ -407,20 +471,21 @@ void MainFrame::OnColor(wxCommandEvent& event) {
 		wxColour color = dialog.GetColourData().GetColour();
 		m_textEditor->SetForegroundColour(color);
 		m_textEditor->Refresh();
-		m_logText->AppendText(wxString::Format("Text color changed to RGB(%d, %d, %d)\n",
+		m_log->Log(wxString::Format("Text color changed to RGB(%d, %d, %d)",
 			color.Red(), color.Green(), color.Blue()));
 		SetStatusText("Text color changed");
 	}
 }
 
 void MainFrame::OnTextChanged(wxCommandEvent& event) {
-	wxString text = m_textEditor->GetValue();
-	int lines = m_textEditor->GetNumberOfLines();
-	size_t chars = text.length();
-	
-	// Update status bar
-	GetStatusBar()->SetStatusText(wxString::Format("Lines: %d", lines), 1);
-	GetStatusBar()->SetStatusText(wxString::Format("Characters: %lu", (unsigned long)chars), 2);
+	// No copy of the text here; words are recounted once typing pauses
+	m_stats->Changed();
+}
+
+void MainFrame::UpdateDocumentStatus() {
+	GetStatusBar()->SetStatusText(wxString::Format("Lines: %ld", m_stats->Lines()), 1);
+	GetStatusBar()->SetStatusText(wxString::Format("Characters: %ld, Words: %ld (%ld min read)",
+		m_stats->Characters(), m_stats->Words(), m_stats->ReadingMinutes()), 2);
 }
 
 void MainFrame::OnListItemSelected(wxListEvent& event) {
@@ -428,7 +493,7 @@ void MainFrame::OnListItemSelected(wxListEvent& event) {
 	wxString name = m_listCtrl->GetItemText(index);
 	wxString type = m_listCtrl->GetItemText(index, 1);
 	
-	m_logText->AppendText(wxString::Format("List item selected: %s (%s)\n", name, type));
+	m_log->Log(wxString::Format("List item selected: %s (%s)", name, type));
 	SetStatusText("Selected: " + name);
 }
 
@@ -436,7 +501,7 @@ void MainFrame::OnTreeItemSelected(wxTreeEvent& event) {
 	wxTreeItemId item = event.GetItem();
 	wxString text = m_treeCtrl->GetItemText(item);
 	
-	m_logText->AppendText("Tree item selected: " + text + "\n");
+	m_log->Log("Tree item selected: " + text);
 	SetStatusText("Tree item: " + text);
 }
 
@@ -444,7 +509,7 @@ void MainFrame::OnNotebookPageChanged(wxBookCtrlEvent& event) {
 	int page = event.GetSelection();
 	wxString pageName = m_notebook->GetPageText(page);
 	
-	m_logText->AppendText("Switched to tab: " + pageName + "\n");
+	m_log->Log("Switched to tab: " + pageName);
 	SetStatusText("Current tab: " + pageName);
 }
 
@@ -458,7 +523,7 @@ void MainFrame::OnAddListItem(wxCommandEvent& event) {
 			m_listCtrl->SetItem(index, 1, "Custom");
 			m_listCtrl->SetItem(index, 2, "New");
 			
-			m_logText->AppendText("Added list item: " + name + "\n");
+			m_log->Log("Added list item: " + name);
 			SetStatusText("Item added: " + name);
 		}
 	}
@@ -469,7 +534,7 @@ void MainFrame::OnDeleteListItem(wxCommandEvent& event) {
 	if (selected != -1) {
 		wxString name = m_listCtrl->GetItemText(selected);
 		m_listCtrl->DeleteItem(selected);
-		m_logText->AppendText("Deleted list item: " + name + "\n");
+		m_log->Log("Deleted list item: " + name);
 		SetStatusText("Item deleted: " + name);
 	} else {
 		wxMessageBox("Please select an item to delete.", "No Selection", 
@@ -478,11 +543,35 @@ void MainFrame::OnDeleteListItem(wxCommandEvent& event) {
 }
 
 void MainFrame::OnClearLog(wxCommandEvent& event) {
-	m_logText->Clear();
-	m_logText->AppendText("Log cleared\n");
+	m_log->Clear();
+	m_log->Log("Log cleared");
 	SetStatusText("Log cleared");
 }
 
+void MainFrame::OnLogToFile(wxCommandEvent& event) {
+	wxButton* button = wxDynamicCast(event.GetEventObject(), wxButton);
+	if (m_log->IsLoggingToFile()) {
+		m_log->Log("Stopped logging to file");
+		m_log->StopLogFile();
+		if (button) button->SetLabel("Log to File...");
+		SetStatusText("Stopped logging to file");
+		return;
+	}
+	
+	wxFileDialog dialog(this, "Log to File", "", "activity.log",
+		"Log files (*.log)|*.log|All files (*.*)|*.*", wxFD_SAVE);
+	if (dialog.ShowModal() != wxID_OK) return;
+	
+	// New lines are appended; earlier sessions in the same file are kept
+	if (m_log->SetLogFile(dialog.GetPath())) {
+		m_log->Log("Logging to file: " + dialog.GetPath());
+		if (button) button->SetLabel("Stop Logging to File");
+		SetStatusText("Logging to " + dialog.GetPath());
+	} else {
+		wxMessageBox("Could not open " + dialog.GetPath() + " for writing.", "Error", wxOK | wxICON_ERROR);
+	}
+}
+
 void MainFrame::OnExit(wxCommandEvent& event) {
 	Close(true);
 }
@@ -2,7 +2,6 @@
 #include <wx/wx.h>
 #include <wx/splitter.h>
 #include <wx/treectrl.h>
-#include <wx/html/htmlwin.h>
 #include <wx/stc/stc.h>
 #include <wx/aui/aui.h>
 #include <wx/listctrl.h>
@@ -13,8 +12,97 @@
 #include <wx/dirdlg.h>
 #include <wx/textdlg.h>
 #include <wx/config.h>
+#include <wx/stdpaths.h>
+#include <algorithm>
 #include <fstream>
+#include <functional>
+#include <memory>
 #include <regex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "common/doc_stats.h"
+#include "common/memory_ledger.h"
+#include "common/task_progress.h"
+#include "obsidian/code_highlight.h"
+#include "obsidian/content_hash.h"
+#include "obsidian/diff_view.h"
+#include "obsidian/graph_view.h"
+#include "obsidian/heading_index.h"
+#include "obsidian/markdown_lexer.h"
+#include "obsidian/memory_view.h"
+#include "obsidian/note_history.h"
+#include "obsidian/outline_view.h"
+#include "obsidian/preview_blocks.h"
+#include "obsidian/preview_markdown.h"
+#include "obsidian/preview_view.h"
+#include "obsidian/search_index.h"
+#include "obsidian/spell_checker.h"
+#include "obsidian/title_index.h"
+#include "obsidian/image_cache.h"
+#include "obsidian/link_index.h"
+#include "obsidian/vault_rename.h"
+#include "obsidian/vault_set.h"
+#include "obsidian/vault_store.h"
+
+// Preview layout: how many blocks around the visible ones background filling
+// may lay out, and how many it lays out per step.
+static const int kPreviewMaxBlocks = 400;
+static const int kPreviewFillStep = 32;
+static const int kPreviewFillDelayMs = 40;
+
+// Wikilink completion: titles offered, and how far back to look for "[["
+static const int kLinkCompletions = 50;
+static const int kLinkLookback = 200;
+
+// Vault search: results listed per query, notes analyzed per indexing batch
+static const int kSearchResults = 50;
+static const size_t kSearchBatch = 1024;
+
+// Open vaults: how many at once, and the default memory budget for their
+// search indexes (the "MemoryBudgetMB" setting)
+static const int kMaxOpenVaults = 16;
+static const long kDefaultMemoryBudgetMB = 1024;
+
+// Memory diagnostics: how often sampled accounts are measured, and rough
+// per-row costs of the native file tree and result list
+static const int kMemorySampleMs = 2000;
+static const size_t kTreeItemBytes = 160;
+static const size_t kListRowBytes = 256;
+
+// Note name as links use it: "Folder/My Note.md" -> "My Note"
+static std::string NoteTitle(const std::string& rel) {
+	std::string name = rel.substr(rel.find_last_of('/') + 1);
+	if (name.size() > 3 && LinkIndex::Lower(name.substr(name.size() - 3)) == ".md") name.resize(name.size() - 3);
+	return name;
+}
+
+// Rough bytes a Scintilla control holds: a style byte beside every text byte,
+// and a few words per line
+static size_t EditorBytes(wxStyledTextCtrl* editor) {
+	return 2 * (size_t)editor->GetTextLength() + 16 * (size_t)editor->GetLineCount();
+}
+
+// Seconds since 1970 a file was last modified, or now if it cannot be read;
+// safe off the UI thread
+static int64_t ModifiedTime(const std::string& path) {
+	time_t modified = wxFileModificationTime(wxString::FromUTF8(path.c_str()));
+	return modified == (time_t)-1 ? (int64_t)time(nullptr) : (int64_t)modified;
+}
+
+// Tree item payload: absolute path of the note or folder
+class VaultItemData : public wxTreeItemData {
+public:
+	VaultItemData(const wxString& path, bool isDir) : m_path(path), m_isDir(isDir) {}
+	
+	const wxString& GetPath() const { return m_path; }
+	bool IsDir() const { return m_isDir; }
+	
+private:
+	wxString m_path;
+	bool m_isDir;
+};
 
 class ObsidianApp : public wxApp {
 public:
@@ -31,45 +119,200 @@ private:
 	void CreateToolBar();
 	void CreateUI();
 	void LoadVault(const wxString& path);
-	void PopulateFileTree(const wxString& path);
+	bool ConfirmSwitchVault();
+	void ShowVault(Vault* vault);
+	void CloseVault(Vault* vault);
+	void UpdateVaultsMenu();
+	void ApplyMemoryBudget();
+	wxString VaultStoreFile(const wxString& root) const;
+	void UpdateVaultStore();
+	void ScanVault(Vault* vault);
+	void CancelVaultScan(Vault* vault);
+	void LoadHistory(Vault* vault, const std::string& packFile);
+	void ChangeHistory(Vault* vault, std::function<void(NoteHistory&)> change);
+	void PopulateFileTree();
+	void BuildLinkIndex(Vault* vault);
+	void BuildTitleIndex(Vault* vault);
+	void LoadSearchIndex(Vault* vault);
+	void BuildSearchIndex(Vault* vault);
+	void UpdateSearchIndex(Vault* vault);
+	void SearchIndexLanded(Vault* vault, std::shared_ptr<SearchIndex> index, bool saved);
+	void CancelSearchIndex(Vault* vault);
+	std::shared_ptr<SearchIndex> TakeSearchIndex(Vault* vault);
+	void SampleMemory();
+	void UpdateMemoryStatus();
+	void IndexNote(const std::string& rel, const std::string& content);
+	void RunSearch();
+	void UpdateNoteTitles(const std::string& rel, const std::string& content,
+		const std::vector<std::string>& oldTargets);
+	void ShowLinkCompletions();
+	void UpdateHeadings(wxStyledTextEvent& event);
+	void ApplyFoldLevels();
+	void JumpToHeading(const Heading& heading);
+	std::string VaultRelative(const wxString& path) const;
+	bool RenameVaultEntry(const wxString& from, const wxString& to);
 	void OpenNote(const wxString& filepath);
 	void SaveCurrentNote();
+	void MarkNoteSaved();
+	bool IsNoteDirty(bool exact);
+	void AcceptDiskVersion(const std::string& disk);
+	void RecordHistory(const std::string& content);
+	void RefreshHistoryList();
+	void ShowDiff(const wxString& leftTitle, std::string left, const wxString& rightTitle, std::string right);
+	void CheckDiskChanges();
+	void RebuildGraph();
+	void HighlightGraphNote();
 	void NewNote();
 	void RefreshPreview();
-	wxString MarkdownToHTML(const wxString& markdown);
+	void UpdatePreview();
+	PreviewBlockEdit ApplyPreviewEdits();
+	PreviewContent ParsePreview(int block);
+	void ResolveEmbed(PreviewSpan& span);
+	void SyncPreviewToEditor();
+	void SyncEditorToPreview();
+	wxString ResolveAttachment(const wxString& target);
+	void OnThumbnailsReady(const wxString& path);
 	
 	// Event handlers
 	void OnNew(wxCommandEvent& event);
 	void OnOpen(wxCommandEvent& event);
 	void OnSave(wxCommandEvent& event);
 	void OnOpenVault(wxCommandEvent& event);
+	void OnCloseVault(wxCommandEvent& event);
+	void OnSwitchVault(wxCommandEvent& event);
 	void OnExit(wxCommandEvent& event);
 	void OnAbout(wxCommandEvent& event);
 	void OnSearch(wxCommandEvent& event);
+	void OnSearchEnter(wxCommandEvent& event);
+	void OnSearchResultActivated(wxListEvent& event);
 	void OnTogglePreview(wxCommandEvent& event);
 	void OnPreferences(wxCommandEvent& event);
+	void OnToggleHistory(wxCommandEvent& event);
+	void OnHistorySelected(wxListEvent& event);
+	void OnHistoryRestore(wxCommandEvent& event);
+	void OnHistoryCompare(wxCommandEvent& event);
+	void OnActivate(wxActivateEvent& event);
+	void OnToggleGraph(wxCommandEvent& event);
+	void OnToggleSpelling(wxCommandEvent& event);
+	void OnToggleOutline(wxCommandEvent& event);
+	void OnToggleMemory(wxCommandEvent& event);
+	void OnMemoryTimer(wxTimerEvent& event);
+	void OnMemoryResetPeaks(wxCommandEvent& event);
+	void OnMemorySave(wxCommandEvent& event);
+	void LoadSpellingDictionary();
 	
 	void OnTreeItemActivated(wxTreeEvent& event);
 	void OnTreeItemMenu(wxTreeEvent& event);
+	void OnTreeBeginLabelEdit(wxTreeEvent& event);
+	void OnTreeEndLabelEdit(wxTreeEvent& event);
+	void OnTreeRename(wxCommandEvent& event);
+	void OnTreeMove(wxCommandEvent& event);
 	void OnEditorChanged(wxStyledTextEvent& event);
+	void OnEditorModified(wxStyledTextEvent& event);
+	void UpdateEditorStatus();
+	void OnStyleNeeded(wxStyledTextEvent& event);
+	void OnEditorUpdateUI(wxStyledTextEvent& event);
+	void OnEditorCharAdded(wxStyledTextEvent& event);
+	void OnLinkCompletion(wxStyledTextEvent& event);
+	void OnEditorMarginClick(wxStyledTextEvent& event);
+	void OnPreviewScrolled(wxScrollWinEvent& event);
+	void OnPreviewFill(wxTimerEvent& event);
 	void OnClose(wxCloseEvent& event);
 
 	// UI Components
 	wxAuiManager m_mgr;
+	wxMenu* m_vaultsMenu;
 	wxSplitterWindow* m_mainSplitter;
 	wxSplitterWindow* m_rightSplitter;
 	
 	wxTreeCtrl* m_fileTree;
 	wxStyledTextCtrl* m_editor;
-	wxHtmlWindow* m_preview;
+	PreviewView* m_preview;
 	wxTextCtrl* m_searchCtrl;
 	wxListCtrl* m_searchResults;
+	wxListCtrl* m_historyList;
+	wxStyledTextCtrl* m_historyView;
+	DiffView* m_diffView;
+	GraphView* m_graphView;
+	OutlineView* m_outline;
+	MemoryView* m_memoryView;
+	
+	// Open vaults. m_vault is the one shown, or m_noVault (empty, never
+	// scanned) before any is open; m_vaultPath is its root.
+	VaultSet m_vaults;
+	Vault m_noVault;
+	Vault* m_vault;
 	
 	// Data
 	wxString m_vaultPath;
 	wxString m_currentFile;
 	bool m_modified;
+	int m_savedLength;
+	uint64_t m_savedHash;
+	wxDateTime m_savedTime;
+	bool m_savePointStale;  // the file changed under the editor's undo save point
+	bool m_checkingDisk;
+	DocStats m_stats;  // kept current from the editor's insertions and deletions
+	HeadingIndex m_headings;  // likewise; drives folding and the outline
+	int m_foldFirst;          // lines whose fold level is due, set on the next UI update
+	int m_foldLast;
+	bool m_foldsChanged;      // fold levels changed since ApplyFoldLevels() began
 	wxTreeItemId m_rootItem;
+	wxTreeItemId m_menuItem;
+	
+	// Completion popup rows: note names and aliases from the vault's
+	// TitleIndex offered after "[[", most linked first
+	std::vector<TitleIndex::Match> m_completions;
+	
+	// Ranked full-text search over the vault's index. After a scan only the
+	// notes whose content changed are indexed again, on the pool; the index
+	// answers queries meanwhile.
+	std::vector<std::pair<std::string, int>> m_searchHits;  // note and line of each result row
+	
+	// Squiggles under misspelled words, checked on the task pool
+	std::unique_ptr<SpellChecker> m_spelling;
+	
+	// Cleared when the frame goes, for results of background jobs still queued
+	std::shared_ptr<bool> m_alive;
+	
+	// The note whose saved versions (from the vault's history pack) are listed
+	std::string m_historyNote;
+	
+	// Graph pane: node i is note m_graphNotes[i]; rebuilt lazily while hidden
+	std::vector<std::string> m_graphNotes;
+	std::unordered_map<std::string, int> m_graphNodes;
+	bool m_graphDirty;
+	
+	// Preview state: the view lays out blocks of m_previewBlocks on demand.
+	// Edits are collected as they happen and given to the index when the
+	// preview is next brought up to date.
+	PreviewBlockIndex m_previewBlocks;
+	PreviewTextEdit m_previewEdit;
+	CodeHighlightCache m_codeHighlights;  // fence runs by block hash, kept across layouts
+	int m_syncedEditorLine;
+	wxTimer m_previewTimer;
+	
+	// Embedded images are decoded off the UI thread
+	ThumbnailCache m_thumbnails;
+	bool m_thumbnailRefreshQueued;
+	std::set<std::string> m_readyImages;  // paths for the queued refresh
+	
+	// Live and peak bytes per subsystem. Search postings charge their own
+	// account as they allocate; the rest are measured every kMemorySampleMs.
+	struct MemoryAccounts {
+		MemoryAccount* stores;
+		MemoryAccount* links;
+		MemoryAccount* titles;
+		MemoryAccount* history;
+		MemoryAccount* searchTables;
+		MemoryAccount* fileTree;
+		MemoryAccount* editors;
+		MemoryAccount* previewLayout;
+		MemoryAccount* thumbnails;
+		MemoryAccount* searchResults;
+		MemoryAccount* graph;
+	} m_memory;
+	wxTimer m_memoryTimer;
 
 	enum {
 		ID_New = 1000,
@@ -79,7 +322,25 @@ private:
 		ID_Search = 1004,
 		ID_TogglePreview = 1005,
 		ID_Preferences = 1006,
-		ID_Editor = 1007
+		ID_Editor = 1007,
+		ID_PreviewTimer = 1008,
+		ID_TreeRename = 1009,
+		ID_TreeMove = 1010,
+		ID_ToggleHistory = 1011,
+		ID_HistoryList = 1012,
+		ID_HistoryRestore = 1013,
+		ID_HistoryCompare = 1014,
+		ID_ToggleGraph = 1015,
+		ID_ToggleSpelling = 1016,
+		ID_ToggleOutline = 1017,
+		ID_SearchBox = 1018,
+		ID_SearchResults = 1019,
+		ID_CloseVault = 1020,
+		ID_ToggleMemory = 1021,
+		ID_MemoryTimer = 1022,
+		ID_MemoryResetPeaks = 1023,
+		ID_MemorySave = 1024,
+		ID_SwitchVault = 1025  // up to ID_SwitchVault + kMaxOpenVaults - 1
 	};
 
 	wxDECLARE_EVENT_TABLE();
@@ -91,12 +352,21 @@ wxBEGIN_EVENT_TABLE(MainFrame, wxFrame)
 	EVT_MENU(ID_Open, MainFrame::OnOpen)
 	EVT_MENU(ID_Save, MainFrame::OnSave)
 	EVT_MENU(ID_OpenVault, MainFrame::OnOpenVault)
+	EVT_MENU(ID_CloseVault, MainFrame::OnCloseVault)
+	EVT_MENU_RANGE(ID_SwitchVault, ID_SwitchVault + kMaxOpenVaults - 1, MainFrame::OnSwitchVault)
 	EVT_MENU(wxID_EXIT, MainFrame::OnExit)
 	
 	// View menu
 	EVT_MENU(ID_Search, MainFrame::OnSearch)
+	EVT_TEXT_ENTER(ID_SearchBox, MainFrame::OnSearchEnter)
+	EVT_LIST_ITEM_ACTIVATED(ID_SearchResults, MainFrame::OnSearchResultActivated)
 	EVT_MENU(ID_TogglePreview, MainFrame::OnTogglePreview)
 	EVT_MENU(ID_Preferences, MainFrame::OnPreferences)
+	EVT_MENU(ID_ToggleHistory, MainFrame::OnToggleHistory)
+	EVT_MENU(ID_ToggleGraph, MainFrame::OnToggleGraph)
+	EVT_MENU(ID_ToggleSpelling, MainFrame::OnToggleSpelling)
+	EVT_MENU(ID_ToggleOutline, MainFrame::OnToggleOutline)
+	EVT_MENU(ID_ToggleMemory, MainFrame::OnToggleMemory)
 	
 	// Help menu
 	EVT_MENU(wxID_ABOUT, MainFrame::OnAbout)
@@ -104,42 +374,118 @@ wxBEGIN_EVENT_TABLE(MainFrame, wxFrame)
 	// Control events
 	EVT_TREE_ITEM_ACTIVATED(wxID_ANY, MainFrame::OnTreeItemActivated)
 	EVT_TREE_ITEM_RIGHT_CLICK(wxID_ANY, MainFrame::OnTreeItemMenu)
+	EVT_TREE_BEGIN_LABEL_EDIT(wxID_ANY, MainFrame::OnTreeBeginLabelEdit)
+	EVT_TREE_END_LABEL_EDIT(wxID_ANY, MainFrame::OnTreeEndLabelEdit)
+	EVT_MENU(ID_TreeRename, MainFrame::OnTreeRename)
+	EVT_MENU(ID_TreeMove, MainFrame::OnTreeMove)
 	EVT_STC_CHANGE(ID_Editor, MainFrame::OnEditorChanged)
+	EVT_STC_MODIFIED(ID_Editor, MainFrame::OnEditorModified)
+	EVT_STC_STYLENEEDED(ID_Editor, MainFrame::OnStyleNeeded)
+	EVT_STC_UPDATEUI(ID_Editor, MainFrame::OnEditorUpdateUI)
+	EVT_STC_CHARADDED(ID_Editor, MainFrame::OnEditorCharAdded)
+	EVT_STC_AUTOCOMP_SELECTION(ID_Editor, MainFrame::OnLinkCompletion)
+	EVT_STC_MARGINCLICK(ID_Editor, MainFrame::OnEditorMarginClick)
+	EVT_TIMER(ID_PreviewTimer, MainFrame::OnPreviewFill)
+	EVT_TIMER(ID_MemoryTimer, MainFrame::OnMemoryTimer)
+	EVT_BUTTON(ID_MemoryResetPeaks, MainFrame::OnMemoryResetPeaks)
+	EVT_BUTTON(ID_MemorySave, MainFrame::OnMemorySave)
+	EVT_LIST_ITEM_SELECTED(ID_HistoryList, MainFrame::OnHistorySelected)
+	EVT_BUTTON(ID_HistoryRestore, MainFrame::OnHistoryRestore)
+	EVT_BUTTON(ID_HistoryCompare, MainFrame::OnHistoryCompare)
+	EVT_ACTIVATE(MainFrame::OnActivate)
 	EVT_CLOSE(MainFrame::OnClose)
 wxEND_EVENT_TABLE()
 
 wxIMPLEMENT_APP(ObsidianApp);
 
 bool ObsidianApp::OnInit() {
+	// Image decoders for attachments embedded in notes
+	wxInitAllImageHandlers();
+	
 	MainFrame* frame = new MainFrame();
 	frame->Show(true);
 	return true;
 }
 
 MainFrame::MainFrame() : wxFrame(nullptr, wxID_ANY, "Custom Obsidian", 
-	wxDefaultPosition, wxSize(1200, 800)), m_modified(false) {
+	wxDefaultPosition, wxSize(1200, 800)), m_noVault(std::string(), std::string()), m_vault(&m_noVault),
+	m_modified(false), m_savedLength(0), m_savedHash(0), m_savePointStale(false),
+	m_checkingDisk(false), m_foldFirst(0), m_foldLast(-1), m_foldsChanged(false),
+	m_alive(std::make_shared<bool>(true)), m_graphDirty(true),
+	m_syncedEditorLine(-1), m_previewTimer(this, ID_PreviewTimer),
+	m_thumbnailRefreshQueued(false), m_memoryTimer(this, ID_MemoryTimer) {
 	
 	Center();
 	
+	// Rows of the memory diagnostics, in this order
+	MemoryLedger& ledger = MemoryLedger::Global();
+	m_memory.stores = &ledger.Add("Vault stores");
+	m_memory.links = &ledger.Add("Link indexes");
+	m_memory.titles = &ledger.Add("Title indexes");
+	m_memory.history = &ledger.Add("Note history");
+	PostingMemory::Account();
+	m_memory.searchTables = &ledger.Add("Search tables");
+	m_memory.fileTree = &ledger.Add("File tree");
+	m_memory.editors = &ledger.Add("Editor buffers");
+	m_memory.previewLayout = &ledger.Add("Preview layout");
+	m_memory.thumbnails = &ledger.Add("Thumbnails");
+	m_memory.searchResults = &ledger.Add("Search results");
+	m_memory.graph = &ledger.Add("Graph");
+	
+	m_thumbnails.SetCacheDir(wxFileName(wxStandardPaths::Get().GetUserLocalDataDir(),
+		"thumbnails").GetFullPath());
+	m_thumbnails.SetReadyCallback([this](const wxString& path) { OnThumbnailsReady(path); });
+	
 	CreateMenuBar();
 	CreateToolBar();
 	CreateUI();
 	
-	// Load last vault if available
 	wxConfig config("CustomObsidian");
+	bool checkSpelling = config.ReadBool("CheckSpelling", true);
+	GetMenuBar()->Check(ID_ToggleSpelling, checkSpelling);
+	m_spelling->SetEnabled(checkSpelling);
+	if (checkSpelling) LoadSpellingDictionary();
+	
+	// Vaults open last time come back in the same order, each loaded from
+	// its cache when first shown; the last one shown is shown again
+	long budget = config.ReadLong("MemoryBudgetMB", kDefaultMemoryBudgetMB);
+	m_vaults.SetBudget((size_t)std::max(budget, 64L) * 1024 * 1024);
+	wxString path;
+	for (int i = 0; config.Read(wxString::Format("OpenVaults/%d", i), &path); i++) {
+		std::string root(path.utf8_str());
+		if (!wxDirExists(path) || m_vaults.Find(root) || m_vaults.Vaults().size() >= (size_t)kMaxOpenVaults) continue;
+		m_vaults.Add(root, std::string(VaultStoreFile(path).utf8_str()));
+	}
 	wxString lastVault;
 	if (config.Read("LastVault", &lastVault) && wxDirExists(lastVault)) {
 		LoadVault(lastVault);
 	}
+	UpdateVaultsMenu();
 	
 	SetStatusText("Ready - Open a vault to get started");
+	SampleMemory();
+	m_memoryTimer.Start(kMemorySampleMs);
 }
 
 MainFrame::~MainFrame() {
+	*m_alive = false;
+	m_memoryTimer.Stop();
+	for (const std::unique_ptr<Vault>& vault : m_vaults.Vaults()) {
+		CancelVaultScan(vault.get());
+		CancelSearchIndex(vault.get());
+	}
+	
 	// Save configuration
 	wxConfig config("CustomObsidian");
+	config.DeleteGroup("OpenVaults");
+	const std::vector<std::unique_ptr<Vault>>& vaults = m_vaults.Vaults();
+	for (size_t i = 0; i < vaults.size(); i++) {
+		config.Write(wxString::Format("OpenVaults/%d", (int)i), wxString::FromUTF8(vaults[i]->root.c_str()));
+	}
 	if (!m_vaultPath.IsEmpty()) {
 		config.Write("LastVault", m_vaultPath);
+	} else {
+		config.DeleteEntry("LastVault");
 	}
 	
 	m_mgr.UnInit();
@@ -151,6 +497,9 @@ void MainFrame::CreateMenuBar() {
 	// File menu
 	wxMenu* fileMenu = new wxMenu;
 	fileMenu->Append(ID_OpenVault, "Open &Vault...\tCtrl-O", "Open a notes vault");
+	m_vaultsMenu = new wxMenu;
+	fileMenu->AppendSubMenu(m_vaultsMenu, "S&witch Vault", "Show another open vault");
+	fileMenu->Append(ID_CloseVault, "C&lose Vault", "Close the vault shown");
 	fileMenu->AppendSeparator();
 	fileMenu->Append(ID_New, "&New Note\tCtrl-N", "Create new note");
 	fileMenu->Append(ID_Save, "&Save\tCtrl-S", "Save current note");
@@ -169,6 +518,11 @@ void MainFrame::CreateMenuBar() {
 	wxMenu* viewMenu = new wxMenu;
 	viewMenu->AppendCheckItem(ID_TogglePreview, "Show &Preview\tCtrl-P", "Toggle markdown preview");
 	viewMenu->Check(ID_TogglePreview, true);
+	viewMenu->Append(ID_ToggleHistory, "Note &History\tCtrl-H", "Browse and restore saved versions");
+	viewMenu->Append(ID_ToggleGraph, "&Graph View\tCtrl-G", "Show how notes link together");
+	viewMenu->Append(ID_ToggleOutline, "&Outline\tCtrl-Shift-O", "Show the headings of the current note");
+	viewMenu->Append(ID_ToggleMemory, "&Memory Diagnostics", "Show live and peak memory of each part of the application");
+	viewMenu->AppendCheckItem(ID_ToggleSpelling, "Check &Spelling", "Underline misspelled words");
 	viewMenu->Append(ID_Preferences, "Pre&ferences...", "Application preferences");
 
 	// Help menu
@@ -215,32 +569,105 @@ void MainFrame::CreateUI() {
 	// Configure editor for markdown
 	m_editor->StyleSetFont(wxSTC_STYLE_DEFAULT, wxFont(12, wxFONTFAMILY_TELETYPE, 
 		wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
-	m_editor->SetLexer(wxSTC_LEX_MARKDOWN);
+	m_editor->SetLexer(wxSTC_LEX_CONTAINER);
 	m_editor->SetTabWidth(4);
 	m_editor->SetUseTabs(true);
 	m_editor->SetWrapMode(wxSTC_WRAP_WORD);
+	m_editor->StyleClearAll();
+	
+	// Markdown syntax highlighting (styled by OnStyleNeeded)
+	m_editor->StyleSetForeground(MD_HEADER1, wxColour(0, 0, 255));
+	m_editor->StyleSetBold(MD_HEADER1, true);
+	m_editor->StyleSetSize(MD_HEADER1, 16);
+	
+	m_editor->StyleSetForeground(MD_HEADER2, wxColour(0, 100, 0));
+	m_editor->StyleSetBold(MD_HEADER2, true);
+	m_editor->StyleSetSize(MD_HEADER2, 14);
+	
+	for (int style = MD_HEADER3; style <= MD_HEADER6; style++) {
+		m_editor->StyleSetForeground(style, wxColour(70, 70, 120));
+		m_editor->StyleSetBold(style, true);
+	}
+	
+	m_editor->StyleSetForeground(MD_STRONG, wxColour(139, 69, 19));
+	m_editor->StyleSetBold(MD_STRONG, true);
+	
+	m_editor->StyleSetForeground(MD_EM, wxColour(128, 0, 128));
+	m_editor->StyleSetItalic(MD_EM, true);
 	
-	// Markdown syntax highlighting
-	m_editor->StyleSetForeground(wxSTC_MARKDOWN_HEADER1, wxColour(0, 0, 255));
-	m_editor->StyleSetBold(wxSTC_MARKDOWN_HEADER1, true);
-	m_editor->StyleSetSize(wxSTC_MARKDOWN_HEADER1, 16);
+	m_editor->StyleSetForeground(MD_CODE, wxColour(220, 20, 60));
+	m_editor->StyleSetBackground(MD_CODE, wxColour(245, 245, 245));
 	
-	m_editor->StyleSetForeground(wxSTC_MARKDOWN_HEADER2, wxColour(0, 100, 0));
-	m_editor->StyleSetBold(wxSTC_MARKDOWN_HEADER2, true);
-	m_editor->StyleSetSize(wxSTC_MARKDOWN_HEADER2, 14);
+	m_editor->StyleSetForeground(MD_FENCE, wxColour(150, 150, 150));
+	m_editor->StyleSetBackground(MD_FENCE, wxColour(245, 245, 245));
+	m_editor->StyleSetForeground(MD_FENCE_INFO, wxColour(0, 128, 128));
+	m_editor->StyleSetBackground(MD_FENCE_INFO, wxColour(245, 245, 245));
+	m_editor->StyleSetForeground(MD_CODEBLOCK, wxColour(60, 60, 60));
+	m_editor->StyleSetBackground(MD_CODEBLOCK, wxColour(245, 245, 245));
+	m_editor->StyleSetEOLFilled(MD_CODEBLOCK, true);
 	
-	m_editor->StyleSetForeground(wxSTC_MARKDOWN_STRONG1, wxColour(139, 69, 19));
-	m_editor->StyleSetBold(wxSTC_MARKDOWN_STRONG1, true);
+	m_editor->StyleSetForeground(MD_WIKILINK, wxColour(52, 152, 219));
+	m_editor->StyleSetUnderline(MD_WIKILINK, true);
+	m_editor->StyleSetForeground(MD_LINK, wxColour(52, 152, 219));
+	m_editor->StyleSetForeground(MD_TAG, wxColour(155, 89, 182));
 	
-	m_editor->StyleSetForeground(wxSTC_MARKDOWN_EM1, wxColour(128, 0, 128));
-	m_editor->StyleSetItalic(wxSTC_MARKDOWN_EM1, true);
+	m_editor->StyleSetForeground(MD_FRONTMATTER, wxColour(127, 140, 141));
+	m_editor->StyleSetForeground(MD_FRONTMATTER_KEY, wxColour(41, 128, 185));
+	m_editor->StyleSetForeground(MD_BLOCKQUOTE, wxColour(127, 140, 141));
+	m_editor->StyleSetItalic(MD_BLOCKQUOTE, true);
+	m_editor->StyleSetForeground(MD_LIST_MARKER, wxColour(230, 126, 34));
+	m_editor->StyleSetForeground(MD_HRULE, wxColour(189, 195, 199));
 	
-	m_editor->StyleSetForeground(wxSTC_MARKDOWN_CODE, wxColour(220, 20, 60));
-	m_editor->StyleSetBackground(wxSTC_MARKDOWN_CODE, wxColour(245, 245, 245));
+	m_spelling.reset(new SpellChecker(m_editor));
+	
+	// Sections fold at their headings; levels are set from m_headings
+	const int foldMargin = 2;
+	m_editor->SetMarginType(foldMargin, wxSTC_MARGIN_SYMBOL);
+	m_editor->SetMarginMask(foldMargin, wxSTC_MASK_FOLDERS);
+	m_editor->SetMarginWidth(foldMargin, FromDIP(14));
+	m_editor->SetMarginSensitive(foldMargin, true);
+	const int foldMarkers[][2] = {
+		{wxSTC_MARKNUM_FOLDER, wxSTC_MARK_BOXPLUS},
+		{wxSTC_MARKNUM_FOLDEROPEN, wxSTC_MARK_BOXMINUS},
+		{wxSTC_MARKNUM_FOLDERSUB, wxSTC_MARK_VLINE},
+		{wxSTC_MARKNUM_FOLDERTAIL, wxSTC_MARK_LCORNER},
+		{wxSTC_MARKNUM_FOLDEREND, wxSTC_MARK_BOXPLUSCONNECTED},
+		{wxSTC_MARKNUM_FOLDEROPENMID, wxSTC_MARK_BOXMINUSCONNECTED},
+		{wxSTC_MARKNUM_FOLDERMIDTAIL, wxSTC_MARK_TCORNER}
+	};
+	for (const auto& marker : foldMarkers) {
+		m_editor->MarkerDefine(marker[0], marker[1], *wxWHITE, wxColour(128, 128, 128));
+	}
+	m_editor->SetAutomaticFold(wxSTC_AUTOMATICFOLD_SHOW | wxSTC_AUTOMATICFOLD_CHANGE);
+	m_editor->SetFoldFlags(wxSTC_FOLDFLAG_LINEAFTER_CONTRACTED);
+	
+	// Link completion keeps the order it is given; titles may contain spaces
+	m_editor->AutoCompSetSeparator('\n');
+	m_editor->AutoCompSetIgnoreCase(true);
+	m_editor->AutoCompSetOrder(wxSTC_ORDER_CUSTOM);
+	m_editor->AutoCompSetMaxHeight(10);
 
 	// Create preview pane
-	m_preview = new wxHtmlWindow(this, wxID_ANY);
-	m_preview->SetPage("<html><body><h2>Preview</h2><p>Markdown preview will appear here when you start typing.</p></body></html>");
+	m_preview = new PreviewView(this);
+	m_preview->SetMessage("Markdown preview will appear here when you start typing.");
+	m_preview->SetParseCallback([this](int block) { return ParsePreview(block); });
+	m_preview->SetImageCallback([this](const std::string& path, int width) {
+		return m_thumbnails.Lookup(wxString::FromUTF8(path.c_str()), width);
+	});
+	
+	// Keep the editor following the preview when the preview is scrolled
+	const wxEventType scrollEvents[] = {
+		wxEVT_SCROLLWIN_TOP, wxEVT_SCROLLWIN_BOTTOM, wxEVT_SCROLLWIN_LINEUP,
+		wxEVT_SCROLLWIN_LINEDOWN, wxEVT_SCROLLWIN_PAGEUP, wxEVT_SCROLLWIN_PAGEDOWN,
+		wxEVT_SCROLLWIN_THUMBTRACK, wxEVT_SCROLLWIN_THUMBRELEASE
+	};
+	for (wxEventType type : scrollEvents) {
+		m_preview->Bind(type, &MainFrame::OnPreviewScrolled, this);
+	}
+	m_preview->Bind(wxEVT_MOUSEWHEEL, [this](wxMouseEvent& event) {
+		event.Skip();
+		CallAfter(&MainFrame::SyncEditorToPreview);
+	});
 
 	// Create search panel
 	wxPanel* searchPanel = new wxPanel(this, wxID_ANY);
@@ -249,10 +676,11 @@ void MainFrame::CreateUI() {
 	wxStaticText* searchLabel = new wxStaticText(searchPanel, wxID_ANY, "Search:");
 	searchSizer->Add(searchLabel, 0, wxALL, 5);
 	
-	m_searchCtrl = new wxTextCtrl(searchPanel, wxID_ANY, "", wxDefaultPosition, wxDefaultSize, wxTE_PROCESS_ENTER);
+	m_searchCtrl = new wxTextCtrl(searchPanel, ID_SearchBox, "", wxDefaultPosition, wxDefaultSize, wxTE_PROCESS_ENTER);
+	m_searchCtrl->SetHint("words, \"a phrase\", word NEAR/5 word, -word, tag:#x path:folder/ modified:>2026-01-01");
 	searchSizer->Add(m_searchCtrl, 0, wxEXPAND | wxALL, 5);
 	
-	m_searchResults = new wxListCtrl(searchPanel, wxID_ANY, wxDefaultPosition, wxDefaultSize, 
+	m_searchResults = new wxListCtrl(searchPanel, ID_SearchResults, wxDefaultPosition, wxDefaultSize, 
 		wxLC_REPORT | wxLC_SINGLE_SEL);
 	m_searchResults->AppendColumn("File", wxLIST_FORMAT_LEFT, 150);
 	m_searchResults->AppendColumn("Line", wxLIST_FORMAT_LEFT, 50);
@@ -260,6 +688,56 @@ void MainFrame::CreateUI() {
 	searchSizer->Add(m_searchResults, 1, wxEXPAND | wxALL, 5);
 	
 	searchPanel->SetSizer(searchSizer);
+	
+	// Create history panel: saved versions of the open note, newest first
+	wxPanel* historyPanel = new wxPanel(this, wxID_ANY);
+	wxBoxSizer* historySizer = new wxBoxSizer(wxVERTICAL);
+	
+	m_historyList = new wxListCtrl(historyPanel, ID_HistoryList, wxDefaultPosition, wxDefaultSize,
+		wxLC_REPORT | wxLC_SINGLE_SEL);
+	m_historyList->AppendColumn("Saved", wxLIST_FORMAT_LEFT, 140);
+	m_historyList->AppendColumn("Size", wxLIST_FORMAT_RIGHT, 70);
+	m_historyList->AppendColumn("Stored", wxLIST_FORMAT_RIGHT, 70);
+	historySizer->Add(m_historyList, 1, wxEXPAND | wxALL, 5);
+	
+	m_historyView = new wxStyledTextCtrl(historyPanel, wxID_ANY);
+	m_historyView->StyleSetFont(wxSTC_STYLE_DEFAULT, wxFont(10, wxFONTFAMILY_TELETYPE,
+		wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
+	m_historyView->StyleClearAll();
+	m_historyView->SetWrapMode(wxSTC_WRAP_WORD);
+	m_historyView->SetReadOnly(true);
+	historySizer->Add(m_historyView, 2, wxEXPAND | wxLEFT | wxRIGHT, 5);
+	
+	wxBoxSizer* historyButtons = new wxBoxSizer(wxHORIZONTAL);
+	historyButtons->Add(new wxButton(historyPanel, ID_HistoryCompare, "Compare with Current"), 0, wxALL, 5);
+	historyButtons->Add(new wxButton(historyPanel, ID_HistoryRestore, "Restore This Version"), 0, wxALL, 5);
+	historySizer->Add(historyButtons, 0, wxALIGN_RIGHT);
+	historyPanel->SetSizer(historySizer);
+	
+	// Create diff view, shown when versions are compared
+	m_diffView = new DiffView(this);
+	
+	// Create graph view; double-clicking a node opens its note
+	m_graphView = new GraphView(this);
+	m_graphView->SetActivateCallback([this](size_t node) {
+		if (node < m_graphNotes.size()) {
+			OpenNote(wxFileName(m_vaultPath + "/" + wxString::FromUTF8(m_graphNotes[node].c_str())).GetFullPath());
+		}
+	});
+
+	m_outline = new OutlineView(this, m_headings);
+	m_outline->SetJumpCallback([this](const Heading& heading) { JumpToHeading(heading); });
+	
+	// Create memory diagnostics panel
+	wxPanel* memoryPanel = new wxPanel(this);
+	wxBoxSizer* memorySizer = new wxBoxSizer(wxVERTICAL);
+	m_memoryView = new MemoryView(memoryPanel, MemoryLedger::Global());
+	memorySizer->Add(m_memoryView, 1, wxEXPAND | wxALL, 5);
+	wxBoxSizer* memoryButtons = new wxBoxSizer(wxHORIZONTAL);
+	memoryButtons->Add(new wxButton(memoryPanel, ID_MemoryResetPeaks, "Reset Peaks"), 0, wxALL, 5);
+	memoryButtons->Add(new wxButton(memoryPanel, ID_MemorySave, "Save as JSON..."), 0, wxALL, 5);
+	memorySizer->Add(memoryButtons, 0, wxALIGN_RIGHT);
+	memoryPanel->SetSizer(memorySizer);
 
 	// Add panes to AUI manager
 	m_mgr.AddPane(m_fileTree, wxAuiPaneInfo()
@@ -270,6 +748,16 @@ void MainFrame::CreateUI() {
 		.BestSize(250, -1)
 		.CloseButton(false));
 
+	m_mgr.AddPane(m_outline, wxAuiPaneInfo()
+		.Name("outline")
+		.Caption("Outline")
+		.Left()
+		.Position(1)
+		.MinSize(200, -1)
+		.BestSize(250, 300)
+		.Hide()
+		.CloseButton(true));
+
 	m_mgr.AddPane(m_editor, wxAuiPaneInfo()
 		.Name("editor")
 		.Caption("Editor")
@@ -293,11 +781,49 @@ void MainFrame::CreateUI() {
 		.Hide()
 		.CloseButton(true));
 
+	m_mgr.AddPane(historyPanel, wxAuiPaneInfo()
+		.Name("history")
+		.Caption("History")
+		.Right()
+		.MinSize(300, -1)
+		.BestSize(350, -1)
+		.Hide()
+		.CloseButton(true));
+
+	m_mgr.AddPane(m_graphView, wxAuiPaneInfo()
+		.Name("graph")
+		.Caption("Graph")
+		.Right()
+		.Layer(1)
+		.MinSize(300, 300)
+		.BestSize(500, -1)
+		.Hide()
+		.CloseButton(true));
+
+	m_mgr.AddPane(m_diffView, wxAuiPaneInfo()
+		.Name("diff")
+		.Caption("Differences")
+		.Bottom()
+		.MinSize(-1, 200)
+		.BestSize(-1, 350)
+		.Hide()
+		.CloseButton(true));
+
+	m_mgr.AddPane(memoryPanel, wxAuiPaneInfo()
+		.Name("memory")
+		.Caption("Memory")
+		.Right()
+		.Layer(1)
+		.MinSize(300, 250)
+		.BestSize(450, -1)
+		.Hide()
+		.CloseButton(true));
+
 	// Commit all changes
 	m_mgr.Update();
 
 	CreateStatusBar(2);
-	int widths[] = {-1, 200};
+	int widths[] = {-1, 320};
 	GetStatusBar()->SetStatusWidths(2, widths);
 	SetStatusText("Ready", 0);
 	SetStatusText("No vault loaded", 1);
@@ -309,62 +835,667 @@ void MainFrame::LoadVault(const wxString& path) {
 		return;
 	}
 
-	m_vaultPath = path;
-	SetTitle("Custom Obsidian - " + wxFileName(path).GetName());
+	// A vault already open is only shown again
+	std::string root(path.utf8_str());
+	Vault* vault = m_vaults.Find(root);
+	if (vault == m_vault) return;
+	if (!vault && m_vaults.Vaults().size() >= (size_t)kMaxOpenVaults) {
+		wxMessageBox(wxString::Format("At most %d vaults can be open at once. Close one first.", kMaxOpenVaults),
+			"Open Vault", wxOK | wxICON_WARNING);
+		return;
+	}
+	if (!ConfirmSwitchVault()) return;
+	if (!vault) vault = m_vaults.Add(root, std::string(VaultStoreFile(path).utf8_str()));
+	ShowVault(vault);
+}
+
+bool MainFrame::ConfirmSwitchVault() {
+	if (!m_modified || !IsNoteDirty(true)) return true;
+	int result = wxMessageBox("Current note has unsaved changes. Save before switching vaults?",
+		"Unsaved Changes", wxYES_NO | wxCANCEL | wxICON_QUESTION);
+	if (result == wxCANCEL) return false;
+	if (result == wxYES) SaveCurrentNote();
+	return true;
+}
+
+void MainFrame::ShowVault(Vault* vault) {
+	// Come back to the same note when this vault is shown again
+	if (!m_currentFile.IsEmpty()) m_vault->openNote = VaultRelative(m_currentFile);
+	m_vault = vault;
+	m_vaultPath = wxString::FromUTF8(vault->root.c_str());
+	m_searchResults->DeleteAllItems();
+	m_searchHits.clear();
+	m_preview->Invalidate();
+	m_currentFile.Clear();
+	m_editor->ClearAll();
+	m_editor->EmptyUndoBuffer();
+	m_editor->SetSavePoint();
+	m_savedLength = 0;
+	m_savedHash = ContentHash(nullptr, 0);
+	m_savedTime = wxDateTime();
+	m_savePointStale = false;
+	m_modified = false;
+	UpdateVaultsMenu();
+	
+	if (vault == &m_noVault) {
+		m_fileTree->DeleteAllItems();
+		RebuildGraph();
+		RefreshHistoryList();
+		RefreshPreview();
+		SetTitle("Custom Obsidian");
+		UpdateMemoryStatus();
+		return;
+	}
+	
+	// The first time round the vault starts from its cached store and search
+	// snapshot; later it still has them. Either way a background rescan picks
+	// up what changed on disk in the meantime.
+	if (vault->lastShown == 0) {
+		vault->store.Open(vault->storeFile);
+		LoadHistory(vault, std::string(wxFileName(m_vaultPath + "/.obsidian", "history.pack").GetFullPath().utf8_str()));
+		BuildLinkIndex(vault);
+		BuildTitleIndex(vault);
+	}
+	m_vaults.Shown(vault);
+	SetTitle("Custom Obsidian - " + wxFileName(m_vaultPath).GetName());
+	PopulateFileTree();
+	RebuildGraph();
+	wxString note = wxFileName(m_vaultPath + "/" + wxString::FromUTF8(vault->openNote.c_str())).GetFullPath();
+	if (!vault->openNote.empty() && wxFileExists(note)) {
+		OpenNote(note);
+	} else {
+		RefreshHistoryList();
+		RefreshPreview();
+	}
+	if (!vault->search && !vault->searchBuilding) LoadSearchIndex(vault);
+	if (vault->scanJob.IsIdle()) ScanVault(vault);
+	ApplyMemoryBudget();
 	
-	// Clear and populate file tree
+	UpdateMemoryStatus();
+}
+
+void MainFrame::CloseVault(Vault* vault) {
+	if (vault == &m_noVault || !ConfirmSwitchVault()) return;
+	
+	// Show the vault that was shown before it, if any
+	Vault* next = &m_noVault;
+	for (const std::unique_ptr<Vault>& open : m_vaults.Vaults()) {
+		if (open.get() != vault && (next == &m_noVault || open->lastShown > next->lastShown)) next = open.get();
+	}
+	if (vault == m_vault) ShowVault(next);
+	
+	// The UI does not wait for the vault's jobs. They are cancelled, and a
+	// task on the pool waits for them, writes the search index if the
+	// snapshot is behind and then frees the vault, whose store the scan
+	// reads. The history scan only fills its own copy, dropped with the report.
+	vault->scanJob.Cancel();
+	vault->historyJob.Cancel();
+	std::shared_ptr<SearchIndex> index = TakeSearchIndex(vault);
+	TaskGroup search = vault->searchJob;
+	std::shared_ptr<Vault> closed(m_vaults.Remove(vault));
+	TaskGroup retire(TaskPool::Shared(), TaskPriority::Low);
+	retire.Run([closed, search, index](const CancelToken&) mutable {
+		closed->scanJob.Wait();
+		search.Wait();
+		if (index) index->Save(closed->searchFile);
+	});
+	retire.Close();
+	UpdateVaultsMenu();
+}
+
+void MainFrame::UpdateVaultsMenu() {
+	// One radio item per open vault, the shown one checked
+	while (m_vaultsMenu->GetMenuItemCount() > 0) m_vaultsMenu->Destroy(m_vaultsMenu->FindItemByPosition(0));
+	const std::vector<std::unique_ptr<Vault>>& vaults = m_vaults.Vaults();
+	for (size_t i = 0; i < vaults.size(); i++) {
+		wxString root = wxString::FromUTF8(vaults[i]->root.c_str());
+		wxString label = wxFileName(root).GetName();
+		if (i < 9) label += wxString::Format("\tCtrl-%d", (int)i + 1);
+		m_vaultsMenu->AppendRadioItem(ID_SwitchVault + (int)i, label, root);
+		if (vaults[i].get() == m_vault) m_vaultsMenu->Check(ID_SwitchVault + (int)i, true);
+	}
+	GetMenuBar()->Enable(ID_CloseVault, m_vault != &m_noVault);
+}
+
+void MainFrame::ApplyMemoryBudget() {
+	// Background vaults give up their search indexes, least recently shown
+	// first. A vault shown again while its snapshot is written gets the index
+	// back when the write is done (see LoadSearchIndex); spillReport drops
+	// the report if the vault stopped waiting, or was closed.
+	for (Vault* vault : m_vaults.OverBudget(m_vault)) {
+		vault->spillReport = CancelToken();
+		CancelToken cancel = vault->spillReport;
+		VaultSet::Spill(*vault, ReportOnUiThread(m_alive, [this, vault, cancel](const TaskGroup::Progress& progress) {
+			if (cancel.IsCancelled() || !progress.finished || !vault->searchReclaim) return;
+			std::shared_ptr<SearchIndex> index = std::move(vault->searchReclaim);
+			SearchIndexLanded(vault, index, false);
+		}));
+	}
+}
+
+wxString MainFrame::VaultStoreFile(const wxString& root) const {
+	// One store file per vault, named after the vault's path
+	wxScopedCharBuffer bytes = root.utf8_str();
+	wxString name = wxString::Format("%016llx.store",
+		(unsigned long long)ContentHash(bytes.data(), bytes.length()));
+	return wxFileName(wxStandardPaths::Get().GetUserLocalDataDir() + "/vaults", name).GetFullPath();
+}
+
+void MainFrame::UpdateVaultStore() {
+	wxBusyCursor busy;
+	
+	// A rescan in flight is superseded by this one
+	CancelVaultScan(m_vault);
+	if (!m_vault->store.IsOpen()) m_vault->store.Open(m_vault->storeFile);
+	if (!m_vault->store.Update(m_vault->root, m_vault->storeFile)) {
+		m_vault->store.Close();
+		SetStatusText("Cannot scan vault: " + m_vaultPath, 0);
+	}
+	BuildTitleIndex(m_vault);
+}
+
+void MainFrame::ScanVault(Vault* vault) {
+	// The scan runs at low priority on the shared pool; progress and the
+	// result come back through CallAfter, and reach the window only while
+	// the vault is the one shown
+	auto image = std::make_shared<std::vector<char>>();
+	vault->scanJob = TaskGroup(TaskPool::Shared(), TaskPriority::Low);
+	CancelToken cancel = vault->scanJob.Token();
+	vault->scanJob.SetReporter(ReportOnUiThread(m_alive, [this, vault, image, cancel](const TaskGroup::Progress& progress) {
+		if (cancel.IsCancelled()) return;
+		if (!progress.finished) {
+			if (vault == m_vault) SetStatusText(FormatProgress("Scanning vault", progress), 0);
+			return;
+		}
+		if (image->empty()) {
+			if (vault == m_vault) SetStatusText("Cannot scan vault: " + m_vaultPath, 0);
+			return;
+		}
+		vault->store.Commit(vault->storeFile, std::move(*image));
+		BuildLinkIndex(vault);
+		BuildTitleIndex(vault);
+		if (vault == m_vault) {
+			PopulateFileTree();
+			RebuildGraph();
+			SetStatusText("Vault scanned", 0);
+		}
+		// Only notes whose content changed are indexed again; a spilled
+		// index catches up when its vault is next shown
+		if (vault->searchBuilding) {
+			vault->searchRecheck = true;
+		} else if (vault->search) {
+			UpdateSearchIndex(vault);
+		} else if (vault == m_vault) {
+			LoadSearchIndex(vault);
+		}
+	}));
+	
+	TaskGroup job = vault->scanJob;
+	std::string root = vault->root;
+	job.Run([vault, job, root, image](const CancelToken&) mutable {
+		if (!vault->store.Scan(root, *image, &job)) image->clear();
+	});
+	job.Close();
+	if (vault == m_vault) SetStatusText("Scanning vault...", 0);
+}
+
+void MainFrame::CancelVaultScan(Vault* vault) {
+	// The scan reads the store, so wait for it before anything replaces the store
+	vault->scanJob.Cancel();
+	vault->scanJob.Wait();
+}
+
+void MainFrame::LoadHistory(Vault* vault, const std::string& packFile) {
+	// Scanning the pack reads all of it, so it runs on the pool into a
+	// history of its own, which replaces the vault's once it is open
+	auto loaded = std::make_shared<NoteHistory>();
+	vault->historyLoading = true;
+	vault->historyJob = TaskGroup(TaskPool::Shared(), TaskPriority::Low);
+	CancelToken cancel = vault->historyJob.Token();
+	vault->historyJob.SetReporter(ReportOnUiThread(m_alive, [this, vault, loaded, cancel](const TaskGroup::Progress& progress) {
+		if (cancel.IsCancelled() || !progress.finished) return;
+		vault->history = std::move(*loaded);
+		vault->historyLoading = false;
+		for (const auto& change : vault->historyPending) change(vault->history);
+		vault->historyPending.clear();
+		if (vault == m_vault) RefreshHistoryList();
+	}));
+	vault->historyJob.Run([loaded, packFile](const CancelToken&) { loaded->Open(packFile); });
+	vault->historyJob.Close();
+}
+
+void MainFrame::ChangeHistory(Vault* vault, std::function<void(NoteHistory&)> change) {
+	if (vault->historyLoading) {
+		vault->historyPending.push_back(std::move(change));
+	} else {
+		change(vault->history);
+	}
+}
+
+void MainFrame::PopulateFileTree() {
 	m_fileTree->DeleteAllItems();
-	PopulateFileTree(path);
+	m_rootItem = m_fileTree->AddRoot(wxFileName(m_vaultPath).GetName());
+	m_fileTree->SetItemData(m_rootItem, new VaultItemData(m_vaultPath, true));
 	
-	SetStatusText("Vault loaded: " + wxFileName(path).GetName(), 1);
-	GetToolBar()->EnableTool(ID_New, true);
+	// Entries are stored in tree order, so every parent is added before its
+	// children and the items can simply be appended
+	const VaultStore& store = m_vault->store;
+	std::vector<wxTreeItemId> items(store.Count());
+	if (!items.empty()) items[0] = m_rootItem;
+	for (uint32_t i = 1; i < store.Count(); i++) {
+		if (!store.IsFolder(i) && !store.IsNote(i)) continue;
+		const wxTreeItemId& parent = items[store.Entry(i).parent];
+		if (!parent.IsOk()) continue;
+		wxString path = wxFileName(m_vaultPath + "/" + wxString::FromUTF8(store.Path(i).c_str())).GetFullPath();
+		items[i] = m_fileTree->AppendItem(parent, wxString::FromUTF8(store.Name(i)));
+		m_fileTree->SetItemData(items[i], new VaultItemData(path, store.IsFolder(i)));
+	}
+	m_fileTree->Expand(m_rootItem);
 }
 
-void MainFrame::PopulateFileTree(const wxString& path) {
-	m_rootItem = m_fileTree->AddRoot(wxFileName(path).GetName());
-	m_fileTree->SetItemData(m_rootItem, new wxTreeItemData());
+void MainFrame::BuildLinkIndex(Vault* vault) {
+	const VaultStore& store = vault->store;
+	vault->links.Clear();
+	for (uint32_t i = 0; i < store.Count(); i++) {
+		if (!store.IsNote(i)) continue;
+		std::vector<std::string> keys;
+		keys.reserve(store.LinkCount(i));
+		for (uint32_t k = 0; k < store.LinkCount(i); k++) keys.push_back(store.Link(i, k));
+		vault->links.SetNote(store.Path(i), std::move(keys));
+	}
+}
 
-	wxDir dir(path);
-	if (!dir.IsOpened()) return;
+void MainFrame::BuildTitleIndex(Vault* vault) {
+	// Every note by its name and its aliases, scored by how many notes link to it
+	const VaultStore& store = vault->store;
+	vault->titles.Clear();
+	for (uint32_t i = 0; i < store.Count(); i++) {
+		if (!store.IsNote(i)) continue;
+		std::string rel = store.Path(i);
+		int score = (int)vault->links.ReferrerCount(LinkIndex::NoteKey(rel));
+		vault->titles.Add(NoteTitle(rel), rel, false, score);
+		for (uint32_t k = 0; k < store.AliasCount(i); k++) vault->titles.Add(store.Alias(i, k), rel, true, score);
+	}
+}
 
-	wxString filename;
+void MainFrame::UpdateNoteTitles(const std::string& rel, const std::string& content,
+	const std::vector<std::string>& oldTargets) {
+	// The note's own aliases may have changed, and so may the link counts of
+	// whatever it linked to before and links to now
+	int score = (int)m_vault->links.ReferrerCount(LinkIndex::NoteKey(rel));
+	m_vault->titles.Remove(rel);
+	m_vault->titles.Add(NoteTitle(rel), rel, false, score);
+	for (const std::string& alias : VaultStore::ExtractAliases(content)) m_vault->titles.Add(alias, rel, true, score);
 	
-	// Add markdown files
-	bool cont = dir.GetFirst(&filename, "*.md", wxDIR_FILES);
-	while (cont) {
-		wxTreeItemId item = m_fileTree->AppendItem(m_rootItem, filename);
-		m_fileTree->SetItemData(item, new wxTreeItemData());
-		cont = dir.GetNext(&filename);
+	std::vector<std::string> keys = m_vault->links.Targets(rel);
+	keys.insert(keys.end(), oldTargets.begin(), oldTargets.end());
+	for (const std::string& key : keys) m_vault->titles.SetScore(key, (int)m_vault->links.ReferrerCount(key));
+}
+
+void MainFrame::LoadSearchIndex(Vault* vault) {
+	// An index spilled a moment ago is simply taken back. If its snapshot
+	// is still being written it lands when the write is done, rather than
+	// the UI waiting for the disk here.
+	std::shared_ptr<SearchIndex> spilled = vault->spilling.lock();
+	vault->spilling.reset();
+	if (spilled) {
+		vault->searchRecheck = true;
+		if (vault->searchJob.IsIdle()) {
+			SearchIndexLanded(vault, spilled, false);
+		} else {
+			vault->searchReclaim = spilled;
+			vault->searchBuilding = true;
+			vault->searchStale.clear();
+		}
+		return;
+	}
+	CancelSearchIndex(vault);
+	// Without a snapshot the index is built from the store, once there is one
+	if (!wxFileExists(wxString::FromUTF8(vault->searchFile.c_str()))) {
+		if (vault->store.IsOpen()) BuildSearchIndex(vault);
+		return;
 	}
 	
-	// Add subdirectories
-	cont = dir.GetFirst(&filename, "", wxDIR_DIRS);
-	while (cont) {
-		if (filename != "." && filename != "..") {
-			wxTreeItemId dirItem = m_fileTree->AppendItem(m_rootItem, filename);
-			m_fileTree->SetItemData(dirItem, new wxTreeItemData());
-			
-			// Recursively add subdirectory contents
-			wxString subPath = wxFileName(path, filename).GetFullPath();
-			if (wxDirExists(subPath)) {
-				wxDir subDir(subPath);
-				wxString subFile;
-				bool subCont = subDir.GetFirst(&subFile, "*.md", wxDIR_FILES);
-				while (subCont) {
-					wxTreeItemId subItem = m_fileTree->AppendItem(dirItem, subFile);
-					m_fileTree->SetItemData(subItem, new wxTreeItemData());
-					subCont = subDir.GetNext(&subFile);
+	auto index = std::make_shared<SearchIndex>();
+	auto loaded = std::make_shared<bool>(false);
+	vault->searchBuilding = true;
+	vault->searchStale.clear();
+	vault->searchJob = TaskGroup(TaskPool::Shared(), TaskPriority::Low);
+	CancelToken cancel = vault->searchJob.Token();
+	vault->searchJob.SetReporter(ReportOnUiThread(m_alive, [this, vault, index, loaded, cancel](const TaskGroup::Progress& progress) {
+		if (cancel.IsCancelled() || !progress.finished) return;
+		if (!*loaded) {
+			vault->searchBuilding = false;
+			BuildSearchIndex(vault);
+			return;
+		}
+		// The snapshot may be older than the store
+		vault->searchRecheck = true;
+		SearchIndexLanded(vault, index, true);
+	}));
+	std::string file = vault->searchFile;
+	vault->searchJob.Run([index, file, loaded](const CancelToken&) { *loaded = index->Load(file); });
+	vault->searchJob.Close();
+	if (vault == m_vault) SetStatusText("Loading search index...", 0);
+}
+
+void MainFrame::BuildSearchIndex(Vault* vault) {
+	// Notes are read and analyzed in parallel a batch at a time, which keeps
+	// the analyzed words of only one batch in memory while the index grows
+	CancelSearchIndex(vault);
+	std::vector<std::string> notes;
+	for (uint32_t i = 0; i < vault->store.Count(); i++) {
+		if (vault->store.IsNote(i)) notes.push_back(vault->store.Path(i));
+	}
+	auto index = std::make_shared<SearchIndex>();
+	std::string root = vault->root;
+	vault->searchBuilding = true;
+	vault->searchRecheck = false;
+	vault->searchStale.clear();
+	vault->searchJob = TaskGroup(TaskPool::Shared(), TaskPriority::Low);
+	CancelToken cancel = vault->searchJob.Token();
+	vault->searchJob.SetReporter(ReportOnUiThread(m_alive, [this, vault, index, cancel](const TaskGroup::Progress& progress) {
+		if (cancel.IsCancelled()) return;
+		if (!progress.finished) {
+			if (vault == m_vault) SetStatusText(FormatProgress("Indexing notes", progress), 0);
+			return;
+		}
+		SearchIndexLanded(vault, index, false);
+	}));
+	
+	TaskGroup job = vault->searchJob;
+	job.SetTotal((int64_t)notes.size());
+	job.Run([job, index, root, notes](const CancelToken& cancel) mutable {
+		std::vector<SearchIndex::Document> docs;
+		for (size_t first = 0; first < notes.size() && !cancel.IsCancelled(); first += kSearchBatch) {
+			docs.assign(std::min(kSearchBatch, notes.size() - first), SearchIndex::Document());
+			job.Pool().ParallelFor(docs.size(), [&](size_t i) {
+				std::string content;
+				const std::string& rel = notes[first + i];
+				if (LinkIndex::ReadFile(root + "/" + rel, content)) {
+					docs[i] = SearchIndex::Analyze(rel, content, ModifiedTime(root + "/" + rel));
 				}
+				job.Advance();
+			}, &cancel, TaskPriority::Low);
+			for (const SearchIndex::Document& doc : docs) {
+				if (!doc.note.empty()) index->Add(doc);
 			}
 		}
-		cont = dir.GetNext(&filename);
+		index->ShrinkToFit();
+	});
+	job.Close();
+}
+
+void MainFrame::UpdateSearchIndex(Vault* vault) {
+	// Notes are compared by content hash with the store. The index is handed
+	// to the pool, which reads and analyzes the changed notes, applies them
+	// and the deletions and compacts if that is due; searches wait for it to
+	// land rather than reading it while it changes.
+	vault->searchRecheck = false;
+	std::shared_ptr<SearchIndex> index = vault->search;
+	if (!index) return;
+	std::vector<std::string> changed, removed;
+	index->Differences(vault->store, changed, removed);
+	if (changed.empty() && removed.empty() && !index->WantsCompact()) return;
+	if (changed.size() > index->NoteCount() / 2) {
+		// Most of the vault is new to the index; starting over is cheaper
+		BuildSearchIndex(vault);
+		return;
 	}
 	
-	m_fileTree->Expand(m_rootItem);
+	std::string root = vault->root;
+	vault->search.reset();
+	vault->searchUpdating = index;
+	vault->searchBuilding = true;
+	vault->searchStale.clear();
+	vault->searchJob = TaskGroup(TaskPool::Shared(), TaskPriority::Low);
+	CancelToken cancel = vault->searchJob.Token();
+	vault->searchJob.SetReporter(ReportOnUiThread(m_alive, [this, vault, index, cancel](const TaskGroup::Progress& progress) {
+		if (cancel.IsCancelled()) return;
+		if (!progress.finished) {
+			if (vault == m_vault) SetStatusText(FormatProgress("Updating search index", progress), 0);
+			return;
+		}
+		SearchIndexLanded(vault, index, false);
+	}));
+	
+	TaskGroup job = vault->searchJob;
+	job.SetTotal((int64_t)changed.size());
+	job.Run([job, index, root, changed, removed](const CancelToken& cancel) mutable {
+		std::vector<SearchIndex::Document> docs(changed.size());
+		job.Pool().ParallelFor(changed.size(), [&](size_t i) {
+			std::string content;
+			const std::string& rel = changed[i];
+			if (LinkIndex::ReadFile(root + "/" + rel, content)) {
+				docs[i] = SearchIndex::Analyze(rel, content, ModifiedTime(root + "/" + rel));
+			}
+			job.Advance();
+		}, &cancel, TaskPriority::Low);
+		// A cancelled update still leaves a consistent index, as the notes
+		// not applied are found again by the next comparison
+		for (const std::string& rel : removed) index->Remove(rel);
+		for (const SearchIndex::Document& doc : docs) {
+			if (!doc.note.empty()) index->Add(doc);
+		}
+		if (index->WantsCompact()) index->Compact();
+	});
+	job.Close();
+}
+
+void MainFrame::SearchIndexLanded(Vault* vault, std::shared_ptr<SearchIndex> index, bool saved) {
+	// Notes saved while the job ran are read again
+	vault->search = index;
+	vault->searchUpdating.reset();
+	vault->searchBuilding = false;
+	vault->searchSaved = saved && vault->searchStale.empty();
+	for (const std::string& rel : vault->searchStale) {
+		std::string content;
+		std::string path = vault->root + "/" + rel;
+		if (LinkIndex::ReadFile(path, content)) {
+			index->Add(SearchIndex::Analyze(rel, content, ModifiedTime(path)));
+		} else {
+			index->Remove(rel);
+		}
+	}
+	vault->searchStale.clear();
+	vault->searchBytes = index->MemoryUsage();
+	vault->searchTableBytes = index->MemoryUsage(false);
+	if (vault == m_vault) SetStatusText(wxString::Format("Indexed %zu notes for search", index->NoteCount()), 0);
+	if (vault->searchRecheck || index->WantsCompact()) UpdateSearchIndex(vault);
+	ApplyMemoryBudget();
+}
+
+void MainFrame::CancelSearchIndex(Vault* vault) {
+	// A job only touches the index it was given, so the UI does not wait for
+	// it: it stops at its next check, and its token drops any report still
+	// to come. A spilled index still writing its snapshot is let finish, and
+	// stays spilled if it was waiting to be taken back.
+	if (vault->searchReclaim) {
+		vault->spilling = vault->searchReclaim;
+		vault->searchReclaim.reset();
+	} else if (vault->searchBuilding) {
+		vault->searchJob.Cancel();
+	}
+	vault->spillReport.Cancel();
+	vault->searchUpdating.reset();
+	vault->searchBuilding = false;
+}
+
+std::shared_ptr<SearchIndex> MainFrame::TakeSearchIndex(Vault* vault) {
+	// What to write when the vault is let go, so that the next time it is
+	// opened it loads this instead of reading every note: the index it holds,
+	// or the one a cancelled update was changing, which is consistent once
+	// the job has stopped. Null when the snapshot already holds the index.
+	std::shared_ptr<SearchIndex> index = vault->search ? vault->search : vault->searchUpdating;
+	if (vault->search && vault->searchSaved) index.reset();
+	CancelSearchIndex(vault);
+	return index;
+}
+
+void MainFrame::IndexNote(const std::string& rel, const std::string& content) {
+	if (rel.empty()) return;
+	if (m_vault->search) {
+		int64_t modified = ModifiedTime(m_vault->root + "/" + rel);
+		m_vault->search->Add(SearchIndex::Analyze(rel, content, modified));
+		m_vault->searchSaved = false;
+		// Every save retires the note's old postings; they are dropped on the pool
+		if (m_vault->search->WantsCompact()) UpdateSearchIndex(m_vault);
+	}
+	if (m_vault->searchBuilding) m_vault->searchStale.insert(rel);
+}
+
+void MainFrame::RunSearch() {
+	m_searchResults->DeleteAllItems();
+	m_searchHits.clear();
+	std::string query(m_searchCtrl->GetValue().utf8_str());
+	if (!m_vault->search) {
+		SetStatusText(m_vault->searchBuilding ? "The search index is still being built" : "Open a vault to search", 0);
+		return;
+	}
+	
+	wxStopWatch timer;
+	std::vector<SearchIndex::Result> results = m_vault->search->Search(query, kSearchResults);
+	long ranked = timer.Time();
+	
+	// Only the listed notes are read again, for the line to jump to
+	SearchIndex::Query parsed = SearchIndex::Parse(query);
+	std::string root(m_vaultPath.utf8_str());
+	m_searchResults->Freeze();
+	for (const SearchIndex::Result& result : results) {
+		std::string content, text;
+		int line = 0;
+		if (LinkIndex::ReadFile(root + "/" + result.note, content)) line = SearchIndex::FindLine(content, parsed, text);
+		size_t start = text.find_first_not_of(" \t");
+		text.erase(0, start == std::string::npos ? text.size() : start);
+		if (text.size() > 200) {
+			size_t cut = 200;
+			while (cut > 0 && ((unsigned char)text[cut] & 0xC0) == 0x80) cut--;
+			text.resize(cut);
+		}
+		long row = m_searchResults->InsertItem(m_searchResults->GetItemCount(), wxString::FromUTF8(result.note.c_str()));
+		m_searchResults->SetItem(row, 1, wxString::Format("%d", line + 1));
+		m_searchResults->SetItem(row, 2, wxString::FromUTF8(text.c_str()));
+		m_searchHits.push_back(std::make_pair(result.note, line));
+	}
+	m_searchResults->Thaw();
+	SetStatusText(wxString::Format("%zu results from %zu notes (ranked in %ld ms)",
+		results.size(), m_vault->search->NoteCount(), ranked), 0);
+}
+
+std::string MainFrame::VaultRelative(const wxString& path) const {
+	// Vault-relative path with '/' separators, empty when outside the vault
+	wxFileName name(path);
+	if (!name.MakeRelativeTo(m_vaultPath)) return std::string();
+	wxString rel = name.GetFullPath(wxPATH_UNIX);
+	if (rel.IsEmpty() || rel.StartsWith("..")) return std::string();
+	return std::string(rel.utf8_str());
+}
+
+bool MainFrame::RenameVaultEntry(const wxString& from, const wxString& to) {
+	std::string fromRel = VaultRelative(from);
+	std::string toRel = VaultRelative(to);
+	if (fromRel.empty() || toRel.empty()) {
+		wxMessageBox("Notes can only be moved within the vault.", "Rename", wxOK | wxICON_WARNING);
+		return false;
+	}
+	if (fromRel == toRel) return false;
+	
+	// Rewritten files are read from disk, so unsaved edits must be there first
+	if (m_modified && IsNoteDirty(true)) SaveCurrentNote();
+	
+	wxBusyCursor busy;
+	wxStopWatch timer;
+	
+	// A note renames itself; a folder renames every note inside it
+	auto stripMd = [](const std::string& rel) {
+		return rel.size() > 3 && LinkIndex::Lower(rel.substr(rel.size() - 3)) == ".md" ?
+			rel.substr(0, rel.size() - 3) : rel;
+	};
+	std::vector<std::string> notes;
+	if (wxDirExists(from)) {
+		for (const std::string& note : m_vault->links.Notes()) {
+			if (VaultRenamer::MapPath(note, fromRel, toRel) != note) notes.push_back(note);
+		}
+	} else {
+		notes.push_back(fromRel);
+	}
+	
+	// Notes sharing a renamed note's name decide where a bare [[Name]] points
+	std::unordered_map<std::string, std::vector<std::string>> namesakes;
+	for (const std::string& note : notes) namesakes[LinkIndex::NoteKey(note)];
+	for (const std::string& note : m_vault->links.Notes()) {
+		auto found = namesakes.find(LinkIndex::NoteKey(note));
+		if (found != namesakes.end()) found->second.push_back(stripMd(note));
+	}
+	
+	std::vector<LinkRename> renames;
+	std::set<std::string> referrers;
+	for (const std::string& note : notes) {
+		renames.push_back({stripMd(note), stripMd(VaultRenamer::MapPath(note, fromRel, toRel)),
+			namesakes[LinkIndex::NoteKey(note)]});
+		for (const std::string& referrer : m_vault->links.Referrers(note)) referrers.insert(referrer);
+	}
+	
+	VaultRenamer::Result result = VaultRenamer::Rename(std::string(m_vaultPath.utf8_str()),
+		fromRel, toRel, renames, std::vector<std::string>(referrers.begin(), referrers.end()));
+	if (!result.ok) {
+		wxMessageBox("Rename failed, nothing was changed:\n" + wxString::FromUTF8(result.error.c_str()),
+			"Rename", wxOK | wxICON_ERROR);
+		return false;
+	}
+	
+	// Keep the link index and history in step with the vault
+	for (const std::string& note : notes) {
+		std::string moved = VaultRenamer::MapPath(note, fromRel, toRel);
+		m_vault->links.RenameNote(note, moved);
+		ChangeHistory(m_vault, [note, moved](NoteHistory& history) { history.RenameNote(note, moved); });
+	}
+	
+	std::string currentRel = m_currentFile.IsEmpty() ? std::string() :
+		VaultRenamer::MapPath(VaultRelative(m_currentFile), fromRel, toRel);
+	const std::string* currentContent = nullptr;
+	int64_t now = (int64_t)wxDateTime::Now().GetTicks();
+	for (const auto& rewritten : result.rewritten) {
+		m_vault->links.UpdateNote(rewritten.first, rewritten.second);
+		ChangeHistory(m_vault, [rewritten, now](NoteHistory& history) {
+			history.Record(rewritten.first, rewritten.second, now);
+		});
+		IndexNote(rewritten.first, rewritten.second);
+		if (rewritten.first == currentRel) currentContent = &rewritten.second;
+	}
+	
+	// Follow the open note to its new location and pick up rewritten links
+	if (!currentRel.empty()) {
+		m_currentFile = wxFileName(m_vaultPath + "/" + wxString::FromUTF8(currentRel.c_str())).GetFullPath();
+		if (currentContent) {
+			int firstLine = m_editor->GetFirstVisibleLine();
+			int pos = m_editor->GetCurrentPos();
+			m_editor->SetText(wxString::FromUTF8(currentContent->c_str()));
+			m_editor->GotoPos(wxMin(pos, m_editor->GetLength()));
+			m_editor->SetFirstVisibleLine(firstLine);
+			MarkNoteSaved();
+		}
+		SetTitle("Custom Obsidian - " + wxFileName(m_currentFile).GetName());
+		RefreshHistoryList();
+	}
+	
+	// Moved notes are picked up by a rescan, which refreshes the tree, the
+	// graph and the title index and re-indexes them for search on the pool.
+	// The tree may be in the middle of a label edit, so it starts afterwards.
+	Vault* vault = m_vault;
+	CallAfter([this, vault]() {
+		if (vault != m_vault) return;
+		CancelVaultScan(vault);
+		ScanVault(vault);
+	});
+	
+	SetStatusText(wxString::Format("Renamed %s, updated links in %d notes (%ld ms)",
+		wxFileName(to).GetFullName(), (int)result.rewritten.size(), timer.Time()), 0);
+	return true;
 }
 
 void MainFrame::OpenNote(const wxString& filepath) {
-	if (m_modified) {
+	if (m_modified && IsNoteDirty(true)) {
 		int result = wxMessageBox("Current note has unsaved changes. Save before opening new note?",
 			"Unsaved Changes", wxYES_NO | wxCANCEL | wxICON_QUESTION);
 		
@@ -378,13 +1509,19 @@ void MainFrame::OpenNote(const wxString& filepath) {
 			std::istreambuf_iterator<char>());
 		file.close();
 		
-		m_editor->SetText(wxString(content));
+		// Cached layouts resolved attachments relative to the old note
+		m_preview->Invalidate();
 		m_currentFile = filepath;
-		m_modified = false;
+		m_editor->SetText(wxString(content));
+		m_editor->EmptyUndoBuffer();
+		MarkNoteSaved();
 		
 		SetTitle("Custom Obsidian - " + wxFileName(filepath).GetName());
 		SetStatusText("Opened: " + wxFileName(filepath).GetName(), 0);
 		
+		// The version on disk is the one the next save overwrites
+		RecordHistory(content);
+		HighlightGraphNote();
 		RefreshPreview();
 	} else {
 		wxMessageBox("Failed to open file: " + filepath, "Error", wxOK | wxICON_ERROR);
@@ -393,19 +1530,110 @@ void MainFrame::OpenNote(const wxString& filepath) {
 
 void MainFrame::SaveCurrentNote() {
 	if (m_currentFile.IsEmpty()) return;
+	
+	// Nothing to write when the text matches what is on disk; this also
+	// keeps the file's mtime (and anything syncing the vault) untouched
+	if (!IsNoteDirty(true)) {
+		MarkNoteSaved();
+		SetStatusText("No changes to save: " + wxFileName(m_currentFile).GetName(), 0);
+		return;
+	}
 
 	std::ofstream file(m_currentFile.ToStdString());
 	if (file.is_open()) {
-		file << m_editor->GetText().ToStdString();
+		wxString text = m_editor->GetText();
+		std::string bytes = text.ToStdString();
+		file << bytes;
 		file.close();
 		
-		m_modified = false;
+		MarkNoteSaved();
 		SetStatusText("Saved: " + wxFileName(m_currentFile).GetName(), 0);
+		RecordHistory(bytes);
+		
+		std::string rel = VaultRelative(m_currentFile);
+		if (!rel.empty()) {
+			std::string content(text.utf8_str());
+			std::vector<std::string> oldTargets = m_vault->links.Targets(rel);
+			m_vault->links.UpdateNote(rel, content);
+			UpdateNoteTitles(rel, content, oldTargets);
+			IndexNote(rel, content);
+		}
+		// Links may have changed; the graph picks them up when next rebuilt
+		m_graphDirty = true;
 	} else {
 		wxMessageBox("Failed to save file: " + m_currentFile, "Error", wxOK | wxICON_ERROR);
 	}
 }
 
+void MainFrame::MarkNoteSaved() {
+	// Remember what is on disk: the undo save point answers most dirty
+	// checks, length and hash settle the rest
+	m_editor->SetSavePoint();
+	m_savedLength = m_editor->GetTextLength();
+	m_savedHash = ContentHash(m_editor->GetCharacterPointer(), m_savedLength);
+	m_savedTime = wxFileName(m_currentFile).GetModificationTime();
+	m_savePointStale = false;
+	m_modified = false;
+}
+
+void MainFrame::AcceptDiskVersion(const std::string& disk) {
+	// The editor keeps its text, but saves and dirty checks now compare it
+	// with `disk`. Undoing back to the save point no longer gets there.
+	m_savedLength = (int)disk.size();
+	m_savedHash = ContentHash(disk.data(), disk.size());
+	m_savePointStale = true;
+	m_modified = IsNoteDirty(false);
+}
+
+void MainFrame::RecordHistory(const std::string& content) {
+	std::string rel = VaultRelative(m_currentFile);
+	int64_t now = (int64_t)wxDateTime::Now().GetTicks();
+	if (rel.empty()) return;
+	if (m_vault->historyLoading) {
+		// Recorded once the pack has been scanned
+		m_vault->historyPending.push_back([rel, content, now](NoteHistory& history) { history.Record(rel, content, now); });
+		return;
+	}
+	if (!m_vault->history.IsOpen()) return;
+	if (!m_vault->history.Record(rel, content, now)) {
+		SetStatusText("Could not record history for " + wxFileName(m_currentFile).GetName(), 0);
+	}
+	RefreshHistoryList();
+}
+
+void MainFrame::RefreshHistoryList() {
+	if (!m_mgr.GetPane("history").IsShown()) return;
+	
+	m_historyNote = VaultRelative(m_currentFile);
+	std::vector<NoteHistory::Version> versions = m_vault->history.Versions(m_historyNote);
+	m_historyList->Freeze();
+	m_historyList->DeleteAllItems();
+	for (size_t i = versions.size(); i-- > 0;) {
+		const NoteHistory::Version& version = versions[i];
+		long row = m_historyList->InsertItem(m_historyList->GetItemCount(),
+			wxDateTime((time_t)version.time).Format("%Y-%m-%d %H:%M:%S"));
+		m_historyList->SetItem(row, 1, wxFileName::GetHumanReadableSize(wxULongLong(version.size)));
+		m_historyList->SetItem(row, 2, wxFileName::GetHumanReadableSize(wxULongLong(version.stored)));
+		m_historyList->SetItemData(row, (long)i);
+	}
+	m_historyList->Thaw();
+	
+	m_historyView->SetReadOnly(false);
+	m_historyView->ClearAll();
+	m_historyView->SetReadOnly(true);
+}
+
+bool MainFrame::IsNoteDirty(bool exact) {
+	// Undo/redo back to the save point, unless the file has changed since
+	if (!m_savePointStale && !m_editor->GetModify()) return false;
+	if (m_editor->GetTextLength() != m_savedLength) return true;
+	
+	// Same length, e.g. a character typed and deleted again. Hashing is
+	// O(document), so it only happens when a prompt or save needs the answer.
+	if (!exact) return true;
+	return ContentHash(m_editor->GetCharacterPointer(), m_savedLength) != m_savedHash;
+}
+
 void MainFrame::NewNote() {
 	if (m_vaultPath.IsEmpty()) {
 		wxMessageBox("Please open a vault first.", "No Vault", wxOK | wxICON_WARNING);
@@ -432,76 +1660,180 @@ void MainFrame::NewNote() {
 			std::ofstream file(filepath.ToStdString());
 			file << "# " << dialog.GetValue().ToStdString() << "\n\n";
 			file.close();
+			m_vault->links.UpdateNote(VaultRelative(filepath), std::string());
+			IndexNote(VaultRelative(filepath), "# " + std::string(dialog.GetValue().utf8_str()) + "\n\n");
 			
 			// Refresh file tree and open the new note
-			PopulateFileTree(m_vaultPath);
+			UpdateVaultStore();
+			PopulateFileTree();
+			RebuildGraph();
 			OpenNote(filepath);
 		}
 	}
 }
 
 void MainFrame::RefreshPreview() {
-	if (m_editor->GetText().IsEmpty()) {
-		m_preview->SetPage("<html><body><p><i>Start typing to see preview...</i></p></body></html>");
+	m_previewTimer.Stop();
+	if (!m_mgr.GetPane("preview").IsShown()) return;
+	
+	ApplyPreviewEdits();
+	const std::vector<PreviewBlock>& blocks = m_previewBlocks.Blocks();
+	if (blocks.empty()) {
+		m_preview->SetBlocks(blocks, std::vector<bool>());
+		m_preview->SetMessage("Start typing to see preview...");
 		return;
 	}
-
-	wxString html = MarkdownToHTML(m_editor->GetText());
-	m_preview->SetPage(html);
+	
+	// Blocks in folded sections take no space in the preview
+	std::vector<bool> hidden(blocks.size());
+	for (size_t i = 0; i < blocks.size(); i++) hidden[i] = !m_editor->GetLineVisible(blocks[i].firstLine);
+	
+	// Only edited blocks are laid out again; the view lays out what it
+	// shows and the fill timer what is around it
+	m_preview->SetBlocks(blocks, hidden);
+	int line = m_editor->DocLineFromVisible(m_editor->GetFirstVisibleLine());
+	int anchor = m_previewBlocks.BlockForLine(line);
+	m_preview->ScrollToBlock(anchor, line - blocks[anchor].firstLine);
+	m_previewTimer.StartOnce(kPreviewFillDelayMs);
 }
 
-wxString MainFrame::MarkdownToHTML(const wxString& markdown) {
-	wxString html = "<html><head><style>"
-		"body { font-family: -apple-system, BlinkMacSystemFont, 'Segoe UI', Arial, sans-serif; "
-		"line-height: 1.6; margin: 20px; }"
-		"h1 { color: #2c3e50; border-bottom: 2px solid #3498db; }"
-		"h2 { color: #34495e; border-bottom: 1px solid #bdc3c7; }"
-		"h3 { color: #7f8c8d; }"
-		"code { background-color: #f8f9fa; padding: 2px 4px; border-radius: 3px; "
-		"font-family: 'Monaco', 'Courier New', monospace; }"
-		"pre { background-color: #f8f9fa; padding: 10px; border-radius: 5px; overflow-x: auto; }"
-		"blockquote { border-left: 4px solid #3498db; margin-left: 0; padding-left: 15px; "
-		"color: #7f8c8d; font-style: italic; }"
-		"a { color: #3498db; text-decoration: none; }"
-		"a:hover { text-decoration: underline; }"
-		"</style></head><body>";
-
-	wxString text = markdown;
+void MainFrame::UpdatePreview() {
+	m_previewTimer.Stop();
+	if (!m_mgr.GetPane("preview").IsShown()) return;
 	
-	// Basic markdown parsing (simplified)
-	// Headers
-	text.Replace("### ", "<h3>");
-	text.Replace("## ", "<h2>");
-	text.Replace("# ", "<h1>");
+	// Typing only splits, checks for folding and lays out the blocks around
+	// the edit; an empty note in either state goes the long way
+	size_t before = m_previewBlocks.Count();
+	PreviewBlockEdit edit = ApplyPreviewEdits();
+	const std::vector<PreviewBlock>& blocks = m_previewBlocks.Blocks();
+	if (before == 0 || blocks.empty()) {
+		RefreshPreview();
+		return;
+	}
+	std::vector<bool> hidden(edit.added);
+	for (size_t k = 0; k < edit.added; k++) hidden[k] = !m_editor->GetLineVisible(blocks[edit.first + k].firstLine);
+	m_preview->EditBlocks(blocks, edit, hidden);
 	
-	// Bold and italic
-	std::regex boldRegex("\\*\\*(.*?)\\*\\*");
-	std::string textStr = text.ToStdString();
-	textStr = std::regex_replace(textStr, boldRegex, "<strong>$1</strong>");
+	int line = m_editor->DocLineFromVisible(m_editor->GetFirstVisibleLine());
+	int anchor = m_previewBlocks.BlockForLine(line);
+	m_preview->ScrollToBlock(anchor, line - blocks[anchor].firstLine);
+	m_previewTimer.StartOnce(kPreviewFillDelayMs);
+}
+
+PreviewBlockEdit MainFrame::ApplyPreviewEdits() {
+	if (!m_previewEdit.pending) return PreviewBlockEdit();
+	m_previewEdit.pending = false;
+	return m_previewBlocks.Edit(m_editor->GetCharacterPointer(), m_editor->GetTextLength(), m_previewEdit.start,
+		m_previewEdit.oldEnd - m_previewEdit.start, m_previewEdit.newEnd - m_previewEdit.start);
+}
+
+PreviewContent MainFrame::ParsePreview(int block) {
+	const PreviewBlock& b = m_previewBlocks.Blocks()[block];
+	const char* text = m_editor->GetCharacterPointer();
+	PreviewContent content = ParsePreviewBlock(b.kind, text + b.start, b.end - b.start, &m_codeHighlights, b.hash);
+	for (PreviewLine& line : content.lines) {
+		for (PreviewSpan& span : line.spans) {
+			if (span.style & SPAN_EMBED) ResolveEmbed(span);
+		}
+	}
+	return content;
+}
+
+void MainFrame::ResolveEmbed(PreviewSpan& span) {
+	std::string target = span.target;
+	wxString path = wxString::FromUTF8(target.c_str());
+	path.Replace("%20", " ");
+	span.style &= ~SPAN_EMBED;
 	
-	std::regex italicRegex("\\*(.*?)\\*");
-	textStr = std::regex_replace(textStr, italicRegex, "<em>$1</em>");
+	if (path.StartsWith("http://") || path.StartsWith("https://")) {
+		// Remote images are not fetched
+		span.style |= SPAN_LINK;
+		if (span.text.empty()) span.text = target;
+		return;
+	}
 	
-	// Code blocks
-	std::regex codeRegex("`(.*?)`");
-	textStr = std::regex_replace(textStr, codeRegex, "<code>$1</code>");
+	wxString ext = wxFileName(path).GetExt().Lower();
+	if (ext != "png" && ext != "jpg" && ext != "jpeg" && ext != "gif" && ext != "bmp" &&
+		ext != "tif" && ext != "tiff") {
+		// Embedded notes are shown as links
+		span.style |= SPAN_LINK;
+		span.text = target;
+		return;
+	}
 	
-	// Links [[note]]
-	std::regex linkRegex("\\[\\[(.*?)\\]\\]");
-	textStr = std::regex_replace(textStr, linkRegex, "<a href=\"#\">$1</a>");
+	// An image that is not there yet is looked for beside the note, where
+	// the thumbnail cache notices it once it appears
+	wxString resolved = ResolveAttachment(path);
+	if (resolved.IsEmpty()) {
+		wxFileName missing(path);
+		missing.MakeAbsolute(m_currentFile.IsEmpty() ? m_vaultPath : wxFileName(m_currentFile).GetPath());
+		resolved = missing.GetFullPath();
+		if (span.text.empty()) span.text = target;
+	}
+	span.style |= SPAN_IMAGE;
+	span.target = std::string(resolved.utf8_str());
+}
+
+void MainFrame::SyncPreviewToEditor() {
+	int line = m_editor->DocLineFromVisible(m_editor->GetFirstVisibleLine());
+	if (line == m_syncedEditorLine) {
+		// This scroll was caused by SyncEditorToPreview
+		m_syncedEditorLine = -1;
+		return;
+	}
 	
-	// Convert line breaks
-	wxString result(textStr);
-	result.Replace("\n\n", "</p><p>");
-	result.Replace("\n", "<br>");
+	// Long tables follow the editor row by row
+	int block = m_previewBlocks.BlockForLine(line);
+	if (block < 0) return;
+	m_preview->ScrollToBlock(block, line - m_previewBlocks.Blocks()[block].firstLine);
+	m_previewTimer.StartOnce(kPreviewFillDelayMs);
+}
+
+void MainFrame::SyncEditorToPreview() {
+	int offset = 0;
+	int block = m_preview->TopBlock(&offset);
+	if (block < 0 || block >= (int)m_previewBlocks.Count()) return;
 	
-	// Process headers properly (simplified approach)
-	result.Replace("<h1>", "<h1>");
-	result.Replace("<h2>", "<h2>");
-	result.Replace("<h3>", "<h3>");
+	const PreviewBlock& b = m_previewBlocks.Blocks()[block];
+	int line = wxMin(b.firstLine + offset, b.lastLine);
+	if (line != m_editor->DocLineFromVisible(m_editor->GetFirstVisibleLine())) {
+		m_syncedEditorLine = line;
+		m_editor->SetFirstVisibleLine(m_editor->VisibleFromDocLine(line));
+	}
+	m_previewTimer.StartOnce(kPreviewFillDelayMs);
+}
+
+wxString MainFrame::ResolveAttachment(const wxString& target) {
+	wxFileName name(target);
+	if (name.IsAbsolute()) return name.FileExists() ? name.GetFullPath() : wxString();
 	
-	html += "<p>" + result + "</p></body></html>";
-	return html;
+	// Relative to the note, then the vault root, then its attachments folder
+	wxArrayString roots;
+	if (!m_currentFile.IsEmpty()) roots.Add(wxFileName(m_currentFile).GetPath());
+	if (!m_vaultPath.IsEmpty()) {
+		roots.Add(m_vaultPath);
+		roots.Add(wxFileName(m_vaultPath, "attachments").GetFullPath());
+	}
+	for (const wxString& root : roots) {
+		wxFileName candidate(target);
+		candidate.MakeAbsolute(root);
+		if (candidate.FileExists()) return candidate.GetFullPath();
+	}
+	return wxEmptyString;
+}
+
+void MainFrame::OnThumbnailsReady(const wxString& path) {
+	// Several thumbnails usually finish together; lay out once for all of them
+	m_readyImages.insert(std::string(path.utf8_str()));
+	if (m_thumbnailRefreshQueued) return;
+	m_thumbnailRefreshQueued = true;
+	CallAfter([this]() {
+		m_thumbnailRefreshQueued = false;
+		std::set<std::string> ready;
+		ready.swap(m_readyImages);
+		m_preview->ImagesChanged(ready);
+		m_previewTimer.StartOnce(kPreviewFillDelayMs);
+	});
 }
 
 // Event Handlers
@@ -531,6 +1863,21 @@ void MainFrame::OnOpenVault(wxCommandEvent& event) {
 	}
 }
 
+void MainFrame::OnCloseVault(wxCommandEvent& event) {
+	CloseVault(m_vault);
+}
+
+void MainFrame::OnSwitchVault(wxCommandEvent& event) {
+	size_t index = (size_t)(event.GetId() - ID_SwitchVault);
+	const std::vector<std::unique_ptr<Vault>>& vaults = m_vaults.Vaults();
+	if (index >= vaults.size() || vaults[index].get() == m_vault) return;
+	if (ConfirmSwitchVault()) {
+		ShowVault(vaults[index].get());
+	} else {
+		UpdateVaultsMenu();
+	}
+}
+
 void MainFrame::OnSearch(wxCommandEvent& event) {
 	wxAuiPaneInfo& pane = m_mgr.GetPane("search");
 	pane.Show(!pane.IsShown());
@@ -541,10 +1888,324 @@ void MainFrame::OnSearch(wxCommandEvent& event) {
 	}
 }
 
+void MainFrame::OnSearchEnter(wxCommandEvent& event) {
+	RunSearch();
+}
+
+void MainFrame::OnSearchResultActivated(wxListEvent& event) {
+	long row = event.GetIndex();
+	if (row < 0 || (size_t)row >= m_searchHits.size()) return;
+	std::string note = m_searchHits[row].first;
+	int line = m_searchHits[row].second;
+	OpenNote(wxFileName(m_vaultPath + "/" + wxString::FromUTF8(note.c_str())).GetFullPath());
+	if (VaultRelative(m_currentFile) != note) return;
+	m_editor->EnsureVisible(line);
+	m_editor->GotoLine(line);
+	m_editor->SetFocus();
+}
+
 void MainFrame::OnTogglePreview(wxCommandEvent& event) {
 	wxAuiPaneInfo& pane = m_mgr.GetPane("preview");
 	pane.Show(!pane.IsShown());
 	m_mgr.Update();
+	
+	// The preview is not kept up to date while hidden
+	if (pane.IsShown()) RefreshPreview();
+}
+
+void MainFrame::OnToggleHistory(wxCommandEvent& event) {
+	wxAuiPaneInfo& pane = m_mgr.GetPane("history");
+	pane.Show(!pane.IsShown());
+	m_mgr.Update();
+	RefreshHistoryList();
+}
+
+void MainFrame::OnHistorySelected(wxListEvent& event) {
+	std::string content;
+	size_t version = (size_t)m_historyList->GetItemData(event.GetIndex());
+	m_historyView->SetReadOnly(false);
+	if (m_vault->history.Load(m_historyNote, version, content)) {
+		m_historyView->SetText(wxString(content));
+	} else {
+		m_historyView->SetText("This version could not be read from the history pack.");
+	}
+	m_historyView->SetReadOnly(true);
+}
+
+void MainFrame::OnHistoryRestore(wxCommandEvent& event) {
+	long row = m_historyList->GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+	if (row < 0 || m_historyNote != VaultRelative(m_currentFile)) return;
+	
+	std::string content;
+	if (!m_vault->history.Load(m_historyNote, (size_t)m_historyList->GetItemData(row), content)) {
+		wxMessageBox("This version could not be read from the history pack.", "History",
+			wxOK | wxICON_ERROR);
+		return;
+	}
+	
+	// Restoring is an ordinary (undoable) edit; saving makes it the newest version
+	m_editor->SetText(wxString(content));
+	SetStatusText("Restored version from " + m_historyList->GetItemText(row) + " - save to keep it", 0);
+}
+
+void MainFrame::RebuildGraph() {
+	// Laying out is only worth it while the pane is visible
+	if (!m_mgr.GetPane("graph").IsShown()) {
+		m_graphDirty = true;
+		return;
+	}
+	m_graphDirty = false;
+	
+	m_graphNotes = m_vault->links.Notes();
+	std::sort(m_graphNotes.begin(), m_graphNotes.end());
+	m_graphNodes.clear();
+	std::unordered_map<std::string, int> byKey;
+	std::vector<wxString> labels;
+	labels.reserve(m_graphNotes.size());
+	for (size_t i = 0; i < m_graphNotes.size(); i++) {
+		m_graphNodes[m_graphNotes[i]] = (int)i;
+		byKey.emplace(LinkIndex::NoteKey(m_graphNotes[i]), (int)i);
+		labels.push_back(wxString::FromUTF8(m_graphNotes[i].c_str()).AfterLast('/').BeforeLast('.'));
+	}
+	
+	// Links resolve by note name, as in the editor; unresolved links are
+	// skipped. Notes linking each other share one edge, so edges are
+	// unordered pairs (a < b), each kept once.
+	std::vector<GraphEdge> edges;
+	for (size_t i = 0; i < m_graphNotes.size(); i++) {
+		for (const std::string& key : m_vault->links.Targets(m_graphNotes[i])) {
+			auto target = byKey.find(key);
+			if (target != byKey.end() && target->second != (int)i) {
+				uint32_t a = (uint32_t)i, b = (uint32_t)target->second;
+				edges.push_back(GraphEdge{std::min(a, b), std::max(a, b)});
+			}
+		}
+	}
+	std::sort(edges.begin(), edges.end(),
+		[](const GraphEdge& x, const GraphEdge& y) { return x.a != y.a ? x.a < y.a : x.b < y.b; });
+	edges.erase(std::unique(edges.begin(), edges.end(),
+		[](const GraphEdge& x, const GraphEdge& y) { return x.a == y.a && x.b == y.b; }), edges.end());
+	m_graphView->SetGraph(std::move(labels), edges);
+	HighlightGraphNote();
+}
+
+void MainFrame::HighlightGraphNote() {
+	auto found = m_graphNodes.find(VaultRelative(m_currentFile));
+	m_graphView->Highlight(found == m_graphNodes.end() ? -1 : found->second);
+}
+
+void MainFrame::OnToggleGraph(wxCommandEvent& event) {
+	wxAuiPaneInfo& pane = m_mgr.GetPane("graph");
+	pane.Show(!pane.IsShown());
+	m_mgr.Update();
+	if (pane.IsShown() && m_graphDirty) RebuildGraph();
+}
+
+void MainFrame::OnToggleOutline(wxCommandEvent& event) {
+	wxAuiPaneInfo& pane = m_mgr.GetPane("outline");
+	pane.Show(!pane.IsShown());
+	m_mgr.Update();
+	if (pane.IsShown()) {
+		m_outline->Sync();
+		m_outline->ShowSection(m_headings.HeadingAt(m_editor->GetCurrentLine()));
+	}
+}
+
+void MainFrame::SampleMemory() {
+	// Everything measured here is only changed on the UI thread
+	size_t stores = 0, links = 0, titles = 0, history = 0, searchTables = 0;
+	for (const std::unique_ptr<Vault>& vault : m_vaults.Vaults()) {
+		stores += vault->store.Bytes();
+		links += vault->links.MemoryUsage();
+		titles += vault->titles.MemoryUsage();
+		history += vault->history.MemoryUsage();
+		if (vault->search) searchTables += vault->searchTableBytes;
+	}
+	m_memory.stores->Set(stores);
+	m_memory.links->Set(links);
+	m_memory.titles->Set(titles);
+	m_memory.history->Set(history);
+	m_memory.searchTables->Set(searchTables);
+	m_memory.fileTree->Set(m_fileTree->GetCount() * kTreeItemBytes);
+	m_memory.editors->Set(EditorBytes(m_editor) + EditorBytes(m_historyView) + m_diffView->MemoryUsage());
+	
+	m_memory.previewLayout->Set(m_preview->MemoryUsage() + m_codeHighlights.MemoryUsage());
+	m_memory.thumbnails->Set(m_thumbnails.MemoryUsed());
+	
+	size_t results = (size_t)m_searchResults->GetItemCount() * kListRowBytes;
+	for (const auto& hit : m_searchHits) results += sizeof(hit) + hit.first.capacity();
+	m_memory.searchResults->Set(results);
+	// Graph notes are held twice: listed, and as keys of m_graphNodes
+	size_t graph = m_graphView->MemoryUsage();
+	for (const std::string& note : m_graphNotes) graph += 2 * (sizeof(note) + note.capacity());
+	m_memory.graph->Set(graph);
+	
+	UpdateMemoryStatus();
+	if (m_mgr.GetPane("memory").IsShown()) m_memoryView->Sync();
+}
+
+void MainFrame::UpdateMemoryStatus() {
+	MemoryLedger& ledger = MemoryLedger::Global();
+	size_t total = ledger.Total();
+	wxString vault = m_vault == &m_noVault ? wxString("No vault") : wxFileName(m_vaultPath).GetName();
+	SetStatusText(wxString::Format("%s - %s (peak %s)", vault, MemoryView::FormatBytes(total),
+		MemoryView::FormatBytes(ledger.PeakTotal())), 1);
+}
+
+void MainFrame::OnToggleMemory(wxCommandEvent& event) {
+	wxAuiPaneInfo& pane = m_mgr.GetPane("memory");
+	pane.Show(!pane.IsShown());
+	m_mgr.Update();
+	if (pane.IsShown()) SampleMemory();
+}
+
+void MainFrame::OnMemoryTimer(wxTimerEvent& event) {
+	SampleMemory();
+}
+
+void MainFrame::OnMemoryResetPeaks(wxCommandEvent& event) {
+	SampleMemory();
+	MemoryLedger::Global().ResetPeaks();
+	UpdateMemoryStatus();
+	m_memoryView->Sync();
+}
+
+void MainFrame::OnMemorySave(wxCommandEvent& event) {
+	SampleMemory();
+	wxFileDialog dialog(this, "Save Memory Report", wxEmptyString,
+		wxDateTime::Now().Format("memory-%Y%m%d-%H%M%S.json"), "JSON files (*.json)|*.json",
+		wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+	if (dialog.ShowModal() != wxID_OK) return;
+	
+	std::ofstream file(dialog.GetPath().ToStdString());
+	file << MemoryLedger::Global().ToJson();
+	file.close();
+	if (file.fail()) {
+		wxMessageBox("Could not write " + dialog.GetPath(), "Memory", wxOK | wxICON_ERROR);
+		return;
+	}
+	SetStatusText("Memory report saved: " + wxFileName(dialog.GetPath()).GetFullName(), 0);
+}
+
+void MainFrame::OnToggleSpelling(wxCommandEvent& event) {
+	bool enabled = event.IsChecked();
+	wxConfig("CustomObsidian").Write("CheckSpelling", enabled);
+	m_spelling->SetEnabled(enabled);
+	if (enabled && !m_spelling->Dictionary()) LoadSpellingDictionary();
+}
+
+void MainFrame::LoadSpellingDictionary() {
+	// Hunspell dictionaries: the user's own first, then the system's
+	wxArrayString folders;
+	folders.Add(wxFileName(wxStandardPaths::Get().GetUserLocalDataDir(), "dictionaries").GetFullPath());
+	folders.Add("/usr/share/hunspell");
+	folders.Add("/usr/share/myspell");
+	folders.Add("/usr/share/myspell/dicts");
+	folders.Add(wxFileName(wxGetHomeDir(), "Library/Spelling").GetFullPath());
+	
+	wxArrayString languages;
+	wxString system = wxLocale::GetLanguageCanonicalName(wxLocale::GetSystemLanguage());
+	if (!system.IsEmpty()) languages.Add(system);
+	languages.Add("en_US");
+	languages.Add("en_GB");
+	
+	wxString dicPath, affPath;
+	if (!SpellChecker::FindDictionary(folders, languages, dicPath, affPath)) {
+		SetStatusText("Spelling: no dictionary found", 0);
+		return;
+	}
+	wxString name = wxFileName(dicPath).GetName();
+	m_spelling->LoadDictionary(dicPath, affPath, [this, name](bool ok) {
+		const SpellDictionary* dictionary = m_spelling->Dictionary();
+		if (!ok || !dictionary) {
+			SetStatusText("Spelling: could not read " + name, 0);
+			return;
+		}
+		SetStatusText(wxString::Format("Spelling: %s, %zu words in %zu KB", name,
+			dictionary->Words(), dictionary->Bytes() / 1024), 0);
+	});
+}
+
+void MainFrame::OnHistoryCompare(wxCommandEvent& event) {
+	long row = m_historyList->GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+	if (row < 0 || m_historyNote != VaultRelative(m_currentFile)) return;
+	
+	std::string content;
+	if (!m_vault->history.Load(m_historyNote, (size_t)m_historyList->GetItemData(row), content)) {
+		wxMessageBox("This version could not be read from the history pack.", "History",
+			wxOK | wxICON_ERROR);
+		return;
+	}
+	ShowDiff("Saved " + m_historyList->GetItemText(row), content,
+		"Current", m_editor->GetText().ToStdString());
+}
+
+void MainFrame::ShowDiff(const wxString& leftTitle, std::string left, const wxString& rightTitle,
+	std::string right) {
+	wxAuiPaneInfo& pane = m_mgr.GetPane("diff");
+	if (!pane.IsShown()) {
+		pane.Show();
+		m_mgr.Update();
+	}
+	m_diffView->Compare(leftTitle, std::move(left), rightTitle, std::move(right));
+}
+
+void MainFrame::OnActivate(wxActivateEvent& event) {
+	event.Skip();
+	// Let the activation finish before a prompt can take the focus. Images
+	// may have been added or edited meanwhile too.
+	if (event.GetActive()) {
+		CallAfter(&MainFrame::CheckDiskChanges);
+		m_thumbnails.Recheck();
+	}
+}
+
+void MainFrame::CheckDiskChanges() {
+	if (m_checkingDisk || m_currentFile.IsEmpty()) return;
+	wxDateTime stamp = wxFileName(m_currentFile).GetModificationTime();
+	if (!stamp.IsValid() || !m_savedTime.IsValid() || stamp == m_savedTime) return;
+	
+	std::ifstream file(m_currentFile.ToStdString(), std::ios::binary);
+	if (!file.is_open()) return;
+	std::string disk((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	file.close();
+	
+	// Touched but not changed; or changed to exactly what the editor shows
+	m_savedTime = stamp;
+	if (ContentHash(disk.data(), disk.size()) == m_savedHash && (int)disk.size() == m_savedLength) return;
+	std::string editor = m_editor->GetText().ToStdString();
+	if (disk == editor) {
+		MarkNoteSaved();
+		return;
+	}
+	
+	// Without local edits the note simply follows the file; otherwise ask
+	wxString name = wxFileName(m_currentFile).GetName();
+	int answer = wxID_YES;
+	if (IsNoteDirty(true)) {
+		m_checkingDisk = true;
+		wxMessageDialog dialog(this, name + " was changed outside the editor while you have unsaved "
+			"edits.\n\nReloading discards your edits.", "Note Changed on Disk",
+			wxYES_NO | wxCANCEL | wxICON_QUESTION);
+		dialog.SetYesNoCancelLabels("Reload", "Show Differences", "Keep My Version");
+		answer = dialog.ShowModal();
+		m_checkingDisk = false;
+	}
+	
+	if (answer == wxID_YES) {
+		int firstLine = m_editor->GetFirstVisibleLine();
+		m_editor->SetText(wxString(disk));
+		m_editor->SetFirstVisibleLine(firstLine);
+		MarkNoteSaved();
+		RecordHistory(disk);
+		SetStatusText("Reloaded after outside change: " + name, 0);
+	} else {
+		// Kept, or to be merged by hand: either way the next save replaces
+		// this version of the file, so history keeps it
+		AcceptDiskVersion(disk);
+		RecordHistory(disk);
+		if (answer == wxID_NO) ShowDiff("Editor", editor, "On disk", disk);
+	}
 }
 
 void MainFrame::OnPreferences(wxCommandEvent& event) {
@@ -561,41 +2222,338 @@ void MainFrame::OnTreeItemActivated(wxTreeEvent& event) {
 	wxTreeItemId item = event.GetItem();
 	if (item == m_rootItem) return;
 	
-	wxString filename = m_fileTree->GetItemText(item);
-	if (filename.EndsWith(".md")) {
-		wxTreeItemId parent = m_fileTree->GetItemParent(item);
-		wxString parentPath = (parent == m_rootItem) ? m_vaultPath : 
-			wxFileName(m_vaultPath, m_fileTree->GetItemText(parent)).GetFullPath();
-		
-		wxString filepath = wxFileName(parentPath, filename).GetFullPath();
-		OpenNote(filepath);
+	VaultItemData* data = dynamic_cast<VaultItemData*>(m_fileTree->GetItemData(item));
+	if (data && !data->IsDir() && data->GetPath().EndsWith(".md")) {
+		OpenNote(data->GetPath());
 	}
 }
 
 void MainFrame::OnTreeItemMenu(wxTreeEvent& event) {
 	// Context menu for file tree
+	m_menuItem = event.GetItem();
+	
 	wxMenu menu;
-	menu.Append(wxID_ANY, "Rename");
+	menu.Append(ID_TreeRename, "Rename");
+	menu.Append(ID_TreeMove, "Move to...");
 	menu.Append(wxID_ANY, "Delete");
 	menu.AppendSeparator();
 	menu.Append(wxID_ANY, "New Note Here");
 	
+	bool editable = m_menuItem.IsOk() && m_menuItem != m_rootItem;
+	menu.Enable(ID_TreeRename, editable);
+	menu.Enable(ID_TreeMove, editable);
+	
 	PopupMenu(&menu);
 }
 
+void MainFrame::OnTreeBeginLabelEdit(wxTreeEvent& event) {
+	// The vault root is renamed on disk, not from here
+	if (event.GetItem() == m_rootItem) event.Veto();
+}
+
+void MainFrame::OnTreeEndLabelEdit(wxTreeEvent& event) {
+	if (event.IsEditCancelled()) return;
+	
+	VaultItemData* data = dynamic_cast<VaultItemData*>(m_fileTree->GetItemData(event.GetItem()));
+	wxString name = event.GetLabel();
+	name.Trim().Trim(false);
+	if (!data || name.IsEmpty() || name.find_first_of("/\\:") != wxString::npos) {
+		event.Veto();
+		return;
+	}
+	if (!data->IsDir() && !name.EndsWith(".md")) {
+		name += ".md";
+	}
+	
+	wxFileName target(data->GetPath());
+	if (data->IsDir()) {
+		target = wxFileName(target.GetPath(), name);
+	} else {
+		target.SetFullName(name);
+	}
+	
+	if (!RenameVaultEntry(data->GetPath(), target.GetFullPath())) {
+		event.Veto();
+	}
+}
+
+void MainFrame::OnTreeRename(wxCommandEvent& event) {
+	if (m_menuItem.IsOk() && m_menuItem != m_rootItem) {
+		m_fileTree->EditLabel(m_menuItem);
+	}
+}
+
+void MainFrame::OnTreeMove(wxCommandEvent& event) {
+	if (!m_menuItem.IsOk() || m_menuItem == m_rootItem) return;
+	VaultItemData* data = dynamic_cast<VaultItemData*>(m_fileTree->GetItemData(m_menuItem));
+	if (!data) return;
+	
+	wxDirDialog dialog(this, "Move to folder", m_vaultPath);
+	if (dialog.ShowModal() != wxID_OK) return;
+	
+	wxString target = wxFileName(dialog.GetPath(), wxFileName(data->GetPath()).GetFullName()).GetFullPath();
+	RenameVaultEntry(data->GetPath(), target);
+}
+
 void MainFrame::OnEditorChanged(wxStyledTextEvent& event) {
-	m_modified = true;
+	m_modified = IsNoteDirty(false);
+	UpdatePreview();
+	UpdateEditorStatus();
+}
+
+void MainFrame::OnEditorModified(wxStyledTextEvent& event) {
+	event.Skip();
+	int type = event.GetModificationType();
+	if (type & wxSTC_MOD_CHANGEFOLD) m_foldsChanged = true;
+	if (!(type & (wxSTC_MOD_INSERTTEXT | wxSTC_MOD_DELETETEXT))) return;
+	m_spelling->Modified(event);
+	UpdateHeadings(event);
+	m_previewEdit.Add(event.GetPosition(), type & wxSTC_MOD_DELETETEXT ? event.GetLength() : 0,
+		type & wxSTC_MOD_INSERTTEXT ? event.GetLength() : 0);
+	
+	// Only the changed text and its two neighbours are looked at; replacing
+	// the whole document (opening a note) clears and recounts instead
+	int pos = event.GetPosition();
+	int length = m_editor->GetLength();
+	wxScopedCharBuffer text = event.GetText().utf8_str();
+	if ((int)text.length() != event.GetLength() || ((type & wxSTC_MOD_DELETETEXT) && length == 0)) {
+		m_stats.Reset(m_editor->GetCharacterPointer(), length);
+	} else if ((type & wxSTC_MOD_INSERTTEXT) && length == event.GetLength()) {
+		m_stats.Reset(text.data(), text.length());
+	} else {
+		int end = type & wxSTC_MOD_INSERTTEXT ? pos + event.GetLength() : pos;
+		int before = pos > 0 ? m_editor->GetCharAt(pos - 1) & 0xFF : -1;
+		int after = end < length ? m_editor->GetCharAt(end) & 0xFF : -1;
+		if (type & wxSTC_MOD_INSERTTEXT) {
+			m_stats.Insert(text.data(), text.length(), before, after);
+		} else {
+			m_stats.Delete(text.data(), text.length(), before, after);
+		}
+	}
+	UpdateEditorStatus();
+}
+
+void MainFrame::UpdateHeadings(wxStyledTextEvent& event) {
+	// Only the lines the edit touched are read again; opening a note indexes
+	// it in one pass
+	int length = m_editor->GetLength();
+	if ((event.GetModificationType() & wxSTC_MOD_INSERTTEXT) && length == event.GetLength()) {
+		m_headings.Rebuild(m_editor->GetCharacterPointer(), length);
+	} else if (length == 0) {
+		m_headings.Clear();
+	} else {
+		m_headings.Edit(m_editor->LineFromPosition(event.GetPosition()), event.GetLinesAdded(), [this](int line) {
+			int start = m_editor->PositionFromLine(line);
+			int end = m_editor->GetLineEndPosition(line);
+			wxCharBuffer raw = m_editor->GetTextRangeRaw(start, end);
+			return std::string(raw.data(), end - start);
+		});
+	}
+	
+	// Fold levels must not change while Scintilla reports a modification:
+	// they are applied on the next UI update. Several edits before then
+	// may have shifted each other's lines, so the range then runs to the end.
+	int first, last;
+	m_headings.ChangedLines(first, last);
+	if (m_foldLast >= m_foldFirst) {
+		first = wxMin(first, m_foldFirst);
+		last = INT32_MAX;
+	}
+	m_foldFirst = first;
+	m_foldLast = last;
+}
+
+void MainFrame::ApplyFoldLevels() {
+	// A heading line opens a fold one level above its body, so a section
+	// folds everything up to the next heading of the same or a higher level
+	int first = wxMax(0, m_foldFirst);
+	int last = wxMin(m_foldLast, m_editor->GetLineCount() - 1);
+	m_foldFirst = 0;
+	m_foldLast = -1;
+	bool folded = !m_editor->GetAllLinesVisible();
+	m_foldsChanged = false;
+	const std::vector<Heading>& headings = m_headings.Headings();
+	int section = m_headings.HeadingAt(first);
+	for (int line = first; line <= last; line++) {
+		while (section + 1 < (int)headings.size() && headings[section + 1].line <= line) section++;
+		int level = wxSTC_FOLDLEVELBASE;
+		if (section >= 0) {
+			const Heading& heading = headings[section];
+			level += heading.line == line ? (heading.level - 1) | wxSTC_FOLDLEVELHEADERFLAG : heading.level;
+		}
+		if (m_editor->GetFoldLevel(line) != level) m_editor->SetFoldLevel(line, level);
+	}
+	// wxSTC_AUTOMATICFOLD_CHANGE unfolds a collapsed section whose levels
+	// change, and says so only through the fold change notifications
+	if (folded && m_foldsChanged) RefreshPreview();
+	m_foldsChanged = false;
+	if (m_mgr.GetPane("outline").IsShown()) m_outline->Sync();
+}
+
+void MainFrame::JumpToHeading(const Heading& heading) {
+	// Unfold the heading if it is inside a collapsed section
+	bool hidden = !m_editor->GetLineVisible(heading.line);
+	m_editor->EnsureVisible(heading.line);
+	m_editor->GotoLine(heading.line);
+	m_editor->SetFirstVisibleLine(m_editor->VisibleFromDocLine(heading.line));
+	m_editor->SetFocus();
+	if (hidden) RefreshPreview();
+}
+
+void MainFrame::UpdateEditorStatus() {
+	SetStatusText(wxString::Format("Lines: %lld, Words: %lld, Characters: %lld, %lld min read %s",
+		(long long)m_stats.Lines(), (long long)m_stats.Words(), (long long)m_stats.Characters(),
+		(long long)m_stats.ReadingMinutes(), m_modified ? "(modified)" : ""), 0);
+}
+
+void MainFrame::OnStyleNeeded(wxStyledTextEvent& event) {
+	// Line states cache the lexer state at the end of every styled line, so
+	// restyling starts at the first unstyled line with the state of the one
+	// before it instead of at the top of the document. A "---" on line 0
+	// only opens frontmatter if a line below closes it, so the lines that
+	// may do so restyle from the top.
+	int line = m_editor->LineFromPosition(m_editor->GetEndStyled());
+	if (line <= MarkdownLexer::kFrontmatterMaxLines && m_editor->GetCharAt(0) == '-') line = 0;
+	bool frontmatter = false;
+	if (line == 0) {
+		int headEnd = MarkdownLexer::kFrontmatterMaxLines + 1 < m_editor->GetLineCount() ?
+			m_editor->PositionFromLine(MarkdownLexer::kFrontmatterMaxLines + 1) : m_editor->GetLength();
+		wxCharBuffer head = m_editor->GetTextRangeRaw(0, headEnd);
+		frontmatter = MarkdownLexer::HasFrontmatter(head.data(), headEnd);
+	}
+	
+	// Never style past the visible range; Scintilla asks again as the user scrolls.
+	int lastVisible = m_editor->DocLineFromVisible(
+		m_editor->GetFirstVisibleLine() + m_editor->LinesOnScreen());
+	int lastLine = wxMin(m_editor->LineFromPosition(event.GetPosition()), lastVisible);
+	if (lastLine < line) lastLine = line;
+	
+	int startPos = m_editor->PositionFromLine(line);
+	int endPos = (lastLine + 1 < m_editor->GetLineCount()) ?
+		m_editor->PositionFromLine(lastLine + 1) : m_editor->GetLength();
+	if (endPos <= startPos) return;
+	
+	wxCharBuffer raw = m_editor->GetTextRangeRaw(startPos, endPos);
+	const char* text = raw.data();
+	size_t length = endPos - startPos;
+	
+	std::vector<char> allStyles;
+	std::vector<char> lineStyles;
+	allStyles.reserve(length);
+	
+	int state = line > 0 ? m_editor->GetLineState(line - 1) : 0;
+	size_t pos = 0;
+	while (pos < length) {
+		size_t eol = pos;
+		while (eol < length && text[eol] != '\n' && text[eol] != '\r') eol++;
+		size_t next = eol;
+		if (next < length && text[next] == '\r') next++;
+		if (next < length && text[next] == '\n') next++;
+		
+		// The line end takes a fence body's style so EOL filling reaches it
+		int stateIn = state;
+		state = MarkdownLexer::StyleLine(text + pos, eol - pos, state, line == 0 && frontmatter, lineStyles);
+		allStyles.insert(allStyles.end(), lineStyles.begin(), lineStyles.end());
+		allStyles.insert(allStyles.end(), next - eol, (char)MarkdownLexer::EolStyle(stateIn, state));
+		m_editor->SetLineState(line, state);
+		
+		pos = next;
+		line++;
+	}
+	
+	m_editor->StartStyling(startPos);
+	m_editor->SetStyleBytes((int)allStyles.size(), allStyles.data());
+}
+
+void MainFrame::OnEditorUpdateUI(wxStyledTextEvent& event) {
+	if (m_foldLast >= m_foldFirst) ApplyFoldLevels();
+	if (event.GetUpdated() & wxSTC_UPDATE_V_SCROLL) {
+		SyncPreviewToEditor();
+		m_spelling->ViewChanged();
+	}
+	if (m_mgr.GetPane("outline").IsShown()) {
+		m_outline->ShowSection(m_headings.HeadingAt(m_editor->GetCurrentLine()));
+	}
+}
+
+void MainFrame::OnEditorMarginClick(wxStyledTextEvent& event) {
+	int line = m_editor->LineFromPosition(event.GetPosition());
+	if (!(m_editor->GetFoldLevel(line) & wxSTC_FOLDLEVELHEADERFLAG)) return;
+	m_editor->ToggleFold(line);
+	// Collapsed sections are left out of the preview
 	RefreshPreview();
+}
+
+void MainFrame::OnEditorCharAdded(wxStyledTextEvent& event) {
+	ShowLinkCompletions();
+}
+
+void MainFrame::ShowLinkCompletions() {
+	// Only right after an unclosed "[[" on the caret's line
+	int pos = m_editor->GetCurrentPos();
+	int start = wxMax(m_editor->PositionFromLine(m_editor->LineFromPosition(pos)), pos - kLinkLookback);
+	if (pos - start < 2 || m_vault->titles.Count() == 0) return;
+	wxCharBuffer raw = m_editor->GetTextRangeRaw(start, pos);
+	std::string before(raw.data(), pos - start);
+	size_t open = before.rfind("[[");
+	if (open == std::string::npos) return;
+	std::string typed = before.substr(open + 2);
+	if (typed.find_first_of("]|#^") != std::string::npos) {
+		if (m_editor->AutoCompActive()) m_editor->AutoCompCancel();
+		return;
+	}
 	
-	// Update status
-	int lines = m_editor->GetLineCount();
-	int chars = m_editor->GetTextLength();
-	SetStatusText(wxString::Format("Lines: %d, Characters: %d %s", 
-		lines, chars, m_modified ? "(modified)" : ""), 0);
+	m_completions = m_vault->titles.Complete(typed, kLinkCompletions);
+	if (m_completions.empty()) {
+		if (m_editor->AutoCompActive()) m_editor->AutoCompCancel();
+		return;
+	}
+	wxString items;
+	for (const TitleIndex::Match& match : m_completions) {
+		if (!items.IsEmpty()) items += '\n';
+		items += wxString::FromUTF8(match.title.c_str());
+		if (match.alias) items += wxString::FromUTF8((" \xE2\x86\x92 " + NoteTitle(match.note)).c_str());
+	}
+	m_editor->AutoCompShow((int)typed.size(), items);
+}
+
+void MainFrame::OnLinkCompletion(wxStyledTextEvent& event) {
+	// Insert the link ourselves: an alias becomes [[Note|Alias]], and the
+	// link is closed unless it already was
+	int row = m_editor->AutoCompGetCurrent();
+	m_editor->AutoCompCancel();
+	if (row < 0 || row >= (int)m_completions.size()) return;
+	const TitleIndex::Match& match = m_completions[row];
+	
+	std::string link = NoteTitle(match.note);
+	if (match.alias) link += "|" + match.title;
+	int start = event.GetPosition();
+	int end = m_editor->GetCurrentPos();
+	bool closed = m_editor->GetTextRange(end, wxMin(end + 2, m_editor->GetLength())) == "]]";
+	if (!closed) link += "]]";
+	
+	m_editor->SetTargetStart(start);
+	m_editor->SetTargetEnd(end);
+	m_editor->ReplaceTarget(wxString::FromUTF8(link.c_str()));
+	m_editor->GotoPos(start + (int)link.size() + (closed ? 2 : 0));
+}
+
+void MainFrame::OnPreviewScrolled(wxScrollWinEvent& event) {
+	event.Skip();
+	// Let the window scroll first, then follow it
+	CallAfter(&MainFrame::SyncEditorToPreview);
+}
+
+void MainFrame::OnPreviewFill(wxTimerEvent& event) {
+	// Lay out a step of blocks at a time around whatever is on screen, so
+	// later scrolling finds them ready
+	if (m_preview->LayOutAhead(kPreviewFillStep, kPreviewMaxBlocks / 2)) {
+		m_previewTimer.StartOnce(kPreviewFillDelayMs);
+	}
 }
 
 void MainFrame::OnClose(wxCloseEvent& event) {
-	if (m_modified) {
+	if (m_modified && IsNoteDirty(true)) {
 		int result = wxMessageBox("Current note has unsaved changes. Save before closing?",
 			"Unsaved Changes", wxYES_NO | wxCANCEL | wxICON_QUESTION);
 		
@@ -606,6 +2564,16 @@ void MainFrame::OnClose(wxCloseEvent& event) {
 		if (result == wxYES) SaveCurrentNote();
 	}
 	
+	// Results still queued for the UI thread must not reach a closing frame
+	*m_alive = false;
+	// The program is ending, so here the snapshots are written before it does
+	for (const std::unique_ptr<Vault>& vault : m_vaults.Vaults()) {
+		CancelVaultScan(vault.get());
+		std::shared_ptr<SearchIndex> index = TakeSearchIndex(vault.get());
+		vault->searchJob.Wait();
+		if (index) index->Save(vault->searchFile);
+	}
+	
 	m_mgr.UnInit();
 	Destroy();
 }
@@ -0,0 +1,135 @@
+// doc_stats.h - Line, word and character counts maintained from edits
+//
+// DocStats keeps the counts of a UTF-8 document current by looking only at
+// the text each edit inserts or deletes, plus the one character on either side
+// of it. A word starts at every non-space character that follows a space (or
+// the start of the text), so an edit can only add or remove word starts
+// inside the changed text and at the character right after it; everything
+// else keeps its count. Characters are code points, i.e. bytes that are not
+// UTF-8 continuation bytes, and lines are newlines plus one.
+//
+// Counting works on eight bytes at a time with plain 64-bit arithmetic, which
+// needs no particular instruction set, so Reset() after loading a document is
+// a single fast pass.
+#ifndef COMMON_DOC_STATS_H
+#define COMMON_DOC_STATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+class DocStats {
+public:
+	static const int kWordsPerMinute = 200;
+
+	DocStats() { Clear(); }
+
+	void Clear() {
+		m_newlines = 0;
+		m_chars = 0;
+		m_words = 0;
+	}
+
+	// Recount from scratch, e.g. after loading a document
+	void Reset(const char* text, size_t length) {
+		Counts counts = Count(text, length, -1, -1);
+		m_newlines = counts.newlines;
+		m_chars = counts.chars;
+		m_words = counts.words;
+	}
+
+	// `text` was inserted between the characters `before` and `after`
+	// (-1 at either end of the document)
+	void Insert(const char* text, size_t length, int before, int after) {
+		Counts counts = Count(text, length, before, after);
+		m_newlines += counts.newlines;
+		m_chars += counts.chars;
+		m_words += counts.words - StartsWord(before, after);
+	}
+
+	// `text` was deleted from between `before` and `after`
+	void Delete(const char* text, size_t length, int before, int after) {
+		Counts counts = Count(text, length, before, after);
+		m_newlines -= counts.newlines;
+		m_chars -= counts.chars;
+		m_words -= counts.words - StartsWord(before, after);
+	}
+
+	int64_t Lines() const { return m_newlines + 1; }
+	int64_t Characters() const { return m_chars; }
+	int64_t Words() const { return m_words; }
+
+	// Rounded up, so any text reads in at least a minute
+	int64_t ReadingMinutes() const { return (m_words + kWordsPerMinute - 1) / kWordsPerMinute; }
+
+private:
+	struct Counts {
+		int64_t newlines;
+		int64_t chars;
+		int64_t words;
+	};
+
+	static bool IsSpace(int c) {
+		return c < 0 || c == ' ' || (unsigned)(c - '\t') <= (unsigned)('\r' - '\t');
+	}
+
+	// Whether `c` starts a word when it follows `previous`
+	static int StartsWord(int previous, int c) {
+		return c >= 0 && !IsSpace(c) && IsSpace(previous) ? 1 : 0;
+	}
+
+	// Number of bytes flagged in a mask with only the high bit of each byte
+	static int64_t CountFlags(uint64_t mask) {
+		return (int64_t)(((mask >> 7) * kOnes) >> 56);
+	}
+
+	// Counts for `text`; words include a start at `after`, which depends on
+	// the last character of `text`
+	static Counts Count(const char* text, size_t length, int before, int after) {
+		const unsigned char* bytes = (const unsigned char*)text;
+		Counts counts = {0, 0, 0};
+		int previous = before;
+		size_t i = 0;
+
+		// Eight bytes at a time: each test leaves the high bit set in the
+		// bytes it matches, and the flags are added up with one multiply
+		for (; i + 8 <= length; i += 8) {
+			uint64_t word;
+			memcpy(&word, bytes + i, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+			word = __builtin_bswap64(word);
+#endif
+			uint64_t low = word & ~kHigh;
+			uint64_t newline = word ^ (kOnes * '\n');
+			newline = ~(((newline & ~kHigh) + ~kHigh) | newline) & kHigh;
+			uint64_t blank = word ^ (kOnes * ' ');
+			blank = ~(((blank & ~kHigh) + ~kHigh) | blank) & kHigh;
+			// '\t' through '\r': at least 9 and below 14, high bit clear
+			uint64_t control = (low + kOnes * (0x80 - '\t')) & ~(low + kOnes * (0x80 - '\r' - 1)) & ~word & kHigh;
+			uint64_t space = blank | control;
+			// Byte k is preceded by byte k - 1, or by the last byte before
+			uint64_t previousSpace = (space << 8) | (IsSpace(previous) ? 0x80 : 0);
+			counts.newlines += CountFlags(newline);
+			counts.chars += 8 - CountFlags(word & ~(word << 1) & kHigh);
+			counts.words += CountFlags(~space & previousSpace & kHigh);
+			previous = bytes[i + 7];
+		}
+		for (; i < length; i++) {
+			counts.newlines += bytes[i] == '\n';
+			counts.chars += (bytes[i] & 0xC0) != 0x80;
+			counts.words += StartsWord(previous, bytes[i]);
+			previous = bytes[i];
+		}
+		counts.words += StartsWord(previous, after);
+		return counts;
+	}
+
+	static const uint64_t kOnes = 0x0101010101010101ULL;
+	static const uint64_t kHigh = 0x8080808080808080ULL;
+
+	int64_t m_newlines;
+	int64_t m_chars;
+	int64_t m_words;
+};
+
+#endif // COMMON_DOC_STATS_H
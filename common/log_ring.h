@@ -0,0 +1,193 @@
+// log_ring.h - Fixed-capacity message queue and file writer for activity logs
+//
+// LogRing is a bounded multi-producer, single-consumer queue: any thread may
+// Push() without taking a lock (each producer claims a slot with one
+// compare-and-swap and publishes it through the slot's sequence number), and
+// one thread, normally the UI thread, drains it with Pop(). Messages are
+// copied into fixed-size slots, so pushing never allocates; text beyond a slot
+// is cut off. When the consumer falls behind and the ring is full, new
+// messages are dropped and counted rather than blocking the producer.
+//
+// LogFileSink appends formatted lines to a file from its own thread, so a slow
+// disk never stalls whoever is draining the ring.
+#ifndef COMMON_LOG_RING_H
+#define COMMON_LOG_RING_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct LogRecord {
+	int64_t time;  // milliseconds since the epoch
+	std::string text;
+};
+
+class LogRing {
+public:
+	// Bytes of message text kept per slot; with the sequence, time and length
+	// in front of it a slot is 256 bytes in total
+	static const size_t kTextBytes = 238;
+
+	// `capacity` is rounded up to a power of two
+	explicit LogRing(size_t capacity = 4096) : m_head(0), m_tail(0), m_dropped(0) {
+		size_t size = 2;
+		while (size < capacity) size *= 2;
+		m_mask = size - 1;
+		m_slots.reset(new Slot[size]);
+		for (size_t i = 0; i < size; i++) m_slots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	LogRing(const LogRing&) = delete;
+	LogRing& operator=(const LogRing&) = delete;
+
+	// Any thread. Returns false (and counts the message as dropped) when full.
+	bool Push(const char* text, size_t length) {
+		uint64_t position = m_tail.load(std::memory_order_relaxed);
+		Slot* slot;
+		for (;;) {
+			slot = &m_slots[position & m_mask];
+			uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+			int64_t lag = (int64_t)(sequence - position);
+			if (lag == 0) {
+				if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+			} else if (lag < 0) {
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			} else {
+				position = m_tail.load(std::memory_order_relaxed);
+			}
+		}
+
+		slot->time = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+		if (length > kTextBytes) {
+			// Cut on a UTF-8 character boundary and mark the cut
+			static const char kEllipsis[] = "\xE2\x80\xA6";
+			length = kTextBytes - 3;
+			while (length > 0 && ((unsigned char)text[length] & 0xC0) == 0x80) length--;
+			memcpy(slot->text, text, length);
+			memcpy(slot->text + length, kEllipsis, 3);
+			length += 3;
+		} else {
+			memcpy(slot->text, text, length);
+		}
+		slot->length = (uint16_t)length;
+		slot->sequence.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool Push(const std::string& text) { return Push(text.data(), text.size()); }
+
+	// Consumer thread only. Returns false when nothing is waiting.
+	bool Pop(LogRecord& record) {
+		Slot& slot = m_slots[m_head & m_mask];
+		if (slot.sequence.load(std::memory_order_acquire) != m_head + 1) return false;
+		record.time = slot.time;
+		record.text.assign(slot.text, slot.length);
+		slot.sequence.store(m_head + m_mask + 1, std::memory_order_release);
+		m_head++;
+		return true;
+	}
+
+	// Messages dropped because the ring was full, reset by the call
+	uint64_t TakeDropped() { return m_dropped.exchange(0, std::memory_order_relaxed); }
+
+	size_t Capacity() const { return m_mask + 1; }
+
+private:
+	struct Slot {
+		std::atomic<uint64_t> sequence;
+		int64_t time;
+		uint16_t length;
+		char text[kTextBytes];
+	};
+	static_assert(sizeof(Slot) == 256, "a slot should be 256 bytes");
+
+	std::unique_ptr<Slot[]> m_slots;
+	size_t m_mask;
+	uint64_t m_head;  // consumer only
+	// Producers contend on the tail; keep it off the consumer's cache line
+	alignas(64) std::atomic<uint64_t> m_tail;
+	alignas(64) std::atomic<uint64_t> m_dropped;
+};
+
+class LogFileSink {
+public:
+	LogFileSink() : m_file(nullptr), m_stopping(false) {}
+
+	LogFileSink(const LogFileSink&) = delete;
+	LogFileSink& operator=(const LogFileSink&) = delete;
+
+	~LogFileSink() { Close(); }
+
+	// Start appending to `path`. Returns false if it cannot be opened.
+	bool Open(const std::string& path) {
+		Close();
+		m_file = fopen(path.c_str(), "ab");
+		if (!m_file) return false;
+		m_stopping = false;
+		m_writer = std::thread(&LogFileSink::WriterLoop, this);
+		return true;
+	}
+
+	// Write whatever is still queued and close the file
+	void Close() {
+		if (!m_file) return;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+		m_wake.notify_one();
+		m_writer.join();
+		fclose(m_file);
+		m_file = nullptr;
+	}
+
+	bool IsOpen() const { return m_file != nullptr; }
+
+	// Queue text (whole lines, newline included) for the writer thread
+	void Write(const std::string& lines) {
+		if (!m_file || lines.empty()) return;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pending += lines;
+		}
+		m_wake.notify_one();
+	}
+
+private:
+	void WriterLoop() {
+		std::string batch;
+		std::unique_lock<std::mutex> lock(m_mutex);
+		for (;;) {
+			m_wake.wait(lock, [this]() { return m_stopping || !m_pending.empty(); });
+			batch.swap(m_pending);
+			bool stopping = m_stopping;
+			lock.unlock();
+			if (!batch.empty()) {
+				fwrite(batch.data(), 1, batch.size(), m_file);
+				fflush(m_file);
+				batch.clear();
+			}
+			if (stopping) return;
+			lock.lock();
+		}
+	}
+
+	FILE* m_file;
+	std::thread m_writer;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::string m_pending;
+	bool m_stopping;
+};
+
+#endif // COMMON_LOG_RING_H
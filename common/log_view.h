@@ -0,0 +1,174 @@
+// log_view.h - Activity log shown in a virtual list
+//
+// Log() may be called from any thread: it only pushes into a lock-free
+// LogRing. A timer on the UI thread drains the ring into a bounded history
+// (the oldest lines fall off the top once it is full), hands the formatted
+// lines to the optional file sink, and updates the item count. The list is
+// virtual, so only the rows on screen are ever asked for their text, and
+// appending costs the same whether the log holds ten lines or ten thousand.
+//
+// Threads that log must be finished before the view is destroyed.
+#ifndef COMMON_LOG_VIEW_H
+#define COMMON_LOG_VIEW_H
+
+#include <wx/wx.h>
+#include <wx/listctrl.h>
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "log_ring.h"
+
+class LogView : public wxListCtrl {
+public:
+	LogView(wxWindow* parent, size_t historyLines = 10000, wxWindowID id = wxID_ANY,
+		const wxPoint& pos = wxDefaultPosition, const wxSize& size = wxDefaultSize)
+		: wxListCtrl(parent, id, pos, size, wxLC_REPORT | wxLC_VIRTUAL | wxLC_NO_HEADER | wxLC_SINGLE_SEL),
+		m_timer(this), m_history(historyLines > 0 ? historyLines : 1), m_first(0), m_count(0), m_shifted(false) {
+		SetBackgroundColour(wxColour(248, 248, 248));
+		InsertColumn(0, "Time", wxLIST_FORMAT_LEFT, FromDIP(90));
+		InsertColumn(1, "Message", wxLIST_FORMAT_LEFT, FromDIP(400));
+		Bind(wxEVT_SIZE, &LogView::OnSize, this);
+		Bind(wxEVT_TIMER, [this](wxTimerEvent&) { Drain(); });
+		m_timer.Start(kDrainMs);
+	}
+
+	~LogView() {
+		m_timer.Stop();
+		Drain();
+		m_sink.Close();
+	}
+
+	// Any thread. Multi-line messages become one row per line.
+	void Log(const wxString& message) {
+		wxScopedCharBuffer utf8 = message.utf8_str();
+		const char* text = utf8.data();
+		size_t length = utf8.length();
+		while (length > 0 && (text[length - 1] == '\n' || text[length - 1] == '\r')) length--;
+		size_t start = 0;
+		for (size_t i = 0; i <= length; i++) {
+			if (i == length || text[i] == '\n') {
+				size_t end = i;
+				if (end > start && text[end - 1] == '\r') end--;
+				m_ring.Push(text + start, end - start);
+				start = i + 1;
+			}
+		}
+	}
+
+	// Forget everything logged so far (UI thread)
+	void Clear() {
+		Drain();
+		m_first = 0;
+		m_count = 0;
+		m_shifted = false;
+		SetItemCount(0);
+		Refresh();
+	}
+
+	// Also append every line to `path` until StopLogFile() (UI thread)
+	bool SetLogFile(const wxString& path) {
+		Drain();
+		return m_sink.Open(std::string(path.fn_str()));
+	}
+
+	void StopLogFile() {
+		Drain();
+		m_sink.Close();
+	}
+
+	bool IsLoggingToFile() const { return m_sink.IsOpen(); }
+
+protected:
+	wxString OnGetItemText(long item, long column) const override {
+		if (item < 0 || (size_t)item >= m_count) return wxString();
+		const LogRecord& record = m_history[(m_first + item) % m_history.size()];
+		if (column == 0) return FormatTime(record.time);
+		return wxString::FromUTF8(record.text.data(), record.text.size());
+	}
+
+private:
+	static const int kDrainMs = 50;
+
+	static wxString FormatTime(int64_t time) {
+		time_t seconds = (time_t)(time / 1000);
+		struct tm local;
+#ifdef _WIN32
+		localtime_s(&local, &seconds);
+#else
+		localtime_r(&seconds, &local);
+#endif
+		return wxString::Format("%02d:%02d:%02d.%03d", local.tm_hour, local.tm_min, local.tm_sec, (int)(time % 1000));
+	}
+
+	void Append(LogRecord& record) {
+		if (m_sink.IsOpen()) {
+			m_fileLines += FormatTime(record.time).utf8_str();
+			m_fileLines += ' ';
+			m_fileLines += record.text;
+			m_fileLines += '\n';
+		}
+		size_t size = m_history.size();
+		size_t index;
+		if (m_count < size) {
+			index = (m_first + m_count++) % size;
+		} else {
+			// Full: the new line takes the slot of the oldest
+			index = m_first;
+			m_first = (m_first + 1) % size;
+			m_shifted = true;
+		}
+		m_history[index].time = record.time;
+		m_history[index].text.swap(record.text);
+	}
+
+	void Drain() {
+		LogRecord record;
+		size_t before = m_count;
+		bool any = false;
+		uint64_t dropped = m_ring.TakeDropped();
+		while (m_ring.Pop(record)) {
+			Append(record);
+			any = true;
+		}
+		if (dropped > 0) {
+			record.time = std::chrono::duration_cast<std::chrono::milliseconds>(
+				std::chrono::system_clock::now().time_since_epoch()).count();
+			record.text = wxString::Format("(%llu messages dropped)", (unsigned long long)dropped).utf8_str();
+			Append(record);
+			any = true;
+		}
+		if (!any) return;
+		m_sink.Write(m_fileLines);
+		m_fileLines.clear();
+
+		// Follow the end of the log only if it was already in view
+		bool following = before == 0 || GetTopItem() + GetCountPerPage() >= (long)before;
+		SetItemCount((long)m_count);
+		if (m_shifted) {
+			// Rows shifted up under the visible ones
+			m_shifted = false;
+			RefreshItems(GetTopItem(), wxMin((long)m_count - 1, GetTopItem() + GetCountPerPage()));
+		}
+		if (following) EnsureVisible((long)m_count - 1);
+	}
+
+	void OnSize(wxSizeEvent& event) {
+		event.Skip();
+		// The message column takes whatever the time column leaves
+		int width = GetClientSize().x - GetColumnWidth(0);
+		if (width > 50) SetColumnWidth(1, width);
+	}
+
+	LogRing m_ring;
+	LogFileSink m_sink;
+	wxTimer m_timer;
+	std::vector<LogRecord> m_history;  // circular, m_count lines from m_first
+	size_t m_first;
+	size_t m_count;
+	bool m_shifted;
+	std::string m_fileLines;
+};
+
+#endif // COMMON_LOG_VIEW_H
@@ -0,0 +1,190 @@
+// memory_ledger.h - Live and peak bytes per subsystem
+//
+// A MemoryLedger holds one MemoryAccount per subsystem, in the order they were
+// added. An account is kept current in one of two ways:
+//
+//  - counted: containers that allocate in bulk, often off the UI thread, take
+//    a CountingAllocator, which charges every allocation to the account of its
+//    tag type as it happens and credits it back when freed;
+//  - sampled: structures that cannot take an allocator (wx controls, strings
+//    owned by wx, node-based maps) are measured by their owner now and then,
+//    which Set()s the account.
+//
+// Either way an account remembers the most it has held since its peak was
+// last reset. Accounts only use relaxed atomics, so charging one costs about
+// as much as the allocation's own bookkeeping. ToJson() writes the ledger out
+// for offline analysis.
+#ifndef COMMON_MEMORY_LEDGER_H
+#define COMMON_MEMORY_LEDGER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class MemoryAccount {
+public:
+	MemoryAccount(const std::string& name, bool counted) : m_name(name), m_counted(counted), m_live(0), m_peak(0) {}
+
+	MemoryAccount(const MemoryAccount&) = delete;
+	MemoryAccount& operator=(const MemoryAccount&) = delete;
+
+	const std::string& Name() const { return m_name; }
+	bool Counted() const { return m_counted; }
+	size_t Live() const { return m_live.load(std::memory_order_relaxed); }
+	size_t Peak() const { return m_peak.load(std::memory_order_relaxed); }
+
+	// Any thread
+	void Charge(size_t bytes) { Raise(m_live.fetch_add(bytes, std::memory_order_relaxed) + bytes); }
+	void Credit(size_t bytes) { m_live.fetch_sub(bytes, std::memory_order_relaxed); }
+
+	// A sampled account's new size
+	void Set(size_t bytes) {
+		m_live.store(bytes, std::memory_order_relaxed);
+		Raise(bytes);
+	}
+
+	void ResetPeak() { m_peak.store(Live(), std::memory_order_relaxed); }
+
+private:
+	void Raise(size_t live) {
+		size_t peak = m_peak.load(std::memory_order_relaxed);
+		while (live > peak && !m_peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+	}
+
+	std::string m_name;
+	bool m_counted;
+	std::atomic<size_t> m_live;
+	std::atomic<size_t> m_peak;
+};
+
+class MemoryLedger {
+public:
+	MemoryLedger() : m_peak(0) {}
+
+	MemoryLedger(const MemoryLedger&) = delete;
+	MemoryLedger& operator=(const MemoryLedger&) = delete;
+
+	// The process-wide ledger that tag types charge
+	static MemoryLedger& Global() {
+		static MemoryLedger ledger;
+		return ledger;
+	}
+
+	// The account called `name`, added at the end if there is none yet.
+	// Accounts live as long as the ledger.
+	MemoryAccount& Add(const std::string& name, bool counted = false) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (const std::unique_ptr<MemoryAccount>& account : m_accounts) {
+			if (account->Name() == name) return *account;
+		}
+		m_accounts.push_back(std::unique_ptr<MemoryAccount>(new MemoryAccount(name, counted)));
+		return *m_accounts.back();
+	}
+
+	std::vector<MemoryAccount*> Accounts() const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::vector<MemoryAccount*> accounts;
+		for (const std::unique_ptr<MemoryAccount>& account : m_accounts) accounts.push_back(account.get());
+		return accounts;
+	}
+
+	// Live bytes of all accounts. The peak total is the highest Total() has
+	// returned, so it is only as fine-grained as the calls to it.
+	size_t Total() {
+		size_t total = 0;
+		for (MemoryAccount* account : Accounts()) total += account->Live();
+		size_t peak = m_peak.load(std::memory_order_relaxed);
+		while (total > peak && !m_peak.compare_exchange_weak(peak, total, std::memory_order_relaxed)) {}
+		return total;
+	}
+
+	size_t PeakTotal() const { return m_peak.load(std::memory_order_relaxed); }
+
+	void ResetPeaks() {
+		for (MemoryAccount* account : Accounts()) account->ResetPeak();
+		m_peak.store(0, std::memory_order_relaxed);
+		Total();
+	}
+
+	// {"time": <seconds since 1970>, "live": .., "peak": .., "accounts": [{"name": ..,
+	// "kind": "counted" | "sampled", "live": .., "peak": ..}, ...]}
+	std::string ToJson() {
+		size_t total = Total();
+		std::string json = "{\n\t\"time\": " + std::to_string((long long)std::time(nullptr)) +
+			",\n\t\"live\": " + std::to_string(total) + ",\n\t\"peak\": " + std::to_string(PeakTotal()) +
+			",\n\t\"accounts\": [";
+		std::vector<MemoryAccount*> accounts = Accounts();
+		for (size_t i = 0; i < accounts.size(); i++) {
+			const MemoryAccount& account = *accounts[i];
+			json += i ? ",\n\t\t{" : "\n\t\t{";
+			json += "\"name\": " + Quote(account.Name()) + ", \"kind\": \"" +
+				(account.Counted() ? "counted" : "sampled") + "\", \"live\": " + std::to_string(account.Live()) +
+				", \"peak\": " + std::to_string(account.Peak()) + "}";
+		}
+		json += accounts.empty() ? "]\n}\n" : "\n\t]\n}\n";
+		return json;
+	}
+
+private:
+	static std::string Quote(const std::string& text) {
+		std::string quoted = "\"";
+		for (char c : text) {
+			if (c == '"' || c == '\\') {
+				quoted += '\\';
+				quoted += c;
+			} else if ((unsigned char)c < 0x20) {
+				char escape[8];
+				snprintf(escape, sizeof(escape), "\\u%04x", (unsigned)c);
+				quoted += escape;
+			} else {
+				quoted += c;
+			}
+		}
+		return quoted + "\"";
+	}
+
+	mutable std::mutex m_mutex;
+	std::vector<std::unique_ptr<MemoryAccount>> m_accounts;
+	std::atomic<size_t> m_peak;
+};
+
+// Allocator that charges what it hands out to `Tag::Account()`, for use as
+// std::vector<T, CountingAllocator<T, Tag>>. It is stateless, so containers
+// using it are as small as with std::allocator and swap and move freely.
+template <typename T, typename Tag>
+class CountingAllocator {
+public:
+	typedef T value_type;
+
+	template <typename U>
+	struct rebind {
+		typedef CountingAllocator<U, Tag> other;
+	};
+
+	CountingAllocator() noexcept {}
+	template <typename U>
+	CountingAllocator(const CountingAllocator<U, Tag>&) noexcept {}
+
+	T* allocate(size_t n) {
+		T* p = std::allocator<T>().allocate(n);
+		Tag::Account().Charge(n * sizeof(T));
+		return p;
+	}
+
+	void deallocate(T* p, size_t n) noexcept {
+		Tag::Account().Credit(n * sizeof(T));
+		std::allocator<T>().deallocate(p, n);
+	}
+
+	template <typename U>
+	bool operator==(const CountingAllocator<U, Tag>&) const noexcept { return true; }
+	template <typename U>
+	bool operator!=(const CountingAllocator<U, Tag>&) const noexcept { return false; }
+};
+
+#endif // COMMON_MEMORY_LEDGER_H
@@ -0,0 +1,346 @@
+// task_pool.h - Work-stealing thread pool with priorities and cancellation
+//
+// Every worker owns a queue per priority. A task submitted from a worker goes
+// on that worker's own queue, which it serves newest first so related work
+// stays in cache; tasks from other threads are spread over the workers round
+// robin. An idle worker looks for the highest priority task anywhere: its own
+// queue first, then the oldest task in another worker's queue (stealing), so a
+// burst of work submitted in one place still spreads over every core.
+//
+// TaskGroup ties a batch of tasks to one CancelToken and one progress count.
+// Progress reports are rate-limited on the reporting thread and handed to a
+// reporter callback; the UI side (see task_progress.h) forwards them to the
+// main thread. A final report is sent once the group is closed and its last
+// task has finished.
+#ifndef COMMON_TASK_POOL_H
+#define COMMON_TASK_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum class TaskPriority {
+	High = 0,
+	Normal = 1,
+	Low = 2
+};
+
+// Shared flag: copies of a token all see the same cancellation
+class CancelToken {
+public:
+	CancelToken() : m_flag(std::make_shared<std::atomic<bool>>(false)) {}
+
+	void Cancel() const { m_flag->store(true, std::memory_order_relaxed); }
+	bool IsCancelled() const { return m_flag->load(std::memory_order_relaxed); }
+
+	// For code that polls a plain flag
+	const std::atomic<bool>* Flag() const { return m_flag.get(); }
+
+private:
+	std::shared_ptr<std::atomic<bool>> m_flag;
+};
+
+class TaskPool {
+public:
+	// 0 threads means one per hardware thread
+	explicit TaskPool(int threads = 0) : m_pending(0), m_next(0), m_stopping(false) {
+		if (threads <= 0) threads = std::max(1, (int)std::thread::hardware_concurrency());
+		for (int i = 0; i < threads; i++) m_queues.emplace_back(new Queue);
+		for (int i = 0; i < threads; i++) m_workers.emplace_back(&TaskPool::WorkerLoop, this, i);
+	}
+
+	TaskPool(const TaskPool&) = delete;
+	TaskPool& operator=(const TaskPool&) = delete;
+
+	// The workers finish every queued task before they exit
+	~TaskPool() {
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+			m_stopping = true;
+		}
+		m_wake.notify_all();
+		for (std::thread& worker : m_workers) worker.join();
+	}
+
+	// The application-wide pool, created on first use
+	static TaskPool& Shared() {
+		static TaskPool pool;
+		return pool;
+	}
+
+	int Threads() const { return (int)m_workers.size(); }
+
+	// `owner` tags the task so RunPending() can pick it out
+	void Submit(std::function<void()> task, TaskPriority priority = TaskPriority::Normal, const void* owner = nullptr) {
+		int self = CurrentWorker();
+		size_t target = self >= 0 ? (size_t)self : m_next.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+		{
+			Queue& queue = *m_queues[target];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.tasks[(int)priority].push_back(Entry{std::move(task), owner});
+		}
+		m_pending.fetch_add(1, std::memory_order_release);
+		// Taking the lock orders this against a worker about to sleep
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+		}
+		m_wake.notify_one();
+	}
+
+	// Run one queued task on the calling thread, or with an `owner` one of the
+	// tasks submitted with it. Lets a thread that waits for tasks help with
+	// them instead of blocking.
+	bool RunPending(const void* owner = nullptr) {
+		std::function<void()> task;
+		if (!(owner ? TakeOwned(owner, task) : Take(CurrentWorker(), task))) return false;
+		task();
+		return true;
+	}
+
+	// Call body(i) for every i in [0, count), spread over the pool. The calling
+	// thread takes part and returns once every index is done; indices not yet
+	// started when `cancel` fires are skipped.
+	void ParallelFor(size_t count, const std::function<void(size_t)>& body,
+		const CancelToken* cancel = nullptr, TaskPriority priority = TaskPriority::Normal) {
+		if (count == 0) return;
+		struct Loop {
+			std::atomic<size_t> next{0};
+			std::atomic<size_t> done{0};
+			std::mutex mutex;
+			std::condition_variable finished;
+		};
+		auto loop = std::make_shared<Loop>();
+		size_t total = count;
+		const std::function<void(size_t)>* work = &body;
+		// `body` is only touched for claimed indices, all of which finish
+		// before this call returns; late helpers find nothing left to claim
+		auto run = [loop, total, work, cancel]() {
+			size_t ran = 0;
+			for (size_t i = loop->next++; i < total; i = loop->next++) {
+				if (!cancel || !cancel->IsCancelled()) (*work)(i);
+				ran++;
+			}
+			if (ran > 0 && loop->done.fetch_add(ran) + ran == total) {
+				std::lock_guard<std::mutex> lock(loop->mutex);
+				loop->finished.notify_all();
+			}
+		};
+		size_t helpers = std::min(count - 1, m_queues.size());
+		for (size_t i = 0; i < helpers; i++) Submit(run, priority);
+		run();
+		std::unique_lock<std::mutex> lock(loop->mutex);
+		loop->finished.wait(lock, [&]() { return loop->done.load() == total; });
+	}
+
+private:
+	static const int kPriorities = 3;
+
+	struct Entry {
+		std::function<void()> task;
+		const void* owner;
+	};
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Entry> tasks[kPriorities];
+	};
+
+	// Index of the calling thread among this pool's workers, or -1
+	int CurrentWorker() const {
+		return t_worker.pool == this ? t_worker.index : -1;
+	}
+
+	struct WorkerId {
+		const TaskPool* pool;
+		int index;
+	};
+	static inline thread_local WorkerId t_worker = {nullptr, -1};
+
+	bool Take(int self, std::function<void()>& task) {
+		if (m_pending.load(std::memory_order_acquire) == 0) return false;
+		size_t count = m_queues.size();
+		size_t start = self >= 0 ? (size_t)self : 0;
+		for (int priority = 0; priority < kPriorities; priority++) {
+			for (size_t k = 0; k < count; k++) {
+				size_t index = (start + k) % count;
+				Queue& queue = *m_queues[index];
+				std::lock_guard<std::mutex> lock(queue.mutex);
+				std::deque<Entry>& tasks = queue.tasks[priority];
+				if (tasks.empty()) continue;
+				// Own queue newest first, stolen work oldest first
+				if ((int)index == self) {
+					task = std::move(tasks.back().task);
+					tasks.pop_back();
+				} else {
+					task = std::move(tasks.front().task);
+					tasks.pop_front();
+				}
+				m_pending.fetch_sub(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// The oldest queued task submitted with `owner`, from any queue
+	bool TakeOwned(const void* owner, std::function<void()>& task) {
+		if (m_pending.load(std::memory_order_acquire) == 0) return false;
+		for (int priority = 0; priority < kPriorities; priority++) {
+			for (const std::unique_ptr<Queue>& queue : m_queues) {
+				std::lock_guard<std::mutex> lock(queue->mutex);
+				std::deque<Entry>& tasks = queue->tasks[priority];
+				auto found = std::find_if(tasks.begin(), tasks.end(), [owner](const Entry& entry) { return entry.owner == owner; });
+				if (found == tasks.end()) continue;
+				task = std::move(found->task);
+				tasks.erase(found);
+				m_pending.fetch_sub(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void WorkerLoop(int index) {
+		t_worker = WorkerId{this, index};
+		std::function<void()> task;
+		for (;;) {
+			if (Take(index, task)) {
+				task();
+				task = nullptr;
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(m_sleepMutex);
+			m_wake.wait(lock, [this]() { return m_stopping || m_pending.load(std::memory_order_acquire) > 0; });
+			if (m_stopping) return;
+		}
+	}
+
+	std::vector<std::unique_ptr<Queue>> m_queues;
+	std::vector<std::thread> m_workers;
+	std::atomic<int64_t> m_pending;
+	std::atomic<size_t> m_next;
+	std::mutex m_sleepMutex;
+	std::condition_variable m_wake;
+	bool m_stopping;
+};
+
+// A batch of tasks sharing a cancel token and a progress count. Copies are
+// handles to the same group, so tasks can capture one by value.
+class TaskGroup {
+public:
+	struct Progress {
+		int64_t done;
+		int64_t total;
+		bool finished;
+		bool cancelled;
+	};
+	typedef std::function<void(const Progress&)> Reporter;
+
+	explicit TaskGroup(TaskPool& pool = TaskPool::Shared(), TaskPriority priority = TaskPriority::Normal)
+		: m_state(std::make_shared<State>(pool, priority)) {}
+
+	// `reporter` is called on whichever thread advanced the count, at most
+	// once per `intervalMs`, and once more when the group finishes. Set it
+	// before running tasks.
+	void SetReporter(Reporter reporter, int intervalMs = 100) {
+		m_state->reporter = reporter;
+		m_state->interval = intervalMs;
+	}
+
+	void SetTotal(int64_t total) { m_state->total = total; }
+
+	void Advance(int64_t amount = 1) {
+		State& state = *m_state;
+		int64_t done = state.done.fetch_add(amount, std::memory_order_relaxed) + amount;
+		if (!state.reporter) return;
+		int64_t now = NowMs();
+		int64_t last = state.lastReport.load(std::memory_order_relaxed);
+		if (now - last < state.interval) return;
+		if (!state.lastReport.compare_exchange_strong(last, now)) return;
+		state.reporter(Progress{done, state.total.load(), false, state.cancel.IsCancelled()});
+	}
+
+	void Run(std::function<void(const CancelToken&)> task) {
+		std::shared_ptr<State> state = m_state;
+		state->running.fetch_add(1);
+		state->pool.Submit([state, task]() {
+			if (!state->cancel.IsCancelled()) task(state->cancel);
+			Release(*state);
+		}, state->priority, state.get());
+	}
+
+	// No more tasks will be added; the final report follows the last task
+	void Close() {
+		if (!m_state->closed.exchange(true)) Release(*m_state);
+	}
+
+	void Cancel() { m_state->cancel.Cancel(); }
+	bool IsCancelled() const { return m_state->cancel.IsCancelled(); }
+	const CancelToken& Token() const { return m_state->cancel; }
+	TaskPool& Pool() const { return m_state->pool; }
+	TaskPriority Priority() const { return m_state->priority; }
+
+	// Whether every task has finished (tasks may still be added until Close)
+	bool IsIdle() const { return m_state->closed ? m_state->settled.load() : m_state->running.load() == 1; }
+
+	// Block until every task run so far has finished, running the group's own
+	// queued tasks meanwhile; other groups' work is left to the pool, as it
+	// could hold the caller (often the UI thread) for much longer
+	void Wait() {
+		while (!IsIdle()) {
+			if (m_state->pool.RunPending(m_state.get())) continue;
+			std::unique_lock<std::mutex> lock(m_state->mutex);
+			m_state->idle.wait_for(lock, std::chrono::milliseconds(5), [this]() { return IsIdle(); });
+		}
+	}
+
+private:
+	struct State {
+		State(TaskPool& pool, TaskPriority priority) : pool(pool), priority(priority),
+			done(0), total(0), lastReport(0), running(1), closed(false), settled(false), interval(100) {}
+		TaskPool& pool;
+		TaskPriority priority;
+		CancelToken cancel;
+		std::atomic<int64_t> done;
+		std::atomic<int64_t> total;
+		std::atomic<int64_t> lastReport;
+		std::atomic<int> running;  // tasks not yet finished, plus one until Close()
+		std::atomic<bool> closed;
+		std::atomic<bool> settled;  // closed, finished and the final report sent
+		Reporter reporter;
+		int interval;
+		std::mutex mutex;
+		std::condition_variable idle;
+	};
+
+	static int64_t NowMs() {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static void Release(State& state) {
+		int left = state.running.fetch_sub(1) - 1;
+		if (left == 0) {
+			if (state.reporter) {
+				state.reporter(Progress{state.done.load(), state.total.load(), true, state.cancel.IsCancelled()});
+			}
+			state.settled = true;
+		}
+		if (left <= 1) {
+			std::lock_guard<std::mutex> lock(state.mutex);
+			state.idle.notify_all();
+		}
+	}
+
+	std::shared_ptr<State> m_state;
+};
+
+#endif // COMMON_TASK_POOL_H
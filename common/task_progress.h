@@ -0,0 +1,44 @@
+// task_progress.h - Showing TaskGroup progress in the UI
+//
+// TaskGroup reporters run on worker threads. ReportOnUiThread() wraps a UI
+// callback so that every report, already rate-limited by the group, is queued
+// to the main thread with CallAfter and dropped there if its owner has been
+// destroyed in the meantime. ReportToStatusBar() is the common case of
+// showing the count in one status bar field.
+#ifndef COMMON_TASK_PROGRESS_H
+#define COMMON_TASK_PROGRESS_H
+
+#include <wx/wx.h>
+
+#include <functional>
+#include <memory>
+
+#include "task_pool.h"
+
+// `alive` is the owner's liveness flag: cleared (or released) when it goes away
+inline TaskGroup::Reporter ReportOnUiThread(std::weak_ptr<bool> alive,
+	std::function<void(const TaskGroup::Progress&)> show) {
+	return [alive, show](const TaskGroup::Progress& progress) {
+		wxTheApp->CallAfter([alive, show, progress]() {
+			std::shared_ptr<bool> live = alive.lock();
+			if (live && *live) show(progress);
+		});
+	};
+}
+
+// "Label: 120 of 500 (24%)", or how the job ended
+inline wxString FormatProgress(const wxString& label, const TaskGroup::Progress& progress) {
+	if (progress.finished) return label + (progress.cancelled ? ": cancelled" : ": done");
+	if (progress.total <= 0) return wxString::Format("%s: %lld", label, (long long)progress.done);
+	return wxString::Format("%s: %lld of %lld (%d%%)", label, (long long)progress.done,
+		(long long)progress.total, (int)(progress.done * 100 / progress.total));
+}
+
+inline TaskGroup::Reporter ReportToStatusBar(std::weak_ptr<bool> alive, wxFrame* frame, int field,
+	const wxString& label) {
+	return ReportOnUiThread(alive, [frame, field, label](const TaskGroup::Progress& progress) {
+		frame->SetStatusText(FormatProgress(label, progress), field);
+	});
+}
+
+#endif // COMMON_TASK_PROGRESS_H
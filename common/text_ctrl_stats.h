@@ -0,0 +1,53 @@
+// text_ctrl_stats.h - Document statistics for a wxTextCtrl
+//
+// wxTextCtrl reports that its text changed but not how, so DocStats cannot be
+// fed edits here. Lines and characters come straight from the control's own
+// counters on every change, which copies nothing; words, and with them the
+// reading time, are recounted from a single copy of the text once typing has
+// paused rather than on every keystroke.
+#ifndef COMMON_TEXT_CTRL_STATS_H
+#define COMMON_TEXT_CTRL_STATS_H
+
+#include <wx/wx.h>
+
+#include <functional>
+
+#include "doc_stats.h"
+
+class TextCtrlStats : public wxTimer {
+public:
+	// `onUpdate` runs whenever the counts change
+	TextCtrlStats(wxTextCtrl* ctrl, std::function<void()> onUpdate, int pauseMs = 300)
+		: m_ctrl(ctrl), m_onUpdate(onUpdate), m_pauseMs(pauseMs) {}
+
+	~TextCtrlStats() { Stop(); }
+
+	// Call from the control's EVT_TEXT handler
+	void Changed() {
+		StartOnce(m_pauseMs);
+		if (m_onUpdate) m_onUpdate();
+	}
+
+	// Recount now, e.g. right after loading a file
+	void Recount() {
+		Stop();
+		wxScopedCharBuffer utf8 = m_ctrl->GetValue().utf8_str();
+		m_stats.Reset(utf8.data(), utf8.length());
+		if (m_onUpdate) m_onUpdate();
+	}
+
+	long Lines() const { return m_ctrl->GetNumberOfLines(); }
+	long Characters() const { return (long)m_ctrl->GetLastPosition(); }
+	long Words() const { return (long)m_stats.Words(); }
+	long ReadingMinutes() const { return (long)m_stats.ReadingMinutes(); }
+
+	void Notify() override { Recount(); }
+
+private:
+	wxTextCtrl* m_ctrl;
+	std::function<void()> m_onUpdate;
+	int m_pauseMs;
+	DocStats m_stats;
+};
+
+#endif // COMMON_TEXT_CTRL_STATS_H
@@ -0,0 +1,415 @@
+// text_file_stream.h - Loading and saving a wxTextCtrl's text in chunks
+//
+// wxTextCtrl::LoadFile() reads and converts the whole file and inserts it in
+// one go, so a large file freezes the window until all of it is in.
+// TextFileStream reads the file on the task pool and decodes it in chunks cut
+// at UTF-8 character boundaries; a file that turns out not to be UTF-8 is
+// read again from the start as Latin-1, so one encoding holds for all of it.
+// The chunks reach the UI thread through a
+// small bounded queue, so the reader never runs far ahead of the control, and
+// a timer appends them a batch at a time: the first screen of text shows up at
+// once and the window stays responsive while the rest streams in.
+//
+// Saving takes one copy of the text; encoding and writing happen on the pool,
+// into a temporary file that replaces the target only once it is complete.
+// A cancelled load leaves the control empty, so a partial document is never
+// mistaken for the file, and a cancelled save leaves the file as it was.
+#ifndef COMMON_TEXT_FILE_STREAM_H
+#define COMMON_TEXT_FILE_STREAM_H
+
+#include <wx/wx.h>
+#include <wx/file.h>
+#include <wx/convauto.h>
+#include <wx/stopwatch.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "task_pool.h"
+
+class TextFileStream : public wxTimer {
+public:
+	enum Outcome {
+		Completed,
+		Failed,     // the file could not be read or written
+		Cancelled
+	};
+	typedef std::function<void(const TaskGroup::Progress&)> ProgressHandler;
+	typedef std::function<void(Outcome outcome)> DoneHandler;
+
+	// `onProgress` is called on the UI thread a few times a second while a
+	// load or save runs
+	TextFileStream(wxTextCtrl* ctrl, ProgressHandler onProgress)
+		: m_ctrl(ctrl), m_onProgress(onProgress), m_mode(Idle),
+		m_lastReport(0), m_caret(0), m_editedWhileSaving(false) {
+		m_ctrl->Bind(wxEVT_TEXT, &TextFileStream::OnText, this);
+	}
+
+	~TextFileStream() {
+		m_ctrl->Unbind(wxEVT_TEXT, &TextFileStream::OnText, this);
+		Stop();
+		Abandon();
+	}
+
+	bool IsBusy() const { return m_mode != Idle; }
+	bool IsLoading() const { return m_mode == Loading; }
+	bool IsSaving() const { return m_mode == Saving; }
+
+	// Replace the control's text with the file's; `done` is called once it is
+	// all in. Returns false, leaving the control alone, if the file cannot be
+	// opened.
+	bool Load(const wxString& path, DoneHandler done) {
+		Cancel();
+		std::unique_ptr<wxFile> file(new wxFile);
+		{
+			wxLogNull quiet;
+			if (!file->Open(path)) return false;
+		}
+		Begin(Loading, file->Length(), done);
+		m_ctrl->Clear();
+		m_ctrl->SetEditable(false);
+		m_caret = 0;
+
+		std::shared_ptr<Transfer> transfer = m_transfer;
+		wxFile* source = file.release();
+		m_job.Run([transfer, source](const CancelToken& cancel) {
+			std::unique_ptr<wxFile> owned(source);
+			Read(*owned, *transfer, cancel);
+		});
+		m_job.Close();
+		return true;
+	}
+
+	// Write the control's current text to `path`. Refused while loading,
+	// since the text is not all there yet.
+	bool Save(const wxString& path, DoneHandler done) {
+		if (IsLoading()) return false;
+		Cancel();
+		Begin(Saving, 0, done);
+		m_editedWhileSaving = false;
+		m_transfer->text = m_ctrl->GetValue();
+		m_transfer->total = (int64_t)m_transfer->text.length();
+
+		std::shared_ptr<Transfer> transfer = m_transfer;
+		m_job.Run([transfer, path](const CancelToken& cancel) {
+			Write(path, *transfer, cancel);
+		});
+		m_job.Close();
+		return true;
+	}
+
+	// Stop the current load or save
+	void Cancel() {
+		if (!IsBusy()) return;
+		Abandon();
+		Finish(Cancelled);
+	}
+
+	void Notify() override {
+		if (m_mode == Loading) {
+			Append();
+		} else if (m_mode == Saving) {
+			bool finished, failed;
+			{
+				std::lock_guard<std::mutex> lock(m_transfer->mutex);
+				finished = m_transfer->finished;
+				failed = m_transfer->failed;
+			}
+			if (finished) {
+				Finish(failed ? Failed : Completed);
+				return;
+			}
+		}
+		if (!IsBusy()) return;
+		wxLongLong now = wxGetLocalTimeMillis();
+		if (m_onProgress && (now - m_lastReport).GetValue() >= kReportMs) {
+			m_lastReport = now;
+			m_onProgress(TaskGroup::Progress{m_transfer->done.load(), m_transfer->total, false, false});
+		}
+	}
+
+private:
+	enum Mode { Idle, Loading, Saving };
+
+	static const size_t kFirstChunk = 16 * 1024;    // about a screenful, shown right away
+	static const size_t kChunk = 256 * 1024;
+	static const size_t kQueuedBytes = 4 * 1024 * 1024;  // how far reading may run ahead
+	static const int kTickMs = 15;
+	static const int kBatchMs = 25;                 // UI time spent appending per tick
+	static const int kReportMs = 100;
+
+	struct Chunk {
+		wxString text;
+		size_t bytes;
+		bool restart;   // drop what was appended so far; the file is being read again
+	};
+
+	// State shared with the pool task, which may outlive a cancelled stream
+	struct Transfer {
+		Transfer() : done(0), total(0), queued(0), finished(false), failed(false) {}
+		std::atomic<int64_t> done;
+		int64_t total;
+		std::mutex mutex;
+		std::condition_variable drained;
+		std::deque<Chunk> chunks;
+		size_t queued;
+		bool finished;
+		bool failed;
+		wxString text;  // being saved
+	};
+
+	void Begin(Mode mode, int64_t total, DoneHandler done) {
+		m_mode = mode;
+		m_onDone = done;
+		m_transfer = std::make_shared<Transfer>();
+		m_transfer->total = total;
+		m_job = TaskGroup(TaskPool::Shared(), TaskPriority::Normal);
+		m_lastReport = wxGetLocalTimeMillis();
+		wxTimer::Start(kTickMs);
+	}
+
+	// Cancel the task and wait for it; a reader blocked on a full queue is
+	// woken so it can notice
+	void Abandon() {
+		if (!m_transfer) return;
+		m_job.Cancel();
+		{
+			std::lock_guard<std::mutex> lock(m_transfer->mutex);
+			m_transfer->chunks.clear();
+			m_transfer->queued = 0;
+		}
+		m_transfer->drained.notify_all();
+		m_job.Wait();
+	}
+
+	void Finish(Outcome outcome) {
+		Stop();
+		Mode mode = m_mode;
+		m_mode = Idle;
+		if (mode == Loading) {
+			if (outcome != Completed) m_ctrl->Clear();
+			m_ctrl->SetEditable(true);
+			m_ctrl->SetInsertionPoint(m_caret);
+			m_ctrl->ShowPosition(m_caret);
+			m_ctrl->DiscardEdits();
+		} else if (outcome == Completed && !m_editedWhileSaving) {
+			// Edits made after the text was taken are still unsaved
+			m_ctrl->DiscardEdits();
+		}
+		m_transfer.reset();
+		DoneHandler done;
+		done.swap(m_onDone);
+		if (done) done(outcome);
+	}
+
+	void OnText(wxCommandEvent& event) {
+		event.Skip();
+		if (m_mode == Saving) m_editedWhileSaving = true;
+	}
+
+	// Move queued chunks into the control until this tick's time is used up
+	void Append() {
+		Transfer& transfer = *m_transfer;
+		wxStopWatch batch;
+		while (batch.Time() < kBatchMs) {
+			Chunk chunk;
+			bool have = false, finished, failed;
+			{
+				std::lock_guard<std::mutex> lock(transfer.mutex);
+				finished = transfer.finished;
+				failed = transfer.failed;
+				if (!transfer.chunks.empty()) {
+					chunk = std::move(transfer.chunks.front());
+					transfer.chunks.pop_front();
+					transfer.queued -= chunk.bytes;
+					have = true;
+				}
+			}
+			if (!have) {
+				if (finished) Finish(failed ? Failed : Completed);
+				return;
+			}
+			transfer.drained.notify_one();
+			if (chunk.restart) {
+				m_ctrl->Clear();
+				m_caret = 0;
+				transfer.done = 0;
+				continue;
+			}
+
+			// AppendText moves the caret to the end; keep the view where the
+			// reader is, at the top of the file unless they moved
+			long caret = m_ctrl->GetInsertionPoint();
+			if (caret != m_ctrl->GetLastPosition()) m_caret = caret;
+			m_ctrl->AppendText(chunk.text);
+			m_ctrl->SetInsertionPoint(m_caret);
+			transfer.done += (int64_t)chunk.bytes;
+		}
+	}
+
+	// Length of the longest prefix of `data` that ends on a whole character
+	static size_t WholeCharacters(const char* data, size_t length) {
+		size_t lead = length;
+		for (int back = 0; back < 4 && lead > 0; back++) {
+			unsigned char c = (unsigned char)data[--lead];
+			if ((c & 0xC0) == 0x80) continue;
+			size_t need = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+			return length - lead >= need ? length : lead;
+		}
+		return length;
+	}
+
+	// Text that is not valid UTF-8 is taken as Latin-1, like wxConvAuto does.
+	// The choice is made once per file: `latin1` is set by the first chunk
+	// that fails as UTF-8 and stays set for the chunks after it.
+	static wxString Decode(const char* data, size_t length, bool& latin1) {
+		if (length == 0) return wxString();
+		if (!latin1) {
+			wxString text = wxString::FromUTF8(data, length);
+			if (!text.empty()) return text;
+			latin1 = true;
+		}
+		return wxString(data, wxConvISO8859_1, length);
+	}
+
+	// Queue a chunk for the UI thread, waiting while the queue is full
+	static bool Push(Transfer& transfer, Chunk chunk, const CancelToken& cancel) {
+		std::unique_lock<std::mutex> lock(transfer.mutex);
+		transfer.drained.wait(lock, [&]() { return cancel.IsCancelled() || transfer.queued < kQueuedBytes; });
+		if (cancel.IsCancelled()) return false;
+		transfer.queued += chunk.bytes;
+		transfer.chunks.push_back(std::move(chunk));
+		return true;
+	}
+
+	static void Read(wxFile& file, Transfer& transfer, const CancelToken& cancel) {
+		std::vector<char> buffer;
+		size_t carry = 0;   // bytes of a character split by the previous read
+		size_t skip = 0;    // a byte order mark, not part of the text
+		bool failed = false;
+		bool first = true;
+		bool latin1 = false;
+		bool pushed = false;    // UTF-8 text already queued
+		for (;;) {
+			size_t want = first ? kFirstChunk : kChunk;
+			buffer.resize(carry + want);
+			ssize_t got = file.Read(buffer.data() + carry, want);
+			if (got == wxInvalidOffset) {
+				failed = true;
+				break;
+			}
+			size_t length = carry + (size_t)got;
+			if (first && length >= 2 && (((unsigned char)buffer[0] == 0xFF && (unsigned char)buffer[1] == 0xFE) ||
+				((unsigned char)buffer[0] == 0xFE && (unsigned char)buffer[1] == 0xFF))) {
+				// UTF-16 or UTF-32: rare enough to convert in one piece
+				failed = !ReadWhole(file, buffer, length, transfer, cancel);
+				break;
+			}
+			if (first && length >= 3 && memcmp(buffer.data(), "\xEF\xBB\xBF", 3) == 0) skip = 3;
+			first = false;
+
+			size_t whole = got == 0 ? length : WholeCharacters(buffer.data(), length);
+			if (whole > skip) {
+				bool wasLatin1 = latin1;
+				Chunk chunk = {Decode(buffer.data() + skip, whole - skip, latin1), whole, false};
+				if (latin1 && !wasLatin1 && pushed) {
+					// The text shown so far was decoded as UTF-8; start over so
+					// the whole file is Latin-1
+					if (!Push(transfer, Chunk{wxString(), 0, true}, cancel)) return;
+					if (file.Seek(0) == wxInvalidOffset) {
+						failed = true;
+						break;
+					}
+					carry = 0;
+					skip = 0;
+					first = true;
+					continue;
+				}
+				if (!Push(transfer, std::move(chunk), cancel)) return;
+				pushed = true;
+			} else {
+				transfer.done += (int64_t)whole;
+			}
+			skip = 0;
+			carry = length - whole;
+			memmove(buffer.data(), buffer.data() + whole, carry);
+			if (got == 0) break;
+		}
+		std::lock_guard<std::mutex> lock(transfer.mutex);
+		transfer.finished = true;
+		transfer.failed = failed;
+	}
+
+	static bool ReadWhole(wxFile& file, std::vector<char>& buffer, size_t length, Transfer& transfer,
+		const CancelToken& cancel) {
+		wxFileOffset rest = file.Length() - file.Tell();
+		buffer.resize(length + (size_t)(rest > 0 ? rest : 0));
+		ssize_t got = file.Read(buffer.data() + length, buffer.size() - length);
+		if (got == wxInvalidOffset) return false;
+		wxString text(buffer.data(), wxConvAuto(), length + (size_t)got);
+		size_t bytes = length + (size_t)got;
+		for (size_t pos = 0; pos < text.length() && !cancel.IsCancelled(); pos += kChunk) {
+			size_t end = wxMin(text.length(), pos + kChunk);
+			// Progress is in bytes of the file; spread them over the pieces
+			size_t share = end == text.length() ? bytes : (size_t)((double)bytes * (end - pos) / text.length());
+			bytes -= share;
+			if (!Push(transfer, Chunk{text.Mid(pos, end - pos), share}, cancel)) return true;
+		}
+		return true;
+	}
+
+	static void Write(const wxString& path, Transfer& transfer, const CancelToken& cancel) {
+		bool ok = false;
+		{
+			wxLogNull quiet;
+			wxTempFile file(path);
+			if (file.IsOpened()) {
+				const wxString& text = transfer.text;
+				// A pointer into the string, or a converted copy in UTF-8 builds
+				auto buffer = text.wc_str();
+				const wchar_t* wide = buffer;
+				size_t length = text.length();
+				ok = true;
+				for (size_t pos = 0; pos < length && ok; ) {
+					if (cancel.IsCancelled()) {
+						ok = false;
+						break;
+					}
+					size_t end = wxMin(length, pos + kChunk);
+					// Keep UTF-16 surrogate pairs together
+					if (sizeof(wchar_t) == 2 && end < length && wide[end - 1] >= 0xD800 && wide[end - 1] < 0xDC00) end--;
+					size_t bytes = 0;
+					wxCharBuffer utf8 = wxConvUTF8.cWC2MB(wide + pos, end - pos, &bytes);
+					// A chunk that does not convert (a lone surrogate) fails the
+					// save rather than leaving a hole in the file
+					ok = bytes != 0 && file.Write(utf8.data(), bytes);
+					transfer.done += (int64_t)(end - pos);
+					pos = end;
+				}
+				// wxTempFile discards its temporary file unless committed
+				ok = ok && file.Commit();
+			}
+		}
+		std::lock_guard<std::mutex> lock(transfer.mutex);
+		transfer.finished = true;
+		transfer.failed = !ok;
+	}
+
+	wxTextCtrl* m_ctrl;
+	ProgressHandler m_onProgress;
+	DoneHandler m_onDone;
+	Mode m_mode;
+	TaskGroup m_job;
+	std::shared_ptr<Transfer> m_transfer;
+	wxLongLong m_lastReport;
+	long m_caret;
+	bool m_editedWhileSaving;
+};
+
+#endif // COMMON_TEXT_FILE_STREAM_H
@@ -0,0 +1,310 @@
+// text_pipeline.h - Fused character transforms over UTF-8 text
+//
+// A TextPipeline is a list of stages (case mapping, character replacement)
+// that are applied to the text in a single pass instead of one pass and one
+// copy per stage. Before anything runs, the stages are folded into a table
+// giving the final output of every ASCII character; characters outside ASCII
+// go through the stages one at a time, in order, so a later stage sees what
+// an earlier one produced. TrimLines() drops blanks at either end of each line
+// before the stages see it.
+//
+// ASCII text takes a fast path that works on eight bytes at a time: when the
+// table is a plain case mapping plus a few exceptions, eight-byte blocks are
+// case-mapped with 64-bit arithmetic and exceptions that map one byte to
+// another are blended in with masks. Only blocks holding a character that
+// grows, shrinks or is not ASCII fall back to a byte at a time.
+//
+// ParallelApply() cuts the text at line breaks (or between two non-blank
+// characters) and transforms the pieces on the task pool, handing each piece
+// over as soon as it is done.
+#ifndef COMMON_TEXT_PIPELINE_H
+#define COMMON_TEXT_PIPELINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+#include <cwctype>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "task_pool.h"
+
+class TextPipeline {
+public:
+	TextPipeline() : m_trimLines(false), m_dirty(true) {}
+
+	TextPipeline& Upper() { return Add(Stage{Stage::Upper, 0, std::string()}); }
+	TextPipeline& Lower() { return Add(Stage{Stage::Lower, 0, std::string()}); }
+
+	// Every `from` character becomes `to` (UTF-8, possibly empty)
+	TextPipeline& Replace(char32_t from, const std::string& to) {
+		return Add(Stage{Stage::Replace, from, to});
+	}
+
+	// Spaces and tabs at the start and end of every line are dropped
+	TextPipeline& TrimLines() {
+		m_trimLines = true;
+		return *this;
+	}
+
+	// Transform `text`, appending the result to `out`. Text handed over in
+	// pieces must be cut where SplitPoints() would cut it, or line trimming
+	// may see a piece boundary as a line end.
+	void Apply(const char* text, size_t length, std::string& out) const {
+		Prepare();
+		const unsigned char* bytes = (const unsigned char*)text;
+		size_t start = 0;
+		while (start < length) {
+			const unsigned char* newline = (const unsigned char*)memchr(bytes + start, '\n', length - start);
+			size_t end = newline ? (size_t)(newline - bytes) : length;
+			size_t first = start;
+			size_t last = end;
+			if (m_trimLines) {
+				while (first < last && IsBlank(bytes[first])) first++;
+				// "\r\n" line ends keep their '\r'
+				size_t body = last > first && bytes[last - 1] == '\r' ? last - 1 : last;
+				size_t trimmed = body;
+				while (trimmed > first && IsBlank(bytes[trimmed - 1])) trimmed--;
+				MapSpan(bytes + first, trimmed - first, out);
+				first = body;
+			}
+			MapSpan(bytes + first, last - first, out);
+			if (!newline) break;
+			MapSpan(bytes + end, 1, out);
+			start = end + 1;
+		}
+	}
+
+	std::string Apply(const std::string& text) const {
+		std::string out;
+		out.reserve(text.size());
+		Apply(text.data(), text.size(), out);
+		return out;
+	}
+
+	// Offsets splitting `text` into pieces of about `target` bytes that can be
+	// transformed independently: just after a newline if one is near, else
+	// between two non-blank characters. The result starts with 0 and ends
+	// with `length`.
+	static std::vector<size_t> SplitPoints(const char* text, size_t length, size_t target) {
+		std::vector<size_t> points(1, 0);
+		size_t at = 0;
+		while (length - at > target) {
+			size_t cut = FindCut(text, length, at + target);
+			if (cut >= length) break;
+			points.push_back(cut);
+			at = cut;
+		}
+		points.push_back(length);
+		return points;
+	}
+
+	// Transform `text` in pieces on `pool`. `done(index, count, out)` is called
+	// for each piece on whichever thread finished it, in no particular order;
+	// pieces not yet started when `cancel` fires are skipped. Returns once all
+	// pieces are done.
+	void ParallelApply(const char* text, size_t length, TaskPool& pool, const CancelToken* cancel,
+		const std::function<void(size_t index, size_t count, std::string& out)>& done,
+		size_t pieceBytes = kPieceBytes) const {
+		Prepare();
+		std::vector<size_t> points = SplitPoints(text, length, pieceBytes);
+		size_t count = points.size() - 1;
+		pool.ParallelFor(count, [&](size_t i) {
+			std::string out;
+			out.reserve(points[i + 1] - points[i] + (points[i + 1] - points[i]) / 8);
+			Apply(text + points[i], points[i + 1] - points[i], out);
+			done(i, count, out);
+		}, cancel);
+	}
+
+	static const size_t kPieceBytes = 1024 * 1024;
+
+private:
+	struct Stage {
+		enum Kind { Upper, Lower, Replace } kind;
+		char32_t from;
+		std::string to;
+	};
+
+	// How the ASCII table relates to a plain case mapping
+	enum CaseOp { Same, ToUpper, ToLower };
+	static const int kMaxExceptions = 4;
+
+	TextPipeline& Add(Stage stage) {
+		m_stages.push_back(stage);
+		m_dirty = true;
+		return *this;
+	}
+
+	static bool IsBlank(unsigned char c) { return c == ' ' || c == '\t'; }
+
+	// Code point `c` run through the stages from `stage` on, as UTF-8
+	void MapCodePoint(char32_t c, size_t stage, std::string& out) const {
+		for (; stage < m_stages.size(); stage++) {
+			const Stage& s = m_stages[stage];
+			if (s.kind == Stage::Replace) {
+				if (c != s.from) continue;
+				size_t at = 0;
+				while (at < s.to.size()) MapCodePoint(Decode((const unsigned char*)s.to.data(), s.to.size(), at), stage + 1, out);
+				return;
+			}
+			// Case mapping follows the C locale's wide character tables, like wxString
+			if (c <= (char32_t)WCHAR_MAX) {
+				c = (char32_t)(s.kind == Stage::Upper ? std::towupper((wint_t)c) : std::towlower((wint_t)c));
+			}
+		}
+		Encode(c, out);
+	}
+
+	// Decode the character at `at`, advancing past it; malformed bytes come
+	// through as U+FFFD
+	static char32_t Decode(const unsigned char* bytes, size_t length, size_t& at) {
+		unsigned char lead = bytes[at++];
+		if (lead < 0x80) return lead;
+		int extra = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : -1;
+		if (extra < 0 || lead >= 0xF8) return 0xFFFD;
+		char32_t c = lead & (0x3F >> extra);
+		for (int i = 0; i < extra; i++) {
+			if (at >= length || (bytes[at] & 0xC0) != 0x80) return 0xFFFD;
+			c = (c << 6) | (bytes[at++] & 0x3F);
+		}
+		return c;
+	}
+
+	static void Encode(char32_t c, std::string& out) {
+		if (c < 0x80) {
+			out += (char)c;
+		} else if (c < 0x800) {
+			out += (char)(0xC0 | (c >> 6));
+			out += (char)(0x80 | (c & 0x3F));
+		} else if (c < 0x10000) {
+			out += (char)(0xE0 | (c >> 12));
+			out += (char)(0x80 | ((c >> 6) & 0x3F));
+			out += (char)(0x80 | (c & 0x3F));
+		} else {
+			out += (char)(0xF0 | (c >> 18));
+			out += (char)(0x80 | ((c >> 12) & 0x3F));
+			out += (char)(0x80 | ((c >> 6) & 0x3F));
+			out += (char)(0x80 | (c & 0x3F));
+		}
+	}
+
+	static unsigned char CaseMap(CaseOp op, unsigned char c) {
+		if (op == ToUpper && c >= 'a' && c <= 'z') return c - 'a' + 'A';
+		if (op == ToLower && c >= 'A' && c <= 'Z') return c - 'A' + 'a';
+		return c;
+	}
+
+	// Fold the stages into the ASCII table and pick the fast path's case
+	// mapping: the one the fewest characters disagree with
+	void Prepare() const {
+		if (!m_dirty) return;
+		for (int c = 0; c < 128; c++) {
+			m_ascii[c].clear();
+			MapCodePoint((char32_t)c, 0, m_ascii[c]);
+		}
+		int best = kMaxExceptions + 1;
+		for (CaseOp op : {Same, ToUpper, ToLower}) {
+			std::vector<std::pair<unsigned char, unsigned char>> swaps;
+			std::vector<unsigned char> stops;
+			for (int c = 0; c < 128; c++) {
+				const std::string& mapped = m_ascii[c];
+				if (mapped.size() != 1 || (unsigned char)mapped[0] >= 0x80) {
+					stops.push_back((unsigned char)c);
+				} else if ((unsigned char)mapped[0] != CaseMap(op, (unsigned char)c)) {
+					swaps.emplace_back((unsigned char)c, (unsigned char)mapped[0]);
+				}
+			}
+			if ((int)(swaps.size() + stops.size()) < best) {
+				best = (int)(swaps.size() + stops.size());
+				m_caseOp = op;
+				m_swaps = swaps;
+				m_stops = stops;
+			}
+		}
+		m_fastPath = best <= kMaxExceptions;
+		m_dirty = false;
+	}
+
+	// High bit set in each byte of `word` (all ASCII) that equals `c`
+	static uint64_t MatchByte(uint64_t word, unsigned char c) {
+		uint64_t v = word ^ (kOnes * c);
+		return ~(((v & ~kHigh) + ~kHigh) | v) & kHigh;
+	}
+
+	// Case-map eight ASCII bytes at once: flag the bytes in the letter range
+	// and flip their 0x20 bit
+	static uint64_t CaseMapWord(CaseOp op, uint64_t word) {
+		if (op == Same) return word;
+		unsigned char first = op == ToUpper ? 'a' : 'A';
+		unsigned char last = op == ToUpper ? 'z' : 'Z';
+		uint64_t letters = (word + kOnes * (0x80 - first)) & ~(word + kOnes * (0x80 - last - 1)) & kHigh;
+		return word ^ (letters >> 2);
+	}
+
+	void MapSpan(const unsigned char* bytes, size_t length, std::string& out) const {
+		size_t i = 0;
+		while (i < length) {
+			if (m_fastPath && i + 8 <= length) {
+				uint64_t word;
+				memcpy(&word, bytes + i, 8);
+				bool plain = (word & kHigh) == 0;
+				for (size_t e = 0; plain && e < m_stops.size(); e++) plain = MatchByte(word, m_stops[e]) == 0;
+				if (plain) {
+					// Byte order does not matter: every byte is mapped on its own
+					uint64_t mapped = CaseMapWord(m_caseOp, word);
+					for (const std::pair<unsigned char, unsigned char>& swap : m_swaps) {
+						uint64_t bytes = (MatchByte(word, swap.first) >> 7) * 0xFF;
+						mapped = (mapped & ~bytes) | (kOnes * swap.second & bytes);
+					}
+					out.append((const char*)&mapped, 8);
+					i += 8;
+					continue;
+				}
+			}
+			if (bytes[i] < 0x80) {
+				out += m_ascii[bytes[i]];
+				i++;
+			} else {
+				MapCodePoint(Decode(bytes, length, i), 0, out);
+			}
+		}
+	}
+
+	// First good cut at or after `from`: after a newline within the search
+	// window, else between two non-blank characters, else the end
+	static size_t FindCut(const char* text, size_t length, size_t from) {
+		size_t window = from + kCutWindow < length ? from + kCutWindow : length;
+		const char* newline = (const char*)memchr(text + from, '\n', window - from);
+		if (newline) return (size_t)(newline - text) + 1;
+		for (size_t at = from; at < length; at++) {
+			unsigned char before = (unsigned char)text[at - 1];
+			unsigned char after = (unsigned char)text[at];
+			if ((after & 0xC0) == 0x80) continue;
+			if (before == '\n') return at;
+			if (!IsBlank(before) && before != '\r' && !IsBlank(after) && after != '\r' && after != '\n') return at;
+		}
+		return length;
+	}
+
+	static const size_t kCutWindow = 64 * 1024;
+	static const uint64_t kOnes = 0x0101010101010101ULL;
+	static const uint64_t kHigh = 0x8080808080808080ULL;
+
+	std::vector<Stage> m_stages;
+	bool m_trimLines;
+
+	// Derived from the stages on first use
+	mutable bool m_dirty;
+	mutable std::string m_ascii[128];
+	mutable CaseOp m_caseOp;
+	mutable std::vector<std::pair<unsigned char, unsigned char>> m_swaps;  // one byte to another
+	mutable std::vector<unsigned char> m_stops;  // anything else: byte at a time
+	mutable bool m_fastPath;
+};
+
+#endif // COMMON_TEXT_PIPELINE_H
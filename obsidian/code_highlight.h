@@ -0,0 +1,487 @@
+// code_highlight.h - Table-driven highlighting of fenced code for the preview
+//
+// Each language is described by a CodeSyntax: which comment, string and
+// variable forms it has, and its keywords. MakeTable() turns a syntax into a
+// transition table over (state, character class) at compile time, so
+// tokenizing is one table lookup per byte, plus a keyword lookup at the end
+// of each word. Like MarkdownLexer, the only state carried from one line to
+// the next is a small int (an open block comment, template string or
+// triple-quoted string).
+//
+// Tokenizing is cheap but not free, and a fence's layout is made again on
+// every resize. CodeHighlightCache keeps the runs of each fence by the hash
+// of its block, so an unchanged fence is tokenized once for as long as it
+// is in use.
+#ifndef OBSIDIAN_CODE_HIGHLIGHT_H
+#define OBSIDIAN_CODE_HIGHLIGHT_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "markdown_lexer.h"
+
+enum CodeToken : uint8_t {
+	CODE_PLAIN = 0,
+	CODE_KEYWORD,
+	CODE_STRING,
+	CODE_NUMBER,
+	CODE_COMMENT,
+	CODE_PREPROCESSOR,  // #include, #define, ...
+	CODE_KEY,           // YAML and JSON keys
+	CODE_VARIABLE,      // $name in shell scripts
+	CODE_TOKEN_COUNT
+};
+
+// Bytes [start, start + length) of a line are `token`
+struct CodeRun {
+	uint32_t start;
+	uint32_t length;
+	uint8_t token;
+};
+
+class CodeHighlighter {
+public:
+	// Runs of each line
+	typedef std::vector<std::vector<CodeRun>> Lines;
+
+	// Whether `lang` (a MarkdownFenceLang) has a syntax; others are plain
+	static bool Supports(int lang) { return Syntax(lang) != nullptr; }
+
+	// Tokenize one line. `tokens` receives one CodeToken per byte. Returns
+	// the state to carry into the next line; 0 starts a fence.
+	static int HighlightLine(int lang, const char* text, size_t len, int stateIn, std::vector<uint8_t>& tokens) {
+		tokens.assign(len, CODE_PLAIN);
+		const CodeSyntax* syntax = Syntax(lang);
+		if (!syntax) return 0;
+		const CodeTable& table = *syntax->table;
+
+		int state = stateIn ? stateIn : CS_LINE_START;
+		size_t wordStart = 0;
+		size_t quoteStart = 0;
+		for (size_t i = 0; i < len; i++) {
+			const CodeStep& step = table[state][CharClasses()[(unsigned char)text[i]]];
+			if (state == CS_WORD && step.next != CS_WORD) EndWord(*syntax, text, len, wordStart, i, tokens);
+			if (step.next == CS_WORD && state != CS_WORD) wordStart = i;
+			if (IsQuote(step.next) && !IsQuote(state)) quoteStart = i;
+			tokens[i] = step.token;
+			if (step.flags & STEP_RETAG) tokens[i - 1] = step.token;
+			if (IsQuote(state) && step.next == CS_START && syntax->features.keys && KeyFollows(text, len, i + 1)) {
+				std::fill(tokens.begin() + quoteStart, tokens.begin() + i + 1, (uint8_t)CODE_KEY);
+			}
+			state = step.next;
+		}
+		if (state == CS_WORD) EndWord(*syntax, text, len, wordStart, len, tokens);
+
+		// Only block comments, template strings and triple-quoted strings run
+		// on into the next line
+		if (state == CS_BLOCK_COMMENT || state == CS_BLOCK_STAR) return CS_BLOCK_COMMENT;
+		if (state == CS_BQ || state == CS_BQ_ESCAPE) return CS_BQ;
+		if (state >= CS_TDQ && state <= CS_TDQ_2) return CS_TDQ;
+		if (state >= CS_TSQ && state <= CS_TSQ_2) return CS_TSQ;
+		return 0;
+	}
+
+	// Runs of `lines`, the body of a fence in `lang`
+	static Lines Highlight(int lang, const std::vector<std::string>& lines) {
+		Lines runs(lines.size());
+		std::vector<uint8_t> tokens;
+		int state = 0;
+		for (size_t i = 0; i < lines.size(); i++) {
+			state = HighlightLine(lang, lines[i].data(), lines[i].size(), state, tokens);
+			for (size_t start = 0; start < tokens.size();) {
+				size_t end = start + 1;
+				while (end < tokens.size() && tokens[end] == tokens[start]) end++;
+				runs[i].push_back(CodeRun{(uint32_t)start, (uint32_t)(end - start), tokens[start]});
+				start = end;
+			}
+		}
+		return runs;
+	}
+
+private:
+	enum CharClass : uint8_t {
+		CC_OTHER,
+		CC_SPACE,
+		CC_WORD,  // letters, '_' and UTF-8 bytes
+		CC_DIGIT,
+		CC_DOT,
+		CC_DQUOTE,
+		CC_SQUOTE,
+		CC_BACKTICK,
+		CC_SLASH,
+		CC_STAR,
+		CC_HASH,
+		CC_BACKSLASH,
+		CC_DOLLAR,
+		CC_BRACE,
+		CC_INDICATOR,  // ':', '-', '[' , ',' and '?', after which a YAML scalar may start
+		CC_COUNT
+	};
+
+	enum State : uint8_t {
+		CS_START = 0,     // between tokens
+		CS_LINE_START,    // only spaces so far on this line
+		CS_WORD,
+		CS_NUMBER,
+		CS_SLASH,         // a '/' that may open a comment
+		CS_DQ,
+		CS_DQ_ESCAPE,
+		CS_SQ,
+		CS_SQ_ESCAPE,
+		CS_BQ,
+		CS_BQ_ESCAPE,
+		CS_DQ_OPEN,       // just after a '"' that may open """
+		CS_SQ_OPEN,
+		CS_TDQ,           // in """...""", which may span lines
+		CS_TDQ_ESCAPE,
+		CS_TDQ_1,         // one '"' of a possible closing """
+		CS_TDQ_2,
+		CS_TSQ,           // in '''...'''
+		CS_TSQ_ESCAPE,
+		CS_TSQ_1,
+		CS_TSQ_2,
+		CS_DQ_PAIR,       // after "", where a third '"' opens """
+		CS_SQ_PAIR,
+		CS_LINE_COMMENT,
+		CS_BLOCK_COMMENT,
+		CS_BLOCK_STAR,    // a '*' in a block comment that may close it
+		CS_PREPROCESSOR,
+		CS_VARIABLE,
+		CS_SCALAR_START,  // after a YAML indicator, where a quote opens a string
+		CS_COUNT
+	};
+
+	enum { STEP_RETAG = 1 };  // the byte before takes this step's token too
+
+	struct CodeStep {
+		uint8_t next;
+		uint8_t token;
+		uint8_t flags;
+	};
+
+	typedef std::array<std::array<CodeStep, CC_COUNT>, CS_COUNT> CodeTable;
+
+	struct Features {
+		bool slashComments;  // // and /* */
+		bool hashComments;   // # to the end of the line
+		bool hashInWords;    // ...except inside a word, as in a#b
+		bool preprocessor;   // # at the start of a line
+		bool singleQuotes;   // '...' strings
+		bool backticks;      // `...` strings, which may span lines
+		bool variables;      // $name and ${name}
+		bool keys;           // "key": and key: (at the start of a line)
+		bool tripleQuotes;   // """...""" and '''...''' strings, which may span lines
+		bool scalarQuotes;   // quotes only open a string where a YAML scalar starts
+	};
+
+	struct CodeSyntax {
+		Features features;
+		const CodeTable* table;
+		const std::string_view* keywords;  // sorted
+		size_t keywordCount;
+	};
+
+	static bool IsQuote(int state) { return state >= CS_DQ && state <= CS_TSQ_2; }
+
+	static constexpr std::array<uint8_t, 256> MakeCharClasses() {
+		std::array<uint8_t, 256> classes{};
+		for (int c = 0; c < 256; c++) {
+			uint8_t cls = CC_OTHER;
+			if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c >= 0x80) cls = CC_WORD;
+			else if (c >= '0' && c <= '9') cls = CC_DIGIT;
+			else if (c == ' ' || c == '\t' || c == '\r') cls = CC_SPACE;
+			else if (c == '.') cls = CC_DOT;
+			else if (c == '"') cls = CC_DQUOTE;
+			else if (c == '\'') cls = CC_SQUOTE;
+			else if (c == '`') cls = CC_BACKTICK;
+			else if (c == '/') cls = CC_SLASH;
+			else if (c == '*') cls = CC_STAR;
+			else if (c == '#') cls = CC_HASH;
+			else if (c == '\\') cls = CC_BACKSLASH;
+			else if (c == '$') cls = CC_DOLLAR;
+			else if (c == '{' || c == '}') cls = CC_BRACE;
+			else if (c == ':' || c == '-' || c == '[' || c == ',' || c == '?') cls = CC_INDICATOR;
+			classes[c] = cls;
+		}
+		return classes;
+	}
+
+	static const std::array<uint8_t, 256>& CharClasses() {
+		static constexpr std::array<uint8_t, 256> classes = MakeCharClasses();
+		return classes;
+	}
+
+	static constexpr void Fill(std::array<CodeStep, CC_COUNT>& row, uint8_t next, uint8_t token) {
+		for (CodeStep& step : row) step = CodeStep{next, token, 0};
+	}
+
+	// A quoted string: everything up to the closing quote, skipping escapes
+	static constexpr void AddString(CodeTable& table, uint8_t state, uint8_t escape, uint8_t quote) {
+		Fill(table[state], state, CODE_STRING);
+		table[state][CC_BACKSLASH] = CodeStep{escape, CODE_STRING, 0};
+		table[state][quote] = CodeStep{CS_START, CODE_STRING, 0};
+		Fill(table[escape], state, CODE_STRING);
+	}
+
+	// A triple-quoted string: everything up to three quotes in a row
+	static constexpr void AddTripleString(CodeTable& table, uint8_t state, uint8_t escape, uint8_t one, uint8_t two,
+		uint8_t quote) {
+		AddString(table, state, escape, quote);
+		table[state][quote] = CodeStep{one, CODE_STRING, 0};
+		table[one] = table[state];
+		table[one][quote] = CodeStep{two, CODE_STRING, 0};
+		table[two] = table[state];
+		table[two][quote] = CodeStep{CS_START, CODE_STRING, 0};
+	}
+
+	// The quote that opens a string in `open`: a second quote closes an
+	// empty string in `pair`, and a third one there opens a triple-quoted one
+	static constexpr void AddTripleOpen(CodeTable& table, uint8_t open, uint8_t pair, uint8_t state,
+		uint8_t triple, uint8_t quote) {
+		table[open] = table[state];
+		table[open][quote] = CodeStep{pair, CODE_STRING, 0};
+		table[pair] = table[CS_START];
+		table[pair][quote] = CodeStep{triple, CODE_STRING, 0};
+	}
+
+	static constexpr CodeTable MakeTable(Features features) {
+		CodeTable table{};
+
+		// What each character class starts
+		std::array<CodeStep, CC_COUNT>& start = table[CS_START];
+		Fill(start, CS_START, CODE_PLAIN);
+		start[CC_WORD] = CodeStep{CS_WORD, CODE_PLAIN, 0};
+		start[CC_DIGIT] = CodeStep{CS_NUMBER, CODE_NUMBER, 0};
+		start[CC_DQUOTE] = CodeStep{features.tripleQuotes ? CS_DQ_OPEN : CS_DQ, CODE_STRING, 0};
+		if (features.singleQuotes) start[CC_SQUOTE] = CodeStep{features.tripleQuotes ? CS_SQ_OPEN : CS_SQ, CODE_STRING, 0};
+		if (features.backticks) start[CC_BACKTICK] = CodeStep{CS_BQ, CODE_STRING, 0};
+		if (features.slashComments) start[CC_SLASH] = CodeStep{CS_SLASH, CODE_PLAIN, 0};
+		if (features.hashComments) start[CC_HASH] = CodeStep{CS_LINE_COMMENT, CODE_COMMENT, 0};
+		if (features.variables) start[CC_DOLLAR] = CodeStep{CS_VARIABLE, CODE_VARIABLE, 0};
+
+		table[CS_LINE_START] = start;
+		table[CS_LINE_START][CC_SPACE] = CodeStep{CS_LINE_START, CODE_PLAIN, 0};
+		if (features.preprocessor) table[CS_LINE_START][CC_HASH] = CodeStep{CS_PREPROCESSOR, CODE_PREPROCESSOR, 0};
+
+		// A YAML quote opens a string at the start of a line or after an
+		// indicator ("key: ", "- ", "[", ","); anywhere else it is part of a
+		// plain scalar, as in "name: don't panic"
+		if (features.scalarQuotes) {
+			start[CC_DQUOTE] = start[CC_SQUOTE] = CodeStep{CS_START, CODE_PLAIN, 0};
+			start[CC_INDICATOR] = start[CC_BRACE] = CodeStep{CS_SCALAR_START, CODE_PLAIN, 0};
+			table[CS_LINE_START][CC_INDICATOR] = table[CS_LINE_START][CC_BRACE] = start[CC_INDICATOR];
+			table[CS_SCALAR_START] = table[CS_LINE_START];
+			table[CS_SCALAR_START][CC_SPACE] = CodeStep{CS_SCALAR_START, CODE_PLAIN, 0};
+		}
+
+		// Tokens that end at the first byte that cannot continue them, which
+		// then starts whatever it starts
+		table[CS_WORD] = start;
+		table[CS_WORD][CC_WORD] = table[CS_WORD][CC_DIGIT] = CodeStep{CS_WORD, CODE_PLAIN, 0};
+		if (features.hashInWords) table[CS_WORD][CC_HASH] = CodeStep{CS_WORD, CODE_PLAIN, 0};
+
+		table[CS_NUMBER] = start;
+		table[CS_NUMBER][CC_WORD] = table[CS_NUMBER][CC_DIGIT] = table[CS_NUMBER][CC_DOT] =
+			CodeStep{CS_NUMBER, CODE_NUMBER, 0};
+
+		table[CS_SLASH] = start;
+		table[CS_SLASH][CC_SLASH] = CodeStep{CS_LINE_COMMENT, CODE_COMMENT, STEP_RETAG};
+		table[CS_SLASH][CC_STAR] = CodeStep{CS_BLOCK_COMMENT, CODE_COMMENT, STEP_RETAG};
+
+		table[CS_VARIABLE] = start;
+		table[CS_VARIABLE][CC_WORD] = table[CS_VARIABLE][CC_DIGIT] = table[CS_VARIABLE][CC_BRACE] =
+			table[CS_VARIABLE][CC_HASH] = CodeStep{CS_VARIABLE, CODE_VARIABLE, 0};
+
+		AddString(table, CS_DQ, CS_DQ_ESCAPE, CC_DQUOTE);
+		AddString(table, CS_SQ, CS_SQ_ESCAPE, CC_SQUOTE);
+		AddString(table, CS_BQ, CS_BQ_ESCAPE, CC_BACKTICK);
+		if (features.tripleQuotes) {
+			AddTripleString(table, CS_TDQ, CS_TDQ_ESCAPE, CS_TDQ_1, CS_TDQ_2, CC_DQUOTE);
+			AddTripleString(table, CS_TSQ, CS_TSQ_ESCAPE, CS_TSQ_1, CS_TSQ_2, CC_SQUOTE);
+			AddTripleOpen(table, CS_DQ_OPEN, CS_DQ_PAIR, CS_DQ, CS_TDQ, CC_DQUOTE);
+			AddTripleOpen(table, CS_SQ_OPEN, CS_SQ_PAIR, CS_SQ, CS_TSQ, CC_SQUOTE);
+		}
+
+		// Comments and directives run to the end of the line, block comments
+		// to "*/"
+		Fill(table[CS_LINE_COMMENT], CS_LINE_COMMENT, CODE_COMMENT);
+		Fill(table[CS_PREPROCESSOR], CS_PREPROCESSOR, CODE_PREPROCESSOR);
+		Fill(table[CS_BLOCK_COMMENT], CS_BLOCK_COMMENT, CODE_COMMENT);
+		table[CS_BLOCK_COMMENT][CC_STAR] = CodeStep{CS_BLOCK_STAR, CODE_COMMENT, 0};
+		Fill(table[CS_BLOCK_STAR], CS_BLOCK_COMMENT, CODE_COMMENT);
+		table[CS_BLOCK_STAR][CC_STAR] = CodeStep{CS_BLOCK_STAR, CODE_COMMENT, 0};
+		table[CS_BLOCK_STAR][CC_SLASH] = CodeStep{CS_START, CODE_COMMENT, 0};
+		return table;
+	}
+
+	template <size_t N>
+	static constexpr bool IsSorted(const std::string_view (&words)[N]) {
+		for (size_t i = 1; i < N; i++) {
+			if (!(words[i - 1] < words[i])) return false;
+		}
+		return true;
+	}
+
+	static const CodeSyntax* Syntax(int lang) {
+		static constexpr std::string_view cppKeywords[] = {
+			"alignas", "alignof", "auto", "bool", "break", "case", "catch", "char", "char16_t", "char32_t",
+			"char8_t", "class", "co_await", "co_return", "co_yield", "const", "const_cast", "consteval",
+			"constexpr", "constinit", "continue", "decltype", "default", "delete", "do", "double",
+			"dynamic_cast", "else", "enum", "explicit", "export", "extern", "false", "final", "float",
+			"for", "friend", "goto", "if", "inline", "int", "long", "mutable", "namespace", "new",
+			"noexcept", "nullptr", "operator", "override", "private", "protected", "public", "register",
+			"reinterpret_cast", "return", "short", "signed", "sizeof", "static", "static_assert",
+			"static_cast", "struct", "switch", "template", "this", "thread_local", "throw", "true", "try",
+			"typedef", "typeid", "typename", "union", "unsigned", "using", "virtual", "void", "volatile",
+			"wchar_t", "while"};
+		static constexpr std::string_view cKeywords[] = {
+			"NULL", "auto", "bool", "break", "case", "char", "const", "continue", "default", "do",
+			"double", "else", "enum", "extern", "false", "float", "for", "goto", "if", "inline", "int",
+			"long", "register", "restrict", "return", "short", "signed", "sizeof", "static", "struct",
+			"switch", "true", "typedef", "union", "unsigned", "void", "volatile", "while"};
+		static constexpr std::string_view bashKeywords[] = {
+			"break", "case", "continue", "declare", "do", "done", "elif", "else", "esac", "exit", "export",
+			"fi", "for", "function", "if", "in", "local", "readonly", "return", "select", "shift",
+			"source", "then", "unset", "until", "while"};
+		static constexpr std::string_view pythonKeywords[] = {
+			"False", "None", "True", "and", "as", "assert", "async", "await", "break", "class", "continue",
+			"def", "del", "elif", "else", "except", "finally", "for", "from", "global", "if", "import",
+			"in", "is", "lambda", "nonlocal", "not", "or", "pass", "raise", "return", "try", "while",
+			"with", "yield"};
+		static constexpr std::string_view yamlKeywords[] = {
+			"False", "Null", "True", "false", "no", "null", "off", "on", "true", "yes"};
+		static constexpr std::string_view jsonKeywords[] = {"false", "null", "true"};
+		static constexpr std::string_view jsKeywords[] = {
+			"as", "async", "await", "break", "case", "catch", "class", "const", "continue", "debugger",
+			"default", "delete", "do", "else", "enum", "export", "extends", "false", "finally", "for",
+			"from", "function", "if", "implements", "import", "in", "instanceof", "interface", "let",
+			"new", "null", "of", "return", "static", "super", "switch", "this", "throw", "true", "try",
+			"type", "typeof", "undefined", "var", "void", "while", "with", "yield"};
+		static_assert(IsSorted(cppKeywords) && IsSorted(cKeywords) && IsSorted(bashKeywords) &&
+			IsSorted(pythonKeywords) && IsSorted(yamlKeywords) && IsSorted(jsonKeywords) && IsSorted(jsKeywords),
+			"keyword lists are binary searched");
+
+		//                                       slash  hash   a#b    cpp    'x'    `x`    $x     keys   """    scalar
+		static constexpr Features c           = {true,  false, false, true,  true,  false, false, false, false, false};
+		static constexpr Features bash        = {false, true,  true,  false, true,  true,  true,  false, false, false};
+		static constexpr Features python      = {false, true,  false, false, true,  false, false, false, true,  false};
+		static constexpr Features yaml        = {false, true,  true,  false, true,  false, false, true,  false, true};
+		static constexpr Features json        = {false, false, false, false, false, false, false, true,  false, false};
+		static constexpr Features javascript  = {true,  false, false, false, true,  true,  false, false, false, false};
+
+		static constexpr CodeTable cTable = MakeTable(c);
+		static constexpr CodeTable bashTable = MakeTable(bash);
+		static constexpr CodeTable pythonTable = MakeTable(python);
+		static constexpr CodeTable yamlTable = MakeTable(yaml);
+		static constexpr CodeTable jsonTable = MakeTable(json);
+		static constexpr CodeTable javascriptTable = MakeTable(javascript);
+
+		static constexpr CodeSyntax syntaxes[] = {
+			{c, &cTable, cppKeywords, sizeof(cppKeywords) / sizeof(cppKeywords[0])},
+			{c, &cTable, cKeywords, sizeof(cKeywords) / sizeof(cKeywords[0])},
+			{bash, &bashTable, bashKeywords, sizeof(bashKeywords) / sizeof(bashKeywords[0])},
+			{python, &pythonTable, pythonKeywords, sizeof(pythonKeywords) / sizeof(pythonKeywords[0])},
+			{yaml, &yamlTable, yamlKeywords, sizeof(yamlKeywords) / sizeof(yamlKeywords[0])},
+			{json, &jsonTable, jsonKeywords, sizeof(jsonKeywords) / sizeof(jsonKeywords[0])},
+			{javascript, &javascriptTable, jsKeywords, sizeof(jsKeywords) / sizeof(jsKeywords[0])},
+		};
+		switch (lang) {
+		case MD_LANG_CPP: return &syntaxes[0];
+		case MD_LANG_C: return &syntaxes[1];
+		case MD_LANG_BASH: return &syntaxes[2];
+		case MD_LANG_PYTHON: return &syntaxes[3];
+		case MD_LANG_YAML: return &syntaxes[4];
+		case MD_LANG_JSON: return &syntaxes[5];
+		case MD_LANG_JAVASCRIPT: return &syntaxes[6];
+		default: return nullptr;
+		}
+	}
+
+	// A ':' after optional spaces, then a space or the end of the line
+	static bool KeyFollows(const char* text, size_t len, size_t from) {
+		while (from < len && (text[from] == ' ' || text[from] == '\t')) from++;
+		return from < len && text[from] == ':' && (from + 1 == len || text[from + 1] == ' ' ||
+			text[from + 1] == '\t' || text[from + 1] == '\r');
+	}
+
+	// Bytes [start, end) were a word: a key at the start of a line ("key:" or
+	// "- key:"), a keyword, or plain
+	static void EndWord(const CodeSyntax& syntax, const char* text, size_t len, size_t start, size_t end,
+		std::vector<uint8_t>& tokens) {
+		if (syntax.features.keys && KeyFollows(text, len, end)) {
+			size_t lead = 0;
+			while (lead < start && (text[lead] == ' ' || text[lead] == '-')) lead++;
+			if (lead == start) {
+				std::fill(tokens.begin() + start, tokens.begin() + end, (uint8_t)CODE_KEY);
+				return;
+			}
+		}
+		std::string_view word(text + start, end - start);
+		if (std::binary_search(syntax.keywords, syntax.keywords + syntax.keywordCount, word)) {
+			std::fill(tokens.begin() + start, tokens.begin() + end, (uint8_t)CODE_KEYWORD);
+		}
+	}
+};
+
+// Highlighted fences by key, normally the hash of their preview block. Two
+// generations: when the current one fills up it becomes the previous one,
+// and fences still in use move back on their next lookup, so fences that
+// were edited away are dropped without tracking which blocks still exist.
+class CodeHighlightCache {
+public:
+	// Runs of `lines` in `lang`; only tokenized the first time `key` is seen
+	std::shared_ptr<const CodeHighlighter::Lines> Get(uint64_t key, int lang, const std::vector<std::string>& lines) {
+		auto found = m_current.find(key);
+		if (found != m_current.end()) return found->second;
+
+		std::shared_ptr<const CodeHighlighter::Lines> runs;
+		found = m_previous.find(key);
+		if (found != m_previous.end()) {
+			runs = found->second;
+			m_previous.erase(found);
+		} else {
+			runs = std::make_shared<CodeHighlighter::Lines>(CodeHighlighter::Highlight(lang, lines));
+		}
+		if (m_current.size() >= kGeneration) {
+			m_previous.swap(m_current);
+			m_current.clear();
+		}
+		m_current[key] = runs;
+		return runs;
+	}
+
+	void Clear() {
+		m_current.clear();
+		m_previous.clear();
+	}
+
+	// Approximate bytes held
+	size_t MemoryUsage() const { return Bytes(m_current) + Bytes(m_previous); }
+
+private:
+	typedef std::unordered_map<uint64_t, std::shared_ptr<const CodeHighlighter::Lines>> Map;
+
+	static const size_t kGeneration = 512;  // fences per generation
+	static const size_t kNodeBytes = 48;    // rough cost of a hash map node
+
+	static size_t Bytes(const Map& map) {
+		size_t bytes = 0;
+		for (const auto& entry : map) {
+			bytes += sizeof(entry) + kNodeBytes + entry.second->capacity() * sizeof(std::vector<CodeRun>);
+			for (const std::vector<CodeRun>& line : *entry.second) bytes += line.capacity() * sizeof(CodeRun);
+		}
+		return bytes;
+	}
+
+	Map m_current;
+	Map m_previous;
+};
+
+#endif // OBSIDIAN_CODE_HIGHLIGHT_H
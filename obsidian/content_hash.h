@@ -0,0 +1,19 @@
+// content_hash.h - Fast 64-bit content hash shared by the caches and stores
+#ifndef OBSIDIAN_CONTENT_HASH_H
+#define OBSIDIAN_CONTENT_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+// FNV-1a: not cryptographic, but cheap and good enough to tell versions of a
+// note or a block apart.
+inline uint64_t ContentHash(const char* data, size_t len, uint64_t seed = 1469598103934665603ULL) {
+	uint64_t h = seed;
+	for (size_t i = 0; i < len; i++) {
+		h ^= (unsigned char)data[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+#endif // OBSIDIAN_CONTENT_HASH_H
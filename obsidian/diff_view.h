@@ -0,0 +1,258 @@
+// diff_view.h - Side-by-side diff of two versions of a note
+//
+// Compare() hands both texts to the shared task pool, which runs LineDiff and
+// builds the two padded, row-aligned texts; the UI thread only loads them into
+// the two wxStyledTextCtrl panes and adds the row markers. Rows line up one
+// to one, so scrolling either pane scrolls the other to the same row. Line
+// numbers are drawn as margin text for the visible rows only.
+#ifndef OBSIDIAN_DIFF_VIEW_H
+#define OBSIDIAN_DIFF_VIEW_H
+
+#include <wx/wx.h>
+#include <wx/stc/stc.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../common/task_pool.h"
+#include "line_diff.h"
+
+class DiffView : public wxPanel {
+public:
+	explicit DiffView(wxWindow* parent) : wxPanel(parent, wxID_ANY),
+		m_alive(std::make_shared<bool>(true)), m_syncing(false) {
+		wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
+
+		wxBoxSizer* bar = new wxBoxSizer(wxHORIZONTAL);
+		m_status = new wxStaticText(this, wxID_ANY, "");
+		wxButton* previous = new wxButton(this, wxID_ANY, "Previous Change");
+		wxButton* next = new wxButton(this, wxID_ANY, "Next Change");
+		bar->Add(m_status, 1, wxALIGN_CENTER_VERTICAL | wxALL, 5);
+		bar->Add(previous, 0, wxALL, 2);
+		bar->Add(next, 0, wxALL, 2);
+		sizer->Add(bar, 0, wxEXPAND);
+
+		wxBoxSizer* titles = new wxBoxSizer(wxHORIZONTAL);
+		m_leftTitle = new wxStaticText(this, wxID_ANY, "");
+		m_rightTitle = new wxStaticText(this, wxID_ANY, "");
+		titles->Add(m_leftTitle, 1, wxLEFT | wxRIGHT, 5);
+		titles->Add(m_rightTitle, 1, wxLEFT | wxRIGHT, 5);
+		sizer->Add(titles, 0, wxEXPAND);
+
+		wxBoxSizer* panes = new wxBoxSizer(wxHORIZONTAL);
+		m_left = CreatePane();
+		m_right = CreatePane();
+		panes->Add(m_left, 1, wxEXPAND | wxRIGHT, 2);
+		panes->Add(m_right, 1, wxEXPAND);
+		sizer->Add(panes, 1, wxEXPAND);
+		SetSizer(sizer);
+
+		previous->Bind(wxEVT_BUTTON, [this](wxCommandEvent&) { GotoChange(false); });
+		next->Bind(wxEVT_BUTTON, [this](wxCommandEvent&) { GotoChange(true); });
+		m_left->Bind(wxEVT_STC_UPDATEUI, [this](wxStyledTextEvent& event) { OnScrolled(event, m_left, m_right); });
+		m_right->Bind(wxEVT_STC_UPDATEUI, [this](wxStyledTextEvent& event) { OnScrolled(event, m_right, m_left); });
+	}
+
+	~DiffView() {
+		*m_alive = false;
+		m_cancel.Cancel();
+	}
+
+	// Diff `left` against `right` in the background and show the result.
+	// A comparison still running is abandoned.
+	void Compare(const wxString& leftTitle, std::string left, const wxString& rightTitle, std::string right) {
+		m_cancel.Cancel();
+		m_cancel = CancelToken();
+		m_leftTitle->SetLabel(leftTitle);
+		m_rightTitle->SetLabel(rightTitle);
+		m_status->SetLabel("Comparing...");
+		Load(m_left, std::string(), std::vector<unsigned char>());
+		Load(m_right, std::string(), std::vector<unsigned char>());
+		m_changes.clear();
+		m_leftLines.clear();
+		m_rightLines.clear();
+
+		CancelToken cancel = m_cancel;
+		std::weak_ptr<bool> alive = m_alive;
+		// Someone is waiting for this one; run it ahead of background work
+		TaskPool::Shared().Submit([this, alive, cancel, left = std::move(left), right = std::move(right)]() {
+			auto result = std::make_shared<Result>();
+			wxStopWatch timer;
+			if (!LineDiff::Diff(left, right, result->hunks, cancel.Flag())) return;
+			Align(left, right, *result);
+			result->ms = timer.Time();
+			wxTheApp->CallAfter([this, alive, cancel, result]() {
+				std::shared_ptr<bool> live = alive.lock();
+				if (!live || !*live || cancel.IsCancelled()) return;
+				Show(*result);
+			});
+		}, TaskPriority::High);
+	}
+
+	// Approximate bytes held: Scintilla keeps a style byte beside every text
+	// byte and a few words per line
+	size_t MemoryUsage() const {
+		size_t bytes = (m_leftLines.capacity() + m_rightLines.capacity() + m_changes.capacity()) * sizeof(int);
+		for (wxStyledTextCtrl* pane : {m_left, m_right}) {
+			bytes += 2 * (size_t)pane->GetTextLength() + 16 * (size_t)pane->GetLineCount();
+		}
+		return bytes;
+	}
+
+private:
+	enum RowKind : unsigned char {
+		ROW_SAME = 0,
+		ROW_REMOVED,
+		ROW_ADDED,
+		ROW_CHANGED,
+		ROW_FILLER
+	};
+
+	struct Result {
+		std::vector<DiffHunk> hunks;
+		std::string leftText;
+		std::string rightText;
+		std::vector<unsigned char> leftRows;
+		std::vector<unsigned char> rightRows;
+		std::vector<int> leftLines;   // source line of each row, -1 for filler
+		std::vector<int> rightLines;
+		std::vector<int> changes;     // first row of every change
+		long ms = 0;
+	};
+
+	wxStyledTextCtrl* CreatePane() {
+		wxStyledTextCtrl* pane = new wxStyledTextCtrl(this, wxID_ANY);
+		pane->StyleSetFont(wxSTC_STYLE_DEFAULT, wxFont(10, wxFONTFAMILY_TELETYPE,
+			wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
+		pane->StyleClearAll();
+		// Rows must stay one screen line each to line up across the panes
+		pane->SetWrapMode(wxSTC_WRAP_NONE);
+		pane->SetMarginType(0, wxSTC_MARGIN_RTEXT);
+		pane->SetMarginWidth(0, pane->TextWidth(wxSTC_STYLE_LINENUMBER, "_999999"));
+		pane->SetMarginWidth(1, 0);
+		pane->MarkerDefine(ROW_REMOVED, wxSTC_MARK_BACKGROUND, wxNullColour, wxColour(255, 220, 220));
+		pane->MarkerDefine(ROW_ADDED, wxSTC_MARK_BACKGROUND, wxNullColour, wxColour(220, 255, 220));
+		pane->MarkerDefine(ROW_CHANGED, wxSTC_MARK_BACKGROUND, wxNullColour, wxColour(255, 245, 200));
+		pane->MarkerDefine(ROW_FILLER, wxSTC_MARK_BACKGROUND, wxNullColour, wxColour(235, 235, 235));
+		pane->SetReadOnly(true);
+		return pane;
+	}
+
+	// Pool thread: lay both sides out row by row, padding the shorter side
+	// of every change with filler rows
+	static void Align(const std::string& left, const std::string& right, Result& result) {
+		std::vector<size_t> leftOffsets = SplitLineOffsets(left);
+		std::vector<size_t> rightOffsets = SplitLineOffsets(right);
+		result.leftText.reserve(left.size() + 1024);
+		result.rightText.reserve(right.size() + 1024);
+
+		auto append = [](std::string& out, const std::string& text, const std::vector<size_t>& offsets, int line) {
+			size_t start = offsets[line];
+			size_t end = offsets[line + 1];
+			while (end > start && (text[end - 1] == '\n' || text[end - 1] == '\r')) end--;
+			out.append(text, start, end - start);
+			out += '\n';
+		};
+
+		for (const DiffHunk& hunk : result.hunks) {
+			int rows = std::max(hunk.aCount, hunk.bCount);
+			if (hunk.kind == DiffHunk::CHANGE) result.changes.push_back((int)result.leftRows.size());
+			for (int r = 0; r < rows; r++) {
+				bool hasLeft = r < hunk.aCount;
+				bool hasRight = r < hunk.bCount;
+				unsigned char kind = hunk.kind == DiffHunk::EQUAL ? ROW_SAME :
+					hasLeft && hasRight ? ROW_CHANGED : ROW_FILLER;
+
+				if (hasLeft) append(result.leftText, left, leftOffsets, hunk.aStart + r);
+				else result.leftText += '\n';
+				result.leftRows.push_back(kind == ROW_FILLER && hasLeft ? ROW_REMOVED : kind);
+				result.leftLines.push_back(hasLeft ? hunk.aStart + r : -1);
+
+				if (hasRight) append(result.rightText, right, rightOffsets, hunk.bStart + r);
+				else result.rightText += '\n';
+				result.rightRows.push_back(kind == ROW_FILLER && hasRight ? ROW_ADDED : kind);
+				result.rightLines.push_back(hasRight ? hunk.bStart + r : -1);
+			}
+		}
+		if (!result.leftText.empty()) result.leftText.pop_back();
+		if (!result.rightText.empty()) result.rightText.pop_back();
+	}
+
+	void Show(Result& result) {
+		Load(m_left, result.leftText, result.leftRows);
+		Load(m_right, result.rightText, result.rightRows);
+		m_leftLines.swap(result.leftLines);
+		m_rightLines.swap(result.rightLines);
+		m_changes.swap(result.changes);
+		m_status->SetLabel(m_changes.empty() ? wxString::Format("No differences (%ld ms)", result.ms) :
+			wxString::Format("%d changes (%ld ms)", (int)m_changes.size(), result.ms));
+		UpdateMargins(m_left, m_leftLines);
+		UpdateMargins(m_right, m_rightLines);
+		if (!m_changes.empty()) m_left->SetFirstVisibleLine(std::max(0, m_changes.front() - 2));
+	}
+
+	static void Load(wxStyledTextCtrl* pane, const std::string& text, const std::vector<unsigned char>& rows) {
+		pane->SetReadOnly(false);
+		pane->MarginTextClearAll();
+		pane->MarkerDeleteAll(-1);
+		pane->SetTextRaw(text.c_str());
+		for (size_t row = 0; row < rows.size(); row++) {
+			if (rows[row] != ROW_SAME) pane->MarkerAdd((int)row, rows[row]);
+		}
+		pane->SetReadOnly(true);
+		pane->EmptyUndoBuffer();
+	}
+
+	// Source line numbers for the rows on screen
+	static void UpdateMargins(wxStyledTextCtrl* pane, const std::vector<int>& lines) {
+		int first = pane->GetFirstVisibleLine();
+		int last = std::min((int)lines.size(), first + pane->LinesOnScreen() + 1);
+		for (int row = first; row < last; row++) {
+			pane->MarginSetText(row, lines[row] < 0 ? wxString() : wxString::Format("%d", lines[row] + 1));
+		}
+	}
+
+	void OnScrolled(wxStyledTextEvent& event, wxStyledTextCtrl* from, wxStyledTextCtrl* to) {
+		event.Skip();
+		if (m_syncing || !(event.GetUpdated() & (wxSTC_UPDATE_V_SCROLL | wxSTC_UPDATE_H_SCROLL))) return;
+		m_syncing = true;
+		to->SetFirstVisibleLine(from->GetFirstVisibleLine());
+		to->SetXOffset(from->GetXOffset());
+		UpdateMargins(m_left, m_leftLines);
+		UpdateMargins(m_right, m_rightLines);
+		m_syncing = false;
+	}
+
+	void GotoChange(bool forward) {
+		if (m_changes.empty()) return;
+		int current = m_left->GetFirstVisibleLine() + 2;
+		int target = -1;
+		if (forward) {
+			auto it = std::upper_bound(m_changes.begin(), m_changes.end(), current);
+			target = it == m_changes.end() ? m_changes.front() : *it;
+		} else {
+			auto it = std::lower_bound(m_changes.begin(), m_changes.end(), current);
+			target = it == m_changes.begin() ? m_changes.back() : *(it - 1);
+		}
+		// Leave a little context above the change
+		m_left->SetFirstVisibleLine(std::max(0, target - 2));
+	}
+
+	wxStyledTextCtrl* m_left;
+	wxStyledTextCtrl* m_right;
+	wxStaticText* m_leftTitle;
+	wxStaticText* m_rightTitle;
+	wxStaticText* m_status;
+
+	std::shared_ptr<bool> m_alive;
+	CancelToken m_cancel;
+	bool m_syncing;
+
+	std::vector<int> m_leftLines;
+	std::vector<int> m_rightLines;
+	std::vector<int> m_changes;
+};
+
+#endif // OBSIDIAN_DIFF_VIEW_H
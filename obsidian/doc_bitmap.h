@@ -0,0 +1,316 @@
+// doc_bitmap.h - Compressed set of note ids for search filters
+//
+// A roaring bitmap: ids are split by their high 16 bits into containers, and
+// each container holds its low halves either as a sorted array (up to 4096
+// ids, two bytes each) or as a 65536-bit bitset (8 KB), whichever is smaller.
+// A tag on a dozen notes costs a few dozen bytes, a folder holding most of
+// the vault one bit per note, and intersecting either kind walks only the
+// containers both sides have.
+#ifndef OBSIDIAN_DOC_BITMAP_H
+#define OBSIDIAN_DOC_BITMAP_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+class DocBitmap {
+public:
+	static const uint32_t kEnd = UINT32_MAX;
+
+	size_t Count() const {
+		size_t count = 0;
+		for (const Container& container : m_containers) count += container.count;
+		return count;
+	}
+
+	bool Empty() const { return m_containers.empty(); }
+
+	size_t MemoryUsage() const {
+		size_t bytes = sizeof(*this) + m_containers.capacity() * sizeof(Container);
+		for (const Container& container : m_containers) {
+			bytes += container.array.capacity() * sizeof(uint16_t) + container.bits.capacity() * sizeof(uint64_t);
+		}
+		return bytes;
+	}
+
+	bool Contains(uint32_t id) const {
+		const Container* container = Find(id >> 16);
+		return container && container->Contains((uint16_t)id);
+	}
+
+	void Add(uint32_t id) {
+		uint16_t key = (uint16_t)(id >> 16);
+		auto at = LowerBound(key);
+		if (at == m_containers.end() || at->key != key) {
+			at = m_containers.insert(at, Container());
+			at->key = key;
+		}
+		at->Add((uint16_t)id);
+	}
+
+	void Remove(uint32_t id) {
+		uint16_t key = (uint16_t)(id >> 16);
+		auto at = LowerBound(key);
+		if (at == m_containers.end() || at->key != key) return;
+		at->Remove((uint16_t)id);
+		if (at->count == 0) m_containers.erase(at);
+	}
+
+	// First id at or after `id`, or kEnd
+	uint32_t NextFrom(uint32_t id) const {
+		for (auto at = LowerBound((uint16_t)(id >> 16)); at != m_containers.end(); ++at) {
+			uint32_t low = at->key == id >> 16 ? (id & 0xFFFF) : 0;
+			int found = at->NextFrom(low);
+			if (found >= 0) return (uint32_t)at->key << 16 | (uint32_t)found;
+		}
+		return kEnd;
+	}
+
+	// Call `visit(id)` for every id, ascending
+	template <typename Visit>
+	void ForEach(Visit visit) const {
+		for (const Container& container : m_containers) {
+			uint32_t high = (uint32_t)container.key << 16;
+			if (container.bits.empty()) {
+				for (uint16_t low : container.array) visit(high | low);
+				continue;
+			}
+			for (size_t word = 0; word < container.bits.size(); word++) {
+				for (uint64_t rest = container.bits[word]; rest; rest &= rest - 1) {
+					visit(high | (uint32_t)(word * 64 + PopCount((rest & (0 - rest)) - 1)));
+				}
+			}
+		}
+	}
+
+	DocBitmap& operator&=(const DocBitmap& other) {
+		std::vector<Container> result;
+		auto a = m_containers.begin();
+		auto b = other.m_containers.begin();
+		while (a != m_containers.end() && b != other.m_containers.end()) {
+			if (a->key < b->key) {
+				++a;
+			} else if (b->key < a->key) {
+				++b;
+			} else {
+				Container both = Container::And(*a, *b);
+				if (both.count) result.push_back(std::move(both));
+				++a;
+				++b;
+			}
+		}
+		m_containers.swap(result);
+		return *this;
+	}
+
+	DocBitmap& operator|=(const DocBitmap& other) {
+		std::vector<Container> result;
+		auto a = m_containers.begin();
+		auto b = other.m_containers.begin();
+		while (a != m_containers.end() || b != other.m_containers.end()) {
+			if (b == other.m_containers.end() || (a != m_containers.end() && a->key < b->key)) {
+				result.push_back(std::move(*a++));
+			} else if (a == m_containers.end() || b->key < a->key) {
+				result.push_back(*b++);
+			} else {
+				result.push_back(Container::Or(*a++, *b++));
+			}
+		}
+		m_containers.swap(result);
+		return *this;
+	}
+
+	// Remove every id of `other`
+	DocBitmap& operator-=(const DocBitmap& other) {
+		auto b = other.m_containers.begin();
+		for (auto a = m_containers.begin(); a != m_containers.end();) {
+			while (b != other.m_containers.end() && b->key < a->key) ++b;
+			if (b != other.m_containers.end() && b->key == a->key) {
+				*a = Container::AndNot(*a, *b);
+				if (a->count == 0) {
+					a = m_containers.erase(a);
+					continue;
+				}
+			}
+			++a;
+		}
+		return *this;
+	}
+
+private:
+	static const uint32_t kArrayMax = 4096;  // beyond this a bitset is smaller
+
+	static int PopCount(uint64_t x) {
+		x = x - ((x >> 1) & 0x5555555555555555ULL);
+		x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+		x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+		return (int)((x * 0x0101010101010101ULL) >> 56);
+	}
+
+	struct Container {
+		uint16_t key = 0;
+		uint32_t count = 0;
+		std::vector<uint16_t> array;  // sorted, while count <= kArrayMax
+		std::vector<uint64_t> bits;   // 1024 words otherwise
+
+		bool Contains(uint16_t low) const {
+			if (!bits.empty()) return (bits[low >> 6] >> (low & 63)) & 1;
+			return std::binary_search(array.begin(), array.end(), low);
+		}
+
+		void Add(uint16_t low) {
+			if (!bits.empty()) {
+				uint64_t mask = 1ULL << (low & 63);
+				if (bits[low >> 6] & mask) return;
+				bits[low >> 6] |= mask;
+				count++;
+				return;
+			}
+			// Ids mostly arrive in order, so appending is the common case
+			if (array.empty() || array.back() < low) {
+				array.push_back(low);
+			} else {
+				auto at = std::lower_bound(array.begin(), array.end(), low);
+				if (*at == low) return;
+				array.insert(at, low);
+			}
+			if (++count > kArrayMax) ToBits();
+		}
+
+		void Remove(uint16_t low) {
+			if (!bits.empty()) {
+				uint64_t mask = 1ULL << (low & 63);
+				if (!(bits[low >> 6] & mask)) return;
+				bits[low >> 6] &= ~mask;
+				if (--count <= kArrayMax) ToArray();
+				return;
+			}
+			auto at = std::lower_bound(array.begin(), array.end(), low);
+			if (at == array.end() || *at != low) return;
+			array.erase(at);
+			count--;
+		}
+
+		int NextFrom(uint32_t low) const {
+			if (bits.empty()) {
+				auto at = std::lower_bound(array.begin(), array.end(), low);
+				return at == array.end() ? -1 : *at;
+			}
+			size_t word = low >> 6;
+			uint64_t rest = bits[word] & (~0ULL << (low & 63));
+			while (!rest) {
+				if (++word == bits.size()) return -1;
+				rest = bits[word];
+			}
+			return (int)(word * 64) + PopCount((rest & (0 - rest)) - 1);
+		}
+
+		void ToBits() {
+			bits.assign(1024, 0);
+			for (uint16_t low : array) bits[low >> 6] |= 1ULL << (low & 63);
+			std::vector<uint16_t>().swap(array);
+		}
+
+		void ToArray() {
+			array.clear();
+			array.reserve(count);
+			for (size_t word = 0; word < bits.size(); word++) {
+				for (uint64_t rest = bits[word]; rest; rest &= rest - 1) {
+					array.push_back((uint16_t)(word * 64 + PopCount((rest & (0 - rest)) - 1)));
+				}
+			}
+			std::vector<uint64_t>().swap(bits);
+		}
+
+		// Count a bitset and switch to an array if that is smaller
+		void Settle() {
+			count = 0;
+			for (uint64_t word : bits) count += PopCount(word);
+			if (count <= kArrayMax) ToArray();
+		}
+
+		static Container And(const Container& a, const Container& b) {
+			Container result;
+			result.key = a.key;
+			if (!a.bits.empty() && !b.bits.empty()) {
+				result.bits.resize(1024);
+				for (size_t w = 0; w < 1024; w++) result.bits[w] = a.bits[w] & b.bits[w];
+				result.Settle();
+			} else if (a.bits.empty() && b.bits.empty()) {
+				std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+					std::back_inserter(result.array));
+				result.count = (uint32_t)result.array.size();
+			} else {
+				const Container& list = a.bits.empty() ? a : b;
+				const Container& set = a.bits.empty() ? b : a;
+				for (uint16_t low : list.array) {
+					if (set.Contains(low)) result.array.push_back(low);
+				}
+				result.count = (uint32_t)result.array.size();
+			}
+			return result;
+		}
+
+		static Container Or(const Container& a, const Container& b) {
+			Container result;
+			result.key = a.key;
+			if (a.bits.empty() && b.bits.empty() && a.count + b.count <= kArrayMax) {
+				std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+					std::back_inserter(result.array));
+				result.count = (uint32_t)result.array.size();
+				return result;
+			}
+			result.bits.assign(1024, 0);
+			for (const Container* side : {&a, &b}) {
+				if (!side->bits.empty()) {
+					for (size_t w = 0; w < 1024; w++) result.bits[w] |= side->bits[w];
+				} else {
+					for (uint16_t low : side->array) result.bits[low >> 6] |= 1ULL << (low & 63);
+				}
+			}
+			result.Settle();
+			return result;
+		}
+
+		static Container AndNot(const Container& a, const Container& b) {
+			Container result;
+			result.key = a.key;
+			if (!a.bits.empty()) {
+				result.bits = a.bits;
+				if (!b.bits.empty()) {
+					for (size_t w = 0; w < 1024; w++) result.bits[w] &= ~b.bits[w];
+				} else {
+					for (uint16_t low : b.array) result.bits[low >> 6] &= ~(1ULL << (low & 63));
+				}
+				result.Settle();
+				return result;
+			}
+			for (uint16_t low : a.array) {
+				if (!b.Contains(low)) result.array.push_back(low);
+			}
+			result.count = (uint32_t)result.array.size();
+			return result;
+		}
+	};
+
+	std::vector<Container>::iterator LowerBound(uint16_t key) {
+		return std::lower_bound(m_containers.begin(), m_containers.end(), key,
+			[](const Container& container, uint16_t k) { return container.key < k; });
+	}
+
+	std::vector<Container>::const_iterator LowerBound(uint16_t key) const {
+		return std::lower_bound(m_containers.begin(), m_containers.end(), key,
+			[](const Container& container, uint16_t k) { return container.key < k; });
+	}
+
+	const Container* Find(uint16_t key) const {
+		auto at = LowerBound(key);
+		return at != m_containers.end() && at->key == key ? &*at : nullptr;
+	}
+
+	std::vector<Container> m_containers;  // by key
+};
+
+#endif // OBSIDIAN_DOC_BITMAP_H
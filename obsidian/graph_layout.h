@@ -0,0 +1,430 @@
+// graph_layout.h - Force-directed layout of the link graph on worker threads
+//
+// Each simulation step builds a quadtree over the current positions and
+// computes repulsion with the Barnes-Hut approximation (distant groups of
+// nodes act as one mass at their centre), so a step is O(n log n) instead of
+// O(n^2). Springs pull linked notes together and a weak gravity keeps
+// disconnected parts on screen. Forces are summed per node from a CSR
+// adjacency list, so the worker threads never write to the same node.
+//
+// Positions are double-buffered: the simulation writes the back frame and
+// publishes it with a pointer swap. Each frame counts the readers holding it;
+// while a reader still holds the back frame, the simulation writes into a
+// fresh one instead.
+#ifndef OBSIDIAN_GRAPH_LAYOUT_H
+#define OBSIDIAN_GRAPH_LAYOUT_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct GraphEdge {
+	uint32_t a;
+	uint32_t b;
+};
+
+struct GraphFrame {
+	std::vector<float> xy;  // x0, y0, x1, y1, ...
+	uint64_t step = 0;
+	float minX = 0, minY = 0, maxX = 0, maxY = 0;
+};
+
+class GraphLayout {
+public:
+	GraphLayout() = default;
+	GraphLayout(const GraphLayout&) = delete;
+	GraphLayout& operator=(const GraphLayout&) = delete;
+	~GraphLayout() { Stop(); }
+
+	// Lay out `nodeCount` nodes joined by `edges`, starting from a spiral
+	void Start(size_t nodeCount, const std::vector<GraphEdge>& edges, int threads) {
+		Stop();
+		m_count = nodeCount;
+		m_threads = std::max(1, threads);
+		BuildAdjacency(edges);
+
+		m_x.resize(nodeCount);
+		m_y.resize(nodeCount);
+		m_vx.assign(nodeCount, 0.0f);
+		m_vy.assign(nodeCount, 0.0f);
+		for (size_t i = 0; i < nodeCount; i++) {
+			// Phyllotaxis spiral: evenly spread, no two nodes on the same spot
+			float radius = 10.0f * std::sqrt(0.5f + (float)i);
+			float angle = (float)i * 2.39996323f;
+			m_x[i] = radius * std::cos(angle);
+			m_y[i] = radius * std::sin(angle);
+		}
+		m_front = std::make_shared<Slot>();
+		m_back = std::make_shared<Slot>();
+		Publish(0);
+
+		m_alpha = 1.0f;
+		m_stopping = false;
+		m_simulation = std::thread(&GraphLayout::Run, this);
+	}
+
+	void Stop() {
+		if (!m_simulation.joinable()) return;
+		m_stopping = true;
+		{
+			std::lock_guard<std::mutex> lock(m_wakeMutex);
+			m_wake.notify_all();
+		}
+		m_simulation.join();
+	}
+
+	// Heat the simulation up again, e.g. after the user dragged a node
+	void Reheat(float alpha = 0.3f) {
+		std::lock_guard<std::mutex> lock(m_wakeMutex);
+		m_alpha = std::max(m_alpha.load(), alpha);
+		m_wake.notify_all();
+	}
+
+	// Latest published positions; safe to hold while the layout keeps running
+	std::shared_ptr<const GraphFrame> Frame() const {
+		std::lock_guard<std::mutex> lock(m_frameMutex);
+		std::shared_ptr<Slot> slot = m_front;
+		if (!slot) return nullptr;
+		slot->readers.fetch_add(1, std::memory_order_relaxed);
+		return std::shared_ptr<const GraphFrame>(&slot->frame,
+			[slot](const GraphFrame*) { slot->readers.fetch_sub(1, std::memory_order_release); });
+	}
+
+	bool IsSettled() const { return m_alpha < kAlphaMin; }
+	size_t Degree(size_t node) const { return m_offsets[node + 1] - m_offsets[node]; }
+
+	// Approximate bytes held: per node the adjacency offset, position,
+	// velocity, quadtree order and two published frames, plus the neighbour
+	// lists and about two quadtree cells per node. Only sizes fixed by
+	// Start() are read, so it is safe while the simulation runs.
+	size_t MemoryUsage() const {
+		size_t perNode = sizeof(uint32_t) * 2 + sizeof(float) * 4 + sizeof(float) * 2 * 2 + sizeof(Cell) * 2;
+		return sizeof(*this) + m_count * perNode + m_neighbours.size() * sizeof(uint32_t);
+	}
+
+	// Pin a node at a position (dragging); pass node = -1 to release
+	void Pin(int node, float x, float y) {
+		std::lock_guard<std::mutex> lock(m_pinMutex);
+		m_pinned = node;
+		m_pinX = x;
+		m_pinY = y;
+	}
+
+private:
+	// A frame and the readers holding it. Readers are only added to the
+	// front frame, under m_frameMutex, so once the back frame's count reaches
+	// zero it stays there, and the release/acquire pair orders the readers'
+	// last reads before the simulation's next writes.
+	struct Slot {
+		GraphFrame frame;
+		std::atomic<int> readers{0};
+	};
+	static constexpr float kAlphaMin = 0.002f;
+	static constexpr float kAlphaDecay = 0.985f;
+	static constexpr float kTheta = 0.9f;          // Barnes-Hut opening angle
+	static constexpr float kRepulsion = 900.0f;
+	static constexpr float kSpringLength = 40.0f;
+	static constexpr float kSpring = 0.06f;
+	static constexpr float kGravity = 0.01f;
+	static constexpr float kDamping = 0.6f;
+	static constexpr int kLeafSize = 8;
+
+	struct Cell {
+		float cx, cy;     // centre of mass
+		float mass;
+		float size;       // side length of the square
+		int32_t child;    // first of four children, -1 for a leaf
+		uint32_t begin;   // leaf: range in m_order
+		uint32_t end;
+	};
+
+	void BuildAdjacency(const std::vector<GraphEdge>& edges) {
+		m_offsets.assign(m_count + 1, 0);
+		for (const GraphEdge& edge : edges) {
+			if (edge.a == edge.b || edge.a >= m_count || edge.b >= m_count) continue;
+			m_offsets[edge.a + 1]++;
+			m_offsets[edge.b + 1]++;
+		}
+		for (size_t i = 0; i < m_count; i++) m_offsets[i + 1] += m_offsets[i];
+		m_neighbours.assign(m_offsets[m_count], 0);
+		std::vector<uint32_t> fill(m_offsets.begin(), m_offsets.end() - 1);
+		for (const GraphEdge& edge : edges) {
+			if (edge.a == edge.b || edge.a >= m_count || edge.b >= m_count) continue;
+			m_neighbours[fill[edge.a]++] = edge.b;
+			m_neighbours[fill[edge.b]++] = edge.a;
+		}
+	}
+
+	void Run() {
+		std::vector<std::thread> workers;
+		for (int t = 1; t < m_threads; t++) workers.emplace_back(&GraphLayout::Worker, this, t);
+
+		uint64_t step = 0;
+		while (!m_stopping) {
+			if (m_alpha < kAlphaMin) {
+				std::unique_lock<std::mutex> lock(m_wakeMutex);
+				m_wake.wait(lock, [this] { return m_stopping || m_alpha >= kAlphaMin; });
+				continue;
+			}
+			BuildTree();
+			RunPhase(PHASE_FORCES);
+			ApplyPin();
+			Publish(++step);
+			m_alpha = m_alpha * kAlphaDecay;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_phaseMutex);
+			m_phase = PHASE_EXIT;
+			m_phaseGeneration++;
+		}
+		m_phaseStart.notify_all();
+		for (std::thread& worker : workers) worker.join();
+	}
+
+	enum Phase { PHASE_NONE, PHASE_FORCES, PHASE_EXIT };
+
+	// Run one phase on all threads (the simulation thread takes slice 0)
+	void RunPhase(Phase phase) {
+		{
+			std::lock_guard<std::mutex> lock(m_phaseMutex);
+			m_phase = phase;
+			m_pending = m_threads - 1;
+			m_phaseGeneration++;
+		}
+		m_phaseStart.notify_all();
+		Slice(0);
+		std::unique_lock<std::mutex> lock(m_phaseMutex);
+		m_phaseDone.wait(lock, [this] { return m_pending == 0; });
+	}
+
+	void Worker(int slice) {
+		uint64_t seen = 0;
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(m_phaseMutex);
+				m_phaseStart.wait(lock, [&] { return m_phaseGeneration != seen; });
+				seen = m_phaseGeneration;
+				if (m_phase == PHASE_EXIT) return;
+			}
+			Slice(slice);
+			std::lock_guard<std::mutex> lock(m_phaseMutex);
+			if (--m_pending == 0) m_phaseDone.notify_one();
+		}
+	}
+
+	// Forces and integration for the nodes of one slice
+	void Slice(int slice) {
+		size_t per = (m_count + m_threads - 1) / m_threads;
+		size_t begin = std::min(m_count, per * slice);
+		size_t end = std::min(m_count, begin + per);
+		float alpha = m_alpha;
+		std::vector<int32_t> stack;
+		stack.reserve(64);
+
+		for (size_t i = begin; i < end; i++) {
+			float fx = 0, fy = 0;
+			Repulsion(i, fx, fy, stack);
+
+			for (uint32_t k = m_offsets[i]; k < m_offsets[i + 1]; k++) {
+				uint32_t j = m_neighbours[k];
+				float dx = m_x[j] - m_x[i];
+				float dy = m_y[j] - m_y[i];
+				float d = std::sqrt(dx * dx + dy * dy) + 0.01f;
+				float pull = kSpring * (d - kSpringLength) / d;
+				fx += dx * pull;
+				fy += dy * pull;
+			}
+			fx -= m_x[i] * kGravity;
+			fy -= m_y[i] * kGravity;
+
+			m_vx[i] = (m_vx[i] + fx * alpha) * kDamping;
+			m_vy[i] = (m_vy[i] + fy * alpha) * kDamping;
+		}
+		// Positions move only after every node has read them this step
+		BarrierAndMove(begin, end);
+	}
+
+	void BarrierAndMove(size_t begin, size_t end) {
+		{
+			std::unique_lock<std::mutex> lock(m_barrierMutex);
+			uint64_t generation = m_barrierGeneration;
+			if (++m_barrierCount == m_threads) {
+				m_barrierCount = 0;
+				m_barrierGeneration++;
+				m_barrier.notify_all();
+			} else {
+				m_barrier.wait(lock, [&] { return m_barrierGeneration != generation; });
+			}
+		}
+		for (size_t i = begin; i < end; i++) {
+			m_x[i] += m_vx[i];
+			m_y[i] += m_vy[i];
+		}
+	}
+
+	void Repulsion(size_t i, float& fx, float& fy, std::vector<int32_t>& stack) const {
+		if (m_cells.empty()) return;
+		float x = m_x[i], y = m_y[i];
+		stack.clear();
+		stack.push_back(0);
+		while (!stack.empty()) {
+			const Cell& cell = m_cells[stack.back()];
+			stack.pop_back();
+			float dx = x - cell.cx;
+			float dy = y - cell.cy;
+			float d2 = dx * dx + dy * dy;
+			if (cell.child >= 0 && cell.size * cell.size >= kTheta * kTheta * d2) {
+				for (int c = 0; c < 4; c++) {
+					if (m_cells[cell.child + c].mass > 0) stack.push_back(cell.child + c);
+				}
+				continue;
+			}
+			if (cell.child < 0 && cell.size * cell.size >= kTheta * kTheta * d2) {
+				// Near leaf: exact forces from its nodes
+				for (uint32_t k = cell.begin; k < cell.end; k++) {
+					uint32_t j = m_order[k];
+					if (j == i) continue;
+					float ex = x - m_x[j];
+					float ey = y - m_y[j];
+					float e2 = ex * ex + ey * ey + 1.0f;
+					fx += ex * kRepulsion / e2;
+					fy += ey * kRepulsion / e2;
+				}
+				continue;
+			}
+			float push = kRepulsion * cell.mass / (d2 + 1.0f);
+			fx += dx * push;
+			fy += dy * push;
+		}
+	}
+
+	void BuildTree() {
+		m_cells.clear();
+		if (m_count == 0) return;
+		m_order.resize(m_count);
+		float minX = m_x[0], maxX = m_x[0], minY = m_y[0], maxY = m_y[0];
+		for (size_t i = 0; i < m_count; i++) {
+			m_order[i] = (uint32_t)i;
+			minX = std::min(minX, m_x[i]);
+			maxX = std::max(maxX, m_x[i]);
+			minY = std::min(minY, m_y[i]);
+			maxY = std::max(maxY, m_y[i]);
+		}
+		float size = std::max(maxX - minX, maxY - minY) + 1.0f;
+		m_cells.push_back(Cell());
+		Split(0, 0, (uint32_t)m_count, minX, minY, size, 0);
+	}
+
+	// Partition m_order[begin, end) into the four quadrants of the square
+	void Split(int32_t index, uint32_t begin, uint32_t end, float x0, float y0, float size, int depth) {
+		float mass = 0, cx = 0, cy = 0;
+		for (uint32_t k = begin; k < end; k++) {
+			cx += m_x[m_order[k]];
+			cy += m_y[m_order[k]];
+		}
+		mass = (float)(end - begin);
+		Cell cell;
+		cell.mass = mass;
+		cell.cx = mass > 0 ? cx / mass : x0;
+		cell.cy = mass > 0 ? cy / mass : y0;
+		cell.size = size;
+		cell.child = -1;
+		cell.begin = begin;
+		cell.end = end;
+		if (end - begin <= (uint32_t)kLeafSize || depth > 24) {
+			m_cells[index] = cell;
+			return;
+		}
+
+		float half = size / 2;
+		float mx = x0 + half, my = y0 + half;
+		uint32_t* first = m_order.data() + begin;
+		uint32_t* last = m_order.data() + end;
+		uint32_t* splitY = std::partition(first, last, [&](uint32_t n) { return m_y[n] < my; });
+		uint32_t* splitX0 = std::partition(first, splitY, [&](uint32_t n) { return m_x[n] < mx; });
+		uint32_t* splitX1 = std::partition(splitY, last, [&](uint32_t n) { return m_x[n] < mx; });
+		uint32_t bounds[5] = {begin, (uint32_t)(splitX0 - m_order.data()), (uint32_t)(splitY - m_order.data()),
+			(uint32_t)(splitX1 - m_order.data()), end};
+
+		cell.child = (int32_t)m_cells.size();
+		m_cells[index] = cell;
+		m_cells.resize(m_cells.size() + 4);
+		float ox[4] = {x0, mx, x0, mx};
+		float oy[4] = {y0, y0, my, my};
+		for (int c = 0; c < 4; c++) {
+			Split(cell.child + c, bounds[c], bounds[c + 1], ox[c], oy[c], half, depth + 1);
+		}
+	}
+
+	void ApplyPin() {
+		std::lock_guard<std::mutex> lock(m_pinMutex);
+		if (m_pinned < 0 || (size_t)m_pinned >= m_count) return;
+		m_x[m_pinned] = m_pinX;
+		m_y[m_pinned] = m_pinY;
+		m_vx[m_pinned] = m_vy[m_pinned] = 0;
+	}
+
+	void Publish(uint64_t step) {
+		// Reuse the back frame unless a reader still holds it
+		if (!m_back || m_back->readers.load(std::memory_order_acquire) != 0) m_back = std::make_shared<Slot>();
+		GraphFrame& frame = m_back->frame;
+		frame.xy.resize(m_count * 2);
+		frame.step = step;
+		frame.minX = frame.minY = 0;
+		frame.maxX = frame.maxY = 0;
+		for (size_t i = 0; i < m_count; i++) {
+			frame.xy[2 * i] = m_x[i];
+			frame.xy[2 * i + 1] = m_y[i];
+			if (i == 0 || m_x[i] < frame.minX) frame.minX = m_x[i];
+			if (i == 0 || m_x[i] > frame.maxX) frame.maxX = m_x[i];
+			if (i == 0 || m_y[i] < frame.minY) frame.minY = m_y[i];
+			if (i == 0 || m_y[i] > frame.maxY) frame.maxY = m_y[i];
+		}
+		std::lock_guard<std::mutex> lock(m_frameMutex);
+		std::swap(m_front, m_back);
+	}
+
+	size_t m_count = 0;
+	int m_threads = 1;
+	std::vector<uint32_t> m_offsets;
+	std::vector<uint32_t> m_neighbours;
+	std::vector<float> m_x, m_y, m_vx, m_vy;
+	std::vector<uint32_t> m_order;
+	std::vector<Cell> m_cells;
+
+	std::thread m_simulation;
+	std::atomic<bool> m_stopping{false};
+	std::atomic<float> m_alpha{0.0f};
+	std::mutex m_wakeMutex;
+	std::condition_variable m_wake;
+
+	std::mutex m_phaseMutex;
+	std::condition_variable m_phaseStart;
+	std::condition_variable m_phaseDone;
+	Phase m_phase = PHASE_NONE;
+	uint64_t m_phaseGeneration = 0;
+	int m_pending = 0;
+
+	std::mutex m_barrierMutex;
+	std::condition_variable m_barrier;
+	int m_barrierCount = 0;
+	uint64_t m_barrierGeneration = 0;
+
+	mutable std::mutex m_frameMutex;
+	std::shared_ptr<Slot> m_front;
+	std::shared_ptr<Slot> m_back;
+
+	std::mutex m_pinMutex;
+	int m_pinned = -1;
+	float m_pinX = 0, m_pinY = 0;
+};
+
+#endif // OBSIDIAN_GRAPH_LAYOUT_H
@@ -0,0 +1,297 @@
+// graph_view.h - Custom-painted pane showing the note link graph
+//
+// The layout runs in GraphLayout on worker threads; this panel only draws the
+// latest published frame. Painting is double-buffered and scaled by level of
+// detail: everything off screen is culled, nodes shrink to single-pixel
+// squares when zoomed out, edges are drawn only while they are long enough to
+// see (and are capped per frame), and labels appear only when zoomed in, for
+// the best-connected notes first.
+#ifndef OBSIDIAN_GRAPH_VIEW_H
+#define OBSIDIAN_GRAPH_VIEW_H
+
+#include <wx/wx.h>
+#include <wx/dcbuffer.h>
+#include <wx/graphics.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+#include "graph_layout.h"
+
+class GraphView : public wxPanel {
+public:
+	explicit GraphView(wxWindow* parent) : wxPanel(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize,
+		wxFULL_REPAINT_ON_RESIZE), m_timer(this), m_scale(1.0), m_offsetX(0), m_offsetY(0),
+		m_autoFit(true), m_highlight(-1), m_dragNode(-1), m_panning(false), m_paintedStep(~0ULL) {
+		SetBackgroundStyle(wxBG_STYLE_PAINT);
+		Bind(wxEVT_PAINT, &GraphView::OnPaint, this);
+		Bind(wxEVT_TIMER, [this](wxTimerEvent&) { OnTick(); });
+		Bind(wxEVT_MOUSEWHEEL, &GraphView::OnWheel, this);
+		Bind(wxEVT_LEFT_DOWN, &GraphView::OnLeftDown, this);
+		Bind(wxEVT_LEFT_UP, &GraphView::OnLeftUp, this);
+		Bind(wxEVT_MOTION, &GraphView::OnMotion, this);
+		Bind(wxEVT_LEFT_DCLICK, &GraphView::OnDoubleClick, this);
+		Bind(wxEVT_MOUSE_CAPTURE_LOST, [this](wxMouseCaptureLostEvent&) { EndDrag(); });
+		m_timer.Start(kFrameMs);
+	}
+
+	~GraphView() {
+		m_timer.Stop();
+		m_layout.Stop();
+	}
+
+	// Replace the graph and start laying it out
+	void SetGraph(std::vector<wxString> labels, const std::vector<GraphEdge>& edges) {
+		m_labels = std::move(labels);
+		m_edges = edges;
+		m_highlight = -1;
+		m_autoFit = true;
+		m_paintedStep = ~0ULL;
+		int threads = wxMax(1, (int)std::thread::hardware_concurrency() - 1);
+		m_layout.Start(m_labels.size(), m_edges, threads);
+
+		// Labels are drawn for the best-connected notes first
+		m_byDegree.resize(m_labels.size());
+		std::iota(m_byDegree.begin(), m_byDegree.end(), 0);
+		std::stable_sort(m_byDegree.begin(), m_byDegree.end(),
+			[this](size_t a, size_t b) { return m_layout.Degree(a) > m_layout.Degree(b); });
+		Refresh(false);
+	}
+
+	// Called with the node index when a node is double-clicked
+	void SetActivateCallback(std::function<void(size_t)> callback) { m_onActivate = callback; }
+
+	// Approximate bytes held by the graph and its layout
+	size_t MemoryUsage() const {
+		size_t bytes = m_layout.MemoryUsage() + m_edges.capacity() * sizeof(GraphEdge) +
+			m_byDegree.capacity() * sizeof(size_t) + m_labels.capacity() * sizeof(wxString);
+		for (const wxString& label : m_labels) bytes += (label.length() + 1) * sizeof(wxChar);
+		return bytes;
+	}
+
+	// Mark the node of the open note (-1 for none)
+	void Highlight(int node) {
+		m_highlight = node;
+		Refresh(false);
+	}
+
+private:
+	static const int kFrameMs = 16;
+	static const int kMaxEdgesPerFrame = 40000;
+	static const int kMaxLabels = 250;
+	static constexpr double kLabelScale = 0.5;
+	static constexpr double kMinEdgePixels = 1.5;
+
+	double NodeRadius(size_t node) const {
+		return 3.0 + std::sqrt((double)m_layout.Degree(node));
+	}
+
+	void ToScreen(float x, float y, double& sx, double& sy) const {
+		sx = x * m_scale + m_offsetX;
+		sy = y * m_scale + m_offsetY;
+	}
+
+	// Whether the segment from a to b crosses the w x h window: not when both
+	// ends lie beyond the same side, nor when all four corners of the window
+	// lie on one side of its line
+	static bool SegmentVisible(double ax, double ay, double bx, double by, double w, double h) {
+		if ((ax < 0 && bx < 0) || (ay < 0 && by < 0) || (ax > w && bx > w) || (ay > h && by > h)) return false;
+		double dx = bx - ax, dy = by - ay;
+		auto side = [&](double x, double y) { return dx * (y - ay) - dy * (x - ax); };
+		double s0 = side(0, 0), s1 = side(w, 0), s2 = side(0, h), s3 = side(w, h);
+		return !((s0 > 0 && s1 > 0 && s2 > 0 && s3 > 0) || (s0 < 0 && s1 < 0 && s2 < 0 && s3 < 0));
+	}
+
+	void FitToFrame(const GraphFrame& frame) {
+		wxSize size = GetClientSize();
+		double w = std::max(1.0f, frame.maxX - frame.minX);
+		double h = std::max(1.0f, frame.maxY - frame.minY);
+		m_scale = std::min(size.x / w, size.y / h) * 0.9;
+		if (m_scale <= 0) m_scale = 1.0;
+		m_offsetX = size.x / 2.0 - (frame.minX + frame.maxX) / 2.0 * m_scale;
+		m_offsetY = size.y / 2.0 - (frame.minY + frame.maxY) / 2.0 * m_scale;
+	}
+
+	void OnTick() {
+		if (!IsShownOnScreen() || m_labels.empty()) return;
+		std::shared_ptr<const GraphFrame> frame = m_layout.Frame();
+		if (frame && frame->step != m_paintedStep) Refresh(false);
+	}
+
+	void OnPaint(wxPaintEvent&) {
+		wxAutoBufferedPaintDC dc(this);
+		dc.SetBackground(wxBrush(wxColour(250, 250, 250)));
+		dc.Clear();
+		std::shared_ptr<const GraphFrame> frame = m_layout.Frame();
+		if (!frame || frame->xy.size() != m_labels.size() * 2 || m_labels.empty()) {
+			dc.DrawText("Open a vault to see how its notes link together.", 10, 10);
+			return;
+		}
+		m_paintedStep = frame->step;
+		if (m_autoFit) FitToFrame(*frame);
+
+		std::unique_ptr<wxGraphicsContext> gc(wxGraphicsContext::Create(dc));
+		if (!gc) return;
+		wxSize size = GetClientSize();
+		const std::vector<float>& xy = frame->xy;
+		auto visible = [&](double sx, double sy, double margin) {
+			return sx >= -margin && sy >= -margin && sx <= size.x + margin && sy <= size.y + margin;
+		};
+
+		// Edges: culled, skipped while too short to see, capped per frame
+		bool drawEdges = m_scale * 40.0 >= kMinEdgePixels;
+		wxGraphicsPath edges = gc->CreatePath();
+		wxGraphicsPath highlighted = gc->CreatePath();
+		int drawn = 0;
+		for (const GraphEdge& edge : m_edges) {
+			bool mark = (int)edge.a == m_highlight || (int)edge.b == m_highlight;
+			if (!drawEdges && !mark) continue;
+			if (!mark && drawn >= kMaxEdgesPerFrame) continue;
+			double ax, ay, bx, by;
+			ToScreen(xy[2 * edge.a], xy[2 * edge.a + 1], ax, ay);
+			ToScreen(xy[2 * edge.b], xy[2 * edge.b + 1], bx, by);
+			if (!SegmentVisible(ax, ay, bx, by, size.x, size.y)) continue;
+			wxGraphicsPath& path = mark ? highlighted : edges;
+			path.MoveToPoint(ax, ay);
+			path.AddLineToPoint(bx, by);
+			drawn++;
+		}
+		gc->SetPen(wxPen(wxColour(200, 200, 210), 1));
+		gc->StrokePath(edges);
+		gc->SetPen(wxPen(wxColour(230, 140, 40), 1));
+		gc->StrokePath(highlighted);
+
+		// Nodes: circles when big enough, single squares otherwise
+		wxGraphicsPath nodes = gc->CreatePath();
+		for (size_t i = 0; i < m_labels.size(); i++) {
+			double sx, sy;
+			ToScreen(xy[2 * i], xy[2 * i + 1], sx, sy);
+			double r = NodeRadius(i) * m_scale;
+			if (!visible(sx, sy, r)) continue;
+			if (r < 1.5) {
+				nodes.AddRectangle(sx - 1, sy - 1, 2, 2);
+			} else {
+				nodes.AddCircle(sx, sy, r);
+			}
+		}
+		gc->SetPen(*wxTRANSPARENT_PEN);
+		gc->SetBrush(wxBrush(wxColour(110, 110, 130)));
+		gc->FillPath(nodes);
+		if (m_highlight >= 0 && (size_t)m_highlight < m_labels.size()) {
+			double sx, sy;
+			ToScreen(xy[2 * m_highlight], xy[2 * m_highlight + 1], sx, sy);
+			double r = std::max(3.0, NodeRadius(m_highlight) * m_scale);
+			gc->SetBrush(wxBrush(wxColour(230, 140, 40)));
+			gc->DrawEllipse(sx - r, sy - r, 2 * r, 2 * r);
+		}
+
+		// Labels: only when zoomed in, best-connected notes first
+		if (m_scale >= kLabelScale) {
+			gc->SetFont(GetFont(), wxColour(60, 60, 60));
+			int labels = 0;
+			for (size_t i : m_byDegree) {
+				if (labels >= kMaxLabels) break;
+				double sx, sy;
+				ToScreen(xy[2 * i], xy[2 * i + 1], sx, sy);
+				if (!visible(sx, sy, 0)) continue;
+				gc->DrawText(m_labels[i], sx + NodeRadius(i) * m_scale + 2, sy - 6);
+				labels++;
+			}
+		}
+	}
+
+	int HitTest(const wxPoint& point) const {
+		std::shared_ptr<const GraphFrame> frame = m_layout.Frame();
+		if (!frame || frame->xy.size() != m_labels.size() * 2) return -1;
+		int best = -1;
+		double bestDistance = 0;
+		for (size_t i = 0; i < m_labels.size(); i++) {
+			double sx, sy;
+			ToScreen(frame->xy[2 * i], frame->xy[2 * i + 1], sx, sy);
+			double r = std::max(4.0, NodeRadius(i) * m_scale) + 2;
+			double d = (sx - point.x) * (sx - point.x) + (sy - point.y) * (sy - point.y);
+			if (d <= r * r && (best < 0 || d < bestDistance)) {
+				best = (int)i;
+				bestDistance = d;
+			}
+		}
+		return best;
+	}
+
+	void OnWheel(wxMouseEvent& event) {
+		// Zoom around the mouse position
+		double factor = event.GetWheelRotation() > 0 ? 1.2 : 1 / 1.2;
+		wxPoint at = event.GetPosition();
+		m_offsetX = at.x - (at.x - m_offsetX) * factor;
+		m_offsetY = at.y - (at.y - m_offsetY) * factor;
+		m_scale *= factor;
+		m_autoFit = false;
+		Refresh(false);
+	}
+
+	void OnLeftDown(wxMouseEvent& event) {
+		SetFocus();
+		m_dragStart = event.GetPosition();
+		m_dragNode = HitTest(event.GetPosition());
+		m_panning = m_dragNode < 0;
+		CaptureMouse();
+	}
+
+	void OnMotion(wxMouseEvent& event) {
+		if (!HasCapture()) return;
+		wxPoint at = event.GetPosition();
+		if (m_panning) {
+			m_offsetX += at.x - m_dragStart.x;
+			m_offsetY += at.y - m_dragStart.y;
+			m_dragStart = at;
+			m_autoFit = false;
+		} else if (m_dragNode >= 0) {
+			// Pull the node along and let its neighbours follow
+			m_layout.Pin(m_dragNode, (float)((at.x - m_offsetX) / m_scale), (float)((at.y - m_offsetY) / m_scale));
+			m_layout.Reheat();
+			m_autoFit = false;
+		}
+		Refresh(false);
+	}
+
+	void OnLeftUp(wxMouseEvent&) {
+		if (HasCapture()) ReleaseMouse();
+		EndDrag();
+	}
+
+	void EndDrag() {
+		if (m_dragNode >= 0) m_layout.Pin(-1, 0, 0);
+		m_dragNode = -1;
+		m_panning = false;
+	}
+
+	void OnDoubleClick(wxMouseEvent& event) {
+		int node = HitTest(event.GetPosition());
+		if (node >= 0 && m_onActivate) m_onActivate((size_t)node);
+	}
+
+	GraphLayout m_layout;
+	wxTimer m_timer;
+	std::vector<wxString> m_labels;
+	std::vector<GraphEdge> m_edges;
+	std::vector<size_t> m_byDegree;
+	std::function<void(size_t)> m_onActivate;
+
+	// View transform: screen = world * m_scale + offset
+	double m_scale;
+	double m_offsetX;
+	double m_offsetY;
+	bool m_autoFit;
+
+	int m_highlight;
+	int m_dragNode;
+	bool m_panning;
+	wxPoint m_dragStart;
+	uint64_t m_paintedStep;
+};
+
+#endif // OBSIDIAN_GRAPH_VIEW_H
@@ -0,0 +1,264 @@
+// heading_index.h - Headings of the open note, kept current from edits
+//
+// The index remembers only the lines that can change the outline: ATX heading
+// lines, code fence lines and frontmatter delimiters ("marks"), sorted by line.
+// An edit re-reads just the lines it touched and shifts the marks after them;
+// typing inside a paragraph, the common case, touches no mark and costs one
+// line. Whether a heading-looking line really is a heading depends on the
+// fences and frontmatter above it, so when a mark does change the headings are
+// resolved again by walking the marks, never the text.
+//
+// After each update ChangedLines() tells which lines may now sit in a
+// different section, which is all the editor needs to refresh fold levels.
+#ifndef OBSIDIAN_HEADING_INDEX_H
+#define OBSIDIAN_HEADING_INDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "markdown_lexer.h"
+
+struct Heading {
+	int line;
+	int level;          // 1..6
+	std::string title;  // without the hashes
+};
+
+class HeadingIndex {
+public:
+	// Raw bytes of a line without its end-of-line characters
+	typedef std::function<std::string(int line)> LineReader;
+
+	HeadingIndex() : m_version(0), m_changedFirst(0), m_changedLast(-1) {}
+
+	void Clear() {
+		m_marks.clear();
+		Resolve(0, -1);
+	}
+
+	// Index a whole document
+	void Rebuild(const char* text, size_t len) {
+		m_marks.clear();
+		size_t pos = 0;
+		int line = 0;
+		while (pos < len) {
+			const char* nl = (const char*)memchr(text + pos, '\n', len - pos);
+			size_t eol = nl ? (size_t)(nl - text) : len;
+			Mark mark;
+			if (Classify(text + pos, eol - pos, line, mark)) m_marks.push_back(std::move(mark));
+			pos = nl ? eol + 1 : len;
+			line++;
+		}
+		Resolve(0, line);
+	}
+
+	// Text was inserted or deleted on `line`, adding `linesAdded` lines
+	// (negative for deletions). The lines from `line` to `line + linesAdded`
+	// are read again; everything after them only moves.
+	void Edit(int line, int linesAdded, const LineReader& read) {
+		int oldLast = line + std::max(0, -linesAdded);
+		int newLast = line + std::max(0, linesAdded);
+
+		auto first = std::lower_bound(m_marks.begin(), m_marks.end(), line, ByLine());
+		auto after = std::upper_bound(first, m_marks.end(), oldLast, LineBefore());
+		std::vector<Mark> fresh;
+		for (int at = line; at <= newLast; at++) {
+			std::string text = read(at);
+			Mark mark;
+			if (Classify(text.data(), text.size(), at, mark)) fresh.push_back(std::move(mark));
+		}
+		bool same = (size_t)(after - first) == fresh.size();
+		for (size_t k = 0; same && k < fresh.size(); k++) {
+			const Mark& old = first[k];
+			same = old.line + (old.line > line ? linesAdded : 0) == fresh[k].line && old.Same(fresh[k]) &&
+				(fresh[k].line != 0 || old.line == 0);  // line 0 may open frontmatter
+		}
+
+		// Whatever follows the edit only moves
+		if (linesAdded != 0) {
+			for (auto it = after; it != m_marks.end(); ++it) it->line += linesAdded;
+			for (Heading& heading : m_headings) {
+				if (heading.line > line) heading.line += linesAdded;
+			}
+		}
+		if (same) {
+			for (size_t k = 0; k < fresh.size(); k++) first[k].line = fresh[k].line;
+			m_changedFirst = line;
+			m_changedLast = newLast;
+			return;
+		}
+
+		size_t at = first - m_marks.begin();
+		m_marks.erase(first, after);
+		m_marks.insert(m_marks.begin() + at, std::make_move_iterator(fresh.begin()),
+			std::make_move_iterator(fresh.end()));
+		Resolve(line, newLast);
+	}
+
+	const std::vector<Heading>& Headings() const { return m_headings; }
+
+	// Bumped whenever a heading appears, goes or changes level or title;
+	// not when headings merely move with inserted or deleted lines
+	uint64_t Version() const { return m_version; }
+
+	// Index of the heading whose section contains `line`, or -1 before the
+	// first heading
+	int HeadingAt(int line) const {
+		auto it = std::upper_bound(m_headings.begin(), m_headings.end(), line,
+			[](int l, const Heading& heading) { return l < heading.line; });
+		return (int)(it - m_headings.begin()) - 1;
+	}
+
+	// Lines whose section may have changed with the last update, inclusive;
+	// `last` may run past the end of the document
+	void ChangedLines(int& first, int& last) const {
+		first = m_changedFirst;
+		last = m_changedLast;
+	}
+
+private:
+	enum MarkKind {
+		MARK_HEADING,
+		MARK_FENCE,
+		MARK_DASHES,  // "---": opens frontmatter on line 0, closes it later
+		MARK_DOTS     // "...": closes frontmatter
+	};
+
+	struct Mark {
+		int line = 0;
+		MarkKind kind = MARK_HEADING;
+		int level = 0;        // heading level, or fence length
+		char fence = 0;       // '`' or '~'
+		bool opens = false;   // fence line can open a block
+		bool closes = false;  // fence line can close a block
+		std::string title;
+
+		bool Same(const Mark& other) const {
+			return kind == other.kind && level == other.level && fence == other.fence &&
+				opens == other.opens && closes == other.closes && title == other.title;
+		}
+	};
+
+	struct ByLine {
+		bool operator()(const Mark& mark, int line) const { return mark.line < line; }
+	};
+	struct LineBefore {
+		bool operator()(int line, const Mark& mark) const { return line < mark.line; }
+	};
+
+	// Whether the "---" on line 0 is closed in time to open frontmatter, as
+	// in MarkdownLexer::HasFrontmatter
+	bool FrontmatterCloses() const {
+		for (size_t i = 1; i < m_marks.size() && m_marks[i].line <= MarkdownLexer::kFrontmatterMaxLines; i++) {
+			if (m_marks[i].kind == MARK_DASHES || m_marks[i].kind == MARK_DOTS) return true;
+		}
+		return false;
+	}
+
+	// The same block rules as MarkdownLexer, reduced to what affects headings
+	static bool Classify(const char* s, size_t n, int line, Mark& mark) {
+		if (n && s[n - 1] == '\r') n--;
+		mark.line = line;
+		size_t trimmed = n;
+		while (trimmed && (s[trimmed - 1] == ' ' || s[trimmed - 1] == '\t')) trimmed--;
+		if (trimmed == 3 && memcmp(s, "---", 3) == 0) {
+			mark.kind = MARK_DASHES;
+			return true;
+		}
+		if (trimmed == 3 && memcmp(s, "...", 3) == 0) {
+			mark.kind = MARK_DOTS;
+			return true;
+		}
+
+		size_t indent = 0;
+		while (indent < n && s[indent] == ' ') indent++;
+		if (indent >= 4 || indent >= n) return false;
+		char c = s[indent];
+		if (c == '`' || c == '~') {
+			size_t run = 0;
+			while (indent + run < n && s[indent + run] == c) run++;
+			if (run < 3) return false;
+			size_t rest = indent + run;
+			mark.kind = MARK_FENCE;
+			mark.fence = c;
+			mark.level = (int)run;
+			mark.closes = rest >= trimmed;
+			mark.opens = c == '~' || memchr(s + rest, '`', n - rest) == nullptr;
+			return true;
+		}
+		if (c != '#') return false;
+		size_t hashes = 0;
+		while (indent + hashes < n && s[indent + hashes] == '#') hashes++;
+		size_t p = indent + hashes;
+		if (hashes > 6 || (p < n && s[p] != ' ' && s[p] != '\t')) return false;
+
+		// Title without the optional closing run of hashes
+		size_t end = trimmed;
+		size_t closing = end;
+		while (closing > p && s[closing - 1] == '#') closing--;
+		if (closing < end && (closing == p || s[closing - 1] == ' ' || s[closing - 1] == '\t')) end = closing;
+		while (p < end && (s[p] == ' ' || s[p] == '\t')) p++;
+		while (end > p && (s[end - 1] == ' ' || s[end - 1] == '\t')) end--;
+		mark.kind = MARK_HEADING;
+		mark.level = (int)hashes;
+		mark.title.assign(s + p, end - p);
+		return true;
+	}
+
+	// Walk the marks to find the real headings, then work out which lines
+	// changed section: from the first heading that differs (or `editFirst`)
+	// up to the first heading of the unchanged tail. m_headings must already
+	// be in the new line numbering.
+	void Resolve(int editFirst, int editLast) {
+		std::vector<Heading> headings;
+		bool frontmatter = false;
+		const Mark* fence = nullptr;
+		for (const Mark& mark : m_marks) {
+			if (frontmatter) {
+				if (mark.kind == MARK_DASHES || mark.kind == MARK_DOTS) frontmatter = false;
+			} else if (fence) {
+				if (mark.kind == MARK_FENCE && mark.fence == fence->fence && mark.level >= fence->level &&
+					mark.closes) fence = nullptr;
+			} else if (mark.kind == MARK_DASHES && mark.line == 0) {
+				frontmatter = FrontmatterCloses();
+			} else if (mark.kind == MARK_FENCE && mark.opens) {
+				fence = &mark;
+			} else if (mark.kind == MARK_HEADING) {
+				headings.push_back({mark.line, mark.level, mark.title});
+			}
+		}
+
+		auto same = [](const Heading& a, const Heading& b) { return a.line == b.line && a.level == b.level; };
+		size_t prefix = 0;
+		size_t common = std::min(headings.size(), m_headings.size());
+		while (prefix < common && same(headings[prefix], m_headings[prefix])) prefix++;
+		size_t suffix = 0;
+		while (suffix < common - prefix &&
+			same(headings[headings.size() - 1 - suffix], m_headings[m_headings.size() - 1 - suffix])) suffix++;
+
+		m_changedFirst = editFirst;
+		if (prefix < headings.size()) m_changedFirst = std::min(m_changedFirst, headings[prefix].line);
+		if (prefix < m_headings.size()) m_changedFirst = std::min(m_changedFirst, m_headings[prefix].line);
+		m_changedLast = suffix > 0 ? headings[headings.size() - suffix].line - 1 : INT32_MAX;
+		m_changedLast = std::max(m_changedLast, editLast);
+
+		bool titlesSame = headings.size() == m_headings.size();
+		for (size_t k = 0; titlesSame && k < headings.size(); k++) {
+			titlesSame = headings[k].level == m_headings[k].level && headings[k].title == m_headings[k].title;
+		}
+		if (!titlesSame) m_version++;
+		m_headings.swap(headings);
+	}
+
+	std::vector<Mark> m_marks;
+	std::vector<Heading> m_headings;
+	uint64_t m_version;
+	int m_changedFirst;
+	int m_changedLast;
+};
+
+#endif // OBSIDIAN_HEADING_INDEX_H
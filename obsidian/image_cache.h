@@ -0,0 +1,384 @@
+// image_cache.h - Background decode and thumbnail cache for embedded images
+//
+// The preview never decodes an attachment, nor even stats one, on the UI
+// thread. Lookup() either returns a bitmap of a thumbnail that is already
+// downscaled to preview width, or queues the image for the worker threads and
+// returns nothing so the caller can draw a placeholder. Workers stat the file,
+// read the on-disk thumbnail cache (keyed by path + mtime + width) or decode
+// and scale the original, then hand the image to the UI thread, which turns
+// it into a bitmap and keeps it in an LRU. Images that are missing or fail to
+// decode are remembered with the mtime the worker saw (none for a missing
+// file) and reported as broken instead of being queued on every paint.
+//
+// What the cache holds is checked again in the background: an entry looked
+// up more than kRecheckMs after its last check, and every entry on Recheck(),
+// is statted by a worker, and one whose file appeared, changed or went away
+// is loaded again and reported through the ready callback. The on-disk cache
+// is pruned to its budget, least recently used first, at startup and every
+// kPruneEvery thumbnails written.
+#ifndef OBSIDIAN_IMAGE_CACHE_H
+#define OBSIDIAN_IMAGE_CACHE_H
+
+#include <wx/wx.h>
+#include <wx/dir.h>
+#include <wx/filename.h>
+#include <wx/bitmap.h>
+#include <wx/image.h>
+#include <wx/log.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "content_hash.h"
+
+class ThumbnailCache {
+public:
+	ThumbnailCache(size_t memoryBudget = 64 * 1024 * 1024, int workers = 0)
+		: m_state(std::make_shared<State>()), m_memoryBudget(memoryBudget), m_memoryUsed(0) {
+		m_state->owner = this;
+		if (workers <= 0) {
+			workers = wxMax(1, (int)std::thread::hardware_concurrency() / 2);
+		}
+		for (int i = 0; i < workers; i++) {
+			m_workers.emplace_back(&ThumbnailCache::WorkerLoop, m_state);
+		}
+	}
+
+	ThumbnailCache(const ThumbnailCache&) = delete;
+	ThumbnailCache& operator=(const ThumbnailCache&) = delete;
+
+	~ThumbnailCache() {
+		m_state->owner = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(m_state->mutex);
+			m_state->stopping = true;
+			m_state->jobs.clear();
+		}
+		m_state->wake.notify_all();
+		for (std::thread& worker : m_workers) worker.join();
+		Clear();
+	}
+
+	// Directory for cached PNG thumbnails, created on first use and kept
+	// under `diskBudget` bytes
+	void SetCacheDir(const wxString& dir, uint64_t diskBudget = 256 * 1024 * 1024) {
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		m_state->cacheDir = dir;
+		m_state->diskBudget = diskBudget;
+		m_state->pruneDue = true;
+	}
+
+	// Called on the UI thread with the path of each image whose thumbnail
+	// becomes available, changes or fails
+	void SetReadyCallback(std::function<void(const wxString& path)> callback) {
+		m_state->onReady = callback;
+	}
+
+	// Returns the thumbnail of `path` at `width` when it is in memory, an
+	// empty bitmap (!IsOk()) when the image is missing or could not be
+	// decoded, or null after queueing it. The bitmap stays valid until the
+	// next call that may evict it, so copy it (cheaply: bitmaps share data).
+	const wxBitmap* Lookup(const wxString& path, int width) {
+		int64_t now = NowMs();
+		auto failed = m_failed.find(path);
+		if (failed != m_failed.end()) {
+			Failure& failure = failed->second;
+			if (now - failure.checked > kRecheckMs) {
+				failure.checked = now;
+				Queue(MakeKey(path, width), path, width, failure.stamp);
+			}
+			return &m_broken;
+		}
+
+		wxString key = MakeKey(path, width);
+		auto found = m_entries.find(key);
+		if (found != m_entries.end()) {
+			Entry& entry = found->second;
+			m_lru.splice(m_lru.begin(), m_lru, entry.lruPos);
+			if (now - entry.checked > kRecheckMs) {
+				entry.checked = now;
+				Queue(key, path, width, entry.stamp);
+			}
+			return &entry.bitmap;
+		}
+
+		Queue(key, path, width, kUnknown);
+		return nullptr;
+	}
+
+	// Check every image held, e.g. when the application is activated again
+	// and files may have changed behind it
+	void Recheck() {
+		int64_t now = NowMs();
+		for (auto& entry : m_entries) {
+			entry.second.checked = now;
+			Queue(entry.first, entry.second.path, entry.second.width, entry.second.stamp);
+		}
+		for (auto& failed : m_failed) {
+			failed.second.checked = now;
+			Queue(MakeKey(failed.first, failed.second.width), failed.first, failed.second.width, failed.second.stamp);
+		}
+	}
+
+	size_t MemoryUsed() const { return m_memoryUsed; }
+
+	void Clear() {
+		m_entries.clear();
+		m_failed.clear();
+		m_lru.clear();
+		m_memoryUsed = 0;
+	}
+
+private:
+	// Stamps are modification times in milliseconds; a missing file has
+	// kMissing, and a job that has not seen the file yet kUnknown
+	static const int64_t kMissing = -1;
+	static const int64_t kUnknown = -2;
+	// How long a held image is trusted before a lookup checks it again
+	static const int64_t kRecheckMs = 5000;
+	// Thumbnails written between prunes of the on-disk cache
+	static const int kPruneEvery = 64;
+
+	struct Job {
+		wxString key;
+		wxString path;
+		int width;
+		int64_t stamp;  // what the cache holds for the image, kUnknown if nothing
+	};
+
+	struct State {
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::vector<Job> jobs;
+		std::set<wxString> inFlight;
+		wxString cacheDir;
+		uint64_t diskBudget = 0;
+		int written = 0;         // thumbnails written since the last prune
+		bool pruneDue = false;
+		bool pruning = false;
+		bool stopping = false;
+		std::function<void(const wxString& path)> onReady;
+		// Only touched on the UI thread; cleared when the cache is destroyed
+		// so results still queued through CallAfter are dropped.
+		ThumbnailCache* owner = nullptr;
+	};
+
+	struct Entry {
+		wxBitmap bitmap;
+		size_t bytes;
+		wxString path;
+		int width;
+		int64_t stamp;
+		int64_t checked;  // NowMs() of the last check
+		std::list<wxString>::iterator lruPos;
+	};
+
+	struct Failure {
+		int64_t stamp;
+		int64_t checked;
+		int width;  // of the lookup that failed, to load it at when it appears
+	};
+
+	static int64_t NowMs() {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static wxString MakeKey(const wxString& path, int width) {
+		wxScopedCharBuffer utf8 = path.utf8_str();
+		unsigned long long h = ContentHash(utf8.data(), utf8.length());
+		return wxString::Format("%016llx-%d", h, width);
+	}
+
+	// Name of the thumbnail in the on-disk cache, which the mtime keeps
+	// apart from those of earlier versions of the file
+	static wxString DiskName(const Job& job, int64_t stamp) {
+		return wxString::Format("%s-%llx.png", job.key, (unsigned long long)stamp);
+	}
+
+	static int64_t Stamp(const wxString& path) {
+		wxFileName file(path);
+		if (!file.FileExists()) return kMissing;
+		wxDateTime mtime = file.GetModificationTime();
+		return mtime.IsValid() ? mtime.GetValue().GetValue() : 0;
+	}
+
+	void Queue(const wxString& key, const wxString& path, int width, int64_t stamp) {
+		{
+			std::lock_guard<std::mutex> lock(m_state->mutex);
+			if (m_state->inFlight.count(key)) return;
+			m_state->inFlight.insert(key);
+			// Most recently requested images (those on screen) go first
+			m_state->jobs.push_back(Job{key, path, width, stamp});
+		}
+		m_state->wake.notify_one();
+	}
+
+	static void WorkerLoop(std::shared_ptr<State> state) {
+		wxLogNull noLog;
+		for (;;) {
+			Job job;
+			wxString cacheDir;
+			uint64_t diskBudget;
+			bool prune = false;
+			{
+				std::unique_lock<std::mutex> lock(state->mutex);
+				state->wake.wait(lock, [&] { return state->stopping || !state->jobs.empty(); });
+				if (state->stopping) return;
+				job = state->jobs.back();
+				state->jobs.pop_back();
+				cacheDir = state->cacheDir;
+				diskBudget = state->diskBudget;
+				if (state->pruneDue && !state->pruning && !cacheDir.IsEmpty()) {
+					state->pruneDue = false;
+					state->pruning = prune = true;
+				}
+			}
+			if (prune) {
+				Prune(cacheDir, diskBudget);
+				std::lock_guard<std::mutex> lock(state->mutex);
+				state->pruning = false;
+			}
+
+			// An image the cache holds is only loaded again if its file changed.
+			// Bitmaps may only be made on the UI thread.
+			int64_t stamp = Stamp(job.path);
+			bool unchanged = stamp == job.stamp;
+			std::shared_ptr<wxImage> image = std::make_shared<wxImage>();
+			if (!unchanged && stamp != kMissing) {
+				bool written = false;
+				*image = LoadThumbnail(job, stamp, cacheDir, written);
+				if (written) {
+					std::lock_guard<std::mutex> lock(state->mutex);
+					if (++state->written >= kPruneEvery) {
+						state->written = 0;
+						state->pruneDue = true;
+					}
+				}
+			}
+
+			std::weak_ptr<State> weak = state;
+			wxTheApp->CallAfter([weak, job, stamp, unchanged, image]() {
+				std::shared_ptr<State> alive = weak.lock();
+				if (!alive) return;
+				{
+					std::lock_guard<std::mutex> lock(alive->mutex);
+					alive->inFlight.erase(job.key);
+				}
+				if (!alive->owner || unchanged) return;
+				alive->owner->Publish(job, stamp, *image);
+			});
+		}
+	}
+
+	static wxImage LoadThumbnail(const Job& job, int64_t stamp, const wxString& cacheDir, bool& written) {
+		wxString cached;
+		if (!cacheDir.IsEmpty()) {
+			wxFileName name(cacheDir, DiskName(job, stamp));
+			cached = name.GetFullPath();
+			if (name.FileExists()) {
+				wxImage thumb(cached, wxBITMAP_TYPE_PNG);
+				if (thumb.IsOk()) {
+					// Its mtime records its last use, for Prune()
+					name.Touch();
+					return thumb;
+				}
+			}
+		}
+
+		wxImage image(job.path);
+		if (!image.IsOk()) return image;
+
+		// Downscale to preview width, never upscale
+		if (image.GetWidth() > job.width) {
+			int height = (int)((long long)image.GetHeight() * job.width / image.GetWidth());
+			image.Rescale(job.width, wxMax(1, height), wxIMAGE_QUALITY_HIGH);
+		}
+
+		if (!cached.IsEmpty() && wxFileName::Mkdir(cacheDir, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL)) {
+			// Write to a temporary name first so readers never see half a file
+			wxString temp = cached + ".tmp";
+			if (image.SaveFile(temp, wxBITMAP_TYPE_PNG)) written = wxRenameFile(temp, cached, true);
+		}
+		return image;
+	}
+
+	// Delete the least recently used thumbnails until the cache is back
+	// under three quarters of `budget`, and any temporary file left behind
+	static void Prune(const wxString& cacheDir, uint64_t budget) {
+		wxDir dir(cacheDir);
+		if (!dir.IsOpened()) return;
+		std::multimap<int64_t, std::pair<wxString, uint64_t>> files;  // by last use
+		uint64_t total = 0;
+		wxString name;
+		for (bool more = dir.GetFirst(&name, wxEmptyString, wxDIR_FILES); more; more = dir.GetNext(&name)) {
+			wxFileName file(cacheDir, name);
+			if (name.EndsWith(".tmp")) {
+				wxRemoveFile(file.GetFullPath());
+				continue;
+			}
+			if (!name.EndsWith(".png")) continue;
+			wxDateTime used = file.GetModificationTime();
+			uint64_t size = file.GetSize().GetValue();
+			files.emplace(used.IsValid() ? used.GetValue().GetValue() : 0, std::make_pair(file.GetFullPath(), size));
+			total += size;
+		}
+		if (total <= budget) return;
+		for (auto it = files.begin(); it != files.end() && total > budget / 4 * 3; ++it) {
+			if (wxRemoveFile(it->second.first)) total -= it->second.second;
+		}
+	}
+
+	// UI thread: keep what a worker found for `job`, replacing what was held
+	void Publish(const Job& job, int64_t stamp, const wxImage& image) {
+		auto found = m_entries.find(job.key);
+		if (found != m_entries.end()) {
+			m_memoryUsed -= found->second.bytes;
+			m_lru.erase(found->second.lruPos);
+			m_entries.erase(found);
+		}
+		if (!image.IsOk()) {
+			m_failed[job.path] = Failure{stamp, NowMs(), job.width};
+			if (m_state->onReady) m_state->onReady(job.path);
+			return;
+		}
+		m_failed.erase(job.path);
+
+		size_t bytes = (size_t)image.GetWidth() * image.GetHeight() * (image.HasAlpha() ? 4 : 3);
+		m_lru.push_front(job.key);
+		m_entries[job.key] = Entry{wxBitmap(image), bytes, job.path, job.width, stamp, NowMs(), m_lru.begin()};
+		m_memoryUsed += bytes;
+
+		while (m_memoryUsed > m_memoryBudget && m_lru.size() > 1) {
+			wxString victim = m_lru.back();
+			m_lru.pop_back();
+			m_memoryUsed -= m_entries[victim].bytes;
+			m_entries.erase(victim);
+		}
+
+		if (m_state->onReady) m_state->onReady(job.path);
+	}
+
+	std::shared_ptr<State> m_state;
+	std::vector<std::thread> m_workers;
+	std::unordered_map<wxString, Entry, wxStringHash, wxStringEqual> m_entries;
+	std::list<wxString> m_lru;
+	std::map<wxString, Failure> m_failed;  // images missing or not decoded, by path
+	wxBitmap m_broken;                     // what Lookup() returns for those
+	size_t m_memoryBudget;
+	size_t m_memoryUsed;
+};
+
+#endif // OBSIDIAN_IMAGE_CACHE_H
@@ -0,0 +1,429 @@
+// line_diff.h - Line-level diff of two texts
+//
+// Lines are interned to integer ids first, so every comparison below is an
+// integer compare. The common prefix and suffix are stripped, then the
+// histogram heuristic (as in git) splits the remaining region at the longest
+// run anchored on its least frequent line, which keeps moved blocks and
+// repeated boilerplate (blank lines, braces, list markers) from producing
+// confusing matches. Regions without a usable anchor fall back to Myers'
+// O(ND) algorithm in its linear-space, middle-snake form.
+//
+// A histogram split costs a pass over its region, so one that lands near an
+// edge every time would make the whole diff quadratic. Large regions are
+// therefore split at every line unique to both sides at once, keeping the
+// longest increasing chain of them (patience diff), the histogram passes
+// share a budget of lines scanned, and Myers stops at an edit count scaled
+// to its region. Regions wait on an explicit stack rather than recursing,
+// so a long file cannot exhaust the thread's stack.
+//
+// Diff() is pure and may run on any thread; a cancel flag is polled so stale
+// comparisons can be abandoned.
+#ifndef OBSIDIAN_LINE_DIFF_H
+#define OBSIDIAN_LINE_DIFF_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "content_hash.h"
+
+struct DiffHunk {
+	enum Kind {
+		EQUAL,
+		CHANGE  // lines [aStart, aStart + aCount) replaced by [bStart, bStart + bCount)
+	};
+	Kind kind;
+	int aStart;
+	int aCount;
+	int bStart;
+	int bCount;
+};
+
+// Start offsets of the lines of `text`, plus a final entry at text.size()
+inline std::vector<size_t> SplitLineOffsets(const std::string& text) {
+	std::vector<size_t> offsets;
+	offsets.push_back(0);
+	for (size_t i = 0; i < text.size(); i++) {
+		if (text[i] == '\n' && i + 1 < text.size()) offsets.push_back(i + 1);
+	}
+	offsets.push_back(text.size());
+	if (text.empty()) offsets.pop_back();
+	return offsets;
+}
+
+class LineDiff {
+public:
+	// Diff `a` against `b`. Returns false when cancelled.
+	static bool Diff(const std::string& a, const std::string& b, std::vector<DiffHunk>& hunks,
+		const std::atomic<bool>* cancel = nullptr) {
+		LineDiff diff(cancel);
+		std::vector<size_t> aOffsets = SplitLineOffsets(a);
+		std::vector<size_t> bOffsets = SplitLineOffsets(b);
+		int aLines = aOffsets.empty() ? 0 : (int)aOffsets.size() - 1;
+		int bLines = bOffsets.empty() ? 0 : (int)bOffsets.size() - 1;
+		// The lines the texts start and end with in common are compared as
+		// text and never interned; the first Region() strips them again
+		int prefix = 0;
+		while (prefix < aLines && prefix < bLines &&
+			Line(a, aOffsets, prefix) == Line(b, bOffsets, prefix)) prefix++;
+		int suffix = 0;
+		while (suffix < aLines - prefix && suffix < bLines - prefix &&
+			Line(a, aOffsets, aLines - 1 - suffix) == Line(b, bOffsets, bLines - 1 - suffix)) suffix++;
+		size_t slots = 16;
+		while (slots < 2 * (size_t)(aLines + bLines - 2 * (prefix + suffix))) slots *= 2;
+		diff.m_slots.assign(slots, kSkipped);
+		diff.Intern(a, aOffsets, prefix, aLines - suffix, diff.m_a);
+		diff.Intern(b, bOffsets, prefix, bLines - suffix, diff.m_b);
+		hunks.clear();
+		diff.m_tasks.push_back(Task{false, 0, (int)diff.m_a.size(), 0, (int)diff.m_b.size()});
+		while (!diff.m_tasks.empty()) {
+			Task task = diff.m_tasks.back();
+			diff.m_tasks.pop_back();
+			if (task.equal) {
+				diff.Emit(DiffHunk::EQUAL, task.a0, task.a1 - task.a0, task.b0, task.b1 - task.b0);
+			} else if (!diff.Region(task.a0, task.a1, task.b0, task.b1)) {
+				return false;
+			}
+		}
+		diff.Flush();
+		hunks.swap(diff.m_hunks);
+		return true;
+	}
+
+private:
+	// Id of the common leading and trailing lines, which are never looked up
+	static constexpr int kSkipped = -1;
+	// Lines occurring more often than this cannot anchor a histogram split
+	static const int kMaxOccurrences = 64;
+	// Regions with more lines than this on either side split at their unique
+	// lines first
+	static const int kPatienceLines = 1024;
+	// Lines the histogram passes may scan in all before regions go to Myers
+	static const int64_t kHistogramBudget = int64_t(1) << 25;
+	// Myers gives up and reports a plain replacement beyond this many edits,
+	// or sooner where (lines of the region) x (edits) would pass kMyersBudget
+	static const int kMaxEditCost = 1 << 12;
+	static const int64_t kMyersBudget = int64_t(1) << 25;
+
+	// A region still to diff, or lines known to be equal, in output order
+	// from the back of m_tasks
+	struct Task {
+		bool equal;
+		int a0, a1, b0, b1;
+	};
+
+	explicit LineDiff(const std::atomic<bool>* cancel) : m_cancel(cancel) {}
+
+	// Line `i` of `text` without its line break
+	static std::string_view Line(const std::string& text, const std::vector<size_t>& offsets, int i) {
+		size_t start = offsets[i];
+		size_t end = offsets[i + 1];
+		if (end > start && text[end - 1] == '\n') end--;
+		if (end > start && text[end - 1] == '\r') end--;
+		return std::string_view(text.data() + start, end - start);
+	}
+
+	// Lines [first, last) get ids, equal lines the same; the rest share
+	// kSkipped, as they lie outside every region. Ids are found through an
+	// open-addressing table of ContentHash values sized for both texts, and
+	// lines are kept as views into the caller's strings, which outlive the
+	// diff.
+	void Intern(const std::string& text, const std::vector<size_t>& offsets, int first, int last,
+		std::vector<int>& ids) {
+		ids.assign(offsets.empty() ? 0 : offsets.size() - 1, kSkipped);
+		size_t mask = m_slots.size() - 1;
+		for (int i = first; i < last; i++) {
+			std::string_view line = Line(text, offsets, i);
+			uint64_t hash = ContentHash(line.data(), line.size());
+			size_t slot = (size_t)hash & mask;
+			while (m_slots[slot] != kSkipped &&
+				(m_hashes[m_slots[slot]] != hash || m_lines[m_slots[slot]] != line)) slot = (slot + 1) & mask;
+			if (m_slots[slot] == kSkipped) {
+				m_slots[slot] = (int)m_lines.size();
+				m_lines.push_back(line);
+				m_hashes.push_back(hash);
+			}
+			ids[i] = m_slots[slot];
+		}
+	}
+
+	bool Cancelled() const { return m_cancel && m_cancel->load(std::memory_order_relaxed); }
+
+	void Emit(DiffHunk::Kind kind, int aStart, int aCount, int bStart, int bCount) {
+		if (aCount == 0 && bCount == 0) return;
+		// Hunks are produced in order; merge neighbours of the same kind
+		if (m_pending.aCount + m_pending.bCount > 0 && m_pending.kind == kind) {
+			m_pending.aCount += aCount;
+			m_pending.bCount += bCount;
+			return;
+		}
+		Flush();
+		m_pending = DiffHunk{kind, aStart, aCount, bStart, bCount};
+	}
+
+	void Flush() {
+		if (m_pending.aCount + m_pending.bCount > 0) m_hunks.push_back(m_pending);
+		m_pending = DiffHunk{DiffHunk::EQUAL, 0, 0, 0, 0};
+	}
+
+	// Diff a region, emitting what it can now and pushing the pieces it was
+	// split into, last first
+	bool Region(int a0, int a1, int b0, int b1) {
+		if (Cancelled()) return false;
+		int prefix = 0;
+		while (a0 + prefix < a1 && b0 + prefix < b1 && m_a[a0 + prefix] == m_b[b0 + prefix]) prefix++;
+		Emit(DiffHunk::EQUAL, a0, prefix, b0, prefix);
+		a0 += prefix;
+		b0 += prefix;
+		int suffix = 0;
+		while (a1 - suffix > a0 && b1 - suffix > b0 && m_a[a1 - 1 - suffix] == m_b[b1 - 1 - suffix]) suffix++;
+		a1 -= suffix;
+		b1 -= suffix;
+		if (suffix > 0) m_tasks.push_back(Task{true, a1, a1 + suffix, b1, b1 + suffix});
+
+		if (a0 == a1 || b0 == b1) {
+			Emit(DiffHunk::CHANGE, a0, a1 - a0, b0, b1 - b0);
+			return true;
+		}
+		if ((a1 - a0 > kPatienceLines || b1 - b0 > kPatienceLines) && Patience(a0, a1, b0, b1)) return true;
+
+		int ma, mb, len;
+		bool common = true;
+		if (m_histogramScanned < kHistogramBudget) {
+			m_histogramScanned += (a1 - a0) + (b1 - b0);
+			if (Anchor(a0, a1, b0, b1, ma, mb, len, common)) {
+				m_tasks.push_back(Task{false, ma + len, a1, mb + len, b1});
+				m_tasks.push_back(Task{true, ma, ma + len, mb, mb + len});
+				m_tasks.push_back(Task{false, a0, ma, b0, mb});
+				return true;
+			}
+		}
+		if (common) return Myers(a0, a1, b0, b1);
+		Emit(DiffHunk::CHANGE, a0, a1 - a0, b0, b1 - b0);
+		return true;
+	}
+
+	// Occurrences of each line of A in the region as chains through m_nextA,
+	// with their counts; ResetChains() undoes it
+	void BuildChains(int a0, int a1) {
+		if (m_head.empty()) {
+			m_head.assign(m_lines.size(), -1);
+			m_count.assign(m_lines.size(), 0);
+			m_countB.assign(m_lines.size(), 0);
+			m_nextA.assign(m_a.size(), -1);
+		}
+		for (int i = a1 - 1; i >= a0; i--) {
+			m_nextA[i] = m_head[m_a[i]];
+			m_head[m_a[i]] = i;
+			m_count[m_a[i]]++;
+		}
+	}
+
+	void ResetChains(int a0, int a1) {
+		for (int i = a0; i < a1; i++) {
+			m_head[m_a[i]] = -1;
+			m_count[m_a[i]] = 0;
+		}
+	}
+
+	// Patience step: match up the lines occurring once in each side of the
+	// region, keep the longest chain of them in order on both sides, and
+	// split at all of those. Fails when the sides share no unique line.
+	bool Patience(int a0, int a1, int b0, int b1) {
+		BuildChains(a0, a1);
+		for (int j = b0; j < b1; j++) m_countB[m_b[j]]++;
+		// Candidates in B's order, as (line of A, line of B)
+		std::vector<std::pair<int, int>> unique;
+		for (int j = b0; j < b1; j++) {
+			int id = m_b[j];
+			if (m_count[id] == 1 && m_countB[id] == 1) unique.emplace_back(m_head[id], j);
+		}
+		for (int j = b0; j < b1; j++) m_countB[m_b[j]] = 0;
+		ResetChains(a0, a1);
+		if (unique.empty()) return false;
+
+		// Longest increasing run of A positions: tails[k] ends the best chain
+		// of length k + 1, and each candidate remembers its predecessor
+		std::vector<int> tails;
+		std::vector<int> previous(unique.size(), -1);
+		for (int c = 0; c < (int)unique.size(); c++) {
+			auto place = std::lower_bound(tails.begin(), tails.end(), unique[c].first,
+				[&](int t, int a) { return unique[t].first < a; });
+			if (place != tails.begin()) previous[c] = *(place - 1);
+			if (place == tails.end()) {
+				tails.push_back(c);
+			} else {
+				*place = c;
+			}
+		}
+		// Walking the chain back from its end pushes the pieces last first
+		int endA = a1, endB = b1;
+		for (int c = tails.back(); c != -1; c = previous[c]) {
+			int ma = unique[c].first, mb = unique[c].second;
+			m_tasks.push_back(Task{false, ma + 1, endA, mb + 1, endB});
+			m_tasks.push_back(Task{true, ma, ma + 1, mb, mb + 1});
+			endA = ma;
+			endB = mb;
+		}
+		m_tasks.push_back(Task{false, a0, endA, b0, endB});
+		return true;
+	}
+
+	// Histogram step: the longest common run containing the least frequent
+	// line of A that also occurs in B. `common` tells whether A and B share
+	// any line at all.
+	bool Anchor(int a0, int a1, int b0, int b1, int& ma, int& mb, int& len, bool& common) {
+		BuildChains(a0, a1);
+		int bestCount = kMaxOccurrences;
+		len = 0;
+		common = false;
+		for (int j = b0; j < b1;) {
+			int next = j + 1;
+			int count = m_count[m_b[j]];
+			common = common || count > 0;
+			if (count == 0 || count > bestCount) {
+				j = next;
+				continue;
+			}
+			for (int i = m_head[m_b[j]]; i != -1; i = m_nextA[i]) {
+				// Extend the match around (i, j) inside the region
+				int s = 0;
+				while (i - s > a0 && j - s > b0 && m_a[i - s - 1] == m_b[j - s - 1]) s++;
+				int e = 1;
+				while (i + e < a1 && j + e < b1 && m_a[i + e] == m_b[j + e]) e++;
+				// Lines inside this run would only find it again
+				next = std::max(next, j + e);
+				if (count < bestCount || (count == bestCount && s + e > len)) {
+					bestCount = count;
+					ma = i - s;
+					mb = j - s;
+					len = s + e;
+				}
+			}
+			j = next;
+		}
+		ResetChains(a0, a1);
+		return len > 0;
+	}
+
+	// Myers, linear space: split the region at the middle snake and recurse
+	bool Myers(int a0, int a1, int b0, int b1) {
+		if (Cancelled()) return false;
+		while (a0 < a1 && b0 < b1 && m_a[a0] == m_b[b0]) {
+			Emit(DiffHunk::EQUAL, a0++, 1, b0++, 1);
+		}
+		int tail = 0;
+		while (a1 - tail > a0 && b1 - tail > b0 && m_a[a1 - 1 - tail] == m_b[b1 - 1 - tail]) tail++;
+		a1 -= tail;
+		b1 -= tail;
+
+		if (a0 == a1 || b0 == b1) {
+			Emit(DiffHunk::CHANGE, a0, a1 - a0, b0, b1 - b0);
+		} else {
+			int x, y;
+			if (!Bisect(a0, a1, b0, b1, x, y)) {
+				if (Cancelled()) return false;
+				Emit(DiffHunk::CHANGE, a0, a1 - a0, b0, b1 - b0);
+			} else if (!(Myers(a0, x, b0, y) && Myers(x, a1, y, b1))) {
+				return false;
+			}
+		}
+		Emit(DiffHunk::EQUAL, a1, tail, b1, tail);
+		return true;
+	}
+
+	// Find the point where the forward and backward searches for the
+	// shortest edit script meet; the region splits there. Fails when the
+	// edit distance exceeds kMaxEditCost or what kMyersBudget allows the region.
+	bool Bisect(int a0, int a1, int b0, int b1, int& x, int& y) {
+		int n = a1 - a0;
+		int m = b1 - b0;
+		int maxD = (int)std::min<int64_t>({(n + m + 1) / 2, kMaxEditCost, std::max<int64_t>(kMyersBudget / (n + m), 1)});
+		int offset = maxD + 1;
+		int length = 2 * offset + 1;
+		std::vector<int> forward(length, -1);
+		std::vector<int> backward(length, -1);
+		forward[offset + 1] = 0;
+		backward[offset + 1] = 0;
+		int delta = n - m;
+		bool odd = (delta & 1) != 0;
+		// Diagonals that ran off the edit graph are trimmed from the sweep
+		int fStart = 0, fEnd = 0, bStart = 0, bEnd = 0;
+
+		for (int d = 0; d <= maxD; d++) {
+			if ((d & 255) == 0 && Cancelled()) return false;
+			for (int k = -d + fStart; k <= d - fEnd; k += 2) {
+				int px = (k == -d || (k != d && forward[offset + k - 1] < forward[offset + k + 1])) ?
+					forward[offset + k + 1] : forward[offset + k - 1] + 1;
+				int py = px - k;
+				while (px < n && py < m && m_a[a0 + px] == m_b[b0 + py]) {
+					px++;
+					py++;
+				}
+				forward[offset + k] = px;
+				if (px > n) {
+					fEnd += 2;
+				} else if (py > m) {
+					fStart += 2;
+				} else if (odd) {
+					int other = offset + delta - k;
+					if (other >= 0 && other < length && backward[other] != -1 && px >= n - backward[other]) {
+						x = a0 + px;
+						y = b0 + py;
+						return true;
+					}
+				}
+			}
+			for (int k = -d + bStart; k <= d - bEnd; k += 2) {
+				int px = (k == -d || (k != d && backward[offset + k - 1] < backward[offset + k + 1])) ?
+					backward[offset + k + 1] : backward[offset + k - 1] + 1;
+				int py = px - k;
+				while (px < n && py < m && m_a[a1 - 1 - px] == m_b[b1 - 1 - py]) {
+					px++;
+					py++;
+				}
+				backward[offset + k] = px;
+				if (px > n) {
+					bEnd += 2;
+				} else if (py > m) {
+					bStart += 2;
+				} else if (!odd) {
+					int other = offset + delta - k;
+					if (other >= 0 && other < length && forward[other] != -1) {
+						int fx = forward[other];
+						int fy = fx - (delta - k);
+						if (fx >= n - px) {
+							x = a0 + fx;
+							y = b0 + fy;
+							return true;
+						}
+					}
+				}
+			}
+		}
+		return false;
+	}
+
+	const std::atomic<bool>* m_cancel;
+	// Interned lines by id, and the table finding them
+	std::vector<std::string_view> m_lines;
+	std::vector<uint64_t> m_hashes;
+	std::vector<int> m_slots;
+	std::vector<int> m_a;
+	std::vector<int> m_b;
+	// Split scratch: first occurrence and count in A and count in B per
+	// line id, next occurrence per line of A
+	std::vector<int> m_head;
+	std::vector<int> m_count;
+	std::vector<int> m_countB;
+	std::vector<int> m_nextA;
+	std::vector<Task> m_tasks;
+	int64_t m_histogramScanned = 0;
+	std::vector<DiffHunk> m_hunks;
+	DiffHunk m_pending = DiffHunk{DiffHunk::EQUAL, 0, 0, 0, 0};
+};
+
+#endif // OBSIDIAN_LINE_DIFF_H
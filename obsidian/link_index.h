@@ -0,0 +1,266 @@
+// link_index.h - Vault-wide index of [[wikilinks]] and the notes using them
+//
+// Every note is indexed from the vault store when the vault is loaded, and
+// parsed again whenever it is saved or rewritten. The index answers "which
+// notes link to this one" without reading the vault, which is what rename
+// needs to know which files have to be rewritten.
+#ifndef OBSIDIAN_LINK_INDEX_H
+#define OBSIDIAN_LINK_INDEX_H
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class LinkIndex {
+public:
+	// Lowercased note name without folders or ".md": the key Obsidian uses
+	// to resolve [[Name]] links.
+	static std::string NoteKey(const std::string& relPath) {
+		size_t slash = relPath.find_last_of('/');
+		std::string name = slash == std::string::npos ? relPath : relPath.substr(slash + 1);
+		if (name.size() > 3 && Lower(name.substr(name.size() - 3)) == ".md") {
+			name.resize(name.size() - 3);
+		}
+		return Lower(name);
+	}
+
+	// Link target as written, reduced to its note part: "Folder/Note#Heading|Alias"
+	// becomes "Folder/Note". Returns false for empty targets.
+	static bool TargetOfLink(const std::string& inner, std::string& target) {
+		size_t end = inner.find_first_of("#|^");
+		target = inner.substr(0, end);
+		while (!target.empty() && target.back() == ' ') target.pop_back();
+		while (!target.empty() && target.front() == ' ') target.erase(0, 1);
+		return !target.empty();
+	}
+
+	// Fenced code, followed line by line: a fence opens with a run of three
+	// or more backticks or tildes, and only a run of the same character at
+	// least as long, alone on its line, closes it
+	struct Fence {
+		char marker = 0;
+		size_t length = 0;
+
+		bool IsOpen() const { return marker != 0; }
+
+		// Whether line [pos, eol) of `content` opens or closes a fence
+		bool Toggles(const std::string& content, size_t pos, size_t eol) {
+			size_t start = content.find_first_not_of(" \t", pos);
+			if (start == std::string::npos || start + 3 > eol) return false;
+			char c = content[start];
+			if (c != '`' && c != '~') return false;
+			size_t run = 0;
+			while (start + run < eol && content[start + run] == c) run++;
+			if (run < 3) return false;
+			if (!IsOpen()) {
+				marker = c;
+				length = run;
+				return true;
+			}
+			if (c != marker || run < length || content.find_first_not_of(" \t\r", start + run) < eol) return false;
+			marker = 0;
+			length = 0;
+			return true;
+		}
+	};
+
+	// Call link(open, close) for every [[...]] on line [pos, eol) that is
+	// not inside an inline code span; `open` is at "[[" and `close` at "]]"
+	template <typename LinkFn>
+	static void ForEachLink(const std::string& content, size_t pos, size_t eol, LinkFn link) {
+		while (pos < eol) {
+			size_t hit = content.find_first_of("[`", pos);
+			if (hit == std::string::npos || hit >= eol) return;
+			if (content[hit] == '`') {
+				pos = SkipCodeSpan(content, hit, eol);
+				continue;
+			}
+			if (hit + 1 >= eol || content[hit + 1] != '[') {
+				pos = hit + 1;
+				continue;
+			}
+			size_t close = content.find("]]", hit + 2);
+			if (close == std::string::npos || close > eol) return;
+			link(hit, close);
+			pos = close + 2;
+		}
+	}
+
+	// All [[link]] and ![[embed]] targets outside of code
+	static std::vector<std::string> ExtractTargets(const std::string& content) {
+		std::vector<std::string> targets;
+		Fence fence;
+		size_t pos = 0;
+		while (pos < content.size()) {
+			size_t eol = content.find('\n', pos);
+			if (eol == std::string::npos) eol = content.size();
+			if (!fence.Toggles(content, pos, eol) && !fence.IsOpen()) {
+				ForEachLink(content, pos, eol, [&](size_t open, size_t close) {
+					std::string target;
+					if (TargetOfLink(content.substr(open + 2, close - open - 2), target)) {
+						targets.push_back(NoteKey(target));
+					}
+				});
+			}
+			pos = eol + 1;
+		}
+		std::sort(targets.begin(), targets.end());
+		targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+		return targets;
+	}
+
+	// Which of `namesakes` (notes sharing one name) a bare [[Name]] written in
+	// `fromRel` means: the one in the same folder, else the one closest to the
+	// vault root, else the first by path
+	static std::string ResolveName(const std::vector<std::string>& namesakes, const std::string& fromRel) {
+		auto folder = [](const std::string& relPath) {
+			size_t slash = relPath.find_last_of('/');
+			return slash == std::string::npos ? std::string() : relPath.substr(0, slash);
+		};
+		std::string from = folder(fromRel);
+		const std::string* best = nullptr;
+		for (const std::string& note : namesakes) {
+			if (folder(note) == from) return note;
+			if (!best || Depth(note) < Depth(*best) || (Depth(note) == Depth(*best) && note < *best)) best = &note;
+		}
+		return best ? *best : std::string();
+	}
+
+	static bool ReadFile(const std::string& path, std::string& content) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open()) return false;
+		content.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+	void Clear() {
+		m_links.clear();
+		m_backlinks.clear();
+	}
+
+	// Re-index one note after it was saved or rewritten
+	void UpdateNote(const std::string& relPath, const std::string& content) {
+		SetTargets(relPath, ExtractTargets(content));
+	}
+
+	// Index a note from link keys that were already extracted, e.g. by the
+	// vault store
+	void SetNote(const std::string& relPath, std::vector<std::string> keys) {
+		SetTargets(relPath, std::move(keys));
+	}
+
+	void RemoveNote(const std::string& relPath) {
+		auto found = m_links.find(relPath);
+		if (found == m_links.end()) return;
+		for (const std::string& key : found->second) Unlink(key, relPath);
+		m_links.erase(found);
+	}
+
+	// Move a note's outgoing links to its new path
+	void RenameNote(const std::string& oldRel, const std::string& newRel) {
+		auto found = m_links.find(oldRel);
+		if (found == m_links.end()) return;
+		std::vector<std::string> keys = std::move(found->second);
+		RemoveNote(oldRel);
+		SetTargets(newRel, std::move(keys));
+	}
+
+	// Notes whose links resolve to `relPath` by name. Links that share the
+	// name but point at another folder, or that ResolveName() settles on a
+	// namesake, are filtered out when rewriting.
+	std::vector<std::string> Referrers(const std::string& relPath) const {
+		std::vector<std::string> result;
+		auto found = m_backlinks.find(NoteKey(relPath));
+		if (found != m_backlinks.end()) result.assign(found->second.begin(), found->second.end());
+		return result;
+	}
+
+	// Number of notes linking to the link key `key`
+	size_t ReferrerCount(const std::string& key) const {
+		auto found = m_backlinks.find(key);
+		return found == m_backlinks.end() ? 0 : found->second.size();
+	}
+
+	// Link keys of the notes `relPath` links to
+	std::vector<std::string> Targets(const std::string& relPath) const {
+		auto found = m_links.find(relPath);
+		return found == m_links.end() ? std::vector<std::string>() : found->second;
+	}
+
+	std::vector<std::string> Notes() const {
+		std::vector<std::string> notes;
+		notes.reserve(m_links.size());
+		for (const auto& note : m_links) notes.push_back(note.first);
+		return notes;
+	}
+
+	size_t NoteCount() const { return m_links.size(); }
+
+	// Approximate bytes held
+	size_t MemoryUsage() const {
+		size_t bytes = sizeof(*this) + (m_links.bucket_count() + m_backlinks.bucket_count()) * sizeof(void*);
+		for (const auto& note : m_links) {
+			bytes += note.first.capacity() + note.second.capacity() * sizeof(std::string) + kNodeBytes;
+			for (const std::string& key : note.second) bytes += key.capacity();
+		}
+		for (const auto& key : m_backlinks) {
+			bytes += key.first.capacity() + key.second.bucket_count() * sizeof(void*) + kNodeBytes;
+			for (const std::string& note : key.second) bytes += note.capacity() + kNodeBytes;
+		}
+		return bytes;
+	}
+
+	static std::string Lower(std::string text) {
+		for (char& c : text) {
+			if (c >= 'A' && c <= 'Z') c = (char)(c + 32);
+		}
+		return text;
+	}
+
+private:
+	static const size_t kNodeBytes = 48;  // rough cost of a hash map node
+
+	static size_t Depth(const std::string& relPath) {
+		return (size_t)std::count(relPath.begin(), relPath.end(), '/');
+	}
+
+	// End of the inline code span opened by the backtick run at `at`: past
+	// the next run of as many backticks on the line, or only past the
+	// opening run when there is none, as the backticks are then literal
+	static size_t SkipCodeSpan(const std::string& content, size_t at, size_t eol) {
+		size_t run = 0;
+		while (at + run < eol && content[at + run] == '`') run++;
+		for (size_t pos = at + run; pos < eol;) {
+			size_t close = content.find('`', pos);
+			if (close == std::string::npos || close >= eol) break;
+			size_t closeRun = 0;
+			while (close + closeRun < eol && content[close + closeRun] == '`') closeRun++;
+			if (closeRun == run) return close + closeRun;
+			pos = close + closeRun;
+		}
+		return at + run;
+	}
+
+	void SetTargets(const std::string& relPath, std::vector<std::string> keys) {
+		RemoveNote(relPath);
+		for (const std::string& key : keys) m_backlinks[key].insert(relPath);
+		m_links[relPath] = std::move(keys);
+	}
+
+	void Unlink(const std::string& key, const std::string& relPath) {
+		auto found = m_backlinks.find(key);
+		if (found == m_backlinks.end()) return;
+		found->second.erase(relPath);
+		if (found->second.empty()) m_backlinks.erase(found);
+	}
+
+	// note -> link keys it contains, and link key -> notes containing it
+	std::unordered_map<std::string, std::vector<std::string>> m_links;
+	std::unordered_map<std::string, std::unordered_set<std::string>> m_backlinks;
+};
+
+#endif // OBSIDIAN_LINK_INDEX_H
@@ -0,0 +1,363 @@
+// markdown_lexer.h - Incremental container lexer for the Markdown editor
+//
+// The editor runs Scintilla in container-lexer mode (wxSTC_LEX_CONTAINER) and
+// styles text itself from EVT_STC_STYLENEEDED. This file holds the part that
+// does not depend on wxWidgets: a line-at-a-time tokenizer whose only state
+// between lines is a single int, so Scintilla's per-line state slots can cache
+// it and restyling can restart at any line.
+#ifndef OBSIDIAN_MARKDOWN_LEXER_H
+#define OBSIDIAN_MARKDOWN_LEXER_H
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Style numbers used by the editor. Scintilla reserves 32-39 for its own
+// predefined styles, so everything stays below that.
+enum MarkdownStyle {
+	MD_DEFAULT = 0,
+	MD_HEADER1,
+	MD_HEADER2,
+	MD_HEADER3,
+	MD_HEADER4,
+	MD_HEADER5,
+	MD_HEADER6,
+	MD_STRONG,
+	MD_EM,
+	MD_CODE,
+	MD_FENCE,        // ``` / ~~~ marker lines
+	MD_FENCE_INFO,   // language after the opening fence
+	MD_CODEBLOCK,    // body of a fenced block
+	MD_WIKILINK,     // [[Note]] and ![[embed.png]]
+	MD_LINK,         // [text](url)
+	MD_TAG,          // #tag
+	MD_FRONTMATTER,  // YAML between leading --- lines
+	MD_FRONTMATTER_KEY,
+	MD_BLOCKQUOTE,
+	MD_LIST_MARKER,
+	MD_HRULE,
+	MD_STYLE_COUNT
+};
+
+// Fenced code languages the lexer recognises. The id is stored in the line
+// state so the styler knows which block it is inside without rescanning.
+enum MarkdownFenceLang {
+	MD_LANG_NONE = 0,
+	MD_LANG_OTHER,
+	MD_LANG_CPP,
+	MD_LANG_C,
+	MD_LANG_BASH,
+	MD_LANG_PYTHON,
+	MD_LANG_YAML,
+	MD_LANG_JSON,
+	MD_LANG_JAVASCRIPT,
+	MD_LANG_MARKDOWN
+};
+
+class MarkdownLexer {
+public:
+	// Line state layout (value carried from the end of one line to the
+	// start of the next):
+	//   bit  0      inside frontmatter
+	//   bit  1      inside fenced code
+	//   bit  2      fence uses '~' instead of '`'
+	//   bits 3-7    opening fence length (3..31)
+	//   bits 8-15   MarkdownFenceLang of the open fence
+	enum {
+		STATE_FRONTMATTER = 1 << 0,
+		STATE_FENCE = 1 << 1,
+		STATE_FENCE_TILDE = 1 << 2
+	};
+
+	// "---" on line 0 opens frontmatter only when a closing "---" or "..."
+	// follows within this many lines; otherwise it is a rule, and a note
+	// that merely starts with one is not swallowed whole
+	static const int kFrontmatterMaxLines = 100;
+
+	static bool InFence(int state) { return (state & STATE_FENCE) != 0; }
+	static bool InFrontmatter(int state) { return (state & STATE_FRONTMATTER) != 0; }
+	static int FenceLength(int state) { return (state >> 3) & 0x1f; }
+	static int FenceLang(int state) { return (state >> 8) & 0xff; }
+
+	// Whether `text`, the start of a note, opens with frontmatter. Only the
+	// first kFrontmatterMaxLines + 1 lines are looked at.
+	static bool HasFrontmatter(const char* text, size_t len) {
+		size_t pos = 0;
+		for (int line = 0; line <= kFrontmatterMaxLines && pos < len; line++) {
+			const char* nl = (const char*)memchr(text + pos, '\n', len - pos);
+			size_t eol = nl ? (size_t)(nl - text) : len;
+			bool dashes = IsDashes(text + pos, eol - pos);
+			if (line == 0 && !dashes) return false;
+			if (line > 0 && (dashes || IsDots(text + pos, eol - pos))) return true;
+			pos = eol + 1;
+		}
+		return false;
+	}
+
+	// Style of a line's end-of-line bytes: a fence body's, so that its
+	// background runs to the edge of the window, and the default elsewhere
+	static int EolStyle(int stateIn, int stateOut) {
+		return InFence(stateIn) && InFence(stateOut) ? MD_CODEBLOCK : MD_DEFAULT;
+	}
+
+	static int LanguageFromInfo(const char* info, size_t len) {
+		std::string lang;
+		for (size_t i = 0; i < len && info[i] != ' ' && info[i] != '\t' && info[i] != '{'; i++)
+			lang += (char)((info[i] >= 'A' && info[i] <= 'Z') ? info[i] + 32 : info[i]);
+		if (lang.empty()) return MD_LANG_NONE;
+		if (lang == "cpp" || lang == "c++" || lang == "cxx" || lang == "hpp") return MD_LANG_CPP;
+		if (lang == "c" || lang == "h") return MD_LANG_C;
+		if (lang == "bash" || lang == "sh" || lang == "shell" || lang == "zsh") return MD_LANG_BASH;
+		if (lang == "python" || lang == "py") return MD_LANG_PYTHON;
+		if (lang == "yaml" || lang == "yml") return MD_LANG_YAML;
+		if (lang == "json") return MD_LANG_JSON;
+		if (lang == "js" || lang == "javascript" || lang == "ts" || lang == "typescript")
+			return MD_LANG_JAVASCRIPT;
+		if (lang == "md" || lang == "markdown") return MD_LANG_MARKDOWN;
+		return MD_LANG_OTHER;
+	}
+
+	// Style one line. `text` holds the raw UTF-8 bytes of the line without
+	// its end-of-line characters; `styles` receives one style per byte.
+	// `opensFrontmatter` is HasFrontmatter() for line 0 and false for every
+	// other line. Returns the state to carry into the next line.
+	static int StyleLine(const char* text, size_t len, int stateIn, bool opensFrontmatter,
+		std::vector<char>& styles) {
+		styles.assign(len, (char)MD_DEFAULT);
+		int state = stateIn;
+
+		if (IsBlank(text, len)) {
+			if (InFence(state)) Fill(styles, 0, len, MD_CODEBLOCK);
+			return state;
+		}
+
+		// Frontmatter: only when the very first line is "---", closed in time
+		if (opensFrontmatter) {
+			Fill(styles, 0, len, MD_FRONTMATTER);
+			return STATE_FRONTMATTER;
+		}
+		if (InFrontmatter(state)) {
+			if (IsDashes(text, len) || IsDots(text, len)) {
+				Fill(styles, 0, len, MD_FRONTMATTER);
+				return 0;
+			}
+			StyleFrontmatterLine(text, len, styles);
+			return state;
+		}
+
+		// Fenced code
+		size_t indent = LeadingSpaces(text, len);
+		if (InFence(state)) {
+			char fenceChar = (state & STATE_FENCE_TILDE) ? '~' : '`';
+			size_t run = RunLength(text, len, indent, fenceChar);
+			if (indent < 4 && run >= (size_t)FenceLength(state) &&
+				IsBlank(text + indent + run, len - indent - run)) {
+				Fill(styles, 0, len, MD_FENCE);
+				return 0;
+			}
+			Fill(styles, 0, len, MD_CODEBLOCK);
+			return state;
+		}
+		if (indent < 4 && indent < len && (text[indent] == '`' || text[indent] == '~')) {
+			char fenceChar = text[indent];
+			size_t run = RunLength(text, len, indent, fenceChar);
+			if (run >= 3) {
+				size_t info = indent + run;
+				while (info < len && (text[info] == ' ' || text[info] == '\t')) info++;
+				bool infoOk = fenceChar == '~' ||
+					memchr(text + info, '`', len - info) == nullptr;
+				if (infoOk) {
+					Fill(styles, 0, info, MD_FENCE);
+					Fill(styles, info, len, MD_FENCE_INFO);
+					int lang = LanguageFromInfo(text + info, len - info);
+					int fenceLen = run > 31 ? 31 : (int)run;
+					return STATE_FENCE | (fenceChar == '~' ? STATE_FENCE_TILDE : 0) |
+						(fenceLen << 3) | (lang << 8);
+				}
+			}
+		}
+
+		// Block-level prefixes
+		if (indent < 4) {
+			size_t p = indent;
+			size_t hashes = RunLength(text, len, p, '#');
+			if (hashes >= 1 && hashes <= 6 && (p + hashes == len || text[p + hashes] == ' ' ||
+				text[p + hashes] == '\t')) {
+				Fill(styles, 0, len, MD_HEADER1 + (int)hashes - 1);
+				StyleInline(text, len, p + hashes, styles, MD_HEADER1 + (int)hashes - 1);
+				return state;
+			}
+			if (IsThematicBreak(text, len)) {
+				Fill(styles, 0, len, MD_HRULE);
+				return state;
+			}
+			if (text[p] == '>') {
+				Fill(styles, 0, len, MD_BLOCKQUOTE);
+				StyleInline(text, len, p + 1, styles, MD_BLOCKQUOTE);
+				return state;
+			}
+			size_t marker = ListMarkerLength(text, len, p);
+			if (marker) {
+				Fill(styles, p, p + marker, MD_LIST_MARKER);
+				StyleInline(text, len, p + marker, styles, MD_DEFAULT);
+				return state;
+			}
+		}
+
+		StyleInline(text, len, indent, styles, MD_DEFAULT);
+		return state;
+	}
+
+private:
+	static void Fill(std::vector<char>& styles, size_t from, size_t to, int style) {
+		if (to > styles.size()) to = styles.size();
+		for (size_t i = from; i < to; i++) styles[i] = (char)style;
+	}
+
+	static bool IsBlank(const char* text, size_t len) {
+		for (size_t i = 0; i < len; i++)
+			if (text[i] != ' ' && text[i] != '\t' && text[i] != '\r') return false;
+		return true;
+	}
+
+	static bool IsDashes(const char* text, size_t len) {
+		while (len && (text[len - 1] == ' ' || text[len - 1] == '\r')) len--;
+		return len == 3 && text[0] == '-' && text[1] == '-' && text[2] == '-';
+	}
+
+	static bool IsDots(const char* text, size_t len) {
+		while (len && (text[len - 1] == ' ' || text[len - 1] == '\r')) len--;
+		return len == 3 && text[0] == '.' && text[1] == '.' && text[2] == '.';
+	}
+
+	static size_t LeadingSpaces(const char* text, size_t len) {
+		size_t i = 0;
+		while (i < len && text[i] == ' ') i++;
+		return i;
+	}
+
+	static size_t RunLength(const char* text, size_t len, size_t from, char c) {
+		size_t i = from;
+		while (i < len && text[i] == c) i++;
+		return i - from;
+	}
+
+	static bool IsThematicBreak(const char* text, size_t len) {
+		char c = 0;
+		int count = 0;
+		for (size_t i = 0; i < len; i++) {
+			char ch = text[i];
+			if (ch == ' ' || ch == '\t' || ch == '\r') continue;
+			if (ch != '-' && ch != '*' && ch != '_') return false;
+			if (c && ch != c) return false;
+			c = ch;
+			count++;
+		}
+		return count >= 3;
+	}
+
+	static size_t ListMarkerLength(const char* text, size_t len, size_t p) {
+		if (p + 1 < len && (text[p] == '-' || text[p] == '*' || text[p] == '+') &&
+			text[p + 1] == ' ')
+			return 2;
+		size_t d = p;
+		while (d < len && d - p < 9 && text[d] >= '0' && text[d] <= '9') d++;
+		if (d > p && d + 1 < len && (text[d] == '.' || text[d] == ')') && text[d + 1] == ' ')
+			return d - p + 2;
+		return 0;
+	}
+
+	static void StyleFrontmatterLine(const char* text, size_t len, std::vector<char>& styles) {
+		Fill(styles, 0, len, MD_FRONTMATTER);
+		size_t i = LeadingSpaces(text, len);
+		if (i < len && text[i] == '-') return;
+		const char* colon = (const char*)memchr(text + i, ':', len - i);
+		if (colon) Fill(styles, i, (size_t)(colon - text), MD_FRONTMATTER_KEY);
+	}
+
+	static bool IsTagChar(unsigned char c) {
+		return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+			c == '_' || c == '-' || c == '/' || c >= 0x80;
+	}
+
+	static size_t FindClose(const char* text, size_t len, size_t from, const char* close) {
+		size_t n = strlen(close);
+		for (size_t i = from; i + n <= len; i++)
+			if (memcmp(text + i, close, n) == 0) return i;
+		return (size_t)-1;
+	}
+
+	// Inline spans never cross a line end, which is what keeps the line
+	// state small. `base` is the style of unmarked text on this line.
+	static void StyleInline(const char* text, size_t len, size_t from,
+		std::vector<char>& styles, int base) {
+		size_t i = from;
+		while (i < len) {
+			char c = text[i];
+			if (c == '`') {
+				size_t ticks = RunLength(text, len, i, '`');
+				std::string close(ticks, '`');
+				size_t end = FindClose(text, len, i + ticks, close.c_str());
+				if (end != (size_t)-1) {
+					Fill(styles, i, end + ticks, MD_CODE);
+					i = end + ticks;
+					continue;
+				}
+				i += ticks;
+				continue;
+			}
+			if ((c == '[' || (c == '!' && i + 1 < len && text[i + 1] == '[')) &&
+				i + 2 < len) {
+				size_t open = c == '!' ? i + 1 : i;
+				if (text[open + 1] == '[') {
+					size_t end = FindClose(text, len, open + 2, "]]");
+					if (end != (size_t)-1) {
+						Fill(styles, i, end + 2, MD_WIKILINK);
+						i = end + 2;
+						continue;
+					}
+				} else {
+					size_t close = FindClose(text, len, open + 1, "](");
+					size_t paren = close == (size_t)-1 ? close : FindClose(text, len, close + 2, ")");
+					if (paren != (size_t)-1) {
+						Fill(styles, i, paren + 1, MD_LINK);
+						i = paren + 1;
+						continue;
+					}
+				}
+			}
+			if (c == '#' && (i == 0 || text[i - 1] == ' ' || text[i - 1] == '\t') &&
+				i + 1 < len && IsTagChar((unsigned char)text[i + 1])) {
+				size_t end = i + 1;
+				bool hasNonDigit = false;
+				while (end < len && IsTagChar((unsigned char)text[end])) {
+					if (text[end] < '0' || text[end] > '9') hasNonDigit = true;
+					end++;
+				}
+				if (hasNonDigit) {
+					Fill(styles, i, end, MD_TAG);
+					i = end;
+					continue;
+				}
+			}
+			if ((c == '*' || c == '_') && i + 1 < len) {
+				bool strong = text[i + 1] == c;
+				const char* close = strong ? (c == '*' ? "**" : "__") : (c == '*' ? "*" : "_");
+				size_t open = strong ? 2 : 1;
+				if (i + open < len && text[i + open] != ' ') {
+					size_t end = FindClose(text, len, i + open, close);
+					if (end != (size_t)-1 && end > i + open) {
+						Fill(styles, i, end + open, strong ? MD_STRONG : MD_EM);
+						i = end + open;
+						continue;
+					}
+				}
+			}
+			if (base != MD_DEFAULT) styles[i] = (char)base;
+			i++;
+		}
+	}
+};
+
+#endif // OBSIDIAN_MARKDOWN_LEXER_H
@@ -0,0 +1,65 @@
+// memory_view.h - Live and peak bytes per subsystem as a list
+//
+// One row per account of a MemoryLedger, in the order they were added, and a
+// total row at the bottom. The list is virtual and only asks the ledger for
+// figures when a row is drawn, so Sync() after each sample just repaints what
+// is on screen.
+#ifndef OBSIDIAN_MEMORY_VIEW_H
+#define OBSIDIAN_MEMORY_VIEW_H
+
+#include <wx/wx.h>
+#include <wx/filename.h>
+#include <wx/listctrl.h>
+
+#include <vector>
+
+#include "../common/memory_ledger.h"
+
+class MemoryView : public wxListCtrl {
+public:
+	MemoryView(wxWindow* parent, MemoryLedger& ledger, wxWindowID id = wxID_ANY)
+		: wxListCtrl(parent, id, wxDefaultPosition, wxDefaultSize, wxLC_REPORT | wxLC_VIRTUAL | wxLC_SINGLE_SEL),
+		m_ledger(ledger) {
+		InsertColumn(0, "Subsystem", wxLIST_FORMAT_LEFT, FromDIP(150));
+		InsertColumn(1, "Live", wxLIST_FORMAT_RIGHT, FromDIP(80));
+		InsertColumn(2, "Peak", wxLIST_FORMAT_RIGHT, FromDIP(80));
+		InsertColumn(3, "Measured", wxLIST_FORMAT_LEFT, FromDIP(80));
+	}
+
+	void Sync() {
+		m_accounts = m_ledger.Accounts();
+		m_total = m_ledger.Total();
+		long count = (long)m_accounts.size() + 1;
+		if (GetItemCount() != count) SetItemCount(count);
+		RefreshItems(0, count - 1);
+	}
+
+	static wxString FormatBytes(size_t bytes) { return wxFileName::GetHumanReadableSize(wxULongLong(bytes), "0 B"); }
+
+protected:
+	wxString OnGetItemText(long item, long column) const override {
+		if (item < 0 || (size_t)item > m_accounts.size()) return wxString();
+		if ((size_t)item == m_accounts.size()) {
+			switch (column) {
+			case 0: return "Total";
+			case 1: return FormatBytes(m_total);
+			case 2: return FormatBytes(m_ledger.PeakTotal());
+			default: return wxString();
+			}
+		}
+		const MemoryAccount& account = *m_accounts[item];
+		switch (column) {
+		case 0: return wxString::FromUTF8(account.Name().c_str());
+		case 1: return FormatBytes(account.Live());
+		case 2: return FormatBytes(account.Peak());
+		default: return account.Counted() ? "allocator" : "sampled";
+		}
+	}
+
+private:
+	MemoryLedger& m_ledger;
+	std::vector<MemoryAccount*> m_accounts;
+	size_t m_total = 0;
+};
+
+#endif // OBSIDIAN_MEMORY_VIEW_H
@@ -0,0 +1,546 @@
+// note_history.h - Content-addressed version history of notes in a pack file
+//
+// Every saved version of a note is split into content-defined chunks (a gear
+// rolling hash picks the cut points, so an edit only changes the chunks it
+// touches). Chunks are keyed by a pair of 64-bit FNV-1a hashes of their bytes
+// (two seeds, the second mixed with the length) and stored once. A new
+// chunk is stored as a delta against the chunk it replaced in the previous
+// version when that saves space, and a version's chunk list is stored as a
+// delta against the previous list. History therefore grows with the size of
+// the edits, not with the size of the notes.
+//
+// All records are appended to a single pack file:
+//
+//   [u32 payload length][u8 type][payload][u32 checksum]
+//
+// Opening the pack reads every record to rebuild the in-memory index, so the
+// app does it on the task pool. A damaged record is skipped by looking for the
+// next offset where a record's checksum holds; a torn record at the end (crash
+// during a save) is dropped, as is whatever a failed append left behind.
+#ifndef OBSIDIAN_NOTE_HISTORY_H
+#define OBSIDIAN_NOTE_HISTORY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include "content_hash.h"
+
+class NoteHistory {
+public:
+	struct Version {
+		int64_t time;     // seconds since the epoch
+		uint64_t size;    // bytes of the note
+		uint64_t stored;  // bytes this version added to the pack
+	};
+
+	NoteHistory() = default;
+	NoteHistory(const NoteHistory&) = delete;
+	NoteHistory& operator=(const NoteHistory&) = delete;
+	// An instance opened on another thread is moved into place
+	NoteHistory(NoteHistory&&) = default;
+	NoteHistory& operator=(NoteHistory&&) = default;
+
+	bool Open(const std::string& packFile) {
+		Close();
+		m_file = packFile;
+		std::error_code ec;
+		std::filesystem::create_directories(std::filesystem::u8path(packFile).parent_path(), ec);
+		uint64_t size = std::filesystem::file_size(std::filesystem::u8path(packFile), ec);
+		if (ec) size = 0;
+
+		std::ifstream pack(std::filesystem::u8path(packFile), std::ios::binary);
+		if (pack.is_open()) Scan(pack, size);
+		pack.close();
+
+		// Drop a torn tail so new records follow the last complete one
+		if (size > m_end) std::filesystem::resize_file(std::filesystem::u8path(packFile), m_end, ec);
+		return true;
+	}
+
+	void Close() {
+		m_file.clear();
+		m_chunks.clear();
+		m_notes.clear();
+		m_end = 0;
+	}
+
+	bool IsOpen() const { return !m_file.empty(); }
+	uint64_t PackBytes() const { return m_end; }
+
+	// Approximate bytes of the in-memory index; the pack itself stays on disk
+	size_t MemoryUsage() const {
+		size_t bytes = sizeof(*this) + m_file.capacity() +
+			m_chunks.size() * (sizeof(ChunkKey) + sizeof(ChunkRef) + kNodeBytes) +
+			(m_chunks.bucket_count() + m_notes.bucket_count()) * sizeof(void*);
+		for (const auto& note : m_notes) {
+			bytes += note.first.capacity() + note.second.capacity() * sizeof(VersionRecord) + kNodeBytes;
+		}
+		return bytes;
+	}
+
+	// Versions of a note, oldest first
+	std::vector<Version> Versions(const std::string& note) const {
+		std::vector<Version> versions;
+		auto found = m_notes.find(note);
+		if (found == m_notes.end()) return versions;
+		for (const VersionRecord& record : found->second) {
+			versions.push_back(Version{record.time, record.size, record.stored});
+		}
+		return versions;
+	}
+
+	// Append `content` as the newest version of `note`. Nothing is written
+	// when it equals the newest version already recorded.
+	bool Record(const std::string& note, const std::string& content, int64_t time) {
+		if (!IsOpen()) return false;
+		uint64_t hash = ContentHash(content.data(), content.size());
+		std::vector<VersionRecord>& versions = m_notes[note];
+		if (!versions.empty() && versions.back().hash == hash && versions.back().size == content.size()) {
+			return true;
+		}
+
+		std::vector<ChunkKey> previous;
+		if (!versions.empty() && !ChunkList(versions, versions.size() - 1, previous)) previous.clear();
+
+		// Cut the note into chunks and find the run that differs from the
+		// previous version's chunk list
+		std::vector<std::pair<size_t, size_t>> spans = Chunk(content);
+		std::vector<ChunkKey> keys;
+		keys.reserve(spans.size());
+		for (const auto& span : spans) keys.push_back(KeyOf(content.data() + span.first, span.second));
+		size_t prefix = 0;
+		while (prefix < keys.size() && prefix < previous.size() && keys[prefix] == previous[prefix]) prefix++;
+		size_t suffix = 0;
+		while (suffix < keys.size() - prefix && suffix < previous.size() - prefix &&
+			keys[keys.size() - 1 - suffix] == previous[previous.size() - 1 - suffix]) suffix++;
+
+		std::string batch;
+		std::unordered_map<ChunkKey, ChunkRef, ChunkKeyHash> added;
+		uint64_t offset = m_end;
+		for (size_t i = prefix; i < keys.size() - suffix; i++) {
+			if (m_chunks.count(keys[i]) || added.count(keys[i])) continue;
+			const char* data = content.data() + spans[i].first;
+			size_t len = spans[i].second;
+
+			// The chunk this one most likely replaced
+			const ChunkKey* base = nullptr;
+			size_t oldMiddle = previous.size() - prefix - suffix;
+			if (oldMiddle > 0) base = &previous[prefix + std::min(i - prefix, oldMiddle - 1)];
+
+			std::string payload;
+			ChunkRef ref;
+			ref.size = (uint32_t)len;
+			if (!(base && EncodeDelta(keys[i], *base, data, len, payload, ref.depth))) {
+				payload.assign((const char*)&keys[i], sizeof(ChunkKey));
+				payload.append(data, len);
+				ref.depth = 0;
+				ref.type = RECORD_CHUNK;
+			} else {
+				ref.type = RECORD_DELTA;
+			}
+			ref.offset = offset + batch.size();
+			AppendRecord(batch, ref.type, payload);
+			added.emplace(keys[i], ref);
+		}
+
+		// The chunk list is a full checkpoint every few versions and a delta
+		// against the previous list otherwise, so restoring stays cheap
+		if (versions.empty() || versions.size() % kCheckpointEvery == 0) prefix = suffix = 0;
+		std::string payload;
+		PutString(payload, note);
+		Put(payload, time);
+		Put(payload, (uint64_t)content.size());
+		Put(payload, hash);
+		Put(payload, (uint32_t)prefix);
+		Put(payload, (uint32_t)suffix);
+		Put(payload, (uint32_t)(keys.size() - prefix - suffix));
+		payload.append((const char*)(keys.data() + prefix), (keys.size() - prefix - suffix) * sizeof(ChunkKey));
+		VersionRecord record;
+		record.offset = offset + batch.size();
+		AppendRecord(batch, RECORD_VERSION, payload);
+		record.time = time;
+		record.size = content.size();
+		record.hash = hash;
+		record.checkpoint = prefix == 0 && suffix == 0;
+		record.stored = batch.size();
+
+		if (!Append(batch)) return false;
+		for (const auto& chunk : added) m_chunks.emplace(chunk.first, chunk.second);
+		versions.push_back(record);
+		return true;
+	}
+
+	// Reassemble version `index` (0 = oldest) of a note
+	bool Load(const std::string& note, size_t index, std::string& content) const {
+		content.clear();
+		auto found = m_notes.find(note);
+		if (found == m_notes.end() || index >= found->second.size()) return false;
+		std::vector<ChunkKey> keys;
+		if (!ChunkList(found->second, index, keys)) return false;
+
+		std::ifstream pack(std::filesystem::u8path(m_file), std::ios::binary);
+		if (!pack.is_open()) return false;
+		content.reserve(found->second[index].size);
+		std::string chunk;
+		for (const ChunkKey& key : keys) {
+			if (!ReadChunk(pack, key, chunk)) return false;
+			content += chunk;
+		}
+		return content.size() == found->second[index].size &&
+			ContentHash(content.data(), content.size()) == found->second[index].hash;
+	}
+
+	// Keep the history of notes that were renamed or moved
+	bool RenameNote(const std::string& oldNote, const std::string& newNote) {
+		auto found = m_notes.find(oldNote);
+		if (!IsOpen() || found == m_notes.end() || oldNote == newNote) return true;
+		std::string payload;
+		PutString(payload, oldNote);
+		PutString(payload, newNote);
+		std::string batch;
+		AppendRecord(batch, RECORD_MOVE, payload);
+		if (!Append(batch)) return false;
+		Move(oldNote, newNote);
+		return true;
+	}
+
+private:
+	enum RecordType : uint8_t {
+		RECORD_CHUNK = 1,    // key, bytes
+		RECORD_DELTA = 2,    // key, base key, prefix, suffix, middle bytes
+		RECORD_VERSION = 3,  // note, time, size, hash, prefix, suffix, new keys
+		RECORD_MOVE = 4      // old note, new note
+	};
+
+	static const size_t kMinChunk = 2 * 1024;
+	static const size_t kMaxChunk = 64 * 1024;
+	static const uint64_t kChunkMask = (1 << 13) - 1;  // ~8 KB average
+	static const size_t kCheckpointEvery = 16;
+	static const int kMaxDeltaDepth = 8;
+	static const size_t kNodeBytes = 48;  // rough cost of a hash map node
+	static const size_t kRecordOverhead = 4 + 1 + 4;
+	static const size_t kResyncWindow = 1 << 20;  // bytes searched per read after a damaged record
+
+	struct ChunkKey {
+		uint64_t a;
+		uint64_t b;
+		bool operator==(const ChunkKey& other) const { return a == other.a && b == other.b; }
+	};
+
+	struct ChunkKeyHash {
+		size_t operator()(const ChunkKey& key) const { return (size_t)(key.a ^ (key.b * 31)); }
+	};
+
+	struct ChunkRef {
+		uint64_t offset = 0;  // record start in the pack
+		uint32_t size = 0;
+		uint8_t type = RECORD_CHUNK;
+		int depth = 0;        // length of the delta chain below this chunk
+	};
+
+	struct VersionRecord {
+		uint64_t offset = 0;
+		int64_t time = 0;
+		uint64_t size = 0;
+		uint64_t hash = 0;
+		uint64_t stored = 0;
+		bool checkpoint = false;
+	};
+
+	static ChunkKey KeyOf(const char* data, size_t len) {
+		return ChunkKey{ContentHash(data, len), ContentHash(data, len, 0x84222325cbf29ce4ULL) ^ len};
+	}
+
+	// Gear rolling hash: a cut point wherever the low bits of the hash are zero
+	static std::vector<std::pair<size_t, size_t>> Chunk(const std::string& content) {
+		static const std::vector<uint64_t> gear = [] {
+			std::vector<uint64_t> table(256);
+			uint64_t x = 0x9e3779b97f4a7c15ULL;
+			for (uint64_t& value : table) {
+				x += 0x9e3779b97f4a7c15ULL;
+				uint64_t z = x;
+				z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+				z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+				value = z ^ (z >> 31);
+			}
+			return table;
+		}();
+
+		std::vector<std::pair<size_t, size_t>> spans;
+		size_t start = 0;
+		uint64_t h = 0;
+		for (size_t i = 0; i < content.size(); i++) {
+			h = (h << 1) + gear[(unsigned char)content[i]];
+			size_t len = i + 1 - start;
+			if ((len >= kMinChunk && (h & kChunkMask) == 0) || len >= kMaxChunk) {
+				spans.emplace_back(start, len);
+				start = i + 1;
+				h = 0;
+			}
+		}
+		if (start < content.size() || spans.empty()) spans.emplace_back(start, content.size() - start);
+		return spans;
+	}
+
+	// Store `data` as the bytes it shares with `base` at both ends plus the
+	// middle. Fails when the base is unknown, too deep or too different.
+	bool EncodeDelta(const ChunkKey& key, const ChunkKey& baseKey, const char* data, size_t len,
+		std::string& payload, int& depth) const {
+		auto found = m_chunks.find(baseKey);
+		if (found == m_chunks.end() || found->second.depth >= kMaxDeltaDepth) return false;
+		std::ifstream pack(std::filesystem::u8path(m_file), std::ios::binary);
+		std::string base;
+		if (!pack.is_open() || !ReadChunk(pack, baseKey, base)) return false;
+
+		size_t prefix = 0;
+		while (prefix < len && prefix < base.size() && data[prefix] == base[prefix]) prefix++;
+		size_t suffix = 0;
+		while (suffix < len - prefix && suffix < base.size() - prefix &&
+			data[len - 1 - suffix] == base[base.size() - 1 - suffix]) suffix++;
+		if ((prefix + suffix) * 4 < len) return false;
+
+		payload.assign((const char*)&key, sizeof(ChunkKey));
+		payload.append((const char*)&baseKey, sizeof(ChunkKey));
+		Put(payload, (uint32_t)prefix);
+		Put(payload, (uint32_t)suffix);
+		payload.append(data + prefix, len - prefix - suffix);
+		depth = found->second.depth + 1;
+		return true;
+	}
+
+	bool ReadChunk(std::ifstream& pack, const ChunkKey& key, std::string& out) const {
+		auto found = m_chunks.find(key);
+		if (found == m_chunks.end()) return false;
+		std::string payload;
+		uint8_t type;
+		if (!ReadRecord(pack, found->second.offset, type, payload)) return false;
+		if (type == RECORD_CHUNK) {
+			out.assign(payload, sizeof(ChunkKey), std::string::npos);
+		} else {
+			ChunkKey baseKey;
+			uint32_t prefix, suffix;
+			size_t at = sizeof(ChunkKey);
+			memcpy(&baseKey, payload.data() + at, sizeof(ChunkKey));
+			at += sizeof(ChunkKey);
+			Get(payload, at, prefix);
+			Get(payload, at, suffix);
+			std::string base;
+			if (!ReadChunk(pack, baseKey, base) || prefix + suffix > base.size()) return false;
+			out.assign(base, 0, prefix);
+			out.append(payload, at, std::string::npos);
+			out.append(base, base.size() - suffix, suffix);
+		}
+		return out.size() == found->second.size;
+	}
+
+	// Chunk list of version `index`: walk back to the last checkpoint and
+	// apply the list deltas forward
+	bool ChunkList(const std::vector<VersionRecord>& versions, size_t index, std::vector<ChunkKey>& keys) const {
+		size_t first = index;
+		while (first > 0 && !versions[first].checkpoint) first--;
+		std::ifstream pack(std::filesystem::u8path(m_file), std::ios::binary);
+		if (!pack.is_open()) return false;
+
+		keys.clear();
+		for (size_t v = first; v <= index; v++) {
+			std::string payload;
+			uint8_t type;
+			if (!ReadRecord(pack, versions[v].offset, type, payload) || type != RECORD_VERSION) return false;
+			size_t at = 0;
+			std::string note;
+			int64_t time;
+			uint64_t size, hash;
+			uint32_t prefix, suffix, count;
+			GetString(payload, at, note);
+			Get(payload, at, time);
+			Get(payload, at, size);
+			Get(payload, at, hash);
+			Get(payload, at, prefix);
+			Get(payload, at, suffix);
+			Get(payload, at, count);
+			if (prefix + suffix > keys.size() || at + (size_t)count * sizeof(ChunkKey) > payload.size()) return false;
+
+			std::vector<ChunkKey> next(keys.begin(), keys.begin() + prefix);
+			size_t middle = next.size();
+			next.resize(middle + count);
+			memcpy(next.data() + middle, payload.data() + at, (size_t)count * sizeof(ChunkKey));
+			next.insert(next.end(), keys.end() - suffix, keys.end());
+			keys.swap(next);
+		}
+		return true;
+	}
+
+	// Write `batch` at the end of the pack. A failed write is cut off again,
+	// so the next record does not follow a partial one.
+	bool Append(const std::string& batch) {
+		std::ofstream pack(std::filesystem::u8path(m_file), std::ios::binary | std::ios::app);
+		if (!pack.is_open()) return false;
+		pack.write(batch.data(), (std::streamsize)batch.size());
+		pack.close();
+		if (pack.fail()) {
+			std::error_code ec;
+			std::filesystem::resize_file(std::filesystem::u8path(m_file), m_end, ec);
+			return false;
+		}
+		m_end += batch.size();
+		return true;
+	}
+
+	void Scan(std::ifstream& pack, uint64_t size) {
+		uint64_t offset = 0;
+		uint64_t batchStart = 0;  // chunks written for the next version start here
+		std::string payload;
+		uint8_t type;
+		for (;;) {
+			if (!ReadRecord(pack, offset, type, payload)) {
+				// Versions whose chunks were in the damaged record fail to load;
+				// everything after it is still found
+				uint64_t next = Resync(pack, offset + 1, size);
+				if (next >= size) break;
+				offset = batchStart = next;
+				continue;
+			}
+			size_t at = 0;
+			if (type == RECORD_CHUNK || type == RECORD_DELTA) {
+				ChunkKey key;
+				memcpy(&key, payload.data(), sizeof(ChunkKey));
+				ChunkRef ref;
+				ref.offset = offset;
+				ref.type = type;
+				if (type == RECORD_CHUNK) {
+					ref.size = (uint32_t)(payload.size() - sizeof(ChunkKey));
+				} else {
+					ChunkKey baseKey;
+					uint32_t prefix, suffix;
+					memcpy(&baseKey, payload.data() + sizeof(ChunkKey), sizeof(ChunkKey));
+					at = 2 * sizeof(ChunkKey);
+					Get(payload, at, prefix);
+					Get(payload, at, suffix);
+					auto base = m_chunks.find(baseKey);
+					ref.depth = base == m_chunks.end() ? kMaxDeltaDepth : base->second.depth + 1;
+					ref.size = (uint32_t)(payload.size() - at + prefix + suffix);
+				}
+				m_chunks.emplace(key, ref);
+			} else if (type == RECORD_VERSION) {
+				std::string note;
+				VersionRecord record;
+				uint32_t prefix, suffix;
+				record.offset = offset;
+				GetString(payload, at, note);
+				Get(payload, at, record.time);
+				Get(payload, at, record.size);
+				Get(payload, at, record.hash);
+				Get(payload, at, prefix);
+				Get(payload, at, suffix);
+				std::vector<VersionRecord>& versions = m_notes[note];
+				record.checkpoint = prefix == 0 && suffix == 0;
+				record.stored = offset + RecordSize(payload) - batchStart;
+				versions.push_back(record);
+			} else if (type == RECORD_MOVE) {
+				std::string oldNote, newNote;
+				GetString(payload, at, oldNote);
+				GetString(payload, at, newNote);
+				Move(oldNote, newNote);
+			}
+			offset += RecordSize(payload);
+			if (type == RECORD_VERSION || type == RECORD_MOVE) batchStart = offset;
+		}
+		m_end = offset;
+	}
+
+	// First offset from `from` on where a whole record checks out, or `size`.
+	// Headers are tested in memory a window at a time; only those that fit
+	// the file are read as records.
+	static uint64_t Resync(std::ifstream& pack, uint64_t from, uint64_t size) {
+		std::string window;
+		std::string payload;
+		uint8_t type;
+		for (uint64_t start = from; start + kRecordOverhead <= size; start += kResyncWindow) {
+			size_t len = (size_t)std::min<uint64_t>(kResyncWindow + 4, size - start);
+			window.resize(len);
+			pack.clear();
+			pack.seekg((std::streamoff)start);
+			if (!pack.read(&window[0], (std::streamsize)len)) return size;
+			for (size_t i = 0; i < kResyncWindow && i + 5 <= len; i++) {
+				uint32_t length;
+				memcpy(&length, window.data() + i, 4);
+				uint8_t kind = (uint8_t)window[i + 4];
+				if (kind < RECORD_CHUNK || kind > RECORD_MOVE || start + i + kRecordOverhead > size ||
+					length > size - start - i - kRecordOverhead) continue;
+				if (ReadRecord(pack, start + i, type, payload)) return start + i;
+			}
+		}
+		return size;
+	}
+
+	void Move(const std::string& oldNote, const std::string& newNote) {
+		auto found = m_notes.find(oldNote);
+		if (found == m_notes.end()) return;
+		std::vector<VersionRecord> versions = std::move(found->second);
+		m_notes.erase(found);
+		// A note created again under the old name starts a new history; the
+		// moved one is kept whole, so checkpoints stay where they were written
+		m_notes[newNote] = std::move(versions);
+	}
+
+	static size_t RecordSize(const std::string& payload) { return kRecordOverhead + payload.size(); }
+
+	static void AppendRecord(std::string& out, uint8_t type, const std::string& payload) {
+		Put(out, (uint32_t)payload.size());
+		out.push_back((char)type);
+		out += payload;
+		Put(out, (uint32_t)ContentHash(payload.data(), payload.size()));
+	}
+
+	static bool ReadRecord(std::ifstream& pack, uint64_t offset, uint8_t& type, std::string& payload) {
+		pack.clear();
+		pack.seekg((std::streamoff)offset);
+		uint32_t length = 0, checksum = 0;
+		char typeByte = 0;
+		if (!pack.read((char*)&length, 4) || !pack.read(&typeByte, 1)) return false;
+		if (length > 64u * 1024 * 1024) return false;
+		payload.resize(length);
+		if (length && !pack.read(&payload[0], length)) return false;
+		if (!pack.read((char*)&checksum, 4)) return false;
+		type = (uint8_t)typeByte;
+		return checksum == (uint32_t)ContentHash(payload.data(), payload.size());
+	}
+
+	template <typename T>
+	static void Put(std::string& out, T value) {
+		out.append((const char*)&value, sizeof(T));
+	}
+
+	template <typename T>
+	static void Get(const std::string& in, size_t& at, T& value) {
+		value = T();
+		if (at + sizeof(T) <= in.size()) memcpy(&value, in.data() + at, sizeof(T));
+		at += sizeof(T);
+	}
+
+	static void PutString(std::string& out, const std::string& text) {
+		Put(out, (uint32_t)text.size());
+		out += text;
+	}
+
+	static void GetString(const std::string& in, size_t& at, std::string& text) {
+		uint32_t len;
+		Get(in, at, len);
+		text = at < in.size() ? in.substr(at, len) : std::string();
+		at += len;
+	}
+
+	std::string m_file;
+	uint64_t m_end = 0;
+	std::unordered_map<ChunkKey, ChunkRef, ChunkKeyHash> m_chunks;
+	std::unordered_map<std::string, std::vector<VersionRecord>> m_notes;
+};
+
+#endif // OBSIDIAN_NOTE_HISTORY_H
@@ -0,0 +1,88 @@
+// outline_view.h - Headings of the open note as an indented list
+//
+// A virtual list over a HeadingIndex: only the rows on screen are asked for
+// their text, so a note with thousands of headings refreshes as fast as one
+// with ten. Selecting a row (by click or keyboard) calls the jump callback;
+// ShowSection() highlights the section the caret is in without calling it.
+#ifndef OBSIDIAN_OUTLINE_VIEW_H
+#define OBSIDIAN_OUTLINE_VIEW_H
+
+#include <wx/wx.h>
+#include <wx/listctrl.h>
+
+#include <functional>
+
+#include "heading_index.h"
+
+class OutlineView : public wxListCtrl {
+public:
+	typedef std::function<void(const Heading&)> JumpCallback;
+
+	OutlineView(wxWindow* parent, const HeadingIndex& headings, wxWindowID id = wxID_ANY)
+		: wxListCtrl(parent, id, wxDefaultPosition, wxDefaultSize,
+			wxLC_REPORT | wxLC_VIRTUAL | wxLC_NO_HEADER | wxLC_SINGLE_SEL),
+		m_headings(headings), m_version(0), m_current(-1), m_showing(false) {
+		InsertColumn(0, "Heading", wxLIST_FORMAT_LEFT, FromDIP(250));
+		Bind(wxEVT_SIZE, &OutlineView::OnSize, this);
+		Bind(wxEVT_LIST_ITEM_SELECTED, &OutlineView::OnSelected, this);
+	}
+
+	void SetJumpCallback(JumpCallback callback) { m_jump = callback; }
+
+	// Pick up added, removed or renamed headings
+	void Sync() {
+		if (m_headings.Version() == m_version && GetItemCount() == (long)m_headings.Headings().size()) return;
+		m_version = m_headings.Version();
+		long count = (long)m_headings.Headings().size();
+		// The highlighted row may now be another heading
+		m_showing = true;
+		if (m_current >= 0 && m_current < GetItemCount()) SetItemState(m_current, 0, wxLIST_STATE_SELECTED);
+		m_showing = false;
+		m_current = -1;
+		SetItemCount(count);
+		if (count > 0) RefreshItems(GetTopItem(), wxMin(count - 1, GetTopItem() + GetCountPerPage()));
+	}
+
+	// Highlight heading `index` (-1 for none) and scroll it into view
+	void ShowSection(int index) {
+		if (index == m_current || index >= GetItemCount()) return;
+		m_showing = true;
+		if (m_current >= 0 && m_current < GetItemCount()) SetItemState(m_current, 0, wxLIST_STATE_SELECTED);
+		if (index >= 0) {
+			SetItemState(index, wxLIST_STATE_SELECTED, wxLIST_STATE_SELECTED);
+			EnsureVisible(index);
+		}
+		m_showing = false;
+		m_current = index;
+	}
+
+protected:
+	wxString OnGetItemText(long item, long column) const override {
+		const std::vector<Heading>& headings = m_headings.Headings();
+		if (item < 0 || (size_t)item >= headings.size()) return wxString();
+		const Heading& heading = headings[item];
+		return wxString(' ', 4 * (heading.level - 1)) + wxString::FromUTF8(heading.title.c_str());
+	}
+
+private:
+	void OnSelected(wxListEvent& event) {
+		m_current = event.GetIndex();
+		const std::vector<Heading>& headings = m_headings.Headings();
+		if (m_showing || !m_jump || m_current < 0 || (size_t)m_current >= headings.size()) return;
+		m_jump(headings[m_current]);
+	}
+
+	void OnSize(wxSizeEvent& event) {
+		event.Skip();
+		int width = GetClientSize().x;
+		if (width > 50) SetColumnWidth(0, width);
+	}
+
+	const HeadingIndex& m_headings;
+	JumpCallback m_jump;
+	uint64_t m_version;
+	long m_current;
+	bool m_showing;  // selection set by ShowSection, not the user
+};
+
+#endif // OBSIDIAN_OUTLINE_VIEW_H
@@ -0,0 +1,338 @@
+// posting_list.h - Compressed postings with word positions
+//
+// A word's postings are the notes it occurs in, by ascending note id, each
+// with the word's weighted count and its positions in the note. They live in
+// one byte stream cut into blocks of 128 postings:
+//
+//   header | id deltas | counts | positions of posting 0 | positions of posting 1 | ...
+//
+// Ids (as deltas) and counts are bit-packed at the width of the block's
+// largest value, in four interleaved lanes: value i goes to lane i % 4, so
+// unpacking applies the same shifts to four neighbouring words and compilers
+// vectorize it without intrinsics. Positions are varint deltas, and are only
+// decoded when a phrase needs them. The header holds the block's last id and
+// its length, a skip pointer: seeking hops from header to header past whole
+// blocks without decoding them. Postings after the last full block are
+// appended as varints and packed once 128 have gathered.
+//
+// A vault has far more rare words than common ones, so the list itself is
+// kept small: one byte vector and three counters. The bytes are charged to the
+// "Search postings" memory account as they are allocated, which makes it the
+// one exact figure for every index in memory, including those being built,
+// loaded or spilled.
+#ifndef OBSIDIAN_POSTING_LIST_H
+#define OBSIDIAN_POSTING_LIST_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../common/memory_ledger.h"
+
+struct PostingMemory {
+	static MemoryAccount& Account() {
+		static MemoryAccount& account = MemoryLedger::Global().Add("Search postings", true);
+		return account;
+	}
+};
+
+class PostingList {
+public:
+	static const size_t kBlock = 128;
+	static const uint32_t kEnd = UINT32_MAX;  // id of a cursor past the last posting
+
+	typedef std::vector<uint8_t, CountingAllocator<uint8_t, PostingMemory>> Bytes;
+
+	PostingList() : m_tailStart(0), m_lastDoc(0), m_size(0) {}
+
+	size_t Size() const { return m_size; }
+
+	size_t MemoryUsage() const { return sizeof(*this) + m_data.capacity(); }
+
+	// Add a posting. `doc` must be above every id added before, `count` at
+	// least 1, and `positions` ascending.
+	void Append(uint32_t doc, uint32_t count, const std::vector<uint32_t>& positions) {
+		PutVarint(m_data, doc - (m_size ? m_lastDoc : kNone) - 1);
+		PutVarint(m_data, count - 1);
+		PutPositions(m_data, positions);
+		m_lastDoc = doc;
+		if (++m_size % kBlock == 0) PackTail();
+	}
+
+	void ShrinkToFit() { m_data.shrink_to_fit(); }
+
+	// The list as it is held, for index snapshots. `out.Write(data, bytes)`
+	// takes each piece; Load() reads them back with `in.Read(data, bytes)`,
+	// which fails past the end, and checks lengths against `in.Remaining()`.
+	template <typename Writer>
+	void Save(Writer& out) const {
+		uint32_t fields[4] = {m_tailStart, m_lastDoc, m_size, (uint32_t)m_data.size()};
+		out.Write(fields, sizeof(fields));
+		out.Write(m_data.data(), m_data.size());
+	}
+
+	template <typename Reader>
+	bool Load(Reader& in) {
+		uint32_t fields[4];
+		if (!in.Read(fields, sizeof(fields)) || fields[0] > fields[3] || fields[3] > in.Remaining()) return false;
+		m_data.resize(fields[3]);
+		if (!in.Read(m_data.data(), m_data.size())) return false;
+		m_tailStart = fields[0];
+		m_lastDoc = fields[1];
+		m_size = fields[2];
+		return true;
+	}
+
+	// Walks the postings in order. The list must not change while in use.
+	class Cursor {
+	public:
+		explicit Cursor(const PostingList& list) : m_list(&list), m_index(0), m_count(0) { Load(0, 0, kNone); }
+
+		uint32_t Doc() const { return m_index < m_count ? m_docs[m_index] : kEnd; }
+		uint32_t Count() const { return m_counts[m_index]; }
+
+		void Next() {
+			if (++m_index >= m_count && m_count) Load(m_block + 1, m_next, m_last);
+		}
+
+		// Move to the first posting at or after `target`
+		void SeekTo(uint32_t target) {
+			if (Doc() >= target) return;
+			if (m_last < target && m_block < m_list->FullBlocks()) {
+				// Hop over the blocks that end before `target`
+				size_t block = m_block + 1;
+				uint32_t offset = m_next;
+				uint32_t base = m_last;
+				while (block < m_list->FullBlocks()) {
+					Header header = m_list->ReadHeader(offset);
+					if (header.lastDoc >= target) break;
+					base = header.lastDoc;
+					offset += kHeaderBytes + header.bytes;
+					block++;
+				}
+				Load(block, offset, base);
+			}
+			m_index = std::lower_bound(m_docs + m_index, m_docs + m_count, target) - m_docs;
+			if (m_index >= m_count && m_count) Load(m_block + 1, m_next, m_last);
+		}
+
+		// Positions of the word in the current note
+		void Positions(std::vector<uint32_t>& positions) {
+			const uint8_t* p;
+			if (m_block < m_list->FullBlocks()) {
+				while (m_positionIndex < m_index) {
+					SkipPositions(m_positionAt);
+					m_positionIndex++;
+				}
+				p = m_positionAt;
+			} else {
+				p = m_list->m_data.data() + m_tailPositions[m_index];
+			}
+			ReadPositions(p, positions);
+		}
+
+	private:
+		// Decode the block at `offset`, whose ids follow `base`; the block
+		// after the last full one is the tail
+		void Load(size_t block, uint32_t offset, uint32_t base) {
+			const PostingList& list = *m_list;
+			m_block = block;
+			m_index = 0;
+			m_count = 0;
+			if (block < list.FullBlocks()) {
+				Header header = list.ReadHeader(offset);
+				const uint8_t* p = list.m_data.data() + offset + kHeaderBytes;
+				Unpack(p, header.docBits, m_docs);
+				p += 16 * header.docBits;
+				Unpack(p, header.countBits, m_counts);
+				m_positionAt = p + 16 * header.countBits;
+				m_positionIndex = 0;
+				m_count = kBlock;
+				m_next = offset + kHeaderBytes + header.bytes;
+			} else if (block == list.FullBlocks()) {
+				const uint8_t* start = list.m_data.data();
+				const uint8_t* p = start + list.m_tailStart;
+				m_count = list.m_size % kBlock;
+				for (size_t i = 0; i < m_count; i++) {
+					m_docs[i] = GetVarint(p);
+					m_counts[i] = GetVarint(p);
+					m_tailPositions[i] = (uint32_t)(p - start);
+					SkipPositions(p);
+				}
+				m_next = (uint32_t)list.m_data.size();
+			}
+			// Deltas to ids, counts back from count - 1
+			for (size_t i = 0; i < m_count; i++) {
+				base += m_docs[i] + 1;
+				m_docs[i] = base;
+				m_counts[i]++;
+			}
+			m_last = base;
+		}
+
+		const PostingList* m_list;
+		size_t m_block;
+		size_t m_index;
+		size_t m_count;
+		uint32_t m_next;  // offset of the next block
+		uint32_t m_last;  // last id of this block
+		uint32_t m_docs[kBlock];
+		uint32_t m_counts[kBlock];
+		const uint8_t* m_positionAt;      // positions of posting m_positionIndex
+		size_t m_positionIndex;
+		uint32_t m_tailPositions[kBlock];  // offsets of the tail's positions
+	};
+
+	// Bit-pack 128 values of at most `bits` bits: 16 * bits bytes
+	static void Pack(const uint32_t* values, int bits, Bytes& out) {
+		if (bits == 0) return;
+		uint32_t words[4 * 32] = {};
+		for (size_t i = 0; i < kBlock; i++) {
+			size_t bit = (i / 4) * bits;
+			size_t word = (bit / 32) * 4 + i % 4;
+			size_t shift = bit % 32;
+			words[word] |= values[i] << shift;
+			if (shift + bits > 32) words[word + 4] |= values[i] >> (32 - shift);
+		}
+		for (int w = 0; w < 4 * bits; w++) {
+			for (int b = 0; b < 4; b++) out.push_back((uint8_t)(words[w] >> (8 * b)));
+		}
+	}
+
+	static void Unpack(const uint8_t* in, int bits, uint32_t* values) {
+		if (bits == 0) {
+			std::fill(values, values + kBlock, 0u);
+			return;
+		}
+		uint32_t words[4 * 32];
+		for (int w = 0; w < 4 * bits; w++) {
+			words[w] = in[4 * w] | (uint32_t)in[4 * w + 1] << 8 | (uint32_t)in[4 * w + 2] << 16 |
+				(uint32_t)in[4 * w + 3] << 24;
+		}
+		uint32_t mask = bits == 32 ? ~0u : (1u << bits) - 1;
+		for (size_t row = 0; row < kBlock / 4; row++) {
+			size_t bit = row * bits;
+			size_t shift = bit % 32;
+			const uint32_t* low = words + (bit / 32) * 4;
+			uint32_t* out = values + row * 4;
+			if (shift + bits <= 32) {
+				for (int lane = 0; lane < 4; lane++) out[lane] = (low[lane] >> shift) & mask;
+			} else {
+				const uint32_t* high = low + 4;
+				for (int lane = 0; lane < 4; lane++) out[lane] = ((low[lane] >> shift) | (high[lane] << (32 - shift))) & mask;
+			}
+		}
+	}
+
+private:
+	static const uint32_t kNone = UINT32_MAX;  // id before 0, so the first delta is the id itself
+
+	static const uint32_t kHeaderBytes = 10;
+
+	struct Header {
+		uint32_t lastDoc;
+		uint32_t bytes;  // of the block after the header
+		uint8_t docBits;
+		uint8_t countBits;
+	};
+
+	size_t FullBlocks() const { return m_size / kBlock; }
+
+	Header ReadHeader(uint32_t offset) const {
+		const uint8_t* p = m_data.data() + offset;
+		Header header;
+		header.lastDoc = GetFixed(p);
+		header.bytes = GetFixed(p + 4);
+		header.docBits = p[8];
+		header.countBits = p[9];
+		return header;
+	}
+
+	static void PutFixed(Bytes& out, uint32_t value) {
+		for (int b = 0; b < 4; b++) out.push_back((uint8_t)(value >> (8 * b)));
+	}
+
+	static uint32_t GetFixed(const uint8_t* p) {
+		return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+	}
+
+	static void PutVarint(Bytes& out, uint32_t value) {
+		while (value >= 0x80) {
+			out.push_back((uint8_t)(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back((uint8_t)value);
+	}
+
+	static uint32_t GetVarint(const uint8_t*& p) {
+		uint32_t value = 0;
+		for (int shift = 0;; shift += 7) {
+			uint8_t byte = *p++;
+			value |= (uint32_t)(byte & 0x7F) << shift;
+			if (byte < 0x80) return value;
+		}
+	}
+
+	static void PutPositions(Bytes& out, const std::vector<uint32_t>& positions) {
+		PutVarint(out, (uint32_t)positions.size());
+		uint32_t last = 0;
+		for (uint32_t position : positions) {
+			PutVarint(out, position - last);
+			last = position;
+		}
+	}
+
+	static void ReadPositions(const uint8_t* p, std::vector<uint32_t>& positions) {
+		uint32_t count = GetVarint(p);
+		positions.resize(count);
+		uint32_t last = 0;
+		for (uint32_t i = 0; i < count; i++) positions[i] = last += GetVarint(p);
+	}
+
+	static void SkipPositions(const uint8_t*& p) {
+		uint32_t count = GetVarint(p);
+		while (count) count -= *p++ < 0x80;
+	}
+
+	static int Bits(const uint32_t* values) {
+		uint32_t all = 0;
+		for (size_t i = 0; i < kBlock; i++) all |= values[i];
+		int bits = 0;
+		while (bits < 32 && (all >> bits)) bits++;
+		return bits;
+	}
+
+	// Repack the 128 varint postings of the tail as a block
+	void PackTail() {
+		uint32_t docs[kBlock];
+		uint32_t counts[kBlock];
+		std::vector<uint8_t> positions;
+		const uint8_t* p = m_data.data() + m_tailStart;
+		for (size_t i = 0; i < kBlock; i++) {
+			docs[i] = GetVarint(p);
+			counts[i] = GetVarint(p);
+			const uint8_t* start = p;
+			SkipPositions(p);
+			positions.insert(positions.end(), start, p);
+		}
+		int docBits = Bits(docs);
+		int countBits = Bits(counts);
+		m_data.resize(m_tailStart);
+		PutFixed(m_data, m_lastDoc);
+		PutFixed(m_data, (uint32_t)(16 * (docBits + countBits) + positions.size()));
+		m_data.push_back((uint8_t)docBits);
+		m_data.push_back((uint8_t)countBits);
+		Pack(docs, docBits, m_data);
+		Pack(counts, countBits, m_data);
+		m_data.insert(m_data.end(), positions.begin(), positions.end());
+		m_tailStart = (uint32_t)m_data.size();
+	}
+
+	Bytes m_data;
+	uint32_t m_tailStart;  // offset of the varint postings
+	uint32_t m_lastDoc;
+	uint32_t m_size;
+};
+
+#endif // OBSIDIAN_POSTING_LIST_H
@@ -0,0 +1,361 @@
+// preview_blocks.h - Block index used to render the preview around the viewport
+//
+// The preview never converts or lays out the whole note at once. The note is
+// split into Markdown blocks (paragraphs, headings, fences, ...) with their
+// source line ranges, so the frame can render just the blocks around the
+// editor's first visible line and map scroll positions between the two panes.
+//
+// After an edit the index is not split again from the top: Edit() starts at
+// the block before the one the edit touched and stops at the first block that
+// starts where one started before the edit. A block's extent depends only on
+// its own lines, so everything from there on is the old blocks, moved.
+#ifndef OBSIDIAN_PREVIEW_BLOCKS_H
+#define OBSIDIAN_PREVIEW_BLOCKS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "content_hash.h"
+#include "markdown_lexer.h"
+
+enum PreviewBlockKind {
+	BLOCK_PARAGRAPH = 0,
+	BLOCK_HEADING,
+	BLOCK_FENCE,
+	BLOCK_FRONTMATTER,
+	BLOCK_QUOTE,
+	BLOCK_LIST,
+	BLOCK_RULE,
+	BLOCK_TABLE
+};
+
+// Split a GFM table row into cells: `bounds` receives a [start, end) pair
+// per cell, trimmed, with the outer pipes dropped. Escaped pipes (\|) do not
+// split. Returns the number of cells.
+inline size_t SplitTableRow(const char* s, size_t n, std::vector<size_t>& bounds) {
+	bounds.clear();
+	size_t i = 0;
+	while (i < n && (s[i] == ' ' || s[i] == '\t')) i++;
+	while (n > i && (s[n - 1] == ' ' || s[n - 1] == '\t' || s[n - 1] == '\r')) n--;
+	if (i < n && s[i] == '|') i++;
+	if (n > i && s[n - 1] == '|' && s[n - 2] != '\\') n--;
+	size_t start = i;
+	for (size_t j = i; j <= n; j++) {
+		if (j < n && (s[j] != '|' || (j > 0 && s[j - 1] == '\\'))) continue;
+		size_t a = start, b = j;
+		while (a < b && (s[a] == ' ' || s[a] == '\t')) a++;
+		while (b > a && (s[b - 1] == ' ' || s[b - 1] == '\t')) b--;
+		bounds.push_back(a);
+		bounds.push_back(b);
+		start = j + 1;
+	}
+	return bounds.size() / 2;
+}
+
+// Whether `s` is a table delimiter row ("| --- | :-: |"), and its cell count
+inline size_t TableDelimiterCells(const char* s, size_t n, std::vector<size_t>& bounds) {
+	if (!memchr(s, '|', n)) return 0;
+	size_t count = SplitTableRow(s, n, bounds);
+	for (size_t c = 0; c < count; c++) {
+		size_t a = bounds[2 * c], b = bounds[2 * c + 1];
+		if (a < b && s[a] == ':') a++;
+		if (b > a && s[b - 1] == ':') b--;
+		if (a == b) return 0;
+		for (size_t i = a; i < b; i++) {
+			if (s[i] != '-') return 0;
+		}
+	}
+	return count;
+}
+
+struct PreviewBlock {
+	PreviewBlockKind kind;
+	int firstLine;  // source lines, inclusive
+	int lastLine;
+	size_t start;   // byte range in the note text
+	size_t end;
+	uint64_t hash;  // FNV-1a of the block bytes, keys the layout cache
+};
+
+// Edits not yet given to the index, merged into one: bytes [start, oldEnd)
+// of the text it was built from are now [start, newEnd)
+struct PreviewTextEdit {
+	size_t start = 0;
+	size_t oldEnd = 0;
+	size_t newEnd = 0;
+	bool pending = false;
+
+	void Add(size_t pos, size_t removed, size_t inserted) {
+		if (!pending) {
+			*this = PreviewTextEdit{pos, pos + removed, pos + inserted, true};
+			return;
+		}
+		// Text past the merged range is where it was, shifted
+		size_t end = std::max(newEnd, pos + removed);
+		oldEnd += end - newEnd;
+		newEnd = end - removed + inserted;
+		start = std::min(start, pos);
+	}
+};
+
+// Blocks [first, first + removed) of the index before an Edit() became
+// [first, first + added) after it; the others only moved
+struct PreviewBlockEdit {
+	size_t first = 0;
+	size_t removed = 0;
+	size_t added = 0;
+};
+
+class PreviewBlockIndex {
+public:
+	// Split `text` into blocks. This is a single forward scan over the bytes;
+	// no conversion or layout happens here.
+	void Rebuild(const char* text, size_t len) {
+		m_blocks.clear();
+		Sync sync;
+		m_lineCount = Split(text, len, 0, 0, m_blocks, sync);
+	}
+
+	// Update the index for an edit that replaced the `removed` bytes at `pos`
+	// with `inserted` bytes; `text` is the note after the edit
+	PreviewBlockEdit Edit(const char* text, size_t len, size_t pos, size_t removed, size_t inserted) {
+		PreviewBlockEdit edit;
+		size_t count = m_blocks.size();
+		if (count == 0) {
+			Rebuild(text, len);
+			edit.added = m_blocks.size();
+			return edit;
+		}
+
+		// The block before the edited one may take in the edited lines
+		auto touched = std::lower_bound(m_blocks.begin(), m_blocks.end(), pos,
+			[](const PreviewBlock& b, size_t p) { return b.end < p; });
+		edit.first = std::max<size_t>(touched - m_blocks.begin(), 1) - 1;
+		// A "---" on line 0 is frontmatter or a rule depending on the lines
+		// below it that may close it
+		if (edit.first && len && text[0] == '-' &&
+			m_blocks[edit.first].firstLine <= MarkdownLexer::kFrontmatterMaxLines) edit.first = 0;
+		// Blank lines ahead of the first block are split again with it
+		size_t start = edit.first ? m_blocks[edit.first].start : 0;
+		int line = edit.first ? m_blocks[edit.first].firstLine : 0;
+
+		Sync sync;
+		sync.from = pos + inserted;
+		sync.shift = (ptrdiff_t)inserted - (ptrdiff_t)removed;
+		sync.next = edit.first;
+		std::vector<PreviewBlock> fresh;
+		int lineCount = Split(text, len, start, line, fresh, sync);
+		if (!sync.found) sync.next = count;
+
+		edit.removed = sync.next - edit.first;
+		edit.added = fresh.size();
+		if (sync.next < count) {
+			int lineShift = sync.line - m_blocks[sync.next].firstLine;
+			for (size_t i = sync.next; i < count; i++) {
+				PreviewBlock& block = m_blocks[i];
+				block.firstLine += lineShift;
+				block.lastLine += lineShift;
+				block.start += sync.shift;
+				block.end += sync.shift;
+			}
+			m_lineCount += lineShift;
+		} else {
+			m_lineCount = lineCount;
+		}
+		m_blocks.erase(m_blocks.begin() + edit.first, m_blocks.begin() + sync.next);
+		m_blocks.insert(m_blocks.begin() + edit.first, fresh.begin(), fresh.end());
+		return edit;
+	}
+
+	const std::vector<PreviewBlock>& Blocks() const { return m_blocks; }
+	size_t Count() const { return m_blocks.size(); }
+	int LineCount() const { return m_lineCount; }
+
+	// Index of the block containing `line`, or of the first block after it
+	// when the line is blank. Returns -1 for an empty index.
+	int BlockForLine(int line) const {
+		if (m_blocks.empty()) return -1;
+		auto it = std::lower_bound(m_blocks.begin(), m_blocks.end(), line,
+			[](const PreviewBlock& b, int l) { return b.lastLine < l; });
+		if (it == m_blocks.end()) return (int)m_blocks.size() - 1;
+		return (int)(it - m_blocks.begin());
+	}
+
+private:
+	// Where an Edit() may stop splitting: the first block starting at or
+	// after `from` where an old block started, `shift` bytes earlier
+	struct Sync {
+		size_t from = SIZE_MAX;
+		ptrdiff_t shift = 0;
+		size_t next = 0;  // old block to compare with; where the old blocks resume
+		int line = 0;     // line the old blocks resume at
+		bool found = false;
+
+		bool At(size_t pos, int atLine, const std::vector<PreviewBlock>& old) {
+			if (pos < from) return false;
+			while (next < old.size() && (ptrdiff_t)old[next].start + shift < (ptrdiff_t)pos) next++;
+			if (next == old.size() || (ptrdiff_t)old[next].start + shift != (ptrdiff_t)pos) return false;
+			// Front matter is only recognised on the first line
+			if (pos == 0 || old[next].start == 0) return false;
+			line = atLine;
+			found = true;
+			return true;
+		}
+	};
+
+	// Split blocks from `pos`, the start of line `line` and of a block, into
+	// `out` until the end of the text or `sync`. Returns the lines scanned.
+	int Split(const char* text, size_t len, size_t pos, int line, std::vector<PreviewBlock>& out,
+		Sync& sync) {
+		bool open = false;
+		PreviewBlock current = {};
+		char fenceChar = 0;
+		size_t fenceLen = 0;
+
+		while (pos < len) {
+			const char* nl = (const char*)memchr(text + pos, '\n', len - pos);
+			size_t eol = nl ? (size_t)(nl - text) : len;
+			size_t next = nl ? eol + 1 : len;
+			const char* s = text + pos;
+			size_t n = eol - pos;
+			if (n && s[n - 1] == '\r') n--;
+
+			if (open && current.kind == BLOCK_FENCE) {
+				// Everything up to the closing fence belongs to the block
+				size_t indent = LeadingSpaces(s, n);
+				size_t run = RunLength(s, n, indent, fenceChar);
+				if (indent < 4 && run >= fenceLen && IsBlank(s + indent + run, n - indent - run)) {
+					Close(current, line, next, text, out);
+					open = false;
+				}
+			} else if (open && current.kind == BLOCK_FRONTMATTER) {
+				if (IsDelimiter(s, n, '-') || IsDelimiter(s, n, '.')) {
+					Close(current, line, next, text, out);
+					open = false;
+				}
+			} else if (IsBlank(s, n)) {
+				if (open) {
+					Close(current, line - 1, pos, text, out);
+					open = false;
+				}
+			} else if (open && current.kind == BLOCK_TABLE &&
+				(line == current.firstLine + 1 || Classify(s, n, line, fenceChar, fenceLen) == BLOCK_PARAGRAPH)) {
+				// Rows run up to a blank line or the start of another block
+			} else {
+				PreviewBlockKind kind = Classify(s, n, line, fenceChar, fenceLen);
+				if (kind == BLOCK_FRONTMATTER && !MarkdownLexer::HasFrontmatter(text, len)) kind = BLOCK_RULE;
+				if (kind == BLOCK_PARAGRAPH && IsTableHeader(s, n, text + next, len - next)) kind = BLOCK_TABLE;
+				bool standalone = kind == BLOCK_HEADING || kind == BLOCK_RULE;
+				bool startsNew = !open || standalone || kind == BLOCK_FENCE ||
+					kind == BLOCK_FRONTMATTER || (kind != current.kind && kind != BLOCK_PARAGRAPH) ||
+					current.kind == BLOCK_HEADING || current.kind == BLOCK_RULE;
+				if (startsNew && sync.At(pos, line, m_blocks)) {
+					if (open) Close(current, line - 1, pos, text, out);
+					return line;
+				}
+				if (startsNew) {
+					if (open) Close(current, line - 1, pos, text, out);
+					current = PreviewBlock();
+					current.kind = kind;
+					current.firstLine = line;
+					current.start = pos;
+					open = true;
+				}
+			}
+
+			pos = next;
+			line++;
+		}
+		if (open) Close(current, line - 1, len, text, out);
+		return line;
+	}
+
+	static void Close(PreviewBlock& block, int lastLine, size_t end, const char* text,
+		std::vector<PreviewBlock>& out) {
+		block.lastLine = lastLine;
+		block.end = end;
+		block.hash = ContentHash(text + block.start, end - block.start) ^ (uint64_t)block.kind;
+		out.push_back(block);
+	}
+
+	static PreviewBlockKind Classify(const char* s, size_t n, int line, char& fenceChar,
+		size_t& fenceLen) {
+		if (line == 0 && IsDelimiter(s, n, '-')) return BLOCK_FRONTMATTER;
+		size_t indent = LeadingSpaces(s, n);
+		if (indent >= 4) return BLOCK_PARAGRAPH;
+		const char* p = s + indent;
+		size_t rest = n - indent;
+		if (rest >= 3 && (p[0] == '`' || p[0] == '~')) {
+			size_t run = RunLength(p, rest, 0, p[0]);
+			if (run >= 3) {
+				fenceChar = p[0];
+				fenceLen = run;
+				return BLOCK_FENCE;
+			}
+		}
+		size_t hashes = RunLength(p, rest, 0, '#');
+		if (hashes >= 1 && hashes <= 6 && (hashes == rest || p[hashes] == ' ' || p[hashes] == '\t'))
+			return BLOCK_HEADING;
+		if (IsRule(p, rest)) return BLOCK_RULE;
+		if (p[0] == '>') return BLOCK_QUOTE;
+		if (rest >= 2 && (p[0] == '-' || p[0] == '*' || p[0] == '+') && p[1] == ' ')
+			return BLOCK_LIST;
+		size_t d = 0;
+		while (d < rest && p[d] >= '0' && p[d] <= '9') d++;
+		if (d > 0 && d + 1 < rest && (p[d] == '.' || p[d] == ')') && p[d + 1] == ' ')
+			return BLOCK_LIST;
+		return BLOCK_PARAGRAPH;
+	}
+
+	// A row with pipes followed by a delimiter row with as many cells
+	bool IsTableHeader(const char* s, size_t n, const char* rest, size_t restLen) {
+		if (!memchr(s, '|', n)) return false;
+		const char* nl = (const char*)memchr(rest, '\n', restLen);
+		size_t delimiter = TableDelimiterCells(rest, nl ? (size_t)(nl - rest) : restLen, m_bounds);
+		return delimiter && delimiter == SplitTableRow(s, n, m_bounds);
+	}
+
+	static bool IsBlank(const char* s, size_t n) {
+		for (size_t i = 0; i < n; i++)
+			if (s[i] != ' ' && s[i] != '\t') return false;
+		return true;
+	}
+
+	static bool IsDelimiter(const char* s, size_t n, char c) {
+		while (n && s[n - 1] == ' ') n--;
+		return n == 3 && s[0] == c && s[1] == c && s[2] == c;
+	}
+
+	static bool IsRule(const char* s, size_t n) {
+		char c = 0;
+		int count = 0;
+		for (size_t i = 0; i < n; i++) {
+			if (s[i] == ' ' || s[i] == '\t') continue;
+			if ((s[i] != '-' && s[i] != '*' && s[i] != '_') || (c && s[i] != c)) return false;
+			c = s[i];
+			count++;
+		}
+		return count >= 3;
+	}
+
+	static size_t LeadingSpaces(const char* s, size_t n) {
+		size_t i = 0;
+		while (i < n && s[i] == ' ') i++;
+		return i;
+	}
+
+	static size_t RunLength(const char* s, size_t n, size_t from, char c) {
+		size_t i = from;
+		while (i < n && s[i] == c) i++;
+		return i - from;
+	}
+
+	std::vector<PreviewBlock> m_blocks;
+	int m_lineCount = 0;
+	std::vector<size_t> m_bounds;  // scratch for table rows
+};
+
+#endif // OBSIDIAN_PREVIEW_BLOCKS_H
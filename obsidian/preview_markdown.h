@@ -0,0 +1,340 @@
+// preview_markdown.h - One preview block parsed into lines of styled spans
+//
+// PreviewBlockIndex finds where blocks start and end; ParsePreviewBlock() turns
+// the bytes of one of them into what the preview draws: lines (paragraph
+// lines, list items, code lines) made of spans with a style. Inline syntax is
+// read in a single left-to-right pass: `code` first, so nothing inside it is
+// styled, then embeds, [[links]], **bold** and *italic*, which may nest.
+// Embeds keep their target and alt text; the caller decides what they become.
+// Fenced code is split into highlighted tokens of its language. Tables are
+// read in one pass into their cells and per-column statistics; their inline
+// syntax is only parsed for the rows that are drawn.
+#ifndef OBSIDIAN_PREVIEW_MARKDOWN_H
+#define OBSIDIAN_PREVIEW_MARKDOWN_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "code_highlight.h"
+#include "preview_blocks.h"
+
+enum PreviewSpanStyle : uint8_t {
+	SPAN_BOLD = 1,
+	SPAN_ITALIC = 2,
+	SPAN_CODE = 4,
+	SPAN_LINK = 8,
+	SPAN_EMBED = 16,    // ![[target]] or ![alt](target); text is the alt text
+	SPAN_IMAGE = 32,    // an embed of an image file; target is its path, which may not exist yet
+};
+
+struct PreviewSpan {
+	std::string text;
+	uint8_t style = 0;
+	std::string target;  // embeds and images
+	uint8_t token = CODE_PLAIN;  // fenced code: CodeToken
+};
+
+struct PreviewLine {
+	std::vector<PreviewSpan> spans;
+	std::string marker;  // list items: "•" or "3."
+};
+
+enum PreviewAlign : uint8_t {
+	ALIGN_DEFAULT = 0,
+	ALIGN_LEFT,
+	ALIGN_CENTER,
+	ALIGN_RIGHT
+};
+
+// Width statistics of a table column, gathered as its rows are read.
+// Lengths are in code points of the cell source.
+struct PreviewColumn {
+	uint8_t align = ALIGN_DEFAULT;
+	size_t headerChars = 0;
+	size_t maxChars = 0;    // longest body cell
+	size_t widestRow = 0;   // the row holding it; 0 while there are no rows
+	size_t totalChars = 0;  // of all body cells
+
+	double MeanChars(size_t rows) const { return rows ? (double)totalChars / rows : 0; }
+};
+
+// A GFM table. Row 0 is the header; the cells of all rows are stored end to
+// end, each row with exactly one cell per column.
+struct PreviewTable {
+	std::vector<PreviewColumn> columns;
+	std::string text;
+	std::vector<uint32_t> cells;  // cell i is text[cells[i], cells[i + 1])
+
+	size_t Rows() const { return columns.empty() ? 0 : (cells.size() - 1) / columns.size(); }
+	size_t BodyRows() const { return Rows() ? Rows() - 1 : 0; }
+
+	std::string Cell(size_t row, size_t column) const {
+		size_t i = row * columns.size() + column;
+		return text.substr(cells[i], cells[i + 1] - cells[i]);
+	}
+
+	size_t MemoryUsage() const {
+		return sizeof(PreviewTable) + columns.capacity() * sizeof(PreviewColumn) + text.capacity() +
+			cells.capacity() * sizeof(uint32_t);
+	}
+};
+
+struct PreviewContent {
+	PreviewBlockKind kind = BLOCK_PARAGRAPH;
+	int level = 0;  // headings: 1 to 6
+	std::vector<PreviewLine> lines;
+	std::shared_ptr<const PreviewTable> table;  // tables, instead of lines
+};
+
+// Append the spans of `text`, all with at least `style`
+inline void ParsePreviewInline(const std::string& text, uint8_t style, std::vector<PreviewSpan>& spans) {
+	std::string plain;
+	auto flush = [&]() {
+		if (plain.empty()) return;
+		if (!spans.empty() && spans.back().style == style && spans.back().target.empty()) {
+			spans.back().text += plain;
+		} else {
+			PreviewSpan span;
+			span.text = plain;
+			span.style = style;
+			spans.push_back(span);
+		}
+		plain.clear();
+	};
+	auto add = [&](const std::string& spanText, uint8_t spanStyle, const std::string& target) {
+		flush();
+		PreviewSpan span;
+		span.text = spanText;
+		span.style = spanStyle;
+		span.target = target;
+		spans.push_back(span);
+	};
+
+	size_t i = 0;
+	while (i < text.size()) {
+		char c = text[i];
+		size_t close;
+		if (c == '`' && (close = text.find('`', i + 1)) != std::string::npos) {
+			add(text.substr(i + 1, close - i - 1), style | SPAN_CODE, std::string());
+			i = close + 1;
+		} else if (text.compare(i, 3, "![[") == 0 && (close = text.find("]]", i + 3)) != std::string::npos) {
+			// ![[target|size]]
+			std::string target = text.substr(i + 3, close - i - 3);
+			target = target.substr(0, target.find('|'));
+			add(target, style | SPAN_EMBED, target);
+			i = close + 2;
+		} else if (text.compare(i, 2, "![") == 0 && (close = text.find("](", i + 2)) != std::string::npos &&
+			text.find(')', close + 2) != std::string::npos) {
+			// ![alt](<target> "title")
+			size_t end = text.find(')', close + 2);
+			std::string target = text.substr(close + 2, end - close - 2);
+			size_t start = target.find_first_not_of(' ');
+			target = start == std::string::npos ? std::string() : target.substr(start);
+			if (!target.empty() && target[0] == '<') {
+				target = target.substr(1, target.find('>') - 1);
+			} else {
+				target = target.substr(0, target.find_first_of(" \t"));
+			}
+			add(text.substr(i + 2, close - i - 2), style | SPAN_EMBED, target);
+			i = end + 1;
+		} else if (text.compare(i, 2, "[[") == 0 && (close = text.find("]]", i + 2)) != std::string::npos) {
+			// [[Note#Heading|Alias]] shows the alias, or the target as written
+			std::string inner = text.substr(i + 2, close - i - 2);
+			size_t bar = inner.find('|');
+			add(bar == std::string::npos ? inner : inner.substr(bar + 1), style | SPAN_LINK, std::string());
+			i = close + 2;
+		} else if (text.compare(i, 2, "**") == 0 && (close = text.find("**", i + 2)) != std::string::npos &&
+			close > i + 2) {
+			flush();
+			ParsePreviewInline(text.substr(i + 2, close - i - 2), style | SPAN_BOLD, spans);
+			i = close + 2;
+		} else if (c == '*' && (close = text.find('*', i + 1)) != std::string::npos && close > i + 1) {
+			flush();
+			ParsePreviewInline(text.substr(i + 1, close - i - 1), style | SPAN_ITALIC, spans);
+			i = close + 1;
+		} else {
+			plain += c;
+			i++;
+		}
+	}
+	flush();
+}
+
+// Length of a list marker ("- ", "* ", "+ ", "12. ", "3) ") at the start of `line`
+inline size_t PreviewListMarker(const std::string& line) {
+	if (line.size() > 1 && (line[0] == '-' || line[0] == '*' || line[0] == '+') && line[1] == ' ') return 2;
+	size_t d = line.find_first_not_of("0123456789");
+	if (d != std::string::npos && d > 0 && d + 1 < line.size() && (line[d] == '.' || line[d] == ')') &&
+		line[d + 1] == ' ') {
+		return d + 2;
+	}
+	return 0;
+}
+
+// Read a table block: header row, delimiter row, then body rows. Missing
+// cells are empty and extra ones dropped, as GFM does.
+inline std::shared_ptr<const PreviewTable> ParsePreviewTable(const char* text, size_t len) {
+	std::shared_ptr<PreviewTable> table = std::make_shared<PreviewTable>();
+	table->cells.push_back(0);
+	std::vector<size_t> bounds;
+	size_t line = 0;
+	size_t row = 0;
+	for (size_t pos = 0; pos < len; line++) {
+		const char* nl = (const char*)memchr(text + pos, '\n', len - pos);
+		size_t eol = nl ? (size_t)(nl - text) : len;
+		const char* s = text + pos;
+		size_t n = eol - pos;
+		pos = nl ? eol + 1 : len;
+
+		size_t count = SplitTableRow(s, n, bounds);
+		if (line == 0) {
+			table->columns.resize(count);
+		} else if (line == 1) {
+			for (size_t c = 0; c < count && c < table->columns.size(); c++) {
+				bool left = s[bounds[2 * c]] == ':';
+				bool right = s[bounds[2 * c + 1] - 1] == ':';
+				table->columns[c].align = left && right ? ALIGN_CENTER : right ? ALIGN_RIGHT :
+					left ? ALIGN_LEFT : ALIGN_DEFAULT;
+			}
+			continue;
+		}
+
+		for (size_t c = 0; c < table->columns.size(); c++) {
+			size_t chars = 0;
+			if (c < count) {
+				for (size_t i = bounds[2 * c]; i < bounds[2 * c + 1]; i++) {
+					if (s[i] == '\\' && i + 1 < bounds[2 * c + 1] && s[i + 1] == '|') continue;
+					table->text += s[i];
+					if (((unsigned char)s[i] & 0xc0) != 0x80) chars++;
+				}
+			}
+			table->cells.push_back((uint32_t)table->text.size());
+
+			PreviewColumn& column = table->columns[c];
+			if (row == 0) {
+				column.headerChars = chars;
+			} else {
+				column.totalChars += chars;
+				if (chars > column.maxChars || !column.widestRow) {
+					column.maxChars = chars;
+					column.widestRow = row;
+				}
+			}
+		}
+		row++;
+	}
+	return table;
+}
+
+// Parse the `len` bytes of a block of the given kind. Fences are highlighted
+// through `code`, under `key` (the block's hash), when there is a cache.
+inline PreviewContent ParsePreviewBlock(PreviewBlockKind kind, const char* text, size_t len,
+	CodeHighlightCache* code = nullptr, uint64_t key = 0) {
+	PreviewContent content;
+	content.kind = kind;
+	if (kind == BLOCK_TABLE) {
+		content.table = ParsePreviewTable(text, len);
+		return content;
+	}
+	std::vector<std::string> lines;
+	for (size_t pos = 0; pos < len;) {
+		size_t eol = pos;
+		while (eol < len && text[eol] != '\n') eol++;
+		std::string line(text + pos, eol - pos);
+		if (!line.empty() && line.back() == '\r') line.pop_back();
+		lines.push_back(line);
+		pos = eol + 1;
+	}
+	while (!lines.empty() && lines.back().find_first_not_of(" \t") == std::string::npos) lines.pop_back();
+	if (lines.empty()) return content;
+
+	switch (kind) {
+	case BLOCK_FRONTMATTER:
+	case BLOCK_RULE:
+		// Frontmatter is metadata, not content; a rule has none
+		break;
+	case BLOCK_FENCE: {
+		// Everything between the fence lines, verbatim; an unclosed fence
+		// runs to the end of the block
+		size_t end = lines.size();
+		if (end > 1 && lines.back().find_first_not_of(" `~") == std::string::npos) end--;
+		std::vector<std::string> body(lines.begin() + 1, lines.begin() + std::max<size_t>(end, 1));
+		size_t info = lines[0].find_first_not_of(" `~");
+		int lang = info == std::string::npos ? MD_LANG_NONE :
+			MarkdownLexer::LanguageFromInfo(lines[0].data() + info, lines[0].size() - info);
+		std::shared_ptr<const CodeHighlighter::Lines> runs = code ? code->Get(key, lang, body) :
+			std::make_shared<const CodeHighlighter::Lines>(CodeHighlighter::Highlight(lang, body));
+		for (size_t i = 0; i < body.size(); i++) {
+			content.lines.emplace_back();
+			for (const CodeRun& run : (*runs)[i]) {
+				PreviewSpan span;
+				span.text = body[i].substr(run.start, run.length);
+				span.style = SPAN_CODE;
+				span.token = run.token;
+				content.lines.back().spans.push_back(span);
+			}
+		}
+		break;
+	}
+	case BLOCK_HEADING: {
+		std::string first = lines[0].substr(lines[0].find_first_not_of(' '));
+		size_t level = first.find_first_not_of('#');
+		if (level == std::string::npos) level = first.size();
+		content.level = (int)level;
+		std::string title = first.substr(level);
+		size_t start = title.find_first_not_of(" \t");
+		content.lines.emplace_back();
+		if (start != std::string::npos) ParsePreviewInline(title.substr(start), 0, content.lines.back().spans);
+		break;
+	}
+	case BLOCK_QUOTE:
+		for (std::string line : lines) {
+			size_t q = line.find_first_not_of(' ');
+			if (q != std::string::npos && line[q] == '>') line.erase(0, q + 1);
+			if (!line.empty() && line[0] == ' ') line.erase(0, 1);
+			content.lines.emplace_back();
+			ParsePreviewInline(line, 0, content.lines.back().spans);
+		}
+		break;
+	case BLOCK_LIST: {
+		// Lines without a marker continue the item above
+		std::string item;
+		std::string marker;
+		auto flushItem = [&]() {
+			if (marker.empty()) return;
+			content.lines.emplace_back();
+			content.lines.back().marker = marker;
+			ParsePreviewInline(item, 0, content.lines.back().spans);
+		};
+		for (const std::string& raw : lines) {
+			size_t lead = raw.find_first_not_of(" \t");
+			std::string line = lead == std::string::npos ? std::string() : raw.substr(lead);
+			size_t length = PreviewListMarker(line);
+			if (length) {
+				flushItem();
+				marker = line[0] >= '0' && line[0] <= '9' ? line.substr(0, length - 1) : std::string("\xE2\x80\xA2");
+				item = line.substr(length);
+			} else {
+				if (marker.empty()) marker = "\xE2\x80\xA2";
+				item += " " + line;
+			}
+		}
+		flushItem();
+		break;
+	}
+	default:
+		for (const std::string& line : lines) {
+			content.lines.emplace_back();
+			ParsePreviewInline(line, 0, content.lines.back().spans);
+		}
+		break;
+	}
+	return content;
+}
+
+#endif // OBSIDIAN_PREVIEW_MARKDOWN_H
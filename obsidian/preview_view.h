@@ -0,0 +1,810 @@
+// preview_view.h - Native preview that draws Markdown blocks directly
+//
+// The note's blocks (PreviewBlockIndex) are drawn with wxGraphicsContext; no
+// HTML is generated and nothing is laid out document-wide. Each block is laid
+// out on its own, into text runs, fills, rules and bitmaps placed relative to
+// the block's top, and the layout is cached by the block's content hash. A
+// layout is only made again when its block changes (its hash is new) or the
+// width does, so refreshing the preview after an edit lays out the one block
+// that was edited; the rest is bookkeeping over block heights.
+//
+// Blocks not laid out yet take an estimated height. Painting lays out the
+// blocks it shows and LayOutAhead() the ones around them, so a long note is
+// never laid out in full, and only blocks that meet the visible area are
+// drawn. Blocks in collapsed sections take no space at all.
+//
+// Tables are virtualized within their block: laying one out only sizes its
+// columns (from the widest cell of each, found when the table was parsed) and
+// its header. Body rows are laid out when they are first drawn, so a table of
+// 10,000 rows costs the rows on screen.
+#ifndef OBSIDIAN_PREVIEW_VIEW_H
+#define OBSIDIAN_PREVIEW_VIEW_H
+
+#include <wx/wx.h>
+#include <wx/dcbuffer.h>
+#include <wx/graphics.h>
+#include <wx/scrolwin.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "preview_blocks.h"
+#include "preview_markdown.h"
+
+class PreviewView : public wxScrolledCanvas {
+public:
+	// Content of block `index` of the last SetBlocks(), with embeds resolved
+	typedef std::function<PreviewContent(int index)> ParseCallback;
+	// Thumbnail of an image at `width`, null while it is being decoded, or an
+	// empty bitmap if it cannot be
+	typedef std::function<const wxBitmap*(const std::string& path, int width)> ImageCallback;
+
+	explicit PreviewView(wxWindow* parent, wxWindowID id = wxID_ANY)
+		: wxScrolledCanvas(parent, id, wxDefaultPosition, wxDefaultSize, wxVSCROLL), m_width(0), m_lineHeight(0) {
+		SetBackgroundStyle(wxBG_STYLE_PAINT);
+		SetBackgroundColour(*wxWHITE);
+		SetScrollRate(0, kScrollStep);
+		m_tops.assign(1, kMargin);
+		Bind(wxEVT_PAINT, &PreviewView::OnPaint, this);
+		Bind(wxEVT_SIZE, &PreviewView::OnSize, this);
+	}
+
+	void SetParseCallback(ParseCallback callback) { m_parse = callback; }
+	void SetImageCallback(ImageCallback callback) { m_image = callback; }
+
+	// Shown instead of the note while there are no blocks
+	void SetMessage(const wxString& message) {
+		m_message = message;
+		if (m_keys.empty()) Refresh(false);
+	}
+
+	// Show `blocks`; `hidden[i]` marks blocks in collapsed sections. Blocks
+	// whose hash was laid out before keep their layout.
+	void SetBlocks(const std::vector<PreviewBlock>& blocks, const std::vector<bool>& hidden) {
+		size_t count = blocks.size();
+		m_keys.resize(count);
+		m_hidden.resize(count);
+		m_estimates.resize(count);
+		m_blockLayouts.assign(count, nullptr);
+		for (size_t i = 0; i < count; i++) SetBlock(i, blocks[i], i < hidden.size() && hidden[i]);
+		DropStaleLayouts();
+		UpdateTops(0);
+		UpdateVirtualSize();
+		Refresh(false);
+	}
+
+	// Follow an Edit() of the block index that SetBlocks() was given:
+	// `blocks` is the index after it and `hidden` holds a flag per added
+	// block. The blocks around the edit keep their heights, so only the tops
+	// from the edit down are added up again.
+	void EditBlocks(const std::vector<PreviewBlock>& blocks, const PreviewBlockEdit& edit,
+		const std::vector<bool>& hidden) {
+		size_t first = edit.first;
+		size_t last = first + edit.removed;
+		m_keys.erase(m_keys.begin() + first, m_keys.begin() + last);
+		m_keys.insert(m_keys.begin() + first, edit.added, 0);
+		m_hidden.erase(m_hidden.begin() + first, m_hidden.begin() + last);
+		m_hidden.insert(m_hidden.begin() + first, edit.added, false);
+		m_estimates.erase(m_estimates.begin() + first, m_estimates.begin() + last);
+		m_estimates.insert(m_estimates.begin() + first, edit.added, 0);
+		m_blockLayouts.erase(m_blockLayouts.begin() + first, m_blockLayouts.begin() + last);
+		m_blockLayouts.insert(m_blockLayouts.begin() + first, edit.added, nullptr);
+		for (size_t k = 0; k < edit.added; k++) {
+			SetBlock(first + k, blocks[first + k], k < hidden.size() && hidden[k]);
+		}
+		DropStaleLayouts();
+		UpdateTops(first);
+		UpdateVirtualSize();
+		Refresh(false);
+	}
+
+	// Forget every layout, e.g. when embeds resolve differently
+	void Invalidate() {
+		m_layouts.clear();
+		m_imageLayouts.clear();
+		std::fill(m_blockLayouts.begin(), m_blockLayouts.end(), nullptr);
+		UpdateTops(0);
+		UpdateVirtualSize();
+		Refresh(false);
+	}
+
+	// Lay out again the blocks showing one of `paths`, images which may have
+	// arrived, changed or gone
+	void ImagesChanged(const std::set<std::string>& paths) {
+		std::set<const Layout*> dropped;
+		for (const std::string& path : paths) {
+			auto users = m_imageLayouts.find(path);
+			if (users == m_imageLayouts.end()) continue;
+			for (uint64_t key : users->second) {
+				auto found = m_layouts.find(key);
+				if (found == m_layouts.end()) continue;
+				dropped.insert(found->second.get());
+				m_layouts.erase(found);
+			}
+			m_imageLayouts.erase(users);
+		}
+		if (dropped.empty()) return;
+		for (const Layout*& layout : m_blockLayouts) {
+			if (layout && dropped.count(layout)) layout = nullptr;
+		}
+		Refresh(false);
+	}
+
+	// Top of `block` in document pixels
+	int BlockY(int block) const {
+		if (block < 0 || block >= (int)m_keys.size()) return -1;
+		return m_tops[block];
+	}
+
+	// The last block starting at or above `y`
+	int BlockAtY(int y) const {
+		if (m_keys.empty()) return -1;
+		auto at = std::upper_bound(m_tops.begin(), m_tops.end() - 1, y);
+		return std::max(0, (int)(at - m_tops.begin()) - 1);
+	}
+
+	// The block at the top of the visible area, below the margin. In a
+	// table, `line` receives the source line of the top row within the block.
+	int TopBlock(int* line = nullptr) const {
+		int y = ViewTop() + kMargin;
+		int block = BlockAtY(y);
+		if (line) {
+			const Layout* layout = block >= 0 ? m_blockLayouts[block] : nullptr;
+			size_t row = layout && layout->table ? (size_t)((y - m_tops[block]) / layout->table->rowHeight) : 0;
+			// Source line 1 is the delimiter row
+			*line = row ? (int)row + 1 : 0;
+		}
+		return block;
+	}
+
+	// Scroll so `block` is the top one, or in a table, the row from source
+	// line `line` of the block
+	void ScrollToBlock(int block, int line = 0) {
+		int y = BlockY(block);
+		if (y < 0) return;
+		if (line > 1 && !m_hidden[block]) {
+			const Layout* layout = m_blockLayouts[block];
+			if (!layout) {
+				layout = LayOutBlock(block);
+				UpdateTops(block);
+				UpdateVirtualSize();
+			}
+			if (layout->table) y += (int)((line - 1) * layout->table->rowHeight);
+		}
+		Scroll(-1, (y - kMargin + kScrollStep - 1) / kScrollStep);
+	}
+
+	// Lay out up to `count` of the blocks within `reach` of the top one that
+	// have none yet, nearest first. Returns false once there are none left.
+	bool LayOutAhead(int count, int reach) {
+		int top = TopBlock();
+		if (top < 0 || !IsShownOnScreen()) return false;
+		int topOffset = ViewTop() - m_tops[top];
+		int n = (int)m_keys.size();
+		int done = 0;
+		int above = m_tops[top];
+		for (int d = 0; d <= reach && done < count; d++) {
+			for (int i : {top + d, top - d - 1}) {
+				if (i < 0 || i >= n || m_hidden[i] || m_blockLayouts[i] || done >= count) continue;
+				LayOutBlock(i);
+				done++;
+			}
+		}
+		if (!done) return false;
+		UpdateTops(0);
+		UpdateVirtualSize();
+		// Keep the top block where it was when blocks above it changed height
+		if (m_tops[top] != above) Scroll(-1, (m_tops[top] + topOffset) / kScrollStep);
+		Refresh(false);
+		return true;
+	}
+
+	// Width thumbnails are decoded at; bucketed so resizing does not thrash
+	// the thumbnail cache
+	int ImageWidth() const { return std::max(100, (GetClientSize().x - 2 * kMargin) / 100 * 100); }
+
+	// Approximate bytes held by layouts and block bookkeeping
+	size_t MemoryUsage() const {
+		size_t bytes = m_keys.capacity() * sizeof(uint64_t) + m_blockLayouts.capacity() * sizeof(Layout*) +
+			(m_estimates.capacity() + m_tops.capacity()) * sizeof(int) + m_hidden.capacity();
+		for (const auto& entry : m_layouts) {
+			bytes += sizeof(entry) + sizeof(Layout) + kNodeBytes + entry.second->pieces.capacity() * sizeof(Piece);
+			for (const Piece& piece : entry.second->pieces) bytes += (piece.text.length() + 1) * sizeof(wxChar);
+			const TableLayout* table = entry.second->table.get();
+			if (!table) continue;
+			bytes += sizeof(TableLayout) + table->table->MemoryUsage() + table->lefts.capacity() * sizeof(double);
+			for (const auto& row : table->rows) {
+				bytes += sizeof(row) + kNodeBytes + row.second.capacity() * sizeof(Piece);
+				for (const Piece& piece : row.second) bytes += (piece.text.length() + 1) * sizeof(wxChar);
+			}
+		}
+		return bytes;
+	}
+
+private:
+	static const int kMargin = 20;
+	static const int kScrollStep = 10;
+	static const int kCodePadding = 10;
+	static const int kQuoteIndent = 19;  // 4 pixel bar, 15 pixel padding
+	static const int kCellPadding = 8;
+	static const size_t kTableRowCache = 1024;  // laid out rows kept per table
+	static const size_t kNodeBytes = 48;  // rough cost of a hash map node
+	static constexpr double kLineSpacing = 1.6;
+
+	enum FontSize { FONT_BODY = 0 };  // 1 to 6: heading levels
+
+	struct Piece {
+		enum Kind : uint8_t { TEXT, FILL, RULE, BITMAP };
+		Kind kind = TEXT;
+		uint8_t font = 0;  // TEXT: index into m_fonts
+		wxColour colour;
+		double x = 0, y = 0, w = 0, h = 0;  // RULE: h is the thickness
+		double radius = 0;                  // FILL: corner radius
+		wxString text;
+		wxBitmap bitmap;
+	};
+
+	// Body rows of a table, each one row high, laid out when first drawn
+	struct TableLayout {
+		std::shared_ptr<const PreviewTable> table;
+		std::vector<double> lefts;  // column c spans [lefts[c], lefts[c + 1])
+		double rowHeight = 0;
+		mutable std::unordered_map<size_t, std::vector<Piece>> rows;
+	};
+
+	struct Layout {
+		int height = 0;
+		std::vector<std::string> images;  // paths it holds a thumbnail, placeholder or label for
+		std::vector<Piece> pieces;
+		std::unique_ptr<TableLayout> table;
+	};
+
+	int ViewTop() const {
+		int x, y;
+		GetViewStart(&x, &y);
+		return y * kScrollStep;
+	}
+
+	wxGraphicsContext& Measure() {
+		if (!m_measure) m_measure.reset(wxGraphicsRenderer::GetDefaultRenderer()->CreateMeasuringContext());
+		return *m_measure;
+	}
+
+	// Index into m_fonts of the font for `size` and span `style`
+	uint8_t Font(int size, uint8_t style) {
+		int key = size << 8 | (style & (SPAN_BOLD | SPAN_ITALIC | SPAN_CODE));
+		auto found = m_fontIndex.find(key);
+		if (found != m_fontIndex.end()) return found->second;
+		wxFont font = GetFont();
+		font.SetFractionalPointSize(font.GetFractionalPointSize() * Scale(size));
+		if (style & SPAN_CODE) font.SetFamily(wxFONTFAMILY_TELETYPE);
+		if ((style & SPAN_BOLD) || size != FONT_BODY) font.SetWeight(wxFONTWEIGHT_BOLD);
+		if (style & SPAN_ITALIC) font.SetStyle(wxFONTSTYLE_ITALIC);
+		m_fonts.push_back(font);
+		m_fontIndex[key] = (uint8_t)(m_fonts.size() - 1);
+		return m_fontIndex[key];
+	}
+
+	void TextSize(uint8_t font, const wxString& text, double& width, double& height) {
+		wxGraphicsContext& gc = Measure();
+		gc.SetFont(m_fonts[font], *wxBLACK);
+		double descent, leading;
+		gc.GetTextExtent(text, &width, &height, &descent, &leading);
+	}
+
+	int LineHeight() {
+		if (!m_lineHeight) {
+			double width, height;
+			TextSize(Font(FONT_BODY, 0), "Ag", width, height);
+			m_lineHeight = std::max(1, (int)(height * kLineSpacing + 0.5));
+		}
+		return m_lineHeight;
+	}
+
+	int Gap() { return LineHeight() / 2; }
+
+	const Layout* LayOutBlock(int index) {
+		std::unique_ptr<Layout> layout(new Layout);
+		if (m_parse) LayOut(m_parse(index), *layout);
+		const Layout* made = layout.get();
+		for (const std::string& path : made->images) m_imageLayouts[path].push_back(m_keys[index]);
+		m_layouts[m_keys[index]] = std::move(layout);
+		m_blockLayouts[index] = made;
+		return made;
+	}
+
+	void LayOut(const PreviewContent& content, Layout& layout) {
+		double width = std::max(50, GetClientSize().x - 2 * kMargin);
+		double y = 0;
+		switch (content.kind) {
+		case BLOCK_FRONTMATTER:
+			return;
+		case BLOCK_RULE:
+			AddRule(layout.pieces, 0, LineHeight() / 2.0, width, 1, wxColour(0xbd, 0xc3, 0xc7));
+			y = LineHeight();
+			break;
+		case BLOCK_FENCE: {
+			// Code keeps its lines as they are: no wrapping
+			double lineHeight = LineHeight();
+			Piece fill;
+			fill.kind = Piece::FILL;
+			fill.colour = wxColour(0xf8, 0xf9, 0xfa);
+			fill.w = width;
+			fill.radius = 5;
+			fill.h = 2 * kCodePadding + std::max<size_t>(1, content.lines.size()) * lineHeight;
+			layout.pieces.push_back(fill);
+			for (size_t i = 0; i < content.lines.size(); i++) {
+				double x = kCodePadding;
+				for (const PreviewSpan& span : content.lines[i].spans) {
+					uint8_t font = Font(FONT_BODY, span.token == CODE_COMMENT ? SPAN_CODE | SPAN_ITALIC : SPAN_CODE);
+					AddText(layout.pieces, font, CodeColour(span.token), x, kCodePadding + i * lineHeight, lineHeight,
+						wxString::FromUTF8(span.text.c_str()));
+					x += layout.pieces.back().w;
+				}
+			}
+			y = fill.h;
+			break;
+		}
+		case BLOCK_HEADING: {
+			static const wxColour colours[] = {wxColour(0x2c, 0x3e, 0x50), wxColour(0x34, 0x49, 0x5e),
+				wxColour(0x7f, 0x8c, 0x8d)};
+			int level = std::min(std::max(content.level, 1), 6);
+			wxColour colour = colours[std::min(level, 3) - 1];
+			for (const PreviewLine& line : content.lines) Flow(layout, line.spans, level, colour, 0, width, y);
+			if (level <= 2) {
+				AddRule(layout.pieces, 0, y + 2, width, level == 1 ? 2 : 1,
+					level == 1 ? wxColour(0x34, 0x98, 0xdb) : wxColour(0xbd, 0xc3, 0xc7));
+				y += 4;
+			}
+			break;
+		}
+		case BLOCK_QUOTE: {
+			for (const PreviewLine& line : content.lines) {
+				std::vector<PreviewSpan> spans = line.spans;
+				for (PreviewSpan& span : spans) span.style |= SPAN_ITALIC;
+				Flow(layout, spans, FONT_BODY, wxColour(0x7f, 0x8c, 0x8d), kQuoteIndent, width - kQuoteIndent, y);
+			}
+			Piece bar;
+			bar.kind = Piece::FILL;
+			bar.colour = wxColour(0x34, 0x98, 0xdb);
+			bar.w = 4;
+			bar.h = y;
+			layout.pieces.push_back(bar);
+			break;
+		}
+		case BLOCK_LIST: {
+			double indent = 2 * LineHeight();
+			for (const PreviewLine& line : content.lines) {
+				wxString marker = wxString::FromUTF8(line.marker.c_str());
+				uint8_t font = Font(FONT_BODY, 0);
+				double markerWidth, markerHeight;
+				TextSize(font, marker, markerWidth, markerHeight);
+				AddText(layout.pieces, font, *wxBLACK, indent - markerWidth - 6, y, LineHeight(), marker);
+				Flow(layout, line.spans, FONT_BODY, *wxBLACK, indent, width - indent, y);
+			}
+			break;
+		}
+		case BLOCK_TABLE:
+			if (content.table) y = LayOutTable(content.table, width, layout);
+			break;
+		default:
+			for (const PreviewLine& line : content.lines) Flow(layout, line.spans, FONT_BODY, *wxBLACK, 0, width, y);
+			break;
+		}
+		bool empty = content.lines.empty() && !content.table && content.kind != BLOCK_RULE;
+		layout.height = (int)(y + 0.5) + (empty ? 0 : Gap());
+	}
+
+	// Size the columns and lay out the header; returns the table's height.
+	// A column wants room for its header and its widest cell. When they do
+	// not all fit, each keeps up to an even share of half the width, the
+	// rest goes first to columns short of their typical width (the mean
+	// cell), then to those short of their widest.
+	double LayOutTable(const std::shared_ptr<const PreviewTable>& table, double width, Layout& layout) {
+		size_t columns = table->columns.size();
+		std::unique_ptr<TableLayout> tableLayout(new TableLayout);
+		tableLayout->table = table;
+		tableLayout->rowHeight = LineHeight();
+		if (!columns) return 0;
+
+		uint8_t body = Font(FONT_BODY, 0);
+		uint8_t bold = Font(FONT_BODY, SPAN_BOLD);
+		double charWidth, h;
+		TextSize(body, "n", charWidth, h);
+		std::vector<double> widest(columns), typical(columns);
+		for (size_t c = 0; c < columns; c++) {
+			const PreviewColumn& column = table->columns[c];
+			double w;
+			TextSize(bold, wxString::FromUTF8(table->Cell(0, c).c_str()), w, h);
+			widest[c] = w;
+			if (column.widestRow) {
+				TextSize(body, wxString::FromUTF8(table->Cell(column.widestRow, c).c_str()), w, h);
+				widest[c] = std::max(widest[c], w);
+			}
+			widest[c] += 2 * kCellPadding;
+			typical[c] = std::min(widest[c], std::max<double>(column.headerChars,
+				column.MeanChars(table->BodyRows())) * charWidth + 2 * kCellPadding);
+		}
+
+		std::vector<double> widths(columns);
+		double left = width;
+		for (size_t c = 0; c < columns; c++) {
+			widths[c] = std::min(widest[c], width / columns / 2);
+			left -= widths[c];
+		}
+		for (const std::vector<double>* target : {&typical, &widest}) {
+			double wanted = 0;
+			for (size_t c = 0; c < columns; c++) wanted += std::max(0.0, (*target)[c] - widths[c]);
+			if (wanted <= 0 || left <= 0) continue;
+			double scale = std::min(1.0, left / wanted);
+			for (size_t c = 0; c < columns; c++) {
+				double grow = std::max(0.0, (*target)[c] - widths[c]) * scale;
+				widths[c] += grow;
+				left -= grow;
+			}
+		}
+		tableLayout->lefts.assign(1, 0);
+		for (size_t c = 0; c < columns; c++) tableLayout->lefts.push_back(tableLayout->lefts.back() + widths[c]);
+
+		LayOutRow(*tableLayout, 0, layout.pieces);
+		double height = table->Rows() * tableLayout->rowHeight;
+		layout.table = std::move(tableLayout);
+		return height;
+	}
+
+	// Lay out row `row` of a table at its place, one line per cell; what
+	// does not fit a cell is cut off with an ellipsis
+	void LayOutRow(const TableLayout& tableLayout, size_t row, std::vector<Piece>& pieces) {
+		const PreviewTable& table = *tableLayout.table;
+		double y = row * tableLayout.rowHeight;
+		double width = tableLayout.lefts.back();
+		if (row == 0 || row % 2 == 0) {
+			Piece fill;
+			fill.kind = Piece::FILL;
+			fill.colour = row == 0 ? wxColour(0xec, 0xf0, 0xf1) : wxColour(0xf8, 0xf9, 0xfa);
+			fill.y = y;
+			fill.w = width;
+			fill.h = tableLayout.rowHeight;
+			pieces.push_back(fill);
+		}
+		for (size_t c = 0; c < table.columns.size(); c++) {
+			std::vector<PreviewSpan> spans;
+			ParsePreviewInline(table.Cell(row, c), row == 0 ? SPAN_BOLD : 0, spans);
+			double left = tableLayout.lefts[c] + kCellPadding;
+			double right = tableLayout.lefts[c + 1] - kCellPadding;
+			size_t first = pieces.size();
+			double x = left;
+			for (const PreviewSpan& span : spans) {
+				uint8_t font = Font(FONT_BODY, span.style);
+				wxString full = wxString::FromUTF8(span.text.c_str());
+				wxString text = Fit(font, full, right - x);
+				if (text.empty()) break;
+				wxColour colour = span.style & (SPAN_LINK | SPAN_EMBED) ? wxColour(0x34, 0x98, 0xdb) : *wxBLACK;
+				AddText(pieces, font, colour, x, y, tableLayout.rowHeight, text);
+				x += pieces.back().w;
+				if (text != full) break;
+			}
+			uint8_t align = table.columns[c].align;
+			double shift = align == ALIGN_RIGHT ? right - x : align == ALIGN_CENTER ? (right - x) / 2 : 0;
+			for (size_t i = first; i < pieces.size(); i++) pieces[i].x += shift;
+		}
+		AddRule(pieces, 0, y + tableLayout.rowHeight - 0.5, width, row == 0 ? 2 : 1,
+			row == 0 ? wxColour(0xbd, 0xc3, 0xc7) : wxColour(0xe5, 0xe8, 0xe8));
+	}
+
+	// `text`, shortened with an ellipsis if it is wider than `width`
+	wxString Fit(uint8_t font, const wxString& text, double width) {
+		double w, h;
+		TextSize(font, text, w, h);
+		if (w <= width) return text;
+		wxString ellipsis(wxUniChar(0x2026));
+		double ellipsisWidth;
+		TextSize(font, ellipsis, ellipsisWidth, h);
+		wxArrayDouble extents;
+		Measure().GetPartialTextExtents(text, extents);
+		size_t n = 0;
+		while (n < extents.size() && extents[n] + ellipsisWidth <= width) n++;
+		return n ? text.Left(n) + ellipsis : wxString();
+	}
+
+	// Lay `spans` out as lines of words from `left`, at most `width` wide,
+	// starting at `y`, which is left below the last line
+	void Flow(Layout& layout, const std::vector<PreviewSpan>& spans, int size, const wxColour& colour,
+		double left, double width, double& y) {
+		double lineHeight = LineHeight() * (size == FONT_BODY ? 1.0 : Scale(size));
+		double x = left;
+		size_t lineStart = layout.pieces.size();
+		auto newLine = [&]() {
+			y += lineHeight;
+			x = left;
+			lineStart = layout.pieces.size();
+		};
+		for (const PreviewSpan& span : spans) {
+			if (span.style & SPAN_IMAGE) {
+				layout.images.push_back(span.target);
+				const wxBitmap* bitmap = m_image ? m_image(span.target, ImageWidth()) : nullptr;
+				if (bitmap && !bitmap->IsOk()) {
+					std::string label = "[missing image: " + (span.text.empty() ? span.target : span.text) + "]";
+					FlowText(layout, Font(size, span.style), wxColour(0xc0, 0x39, 0x2b),
+						wxString::FromUTF8(label.c_str()), left, width, lineHeight, x, y, lineStart);
+					continue;
+				}
+				if (!bitmap) {
+					std::string label = "[loading " + (span.text.empty() ? span.target : span.text) + "...]";
+					FlowText(layout, Font(size, SPAN_ITALIC), wxColour(0x7f, 0x8c, 0x8d),
+						wxString::FromUTF8(label.c_str()), left, width, lineHeight, x, y, lineStart);
+					continue;
+				}
+				// Images take lines of their own
+				if (x > left) newLine();
+				Piece piece;
+				piece.kind = Piece::BITMAP;
+				piece.bitmap = *bitmap;
+				piece.x = left;
+				piece.y = y;
+				piece.w = std::min<double>(bitmap->GetWidth(), width);
+				piece.h = bitmap->GetHeight() * piece.w / std::max(1, bitmap->GetWidth());
+				layout.pieces.push_back(piece);
+				y += piece.h + 4;
+				x = left;
+				lineStart = layout.pieces.size();
+				continue;
+			}
+			wxColour spanColour = colour;
+			if (span.style & SPAN_LINK) spanColour = wxColour(0x34, 0x98, 0xdb);
+			FlowText(layout, Font(size, span.style), spanColour, wxString::FromUTF8(span.text.c_str()),
+				left, width, lineHeight, x, y, lineStart);
+		}
+		if (x > left || spans.empty()) y += lineHeight;
+	}
+
+	// Place `text` word by word, joining words of one line into one piece
+	void FlowText(Layout& layout, uint8_t font, const wxColour& colour, const wxString& text,
+		double left, double width, double lineHeight, double& x, double& y, size_t& lineStart) {
+		size_t pos = 0;
+		while (pos < text.length()) {
+			// A word and the spaces after it
+			size_t end = pos;
+			while (end < text.length() && text[end] != ' ') end++;
+			while (end < text.length() && text[end] == ' ') end++;
+			wxString word = text.Mid(pos, end - pos);
+			pos = end;
+
+			double w, h;
+			TextSize(font, word, w, h);
+			if (x + w > left + width && x > left) {
+				y += lineHeight;
+				x = left;
+				lineStart = layout.pieces.size();
+				word.Trim(false);
+				if (word.empty()) continue;
+				TextSize(font, word, w, h);
+			}
+			// A word wider than the line is broken between characters
+			while (w > width && word.length() > 1) {
+				wxArrayDouble extents;
+				Measure().GetPartialTextExtents(word, extents);
+				size_t n = 1;
+				while (n < extents.size() && extents[n] <= width) n++;
+				// Spaces may hang past the edge
+				if (word.find_first_not_of(' ', n) == wxString::npos) break;
+				AddText(layout.pieces, font, colour, x, y, lineHeight, word.Left(n));
+				y += lineHeight;
+				x = left;
+				lineStart = layout.pieces.size();
+				word = word.Mid(n);
+				TextSize(font, word, w, h);
+			}
+			Piece* last = layout.pieces.size() > lineStart ? &layout.pieces.back() : nullptr;
+			if (last && last->kind == Piece::TEXT && last->font == font && last->colour == colour &&
+				std::abs(last->x + last->w - x) < 0.5) {
+				last->text += word;
+				last->w += w;
+			} else {
+				AddText(layout.pieces, font, colour, x, y, lineHeight, word);
+			}
+			x += w;
+		}
+	}
+
+	void AddText(std::vector<Piece>& pieces, uint8_t font, const wxColour& colour, double x, double y,
+		double lineHeight, const wxString& text) {
+		double w, h;
+		TextSize(font, text, w, h);
+		Piece piece;
+		piece.kind = Piece::TEXT;
+		piece.font = font;
+		piece.colour = colour;
+		piece.x = x;
+		piece.y = y + (lineHeight - h) / 2;
+		piece.w = w;
+		piece.h = h;
+		piece.text = text;
+		pieces.push_back(piece);
+	}
+
+	static void AddRule(std::vector<Piece>& pieces, double x, double y, double width, double thickness,
+		const wxColour& colour) {
+		Piece piece;
+		piece.kind = Piece::RULE;
+		piece.colour = colour;
+		piece.x = x;
+		piece.y = y;
+		piece.w = width;
+		piece.h = thickness;
+		pieces.push_back(piece);
+	}
+
+	static wxColour CodeColour(uint8_t token) {
+		switch (token) {
+		case CODE_KEYWORD: return wxColour(0x8e, 0x44, 0xad);
+		case CODE_STRING: return wxColour(0x27, 0xae, 0x60);
+		case CODE_NUMBER: return wxColour(0xd3, 0x54, 0x00);
+		case CODE_COMMENT: return wxColour(0x95, 0xa5, 0xa6);
+		case CODE_PREPROCESSOR: return wxColour(0x16, 0xa0, 0x85);
+		case CODE_KEY: return wxColour(0x29, 0x80, 0xb9);
+		case CODE_VARIABLE: return wxColour(0xc0, 0x39, 0x2b);
+		default: return wxColour(0x2c, 0x3e, 0x50);
+		}
+	}
+
+	static double Scale(int size) {
+		static const double scale[] = {1.0, 2.0, 1.5, 1.25, 1.1, 1.0, 0.9};
+		return scale[size];
+	}
+
+	// m_tops[i] from the heights of blocks `from` onwards
+	void UpdateTops(size_t from) {
+		size_t count = m_keys.size();
+		m_tops.resize(count + 1);
+		if (from == 0) m_tops[0] = kMargin;
+		for (size_t i = from; i < count; i++) {
+			int height = m_hidden[i] ? 0 : m_blockLayouts[i] ? m_blockLayouts[i]->height : m_estimates[i];
+			m_tops[i + 1] = m_tops[i] + height;
+		}
+	}
+
+	void UpdateVirtualSize() { SetVirtualSize(-1, m_tops.back() + kMargin); }
+
+	void SetBlock(size_t i, const PreviewBlock& block, bool hidden) {
+		m_keys[i] = block.hash;
+		m_hidden[i] = hidden;
+		m_estimates[i] = block.kind == BLOCK_FRONTMATTER ? 0 :
+			(block.lastLine - block.firstLine + 1) * LineHeight() + Gap();
+		auto cached = m_layouts.find(block.hash);
+		m_blockLayouts[i] = cached != m_layouts.end() ? cached->second.get() : nullptr;
+	}
+
+	// Drop layouts of blocks that are gone once there are many of them
+	void DropStaleLayouts() {
+		if (m_layouts.size() <= 4 * m_keys.size() + 256) return;
+		std::unordered_map<uint64_t, std::unique_ptr<Layout>> kept;
+		for (uint64_t key : m_keys) {
+			auto found = m_layouts.find(key);
+			if (found != m_layouts.end()) kept.emplace(key, std::move(found->second));
+		}
+		m_layouts.swap(kept);
+		m_imageLayouts.clear();
+		for (const auto& entry : m_layouts) {
+			for (const std::string& path : entry.second->images) m_imageLayouts[path].push_back(entry.first);
+		}
+	}
+
+	void OnSize(wxSizeEvent& event) {
+		event.Skip();
+		int width = GetClientSize().x;
+		if (width == m_width) return;
+		// Every layout depends on the width
+		int top = TopBlock();
+		m_width = width;
+		m_layouts.clear();
+		m_imageLayouts.clear();
+		std::fill(m_blockLayouts.begin(), m_blockLayouts.end(), nullptr);
+		UpdateTops(0);
+		UpdateVirtualSize();
+		if (top >= 0) ScrollToBlock(top);
+		Refresh(false);
+	}
+
+	void OnPaint(wxPaintEvent&) {
+		wxAutoBufferedPaintDC dc(this);
+		dc.SetBackground(*wxWHITE_BRUSH);
+		dc.Clear();
+		if (m_keys.empty()) {
+			dc.SetTextForeground(wxColour(0x7f, 0x8c, 0x8d));
+			dc.DrawText(m_message, kMargin, kMargin);
+			return;
+		}
+
+		std::unique_ptr<wxGraphicsContext> gc(wxGraphicsContext::Create(dc));
+		if (!gc) return;
+		int top = ViewTop();
+		int bottom = top + GetClientSize().y;
+		bool resized = false;
+		for (int i = BlockAtY(top); i < (int)m_keys.size() && m_tops[i] < bottom; i++) {
+			if (m_hidden[i]) continue;
+			const Layout* layout = m_blockLayouts[i];
+			if (!layout) {
+				layout = LayOutBlock(i);
+				if (layout->height != m_estimates[i]) {
+					UpdateTops(i);
+					resized = true;
+				}
+			}
+			Draw(*gc, *layout, kMargin, m_tops[i] - top);
+		}
+		if (resized) CallAfter([this]() { UpdateVirtualSize(); });
+	}
+
+	void Draw(wxGraphicsContext& gc, const Layout& layout, double dx, double dy) {
+		Draw(gc, layout.pieces, dx, dy);
+		if (!layout.table) return;
+
+		// Table rows that meet the window, laid out on first use
+		const TableLayout& table = *layout.table;
+		size_t rows = table.table->Rows();
+		size_t first = (size_t)std::max(1.0, std::floor(-dy / table.rowHeight));
+		size_t last = (size_t)std::max(0.0, std::ceil((GetClientSize().y - dy) / table.rowHeight));
+		if (table.rows.size() > kTableRowCache) table.rows.clear();
+		for (size_t row = first; row < std::min(last, rows); row++) {
+			auto found = table.rows.find(row);
+			if (found == table.rows.end()) {
+				found = table.rows.emplace(row, std::vector<Piece>()).first;
+				LayOutRow(table, row, found->second);
+			}
+			Draw(gc, found->second, dx, dy);
+		}
+	}
+
+	void Draw(wxGraphicsContext& gc, const std::vector<Piece>& pieces, double dx, double dy) {
+		for (const Piece& piece : pieces) {
+			switch (piece.kind) {
+			case Piece::TEXT:
+				gc.SetFont(m_fonts[piece.font], piece.colour);
+				gc.DrawText(piece.text, dx + piece.x, dy + piece.y);
+				break;
+			case Piece::FILL:
+				gc.SetPen(*wxTRANSPARENT_PEN);
+				gc.SetBrush(wxBrush(piece.colour));
+				gc.DrawRoundedRectangle(dx + piece.x, dy + piece.y, piece.w, piece.h, piece.radius);
+				break;
+			case Piece::RULE:
+				gc.SetPen(wxPen(piece.colour, (int)piece.h));
+				gc.StrokeLine(dx + piece.x, dy + piece.y, dx + piece.x + piece.w, dy + piece.y);
+				break;
+			case Piece::BITMAP:
+				gc.DrawBitmap(piece.bitmap, dx + piece.x, dy + piece.y, piece.w, piece.h);
+				break;
+			}
+		}
+	}
+
+	ParseCallback m_parse;
+	ImageCallback m_image;
+	wxString m_message;
+
+	// Per block of the last SetBlocks(); m_tops has one more entry, the
+	// bottom of the last block
+	std::vector<uint64_t> m_keys;
+	std::vector<unsigned char> m_hidden;
+	std::vector<int> m_estimates;
+	std::vector<const Layout*> m_blockLayouts;  // null until laid out
+	std::vector<int> m_tops;
+
+	std::unordered_map<uint64_t, std::unique_ptr<Layout>> m_layouts;  // by block hash, at m_width
+	std::unordered_map<std::string, std::vector<uint64_t>> m_imageLayouts;  // keys of m_layouts, by image path
+	int m_width;
+	int m_lineHeight;
+	std::unique_ptr<wxGraphicsContext> m_measure;
+	std::vector<wxFont> m_fonts;
+	std::map<int, uint8_t> m_fontIndex;
+};
+
+#endif // OBSIDIAN_PREVIEW_VIEW_H
@@ -0,0 +1,1204 @@
+// search_index.h - Full-text vault search ranked by BM25
+//
+// An inverted index from lowercased words to the notes containing them. Each
+// note is analyzed into fields that count for more or less: its title and
+// aliases weigh three times a body word, headings and tags twice. A note's
+// score for a word is BM25 over those weighted counts (BM25F), and a query's
+// score is the sum over its words, so rare words and short notes win.
+//
+// Search() keeps the best k notes in a min-heap and uses MaxScore to avoid
+// scoring the rest: every word has an upper bound on what it can add to any
+// note, so once the heap is full the words whose bounds together cannot lift
+// a note past the weakest result are only looked up in the notes the other
+// words found, never walked. The first page for a common word plus a rarer
+// one costs about as much as walking the rarer word's postings.
+//
+// Queries may also hold "quoted phrases" (as may hyphenated-words) and
+// `a NEAR b` or `a NEAR/5 b`, which a note must satisfy. Postings keep word
+// positions for these (see posting_list.h); notes containing every required
+// word are found by leapfrogging the cursors, scored, and have their
+// positions decoded only if the score would make the page.
+//
+// Filters narrow a query by metadata: tag:#ops (nested tags too),
+// path:runbooks/ and modified:>2026-01-01, each of which, like a word or a
+// phrase, a leading '-' negates. Tags and folders map to compressed bitmaps
+// of note ids (doc_bitmap.h), and Search() plans a query before it reads a
+// posting: the bitmap filters are intersected smallest first, the rest are
+// tested only on the notes left, and the words are then walked from
+// whichever side is smaller, the filtered notes (looking each one up in the
+// postings) or the rarest word's postings (checking each note against the
+// filter, after its score, as most notes never make the page). Adding a
+// filter to words so costs little more than the words alone, and usually less.
+//
+// Save() writes the whole index to a snapshot file and Load() reads it back
+// as it was, without touching a note. Every note is indexed with the content
+// hash the vault store keeps for it, so Differences() tells which notes of a
+// rescanned store the index lacks or holds an older version of: a snapshot
+// (or an index kept through a rescan) is brought up to date by re-indexing
+// only those.
+//
+// Postings are sorted by note id and ids only ever grow: re-indexing a note
+// retires its old id and gives it a new one, and Compact() drops the postings
+// of retired ids once they pile up (WantsCompact(); it walks every posting,
+// so the app runs it on the pool). Document frequencies still count retired
+// notes until then; with at most a fifth of the notes retired that moves
+// scores very little.
+#ifndef OBSIDIAN_SEARCH_INDEX_H
+#define OBSIDIAN_SEARCH_INDEX_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <queue>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include "content_hash.h"
+#include "doc_bitmap.h"
+#include "heading_index.h"
+#include "link_index.h"
+#include "posting_list.h"
+#include "vault_store.h"
+
+class SearchIndex {
+public:
+	// What a note contributes to the index; built off the UI thread by Analyze()
+	struct Document {
+		struct Term {
+			std::string word;
+			uint32_t count = 0;               // weighted
+			std::vector<uint32_t> positions;  // in the body, then the title and aliases
+		};
+		std::string note;  // vault-relative path
+		std::vector<Term> terms;
+		uint32_t length = 0;            // weighted word count
+		std::vector<std::string> tags;  // lowercased, without the '#'
+		int64_t modified = 0;           // seconds since 1970
+		uint64_t hash = 0;              // ContentHash of the note, as the vault store has it
+	};
+
+	struct Result {
+		std::string note;
+		float score;
+	};
+
+	// A query as words to score, the phrases and proximity a note must match,
+	// and the items and filters it must not
+	struct Query {
+		struct Near {
+			size_t left;   // items
+			size_t right;
+			uint32_t distance;
+		};
+		struct Filter {
+			enum Kind { TAG, PATH, MODIFIED };
+			Kind kind;
+			std::string value;  // TAG, PATH: lowercased
+			int64_t from;       // MODIFIED: from this second up to before `to`
+			int64_t to;
+			bool negated;
+		};
+		std::vector<std::string> words;            // distinct; scored unless only in negated items
+		std::vector<std::vector<size_t>> items;    // single words or phrases, as indexes into words
+		std::vector<bool> required;                // per item
+		std::vector<bool> negated;                 // per item
+		std::vector<Near> nears;
+		std::vector<Filter> filters;
+	};
+
+	static const uint32_t kTitleWeight = 3;
+	static const uint32_t kHeadingWeight = 2;
+	static const uint32_t kTagWeight = 2;
+	static const uint32_t kBodyWeight = 1;
+	static const uint32_t kNearDistance = 10;  // for NEAR without a /n
+
+	SearchIndex() : m_totalLength(0), m_live(0), m_retired(0) {}
+
+	size_t NoteCount() const { return m_live; }
+
+	// Approximate bytes held, dictionary included; postings too unless
+	// `postings` is false (they are counted as allocated, see PostingMemory)
+	size_t MemoryUsage(bool postings = true) const {
+		size_t bytes = sizeof(*this) + m_terms.capacity() * sizeof(Postings) + m_docs.capacity() * sizeof(Doc) +
+			m_words.capacity() + m_slots.capacity() * sizeof(uint32_t);
+		if (postings) {
+			for (const Postings& term : m_terms) bytes += term.list.MemoryUsage() - sizeof(PostingList);
+		}
+		for (const auto& note : m_byNote) bytes += 2 * note.first.capacity() + kNodeBytes;
+		bytes += m_liveDocs.MemoryUsage();
+		for (const std::map<std::string, DocBitmap>* bitmaps : {&m_tags, &m_folders}) {
+			for (const auto& entry : *bitmaps) bytes += entry.first.capacity() + entry.second.MemoryUsage() + kNodeBytes;
+		}
+		return bytes;
+	}
+
+	// Give back what growing left unused, e.g. once a whole vault is indexed
+	void ShrinkToFit() {
+		for (Postings& postings : m_terms) postings.list.ShrinkToFit();
+		m_terms.shrink_to_fit();
+		m_docs.shrink_to_fit();
+		m_words.shrink_to_fit();
+	}
+
+	// Split `text` into lowercased words: runs of ASCII letters and digits,
+	// with any non-ASCII byte counted as a letter so UTF-8 words stay whole
+	static void Tokenize(const char* text, size_t len, const std::function<void(const std::string&)>& word) {
+		std::string current;
+		for (size_t i = 0; i <= len; i++) {
+			unsigned char c = i < len ? (unsigned char)text[i] : 0;
+			bool letter = (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c >= 0x80 || (c >= 'A' && c <= 'Z');
+			if (letter) {
+				if (current.size() < kMaxWord) current += (char)(c >= 'A' && c <= 'Z' ? c + 32 : c);
+				continue;
+			}
+			if (!current.empty()) word(current);
+			current.clear();
+		}
+	}
+
+	// Words are separated by spaces; a quoted phrase, or a run like
+	// "follow-up" that splits into several words, must appear as written, and
+	// NEAR or NEAR/n between two of these asks for them within n words.
+	// tag:, path: and modified: filter the notes, and a leading '-' excludes
+	// the notes matching a word, phrase or filter.
+	static Query Parse(const std::string& text) {
+		Query query;
+		bool pendingNear = false;
+		uint32_t distance = kNearDistance;
+		size_t pos = 0;
+		while (pos < text.size()) {
+			if (text[pos] == ' ' || text[pos] == '\t') {
+				pos++;
+				continue;
+			}
+			bool negated = text[pos] == '-' && pos + 1 < text.size() && text[pos + 1] != ' ' && text[pos + 1] != '\t';
+			if (negated) pos++;
+			size_t end;
+			std::string chunk;
+			if (text[pos] == '"') {
+				end = ReadQuoted(text, pos, chunk);
+			} else {
+				end = text.find_first_of(" \t\"", pos);
+				if (end == std::string::npos) end = text.size();
+				chunk = text.substr(pos, end - pos);
+				if (!negated && !query.items.empty() && (chunk == "NEAR" || chunk.compare(0, 5, "NEAR/") == 0)) {
+					pendingNear = true;
+					distance = chunk.size() > 5 ? (uint32_t)std::strtoul(chunk.c_str() + 5, nullptr, 10) : kNearDistance;
+					pos = end;
+					continue;
+				}
+				// key:value, where the value may be quoted
+				size_t colon = chunk.find(':');
+				std::string key = LinkIndex::Lower(chunk.substr(0, colon));
+				if (colon != std::string::npos && (key == "tag" || key == "path" || key == "modified")) {
+					std::string value = chunk.substr(colon + 1);
+					if (value.empty() && end < text.size() && text[end] == '"') end = ReadQuoted(text, end, value);
+					if (AddFilter(query, key, value, negated)) {
+						pos = end;
+						continue;
+					}
+				}
+			}
+			pos = end;
+
+			std::vector<size_t> item;
+			Tokenize(chunk.data(), chunk.size(), [&](const std::string& word) {
+				size_t index = std::find(query.words.begin(), query.words.end(), word) - query.words.begin();
+				if (index == query.words.size()) query.words.push_back(word);
+				item.push_back(index);
+			});
+			if (item.empty()) continue;
+			query.items.push_back(item);
+			query.required.push_back(!negated && item.size() > 1);
+			query.negated.push_back(negated);
+			if (pendingNear && !negated && !query.negated[query.items.size() - 2]) {
+				size_t right = query.items.size() - 1;
+				query.nears.push_back({right - 1, right, std::max(distance, 1u)});
+				query.required[right - 1] = true;
+				query.required[right] = true;
+			}
+			pendingNear = false;
+		}
+		return query;
+	}
+
+	// Weighted words and metadata of a note last modified at `modified`
+	// (seconds since 1970). Pure, so it can run on any thread.
+	static Document Analyze(const std::string& relPath, const std::string& content, int64_t modified) {
+		Document doc;
+		doc.note = relPath;
+		doc.modified = modified;
+		doc.hash = ContentHash(content.data(), content.size());
+		std::unordered_map<std::string, size_t> terms;
+		uint32_t position = 0;
+		auto add = [&](const std::string& text, uint32_t weight, bool positions) {
+			Tokenize(text.data(), text.size(), [&](const std::string& word) {
+				auto found = terms.emplace(word, doc.terms.size());
+				if (found.second) {
+					doc.terms.emplace_back();
+					doc.terms.back().word = word;
+				}
+				Document::Term& term = doc.terms[found.first->second];
+				term.count += weight;
+				doc.length += weight;
+				if (positions) term.positions.push_back(position++);
+			});
+		};
+
+		// Positions run through the body, then the title and each alias with a
+		// gap between them so phrases do not match across; headings and tags
+		// are part of the body already
+		add(content, kBodyWeight, true);
+		size_t slash = relPath.find_last_of('/');
+		std::string name = slash == std::string::npos ? relPath : relPath.substr(slash + 1);
+		if (name.size() > 3 && LinkIndex::Lower(name.substr(name.size() - 3)) == ".md") name.resize(name.size() - 3);
+		position += kFieldGap;
+		add(name, kTitleWeight, true);
+		for (const std::string& alias : VaultStore::ExtractAliases(content)) {
+			position += kFieldGap;
+			add(alias, kTitleWeight, true);
+		}
+		HeadingIndex headings;
+		headings.Rebuild(content.data(), content.size());
+		for (const Heading& heading : headings.Headings()) add(heading.title, kHeadingWeight, false);
+		doc.tags = VaultStore::ExtractTags(content);
+		for (const std::string& tag : doc.tags) add(tag, kTagWeight, false);
+		return doc;
+	}
+
+	// Index a note, replacing whatever was indexed for it before
+	void Add(const Document& doc) {
+		Remove(doc.note);
+		uint32_t id = (uint32_t)m_docs.size();
+		m_docs.emplace_back();
+		Doc& entry = m_docs.back();
+		entry.note = doc.note;
+		entry.length = doc.length;
+		entry.modified = doc.modified;
+		entry.hash = doc.hash;
+		entry.live = true;
+		for (const Document::Term& term : doc.terms) {
+			uint32_t termId = FindTerm(term.word);
+			if (termId == kNoTerm) termId = AddTerm(term.word);
+			Postings& postings = m_terms[termId];
+			postings.list.Append(id, term.count, term.positions);
+			postings.maxCount = std::max(postings.maxCount, term.count);
+			postings.minLength = std::min(postings.minLength, doc.length);
+			postings.notes++;
+		}
+		m_byNote[entry.note] = id;
+		m_liveDocs.Add(id);
+		for (const std::string& tag : doc.tags) m_tags[tag].Add(id);
+		m_folders[Folder(doc.note)].Add(id);
+		m_totalLength += doc.length;
+		m_live++;
+	}
+
+	void Remove(const std::string& note) {
+		auto found = m_byNote.find(note);
+		if (found == m_byNote.end()) return;
+		Doc& entry = m_docs[found->second];
+		m_totalLength -= entry.length;
+		m_live--;
+		m_retired++;
+		entry.live = false;
+		m_liveDocs.Remove(found->second);
+		entry.note.clear();
+		entry.note.shrink_to_fit();
+		m_byNote.erase(found);
+	}
+
+	// Whether enough notes were retired for Compact() to be worth its pass
+	bool WantsCompact() const { return m_retired > 1024 && m_retired > m_live / 4; }
+
+	// Drop the postings and bitmap entries of removed notes and tighten the
+	// score bounds. Terms keep their ids and words, so the dictionary holds.
+	void Compact() {
+		std::vector<uint32_t> positions;
+		for (Postings& postings : m_terms) {
+			Postings kept;
+			kept.wordEnd = postings.wordEnd;
+			for (PostingList::Cursor cursor(postings.list); cursor.Doc() != PostingList::kEnd; cursor.Next()) {
+				const Doc& doc = m_docs[cursor.Doc()];
+				if (!doc.live) continue;
+				cursor.Positions(positions);
+				kept.list.Append(cursor.Doc(), cursor.Count(), positions);
+				kept.maxCount = std::max(kept.maxCount, cursor.Count());
+				kept.minLength = std::min(kept.minLength, doc.length);
+				kept.notes++;
+			}
+			kept.list.ShrinkToFit();
+			postings = std::move(kept);
+		}
+		for (std::map<std::string, DocBitmap>* bitmaps : {&m_tags, &m_folders}) {
+			for (auto it = bitmaps->begin(); it != bitmaps->end();) {
+				it->second &= m_liveDocs;
+				it = it->second.Empty() ? bitmaps->erase(it) : std::next(it);
+			}
+		}
+		m_retired = 0;
+	}
+
+	// Notes of `store` that are not indexed or were indexed with other
+	// content, and indexed notes the store no longer has
+	void Differences(const VaultStore& store, std::vector<std::string>& changed,
+		std::vector<std::string>& removed) const {
+		// Entries come in tree order, so a folder's path is known before its
+		// children need it
+		std::vector<std::string> folders(store.Count());
+		std::vector<bool> seen(m_docs.size(), false);
+		for (uint32_t i = 1; i < store.Count(); i++) {
+			const VaultStoreEntry& entry = store.Entry(i);
+			std::string path = entry.parent == 0 || entry.parent >= i ? std::string(store.Name(i)) :
+				folders[entry.parent] + '/' + store.Name(i);
+			if (store.IsFolder(i)) {
+				folders[i] = std::move(path);
+				continue;
+			}
+			if (!store.IsNote(i)) continue;
+			auto found = m_byNote.find(path);
+			if (found != m_byNote.end()) seen[found->second] = true;
+			if (found == m_byNote.end() || m_docs[found->second].hash != entry.hash) changed.push_back(std::move(path));
+		}
+		for (const auto& note : m_byNote) {
+			if (!seen[note.second]) removed.push_back(note.first);
+		}
+	}
+
+	// Write the index to `file` through a temporary beside it
+	bool Save(const std::string& file) const {
+		std::string temp = file + ".tmp";
+		std::error_code ec;
+		std::filesystem::create_directories(std::filesystem::u8path(file).parent_path(), ec);
+		SnapshotWriter out(temp);
+		out.Write(kSnapshotMagic, 8);
+		out.Put(kSnapshotVersion);
+		out.Put((uint32_t)m_terms.size());
+		for (const Postings& postings : m_terms) {
+			out.Put(postings.maxCount);
+			out.Put(postings.minLength);
+			out.Put(postings.notes);
+			out.Put(postings.wordEnd);
+			postings.list.Save(out);
+		}
+		out.PutString(m_words);
+		out.Put((uint32_t)m_docs.size());
+		for (const Doc& doc : m_docs) {
+			out.PutString(doc.note);
+			out.Put(doc.length);
+			out.Put((uint8_t)doc.live);
+			out.Put(doc.modified);
+			out.Put(doc.hash);
+		}
+		out.Put((uint32_t)m_tags.size());
+		std::vector<uint32_t> ids;
+		for (const auto& tag : m_tags) {
+			out.PutString(tag.first);
+			ids.clear();
+			tag.second.ForEach([&](uint32_t id) { ids.push_back(id); });
+			out.Put((uint32_t)ids.size());
+			out.Write(ids.data(), ids.size() * sizeof(uint32_t));
+		}
+		out.Put(m_totalLength);
+		out.Put((uint64_t)m_retired);
+		if (!out.Finish()) {
+			std::filesystem::remove(std::filesystem::u8path(temp), ec);
+			return false;
+		}
+		std::filesystem::rename(std::filesystem::u8path(temp), std::filesystem::u8path(file), ec);
+		return !ec;
+	}
+
+	// Replace the index with the snapshot in `file`. Fails on missing,
+	// damaged or older snapshots, leaving the index empty.
+	bool Load(const std::string& file) {
+		*this = SearchIndex();
+		if (!ReadSnapshot(file)) {
+			*this = SearchIndex();
+			return false;
+		}
+		// The lookup tables and the folder bitmaps follow from what was read
+		m_slots.assign(std::max<size_t>(1024, NextPowerOfTwo(m_terms.size() * 2)), 0);
+		for (uint32_t term = 0; term < m_terms.size(); term++) PlaceTerm(term);
+		for (uint32_t id = 0; id < m_docs.size(); id++) {
+			const Doc& doc = m_docs[id];
+			if (!doc.live) continue;
+			m_byNote[doc.note] = id;
+			m_liveDocs.Add(id);
+			m_folders[Folder(doc.note)].Add(id);
+			m_live++;
+		}
+		return true;
+	}
+
+	// The `k` notes scoring highest for `query`, best first; with filters
+	// and no words to score, the `k` most recently modified notes that pass
+	std::vector<Result> Search(const std::string& text, size_t k) const {
+		std::vector<Result> results;
+		Query query = Parse(text);
+		if (k == 0 || m_live == 0 || (query.words.empty() && query.filters.empty())) return results;
+		float average = (float)(m_totalLength / m_live);
+
+		// One cursor per known scored word; a required word nobody has means
+		// no results
+		std::vector<bool> scored(query.words.size(), false);
+		for (size_t i = 0; i < query.items.size(); i++) {
+			if (query.negated[i]) continue;
+			for (size_t w : query.items[i]) scored[w] = true;
+		}
+		bool anyScored = std::find(scored.begin(), scored.end(), true) != scored.end();
+		std::vector<WordCursor> cursors;
+		std::vector<int> cursorOf(query.words.size(), -1);
+		cursors.reserve(query.words.size());
+		for (size_t w = 0; w < query.words.size(); w++) {
+			uint32_t termId = scored[w] ? FindTerm(query.words[w]) : kNoTerm;
+			if (termId == kNoTerm || m_terms[termId].notes == 0) continue;
+			cursorOf[w] = (int)cursors.size();
+			cursors.emplace_back(m_terms[termId], Idf(m_terms[termId]), average);
+		}
+		std::vector<WordCursor*> required;
+		for (size_t i = 0; i < query.items.size(); i++) {
+			if (!query.required[i]) continue;
+			for (size_t w : query.items[i]) {
+				if (cursorOf[w] < 0) return results;
+				WordCursor* cursor = &cursors[cursorOf[w]];
+				if (std::find(required.begin(), required.end(), cursor) == required.end()) required.push_back(cursor);
+			}
+		}
+		if (anyScored && cursors.empty()) return results;
+
+		// Metadata first. The bitmap filters are cheap and may end the search
+		// here; the others cost a test per note, so they are run over the
+		// filtered notes up front only if those are few enough to lead the
+		// search (see SearchAny and SearchRequired), and otherwise on just
+		// the notes the words find.
+		NoteFilter filter;
+		const NoteFilter* allowed = nullptr;
+		if (!query.filters.empty()) {
+			FilterNotes(query.filters, filter);
+			size_t count = filter.all ? m_live : filter.notes.Count();
+			size_t postings = 0;
+			for (const WordCursor& cursor : cursors) postings += cursor.notes;
+			bool leads = required.empty() ? count * cursors.size() * kLeadFactor < postings :
+				count * kLeadFactor < (*std::min_element(required.begin(), required.end(),
+					[](const WordCursor* a, const WordCursor* b) { return a->notes < b->notes; }))->notes;
+			if (!filter.tests.empty() && (!anyScored || leads)) ApplyTests(filter);
+			if (!filter.all && filter.notes.Empty()) return results;
+			allowed = &filter;
+		}
+		Exclusions excluded(*this, query, average);
+		if (!anyScored) {
+			SearchNewest(allowed ? filter.notes : m_liveDocs, excluded, k, results);
+			return results;
+		}
+
+		TopK top(k);
+		if (required.empty()) {
+			SearchAny(cursors, allowed, excluded, top);
+		} else {
+			SearchRequired(query, cursorOf, cursors, required, allowed, excluded, top);
+		}
+
+		results.resize(top.heap.size());
+		for (size_t i = top.heap.size(); i-- > 0; top.heap.pop()) {
+			results[i].note = m_docs[top.heap.top().second].note;
+			results[i].score = top.heap.top().first;
+		}
+		return results;
+	}
+
+	// First line of `content` (zero-based) holding one of the query's phrases,
+	// or else one of its words, or else the first line that is not blank
+	static int FindLine(const std::string& content, const Query& query, std::string& text) {
+		// Excluded words are in none of the results, or only in a phrase
+		std::vector<bool> wanted(query.words.size(), false);
+		bool phrases = false;
+		for (size_t i = 0; i < query.items.size(); i++) {
+			if (query.negated[i]) continue;
+			for (size_t w : query.items[i]) wanted[w] = true;
+			phrases = phrases || query.items[i].size() > 1;
+		}
+		int best = -1;
+		int bestRank = 0;  // 1 blank-free, 2 a word, 3 a phrase
+		size_t bestPos = 0;
+		size_t bestEnd = 0;
+		std::vector<size_t> words;
+		int line = 0;
+		size_t pos = 0;
+		while (pos < content.size() && bestRank < (phrases ? 3 : 2)) {
+			size_t eol = content.find('\n', pos);
+			if (eol == std::string::npos) eol = content.size();
+			words.clear();
+			Tokenize(content.data() + pos, eol - pos, [&](const std::string& word) {
+				words.push_back(std::find(query.words.begin(), query.words.end(), word) - query.words.begin());
+			});
+			int rank = content.find_first_not_of(" \t\r", pos) < eol ? 1 : 0;
+			for (size_t i = 0; i < words.size(); i++) {
+				if (words[i] == query.words.size() || !wanted[words[i]]) continue;
+				rank = std::max(rank, 2);
+				for (size_t j = 0; j < query.items.size(); j++) {
+					const std::vector<size_t>& item = query.items[j];
+					if (!query.negated[j] && item.size() > 1 && i + item.size() <= words.size() &&
+						std::equal(item.begin(), item.end(), words.begin() + i)) rank = 3;
+				}
+			}
+			if (rank > bestRank) {
+				best = line;
+				bestRank = rank;
+				bestPos = pos;
+				bestEnd = eol;
+			}
+			pos = eol + 1;
+			line++;
+		}
+		text = content.substr(bestPos, bestEnd - bestPos);
+		if (!text.empty() && text.back() == '\r') text.pop_back();
+		return std::max(best, 0);
+	}
+
+private:
+	static const size_t kMaxWord = 64;
+	static const uint32_t kFieldGap = 256;
+	static const size_t kNodeBytes = 48;  // rough cost of a hash map node
+	static const uint32_t kNoTerm = UINT32_MAX;
+	static const size_t kLeadFactor = 4;  // how much fewer notes must be to lead the words
+	static constexpr const char* kSnapshotMagic = "OBSINDEX";
+	static const uint32_t kSnapshotVersion = 1;
+	static constexpr float kK1 = 1.2f;
+	static constexpr float kB = 0.75f;
+
+	struct Postings {
+		PostingList list;
+		uint32_t maxCount = 0;  // bounds over every posting, live or not
+		uint32_t minLength = UINT32_MAX;
+		uint32_t notes = 0;     // notes with the word, retired ones included
+		uint32_t wordEnd = 0;   // the word is m_words up to here from the previous term's end
+	};
+
+	struct Doc {
+		std::string note;
+		uint32_t length = 0;
+		bool live = false;
+		int64_t modified = 0;
+		uint64_t hash = 0;
+	};
+
+	struct WordCursor {
+		PostingList::Cursor cursor;
+		uint32_t notes;
+		float idf;
+		float average;
+		float bound;  // most the word can add to any note
+
+		WordCursor(const Postings& postings, float idf, float average)
+			: cursor(postings.list), notes(postings.notes), idf(idf), average(average),
+			bound(Contribution(postings.maxCount, postings.minLength)) {}
+
+		uint32_t Doc() const { return cursor.Doc(); }
+
+		float Contribution(uint32_t count, uint32_t length) const {
+			return idf * count * (kK1 + 1) / (count + kK1 * (1 - kB + kB * length / average));
+		}
+
+		float Score(uint32_t length) const { return Contribution(cursor.Count(), length); }
+	};
+
+	struct TopK {
+		typedef std::pair<float, uint32_t> Hit;  // score, note id
+		std::priority_queue<Hit, std::vector<Hit>, std::greater<Hit>> heap;
+		size_t k;
+		float threshold;
+
+		explicit TopK(size_t k) : k(k), threshold(0) {}
+
+		bool Accepts(float score) const { return heap.size() < k || score > threshold; }
+
+		// Returns whether the threshold rose
+		bool Push(float score, uint32_t doc) {
+			heap.push(Hit(score, doc));
+			if (heap.size() > k) heap.pop();
+			if (heap.size() < k) return false;
+			threshold = heap.top().first;
+			return true;
+		}
+	};
+
+	// The notes a query's filters leave: those of `notes`, or every live
+	// note if `all`, that pass the `tests`
+	struct NoteFilter {
+		DocBitmap notes;
+		bool all = true;
+		std::vector<const Query::Filter*> tests;
+
+		bool Allows(const SearchIndex& index, uint32_t doc) const {
+			if (!all && !notes.Contains(doc)) return false;
+			for (const Query::Filter* filter : tests) {
+				if (Passes(*filter, index.m_docs[doc]) == filter->negated) return false;
+			}
+			return true;
+		}
+
+		// The notes left, if they are known without tests
+		const DocBitmap* Bitmap() const { return all || !tests.empty() ? nullptr : &notes; }
+	};
+
+	// The negated items of a query, on cursors of their own: the scoring
+	// cursors have often moved past the note in question
+	struct Exclusions {
+		const Query& query;
+		std::vector<size_t> items;  // negated items whose words are all indexed
+		std::vector<int> cursorOf;
+		std::vector<WordCursor> cursors;
+		std::vector<uint32_t> starts;
+		std::vector<uint32_t> positions;
+
+		Exclusions(const SearchIndex& index, const Query& query, float average)
+			: query(query), cursorOf(query.words.size(), -1) {
+			for (size_t i = 0; i < query.items.size(); i++) {
+				if (!query.negated[i]) continue;
+				bool known = true;
+				for (size_t w : query.items[i]) {
+					if (cursorOf[w] >= 0) continue;
+					uint32_t termId = index.FindTerm(query.words[w]);
+					if (termId == kNoTerm) {
+						known = false;
+						break;
+					}
+					cursorOf[w] = (int)cursors.size();
+					cursors.emplace_back(index.m_terms[termId], 0.0f, average);
+				}
+				if (known) items.push_back(i);
+			}
+		}
+
+		bool Empty() const { return items.empty(); }
+
+		// Whether note `doc` has one of the items; asked in ascending order
+		bool Excludes(uint32_t doc) {
+			for (size_t i : items) {
+				const std::vector<size_t>& item = query.items[i];
+				bool all = true;
+				for (size_t j = 0; all && j < item.size(); j++) {
+					WordCursor& cursor = cursors[cursorOf[item[j]]];
+					cursor.cursor.SeekTo(doc);
+					all = cursor.Doc() == doc;
+				}
+				if (all && (item.size() == 1 || PhraseStarts(item, cursorOf, cursors, starts, positions))) return true;
+			}
+			return false;
+		}
+	};
+
+	// Snapshot files are the sections in the order Save() writes them and a
+	// checksum of everything before it
+	struct SnapshotWriter {
+		std::ofstream file;
+		uint64_t sum = ContentHash(nullptr, 0);
+
+		explicit SnapshotWriter(const std::string& path)
+			: file(std::filesystem::u8path(path), std::ios::binary | std::ios::trunc) {}
+
+		void Write(const void* data, size_t bytes) {
+			file.write((const char*)data, (std::streamsize)bytes);
+			sum = ContentHash((const char*)data, bytes, sum);
+		}
+
+		template <typename T>
+		void Put(T value) { Write(&value, sizeof(T)); }
+
+		void PutString(const std::string& text) {
+			Put((uint32_t)text.size());
+			Write(text.data(), text.size());
+		}
+
+		bool Finish() {
+			file.write((const char*)&sum, sizeof(sum));
+			file.close();
+			return !file.fail();
+		}
+	};
+
+	struct SnapshotReader {
+		std::ifstream file;
+		uint64_t left = 0;
+		uint64_t sum = ContentHash(nullptr, 0);
+
+		explicit SnapshotReader(const std::string& path) : file(std::filesystem::u8path(path), std::ios::binary) {
+			std::error_code ec;
+			uint64_t size = std::filesystem::file_size(std::filesystem::u8path(path), ec);
+			if (!ec && size >= sizeof(sum)) left = size - sizeof(sum);
+		}
+
+		uint64_t Remaining() const { return left; }
+
+		bool Read(void* data, size_t bytes) {
+			if (bytes > left || !file.read((char*)data, (std::streamsize)bytes)) return false;
+			left -= bytes;
+			sum = ContentHash((const char*)data, bytes, sum);
+			return true;
+		}
+
+		template <typename T>
+		bool Get(T& value) { return Read(&value, sizeof(T)); }
+
+		bool GetString(std::string& text) {
+			uint32_t size;
+			if (!Get(size) || size > left) return false;
+			text.resize(size);
+			return Read(&text[0], size);
+		}
+
+		bool Finish() {
+			uint64_t stored;
+			return left == 0 && file.read((char*)&stored, sizeof(stored)) && stored == sum;
+		}
+	};
+
+	bool ReadSnapshot(const std::string& path) {
+		SnapshotReader in(path);
+		char magic[8];
+		uint32_t version, count;
+		if (!in.Read(magic, 8) || memcmp(magic, kSnapshotMagic, 8) != 0 || !in.Get(version) ||
+			version != kSnapshotVersion || !in.Get(count) || count > in.Remaining() / 20) return false;
+		m_terms.resize(count);
+		for (Postings& postings : m_terms) {
+			if (!in.Get(postings.maxCount) || !in.Get(postings.minLength) || !in.Get(postings.notes) ||
+				!in.Get(postings.wordEnd) || !postings.list.Load(in)) return false;
+		}
+		if (!in.GetString(m_words) || !in.Get(count) || count > in.Remaining() / 25) return false;
+		m_docs.resize(count);
+		for (Doc& doc : m_docs) {
+			uint8_t live;
+			if (!in.GetString(doc.note) || !in.Get(doc.length) || !in.Get(live) || !in.Get(doc.modified) ||
+				!in.Get(doc.hash)) return false;
+			doc.live = live != 0;
+		}
+		if (!in.Get(count)) return false;
+		std::vector<uint32_t> ids;
+		for (uint32_t tag = 0; tag < count; tag++) {
+			std::string name;
+			uint32_t size;
+			if (!in.GetString(name) || !in.Get(size) || size > in.Remaining() / sizeof(uint32_t)) return false;
+			ids.resize(size);
+			if (!in.Read(ids.data(), ids.size() * sizeof(uint32_t))) return false;
+			DocBitmap& bitmap = m_tags[name];
+			for (uint32_t id : ids) bitmap.Add(id);
+		}
+		uint64_t retired;
+		if (!in.Get(m_totalLength) || !in.Get(retired) || !in.Finish()) return false;
+		m_retired = (size_t)retired;
+		// Word ends must step through m_words for the dictionary to hold
+		uint32_t wordEnd = 0;
+		for (const Postings& postings : m_terms) {
+			if (postings.wordEnd <= wordEnd || postings.wordEnd > m_words.size()) return false;
+			wordEnd = postings.wordEnd;
+		}
+		return true;
+	}
+
+	static size_t NextPowerOfTwo(size_t n) {
+		size_t power = 1;
+		while (power < n) power *= 2;
+		return power;
+	}
+
+	// The dictionary is an open-addressing table of term ids, with the words
+	// back to back in one string: a few bytes a word on top of its letters,
+	// where a node-based map would cost more than the postings of a word
+	// that occurs once
+	uint32_t FindTerm(const std::string& word) const {
+		if (m_slots.empty()) return kNoTerm;
+		size_t mask = m_slots.size() - 1;
+		for (size_t slot = ContentHash(word.data(), word.size()) & mask;; slot = (slot + 1) & mask) {
+			uint32_t id = m_slots[slot];
+			if (id == 0) return kNoTerm;
+			uint32_t start = id > 1 ? m_terms[id - 2].wordEnd : 0;
+			if (m_terms[id - 1].wordEnd - start == word.size() && m_words.compare(start, word.size(), word) == 0) {
+				return id - 1;
+			}
+		}
+	}
+
+	uint32_t AddTerm(const std::string& word) {
+		uint32_t id = (uint32_t)m_terms.size();
+		m_words += word;
+		m_terms.emplace_back();
+		m_terms.back().wordEnd = (uint32_t)m_words.size();
+		if (m_terms.size() * 2 > m_slots.size()) {
+			// Keep the table at most half full
+			m_slots.assign(std::max<size_t>(1024, m_slots.size() * 2), 0);
+			for (uint32_t term = 0; term < m_terms.size(); term++) PlaceTerm(term);
+		} else {
+			PlaceTerm(id);
+		}
+		return id;
+	}
+
+	void PlaceTerm(uint32_t term) {
+		uint32_t start = term > 0 ? m_terms[term - 1].wordEnd : 0;
+		size_t mask = m_slots.size() - 1;
+		size_t slot = ContentHash(m_words.data() + start, m_terms[term].wordEnd - start) & mask;
+		while (m_slots[slot]) slot = (slot + 1) & mask;
+		m_slots[slot] = term + 1;
+	}
+
+	float Idf(const Postings& postings) const {
+		double notes = std::min<double>(postings.notes, m_live);
+		return (float)std::log(1.0 + (m_live - notes + 0.5) / (notes + 0.5));
+	}
+
+	// Any of the words: MaxScore over the cursors, or over the notes of
+	// `allowed` when there are fewer of those than postings
+	void SearchAny(std::vector<WordCursor>& words, const NoteFilter* allowed, Exclusions& excluded, TopK& top) const {
+		// Weakest words first: bounds[i] is what words 0..i can add together
+		std::vector<WordCursor*> cursors;
+		for (WordCursor& word : words) cursors.push_back(&word);
+		std::sort(cursors.begin(), cursors.end(), [](const WordCursor* a, const WordCursor* b) { return a->bound < b->bound; });
+		std::vector<float> bounds(cursors.size());
+		float sum = 0;
+		size_t postings = 0;
+		for (size_t i = 0; i < cursors.size(); i++) {
+			bounds[i] = sum += cursors[i]->bound;
+			postings += cursors[i]->notes;
+		}
+
+		const DocBitmap* bitmap = allowed ? allowed->Bitmap() : nullptr;
+		if (bitmap && bitmap->Count() * cursors.size() * kLeadFactor < postings) {
+			bitmap->ForEach([&](uint32_t doc) {
+				uint32_t length = m_docs[doc].length;
+				float score = 0;
+				for (size_t i = cursors.size(); i-- > 0;) {
+					if (score + bounds[i] <= top.threshold) break;
+					WordCursor& cursor = *cursors[i];
+					cursor.cursor.SeekTo(doc);
+					if (cursor.Doc() == doc) score += cursor.Score(length);
+				}
+				if (score > 0 && top.Accepts(score) && !(!excluded.Empty() && excluded.Excludes(doc))) top.Push(score, doc);
+			});
+			return;
+		}
+
+		size_t essential = 0;  // words before this one cannot make a result alone
+		while (true) {
+			uint32_t doc = PostingList::kEnd;
+			for (size_t i = essential; i < cursors.size(); i++) doc = std::min(doc, cursors[i]->Doc());
+			if (doc == PostingList::kEnd) break;
+
+			uint32_t length = m_docs[doc].length;
+			float score = 0;
+			for (size_t i = essential; i < cursors.size(); i++) {
+				WordCursor& cursor = *cursors[i];
+				if (cursor.Doc() != doc) continue;
+				score += cursor.Score(length);
+				cursor.cursor.Next();
+			}
+			if (!m_docs[doc].live) continue;
+			for (size_t i = essential; i-- > 0;) {
+				if (score + bounds[i] <= top.threshold) break;
+				WordCursor& cursor = *cursors[i];
+				cursor.cursor.SeekTo(doc);
+				if (cursor.Doc() == doc) score += cursor.Score(length);
+			}
+			// Filters last, as most notes have fallen below the threshold by
+			// now; exclusions first of those, as they only move cursors on
+			if (!top.Accepts(score) || (!excluded.Empty() && excluded.Excludes(doc)) ||
+				(allowed && !allowed->Allows(*this, doc)) || !top.Push(score, doc)) continue;
+			while (essential < cursors.size() && bounds[essential] <= top.threshold) essential++;
+		}
+	}
+
+	// Notes with every required word, checked for the phrases and NEARs.
+	// The rarest word leads and the others catch up to it, or the notes of
+	// `allowed` lead if there are fewer of them.
+	void SearchRequired(const Query& query, const std::vector<int>& cursorOf, std::vector<WordCursor>& cursors,
+		std::vector<WordCursor*>& required, const NoteFilter* allowed, Exclusions& excluded, TopK& top) const {
+		std::sort(required.begin(), required.end(), [](const WordCursor* a, const WordCursor* b) {
+			return a->notes < b->notes;
+		});
+		const DocBitmap* bitmap = allowed ? allowed->Bitmap() : nullptr;
+		bool allowedLeads = bitmap && bitmap->Count() < required[0]->notes;
+		std::vector<std::vector<uint32_t>> starts(query.items.size());
+		uint32_t doc = 0;
+		while (true) {
+			if (allowedLeads) {
+				doc = bitmap->NextFrom(doc);
+			} else {
+				required[0]->cursor.SeekTo(doc);
+				doc = required[0]->Doc();
+			}
+			bool all = true;
+			for (size_t i = allowedLeads ? 0 : 1; all && i < required.size() && doc != PostingList::kEnd; i++) {
+				required[i]->cursor.SeekTo(doc);
+				if (required[i]->Doc() != doc) {
+					doc = required[i]->Doc();
+					all = false;
+				}
+			}
+			if (doc == PostingList::kEnd) break;
+			if (!all) continue;
+
+			if (m_docs[doc].live && (allowedLeads || !bitmap || bitmap->Contains(doc))) {
+				uint32_t length = m_docs[doc].length;
+				float score = 0;
+				for (WordCursor& cursor : cursors) {
+					cursor.cursor.SeekTo(doc);
+					if (cursor.Doc() == doc) score += cursor.Score(length);
+				}
+				if (top.Accepts(score) && !(!excluded.Empty() && excluded.Excludes(doc)) &&
+					(bitmap || !allowed || allowed->Allows(*this, doc)) && Matches(query, cursorOf, cursors, starts)) {
+					top.Push(score, doc);
+				}
+			}
+			doc++;
+		}
+	}
+
+	// Notes of `notes` that are not excluded, most recently modified first
+	void SearchNewest(const DocBitmap& notes, Exclusions& excluded, size_t k, std::vector<Result>& results) const {
+		typedef std::pair<int64_t, uint32_t> Hit;
+		std::priority_queue<Hit, std::vector<Hit>, std::greater<Hit>> heap;
+		notes.ForEach([&](uint32_t doc) {
+			Hit hit(m_docs[doc].modified, doc);
+			if (heap.size() == k && !(heap.top() < hit)) return;
+			if (!excluded.Empty() && excluded.Excludes(doc)) return;
+			heap.push(hit);
+			if (heap.size() > k) heap.pop();
+		});
+		results.resize(heap.size());
+		for (size_t i = heap.size(); i-- > 0; heap.pop()) {
+			results[i].note = m_docs[heap.top().second].note;
+			results[i].score = 0;
+		}
+	}
+
+	// Intersect the bitmaps of the filters that have one, smallest first so
+	// the set shrinks as early as it can, and leave the rest as tests
+	void FilterNotes(const std::vector<Query::Filter>& filters, NoteFilter& filter) const {
+		std::vector<std::pair<size_t, DocBitmap>> included;
+		std::vector<DocBitmap> excluded;
+		for (const Query::Filter& each : filters) {
+			DocBitmap bitmap;
+			if (!FilterBitmap(each, bitmap)) {
+				filter.tests.push_back(&each);
+			} else if (each.negated) {
+				excluded.push_back(std::move(bitmap));
+			} else {
+				size_t count = bitmap.Count();
+				included.emplace_back(count, std::move(bitmap));
+			}
+		}
+		if (included.empty() && excluded.empty()) return;
+		std::sort(included.begin(), included.end(),
+			[](const std::pair<size_t, DocBitmap>& a, const std::pair<size_t, DocBitmap>& b) { return a.first < b.first; });
+
+		filter.all = false;
+		if (included.empty()) {
+			filter.notes = m_liveDocs;
+		} else {
+			filter.notes = std::move(included[0].second);
+			for (size_t i = 1; i < included.size() && !filter.notes.Empty(); i++) filter.notes &= included[i].second;
+			if (m_retired) filter.notes &= m_liveDocs;
+		}
+		for (const DocBitmap& bitmap : excluded) filter.notes -= bitmap;
+	}
+
+	// Run the tests of `filter` over its notes, leaving just a bitmap
+	void ApplyTests(NoteFilter& filter) const {
+		DocBitmap passed;
+		(filter.all ? m_liveDocs : filter.notes).ForEach([&](uint32_t doc) {
+			if (filter.Allows(*this, doc)) passed.Add(doc);
+		});
+		filter.notes = std::move(passed);
+		filter.all = false;
+		filter.tests.clear();
+	}
+
+	// The notes a tag filter, or a path filter naming a folder, matches;
+	// false for the filters tested note by note
+	bool FilterBitmap(const Query::Filter& filter, DocBitmap& bitmap) const {
+		if (filter.kind == Query::Filter::TAG) {
+			// The tag itself and the tags nested under it
+			auto found = m_tags.find(filter.value);
+			if (found != m_tags.end()) bitmap = found->second;
+			std::string nested = filter.value + "/";
+			for (auto it = m_tags.lower_bound(nested); it != m_tags.end() && it->first.compare(0, nested.size(), nested) == 0; ++it) {
+				bitmap |= it->second;
+			}
+			return true;
+		}
+		if (filter.kind == Query::Filter::PATH && filter.value.back() == '/') {
+			for (const auto& folder : m_folders) {
+				if (folder.first.find(filter.value) != std::string::npos) bitmap |= folder.second;
+			}
+			return true;
+		}
+		return false;
+	}
+
+	static bool Passes(const Query::Filter& filter, const Doc& doc) {
+		if (filter.kind == Query::Filter::MODIFIED) return doc.modified >= filter.from && doc.modified < filter.to;
+		// A path substring, ignoring ASCII case
+		const std::string& note = doc.note;
+		const std::string& value = filter.value;
+		for (size_t at = 0; at + value.size() <= note.size(); at++) {
+			size_t i = 0;
+			while (i < value.size() && LowerByte(note[at + i]) == value[i]) i++;
+			if (i == value.size()) return true;
+		}
+		return false;
+	}
+
+	static char LowerByte(char c) { return c >= 'A' && c <= 'Z' ? (char)(c + 32) : c; }
+
+	// Lowercased folder of a vault-relative path with its trailing '/', or
+	// "" for the vault root
+	static std::string Folder(const std::string& note) {
+		size_t slash = note.find_last_of('/');
+		return slash == std::string::npos ? std::string() : LinkIndex::Lower(note.substr(0, slash + 1));
+	}
+
+	// Read the "quoted" text at `pos` into `value`; returns where it ends
+	static size_t ReadQuoted(const std::string& text, size_t pos, std::string& value) {
+		size_t end = text.find('"', pos + 1);
+		if (end == std::string::npos) end = text.size();
+		value = text.substr(pos + 1, end - pos - 1);
+		return end + 1;
+	}
+
+	// tag:#name, path:text and modified: followed by a local YYYY-MM-DD day,
+	// optionally after >, >=, < or <=. False when the value makes no sense,
+	// so the term is searched for as words instead.
+	static bool AddFilter(Query& query, const std::string& key, std::string value, bool negated) {
+		Query::Filter filter;
+		filter.from = INT64_MIN;
+		filter.to = INT64_MAX;
+		filter.negated = negated;
+		if (key == "tag" || key == "path") {
+			value.erase(0, value.find_first_not_of(key == "tag" ? "#" : "/"));
+			if (value.empty()) return false;
+			filter.kind = key == "tag" ? Query::Filter::TAG : Query::Filter::PATH;
+			filter.value = LinkIndex::Lower(value);
+			query.filters.push_back(filter);
+			return true;
+		}
+		size_t digits = value.find_first_not_of("<>=");
+		std::string op = value.substr(0, digits);
+		int64_t start, end;
+		if (digits == std::string::npos || !ParseDay(value.substr(digits), start, end)) return false;
+		if (op == ">") {
+			filter.from = end;
+		} else if (op == ">=") {
+			filter.from = start;
+		} else if (op == "<") {
+			filter.to = start;
+		} else if (op == "<=") {
+			filter.to = end;
+		} else if (op.empty() || op == "=") {
+			filter.from = start;
+			filter.to = end;
+		} else {
+			return false;
+		}
+		filter.kind = Query::Filter::MODIFIED;
+		query.filters.push_back(filter);
+		return true;
+	}
+
+	// Local midnight starting a YYYY-MM-DD day, and the next one
+	static bool ParseDay(const std::string& text, int64_t& start, int64_t& end) {
+		int year, month, day;
+		char rest;
+		if (std::sscanf(text.c_str(), "%4d-%2d-%2d%c", &year, &month, &day, &rest) != 3) return false;
+		if (month < 1 || month > 12 || day < 1 || day > 31) return false;
+		std::tm midnight = {};
+		midnight.tm_year = year - 1900;
+		midnight.tm_mon = month - 1;
+		midnight.tm_mday = day;
+		midnight.tm_isdst = -1;
+		start = (int64_t)std::mktime(&midnight);
+		midnight = {};
+		midnight.tm_year = year - 1900;
+		midnight.tm_mon = month - 1;
+		midnight.tm_mday = day + 1;
+		midnight.tm_isdst = -1;
+		end = (int64_t)std::mktime(&midnight);
+		return start != -1 && end != -1;
+	}
+
+	// Whether the note under the cursors has every phrase and NEAR of the
+	// query; `starts` receives where each required item begins
+	static bool Matches(const Query& query, const std::vector<int>& cursorOf, std::vector<WordCursor>& cursors,
+		std::vector<std::vector<uint32_t>>& starts) {
+		std::vector<uint32_t> positions;
+		for (size_t i = 0; i < query.items.size(); i++) {
+			if (query.required[i] && !PhraseStarts(query.items[i], cursorOf, cursors, starts[i], positions)) return false;
+		}
+		for (const Query::Near& near : query.nears) {
+			if (!Near(starts[near.left], (uint32_t)query.items[near.left].size(), starts[near.right],
+				(uint32_t)query.items[near.right].size(), near.distance)) return false;
+		}
+		return true;
+	}
+
+	// Where `item` begins in the note under the cursors, into `at`; false if
+	// nowhere
+	static bool PhraseStarts(const std::vector<size_t>& item, const std::vector<int>& cursorOf,
+		std::vector<WordCursor>& cursors, std::vector<uint32_t>& at, std::vector<uint32_t>& positions) {
+		cursors[cursorOf[item[0]]].cursor.Positions(at);
+		for (size_t j = 1; j < item.size() && !at.empty(); j++) {
+			cursors[cursorOf[item[j]]].cursor.Positions(positions);
+			// Keep the starts with word j right where the phrase needs it
+			size_t kept = 0;
+			size_t p = 0;
+			for (uint32_t start : at) {
+				while (p < positions.size() && positions[p] < start + j) p++;
+				if (p < positions.size() && positions[p] == start + j) at[kept++] = start;
+			}
+			at.resize(kept);
+		}
+		return !at.empty();
+	}
+
+	// Whether an occurrence of item a (starts `a`, `lengthA` words) and one of
+	// item b lie within `distance` words of each other, in either order
+	static bool Near(const std::vector<uint32_t>& a, uint32_t lengthA, const std::vector<uint32_t>& b,
+		uint32_t lengthB, uint32_t distance) {
+		size_t i = 0;
+		size_t j = 0;
+		while (i < a.size() && j < b.size()) {
+			// Overlapping occurrences count as near
+			if (a[i] <= b[j]) {
+				if ((int64_t)b[j] - (a[i] + lengthA - 1) <= (int64_t)distance) return true;
+				i++;
+			} else {
+				if ((int64_t)a[i] - (b[j] + lengthB - 1) <= (int64_t)distance) return true;
+				j++;
+			}
+		}
+		return false;
+	}
+
+	std::vector<Postings> m_terms;
+	std::string m_words;
+	std::vector<uint32_t> m_slots;  // term id + 1, or 0 for a free slot
+	std::vector<Doc> m_docs;
+	std::unordered_map<std::string, uint32_t> m_byNote;
+	DocBitmap m_liveDocs;
+	std::map<std::string, DocBitmap> m_tags;     // by lowercased tag
+	std::map<std::string, DocBitmap> m_folders;  // by Folder(); both may hold retired ids
+	double m_totalLength;  // of live notes
+	size_t m_live;
+	size_t m_retired;      // removed notes whose postings are still there
+};
+
+#endif // OBSIDIAN_SEARCH_INDEX_H
@@ -0,0 +1,306 @@
+// spell_checker.h - Marks misspelled words in the editor
+//
+// Each line is checked once and then again only after it has been edited. A
+// timer, restarted by every edit and scroll, collects the unchecked lines that
+// are on screen, copies their text and styles, and checks them on the task
+// pool; the results come back with CallAfter and are drawn as a squiggle
+// indicator, unless the line changed in the meantime, in which case it simply
+// stays unchecked. Typing in a large note therefore only ever costs the lines
+// in view, and never waits for the checker.
+//
+// Words inside code, links, tags and front matter are skipped using the styles
+// the Markdown lexer has already set, as are words in mixed or upper case,
+// words joined to digits or underscores, and parts of paths and addresses.
+#ifndef OBSIDIAN_SPELL_CHECKER_H
+#define OBSIDIAN_SPELL_CHECKER_H
+
+#include <wx/wx.h>
+#include <wx/dir.h>
+#include <wx/filename.h>
+#include <wx/stc/stc.h>
+
+#include <cwctype>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../common/task_pool.h"
+#include "content_hash.h"
+#include "markdown_lexer.h"
+#include "spell_dictionary.h"
+
+class SpellChecker : public wxTimer {
+public:
+	static const int kIndicator = wxSTC_INDIC_CONTAINER;
+
+	explicit SpellChecker(wxStyledTextCtrl* editor) : m_editor(editor),
+		m_alive(std::make_shared<bool>(true)), m_enabled(true), m_busy(false) {
+		m_editor->IndicatorSetStyle(kIndicator, wxSTC_INDIC_SQUIGGLE);
+		m_editor->IndicatorSetForeground(kIndicator, wxColour(220, 40, 40));
+	}
+
+	~SpellChecker() {
+		Stop();
+		*m_alive = false;
+		m_job.Cancel();
+		m_job.Wait();
+	}
+
+	// Look for "<language>.dic" (and its .aff) in `folders`, in order
+	static bool FindDictionary(const wxArrayString& folders, const wxArrayString& languages,
+		wxString& dicPath, wxString& affPath) {
+		for (const wxString& language : languages) {
+			for (const wxString& folder : folders) {
+				wxFileName dic(folder, language + ".dic");
+				if (!dic.FileExists()) continue;
+				dicPath = dic.GetFullPath();
+				affPath = wxFileName(folder, language + ".aff").GetFullPath();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Build the dictionary on the pool; `done(ok)` runs on the UI thread once
+	// it is in use
+	void LoadDictionary(const wxString& dicPath, const wxString& affPath, std::function<void(bool)> done) {
+		std::string dic(dicPath.fn_str());
+		std::string aff(affPath.fn_str());
+		std::weak_ptr<bool> alive = m_alive;
+		TaskPool::Shared().Submit([this, alive, dic, aff, done]() {
+			auto dictionary = std::make_shared<SpellDictionary>();
+			bool ok = dictionary->Load(dic, aff) && !dictionary->IsEmpty();
+			wxTheApp->CallAfter([this, alive, dictionary, ok, done]() {
+				std::shared_ptr<bool> live = alive.lock();
+				if (!live || !*live) return;
+				if (ok) SetDictionary(dictionary);
+				if (done) done(ok);
+			});
+		}, TaskPriority::Low);
+	}
+
+	void SetDictionary(std::shared_ptr<const SpellDictionary> dictionary) {
+		m_dictionary = dictionary;
+		RecheckAll();
+	}
+
+	const SpellDictionary* Dictionary() const { return m_dictionary.get(); }
+
+	void SetEnabled(bool enabled) {
+		m_enabled = enabled;
+		RecheckAll();
+	}
+
+	bool IsEnabled() const { return m_enabled; }
+
+	// Call from the editor's EVT_STC_MODIFIED handler
+	void Modified(wxStyledTextEvent& event) {
+		if (!(event.GetModificationType() & (wxSTC_MOD_INSERTTEXT | wxSTC_MOD_DELETETEXT))) return;
+		int line = m_editor->LineFromPosition(event.GetPosition());
+		int added = event.GetLinesAdded();
+		if (added > 0 && line < (int)m_checked.size()) {
+			m_checked.insert(m_checked.begin() + line + 1, added, 0);
+		} else if (added < 0 && line + 1 - added <= (int)m_checked.size()) {
+			m_checked.erase(m_checked.begin() + line + 1, m_checked.begin() + line + 1 - added);
+		}
+		if (line < (int)m_checked.size()) m_checked[line] = 0;
+		if (m_enabled && m_dictionary) StartOnce(kTypingPauseMs);
+	}
+
+	// Call when the editor scrolls or resizes
+	void ViewChanged() {
+		if (m_enabled && m_dictionary && !IsRunning()) StartOnce(kScrollPauseMs);
+	}
+
+	void Notify() override { CheckVisibleLines(); }
+
+private:
+	static const int kTypingPauseMs = 300;
+	static const int kScrollPauseMs = 50;
+	static const int kMaxLineBytes = 64 * 1024;  // longer lines are not checked
+
+	struct LineText {
+		int line;
+		uint64_t hash;
+		std::string text;
+		std::string styles;
+		std::vector<std::pair<int, int>> misspelled;  // byte offset and length
+	};
+
+	void RecheckAll() {
+		Stop();
+		m_job.Cancel();
+		m_busy = false;
+		m_checked.assign(m_editor->GetLineCount(), 0);
+		m_editor->SetIndicatorCurrent(kIndicator);
+		m_editor->IndicatorClearRange(0, m_editor->GetLength());
+		if (m_enabled && m_dictionary) StartOnce(kScrollPauseMs);
+	}
+
+	uint64_t LineHash(int start, int end) const {
+		return ContentHash(m_editor->GetCharacterPointer() + start, end - start);
+	}
+
+	void CheckVisibleLines() {
+		if (!m_enabled || !m_dictionary || m_busy) return;
+		if ((int)m_checked.size() != m_editor->GetLineCount()) m_checked.assign(m_editor->GetLineCount(), 0);
+
+		int first = m_editor->DocLineFromVisible(m_editor->GetFirstVisibleLine());
+		int last = wxMin(m_editor->GetLineCount() - 1,
+			m_editor->DocLineFromVisible(m_editor->GetFirstVisibleLine() + m_editor->LinesOnScreen()));
+		auto lines = std::make_shared<std::vector<LineText>>();
+		for (int line = first; line <= last; line++) {
+			if (m_checked[line]) continue;
+			int start = m_editor->PositionFromLine(line);
+			int end = m_editor->GetLineEndPosition(line);
+			if (end - start > kMaxLineBytes) {
+				m_checked[line] = 1;
+				continue;
+			}
+			// Styles come from the lexer; make sure this line has them
+			if (m_editor->GetEndStyled() < end) m_editor->Colourise(start, end);
+			LineText text;
+			text.line = line;
+			text.hash = LineHash(start, end);
+			text.text.assign(m_editor->GetCharacterPointer() + start, end - start);
+			wxMemoryBuffer styled = m_editor->GetStyledText(start, end);
+			const char* pairs = (const char*)styled.GetData();
+			text.styles.resize(end - start);
+			for (int i = 0; i < end - start && 2 * i + 1 < (int)styled.GetDataLen(); i++) text.styles[i] = pairs[2 * i + 1];
+			lines->push_back(std::move(text));
+		}
+		if (lines->empty()) return;
+
+		m_busy = true;
+		m_job = TaskGroup(TaskPool::Shared(), TaskPriority::Normal);
+		std::shared_ptr<const SpellDictionary> dictionary = m_dictionary;
+		std::weak_ptr<bool> alive = m_alive;
+		CancelToken cancel = m_job.Token();
+		m_job.Run([this, lines, dictionary, alive, cancel](const CancelToken&) {
+			for (LineText& text : *lines) {
+				if (cancel.IsCancelled()) return;
+				FindMisspelled(*dictionary, text);
+			}
+			wxTheApp->CallAfter([this, lines, alive, cancel]() {
+				std::shared_ptr<bool> live = alive.lock();
+				if (live && *live && !cancel.IsCancelled()) Apply(*lines);
+			});
+		});
+		m_job.Close();
+	}
+
+	void Apply(const std::vector<LineText>& lines) {
+		m_busy = false;
+		int caret = m_editor->GetCurrentPos();
+		m_editor->SetIndicatorCurrent(kIndicator);
+		for (const LineText& text : lines) {
+			if (text.line >= m_editor->GetLineCount() || text.line >= (int)m_checked.size()) continue;
+			int start = m_editor->PositionFromLine(text.line);
+			int end = m_editor->GetLineEndPosition(text.line);
+			// Edited since it was copied: it is unchecked again anyway
+			if (end - start != (int)text.text.size() || LineHash(start, end) != text.hash) continue;
+			m_editor->IndicatorClearRange(start, end - start);
+			for (const std::pair<int, int>& word : text.misspelled) {
+				// Leave the word being typed alone until the caret moves on
+				if (start + word.first + word.second == caret) continue;
+				m_editor->IndicatorFillRange(start + word.first, word.second);
+			}
+			m_checked[text.line] = 1;
+		}
+		// Lines edited or scrolled into view meanwhile
+		StartOnce(kScrollPauseMs);
+	}
+
+	static bool IsSkippedStyle(char style) {
+		switch (style) {
+			case MD_CODE: case MD_FENCE: case MD_FENCE_INFO: case MD_CODEBLOCK:
+			case MD_WIKILINK: case MD_LINK: case MD_TAG: case MD_FRONTMATTER: case MD_FRONTMATTER_KEY:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	static bool IsApostrophe(char32_t c) { return c == '\'' || c == 0x2019; }
+
+	// Not every locale classifies non-ASCII letters; outside ASCII anything
+	// but symbols and punctuation is taken to be one
+	static bool IsLetter(char32_t c) {
+		if (c < 0x80) return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+		if (std::iswalpha((wint_t)c)) return true;
+		return c >= 0xC0 && c != 0xD7 && c != 0xF7 && !(c >= 0x2000 && c <= 0x2BFF) &&
+			!(c >= 0x3000 && c <= 0x303F) && !(c >= 0xFE30 && c <= 0xFF20);
+	}
+
+	static void FindMisspelled(const SpellDictionary& dictionary, LineText& line) {
+		const std::string& text = line.text;
+		size_t at = 0;
+		char32_t before = 0;
+		while (at < text.size()) {
+			size_t start = at;
+			char32_t c = SpellDictionary::DecodeAt(text.data(), text.size(), at);
+			if (!IsLetter(c)) {
+				before = c;
+				continue;
+			}
+			// A word: letters, with apostrophes between them
+			bool upperInside = false;
+			bool skip = IsSkippedStyle(line.styles[start]);
+			size_t end = at;
+			char32_t after = 0;
+			while (end < text.size()) {
+				size_t next = end;
+				char32_t d = SpellDictionary::DecodeAt(text.data(), text.size(), next);
+				if (IsLetter(d)) {
+					if (std::iswupper((wint_t)d)) upperInside = true;
+					if (IsSkippedStyle(line.styles[end])) skip = true;
+					end = next;
+				} else if (IsApostrophe(d) && next < text.size()) {
+					size_t peek = next;
+					if (!IsLetter(SpellDictionary::DecodeAt(text.data(), text.size(), peek))) {
+						after = d;
+						break;
+					}
+					end = next;
+				} else {
+					after = d;
+					break;
+				}
+			}
+			size_t following = end;
+			char32_t afterNext = 0;
+			if (following < text.size()) {
+				SpellDictionary::DecodeAt(text.data(), text.size(), following);
+				if (following < text.size()) {
+					size_t peek = following;
+					afterNext = SpellDictionary::DecodeAt(text.data(), text.size(), peek);
+				}
+			}
+			at = end;
+
+			// Identifiers, paths, addresses and file names
+			auto joins = [](char32_t c) { return std::iswdigit((wint_t)c) || c == '_' || c == '/' || c == '\\' || c == '@'; };
+			if (joins(before) || joins(after) || upperInside) skip = true;
+			if ((after == '.' || after == ':') && std::iswalnum((wint_t)afterNext)) skip = true;
+			if (before == '.' && start >= 2 && std::iswalnum((wint_t)(unsigned char)text[start - 2])) skip = true;
+			before = 0;
+			if (skip) continue;
+
+			std::string word = text.substr(start, end - start);
+			// Typographic apostrophes are looked up as plain ones
+			size_t curly;
+			while ((curly = word.find("\xE2\x80\x99")) != std::string::npos) word.replace(curly, 3, "'");
+			if (!dictionary.Check(word)) line.misspelled.emplace_back((int)start, (int)(end - start));
+		}
+	}
+
+	wxStyledTextCtrl* m_editor;
+	std::shared_ptr<bool> m_alive;
+	std::shared_ptr<const SpellDictionary> m_dictionary;
+	std::vector<unsigned char> m_checked;  // per line: checked since last edited
+	TaskGroup m_job;
+	bool m_enabled;
+	bool m_busy;
+};
+
+#endif // OBSIDIAN_SPELL_CHECKER_H
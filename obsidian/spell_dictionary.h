@@ -0,0 +1,498 @@
+// spell_dictionary.h - Compact word list for spell checking
+//
+// Load() reads a Hunspell dictionary (.dic plus its .aff), expands each word
+// with the prefix and suffix rules its flags name, and stores the resulting
+// forms as a DAWG: a trie over UTF-8 bytes in which identical subtrees are
+// shared, so the many words ending in "-ing" or "-ness" store that ending once.
+// The DAWG is packed into an array of 32-bit edges with their byte labels
+// beside it, which keeps a 150,000 form English dictionary well under a
+// megabyte. A Bloom filter in front
+// of it turns most misspellings away without walking the DAWG.
+//
+// Only the affix features that decide which forms exist are supported: PFX and
+// SFX rules with their conditions, cross products, FLAG long/num, NEEDAFFIX and
+// FORBIDDENWORD. Compounding, suggestions and morphology are not.
+#ifndef OBSIDIAN_SPELL_DICTIONARY_H
+#define OBSIDIAN_SPELL_DICTIONARY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cwctype>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "content_hash.h"
+
+class SpellDictionary {
+public:
+	SpellDictionary() : m_words(0) {}
+
+	// `affPath` may be empty, or name a missing file, for a plain word list
+	bool Load(const std::string& dicPath, const std::string& affPath) {
+		Affixes affixes;
+		if (!affPath.empty()) ReadAffixes(affPath, affixes);
+		std::ifstream dic(dicPath, std::ios::binary);
+		if (!dic.is_open()) return false;
+
+		std::vector<std::string> words;
+		std::string line;
+		bool first = true;
+		while (std::getline(dic, line)) {
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+			if (affixes.latin1) line = Latin1ToUtf8(line);
+			// The first line is the (approximate) word count
+			if (first) {
+				first = false;
+				if (!line.empty() && line.find_first_not_of("0123456789 \t") == std::string::npos) continue;
+			}
+			// "word/FLAGS\tmorphology"; a backslash escapes a slash in the word
+			std::string word;
+			size_t i = 0;
+			for (; i < line.size() && line[i] != '\t'; i++) {
+				if (line[i] == '\\' && i + 1 < line.size() && line[i + 1] == '/') {
+					word += '/';
+					i++;
+				} else if (line[i] == '/') {
+					break;
+				} else {
+					word += line[i];
+				}
+			}
+			while (!word.empty() && word.back() == ' ') word.pop_back();
+			if (word.empty()) continue;
+			std::vector<std::string> flags;
+			if (i < line.size() && line[i] == '/') {
+				size_t end = line.find_first_of(" \t", i + 1);
+				flags = ParseFlags(line.substr(i + 1, end == std::string::npos ? std::string::npos : end - i - 1), affixes.flagMode);
+			}
+			Expand(word, flags, affixes, words);
+		}
+		return Build(words);
+	}
+
+	// Build from a plain list of words
+	bool Build(std::vector<std::string> words) {
+		std::sort(words.begin(), words.end());
+		words.erase(std::unique(words.begin(), words.end()), words.end());
+		words.erase(std::remove(words.begin(), words.end(), std::string()), words.end());
+		if (!BuildGraph(words)) return false;
+		BuildBloom(words);
+		m_words = words.size();
+		return true;
+	}
+
+	bool IsEmpty() const { return m_words == 0; }
+	size_t Words() const { return m_words; }
+	size_t Bytes() const {
+		return m_edges.size() * sizeof(uint32_t) + m_labels.size() + m_bloom.size() * sizeof(uint64_t);
+	}
+
+	// Exactly this form
+	bool Contains(const char* word, size_t length) const {
+		if (m_words == 0 || length == 0 || !MayContain(word, length)) return false;
+		uint32_t node = 1;
+		for (size_t i = 0; i < length; i++) {
+			if (node == 0) return false;
+			unsigned char c = (unsigned char)word[i];
+			uint32_t edge = node;
+			for (;; edge++) {
+				if (m_labels[edge] == c) break;
+				if (m_labels[edge] > c || IsLast(m_edges[edge])) return false;
+			}
+			if (i + 1 == length) return IsFinal(m_edges[edge]);
+			node = Target(m_edges[edge]);
+		}
+		return false;
+	}
+
+	// With the usual case rules: "Word" at the start of a sentence is fine if
+	// "word" is, and "WORD" if "word" or "Word" is
+	bool Check(const std::string& word) const {
+		if (Contains(word.data(), word.size())) return true;
+		std::u32string chars = Decode(word);
+		if (chars.empty()) return true;
+		bool restLower = true;
+		bool restUpper = true;
+		for (size_t i = 1; i < chars.size(); i++) {
+			if (std::iswupper((wint_t)chars[i])) restLower = false;
+			if (std::iswlower((wint_t)chars[i])) restUpper = false;
+		}
+		if (!std::iswupper((wint_t)chars[0])) return false;
+		std::u32string lower = chars;
+		for (char32_t& c : lower) c = (char32_t)std::towlower((wint_t)c);
+		std::string folded = Encode(lower);
+		if (restLower) return Contains(folded.data(), folded.size());
+		if (restUpper) {
+			if (Contains(folded.data(), folded.size())) return true;
+			lower[0] = chars[0];
+			std::string capitalized = Encode(lower);
+			return Contains(capitalized.data(), capitalized.size());
+		}
+		return false;
+	}
+
+	static std::u32string Decode(const std::string& text) {
+		std::u32string chars;
+		size_t i = 0;
+		while (i < text.size()) chars += DecodeAt(text.data(), text.size(), i);
+		return chars;
+	}
+
+	static char32_t DecodeAt(const char* text, size_t length, size_t& at) {
+		unsigned char lead = (unsigned char)text[at++];
+		if (lead < 0x80) return lead;
+		int extra = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : -1;
+		if (extra < 0 || lead >= 0xF8) return 0xFFFD;
+		char32_t c = lead & (0x3F >> extra);
+		for (int i = 0; i < extra; i++) {
+			if (at >= length || ((unsigned char)text[at] & 0xC0) != 0x80) return 0xFFFD;
+			c = (c << 6) | ((unsigned char)text[at++] & 0x3F);
+		}
+		return c;
+	}
+
+	static std::string Encode(const std::u32string& chars) {
+		std::string out;
+		for (char32_t c : chars) {
+			if (c < 0x80) {
+				out += (char)c;
+			} else if (c < 0x800) {
+				out += (char)(0xC0 | (c >> 6));
+				out += (char)(0x80 | (c & 0x3F));
+			} else if (c < 0x10000) {
+				out += (char)(0xE0 | (c >> 12));
+				out += (char)(0x80 | ((c >> 6) & 0x3F));
+				out += (char)(0x80 | (c & 0x3F));
+			} else {
+				out += (char)(0xF0 | (c >> 18));
+				out += (char)(0x80 | ((c >> 12) & 0x3F));
+				out += (char)(0x80 | ((c >> 6) & 0x3F));
+				out += (char)(0x80 | (c & 0x3F));
+			}
+		}
+		return out;
+	}
+
+private:
+	enum FlagMode { FlagChar, FlagLong, FlagNum };
+
+	// One element of an affix condition: a character or a [class]
+	struct Condition {
+		std::u32string chars;  // empty for '.'
+		bool negated;
+	};
+
+	struct AffixRule {
+		std::u32string strip;
+		std::u32string add;
+		std::vector<Condition> condition;
+	};
+
+	struct AffixClass {
+		bool prefix = false;
+		bool cross = false;
+		std::vector<AffixRule> rules;
+	};
+
+	struct Affixes {
+		Affixes() : flagMode(FlagChar), latin1(false) {}
+		FlagMode flagMode;
+		bool latin1;
+		std::string needAffix;
+		std::string forbidden;
+		std::unordered_map<std::string, AffixClass> classes;
+	};
+
+	static std::string Latin1ToUtf8(const std::string& text) {
+		std::string out;
+		out.reserve(text.size());
+		for (unsigned char c : text) {
+			if (c < 0x80) {
+				out += (char)c;
+			} else {
+				out += (char)(0xC0 | (c >> 6));
+				out += (char)(0x80 | (c & 0x3F));
+			}
+		}
+		return out;
+	}
+
+	static std::vector<std::string> ParseFlags(const std::string& text, FlagMode mode) {
+		std::vector<std::string> flags;
+		if (mode == FlagNum) {
+			std::stringstream in(text);
+			std::string flag;
+			while (std::getline(in, flag, ',')) {
+				if (!flag.empty()) flags.push_back(flag);
+			}
+		} else if (mode == FlagLong) {
+			for (size_t i = 0; i + 1 < text.size(); i += 2) flags.push_back(text.substr(i, 2));
+		} else {
+			// One character each, which may take several UTF-8 bytes
+			size_t i = 0;
+			while (i < text.size()) {
+				size_t start = i;
+				DecodeAt(text.data(), text.size(), i);
+				flags.push_back(text.substr(start, i - start));
+			}
+		}
+		return flags;
+	}
+
+	static std::vector<Condition> ParseCondition(const std::u32string& text) {
+		std::vector<Condition> condition;
+		if (text == U".") return condition;
+		for (size_t i = 0; i < text.size(); i++) {
+			Condition element = {std::u32string(), false};
+			if (text[i] == '[') {
+				size_t close = text.find(']', i);
+				if (close == std::u32string::npos) close = text.size();
+				size_t from = i + 1;
+				if (from < close && text[from] == '^') {
+					element.negated = true;
+					from++;
+				}
+				element.chars = text.substr(from, close - from);
+				i = close;
+			} else if (text[i] != '.') {
+				element.chars = text.substr(i, 1);
+			}
+			condition.push_back(element);
+		}
+		return condition;
+	}
+
+	static bool Matches(const Condition& element, char32_t c) {
+		if (element.chars.empty()) return true;
+		bool found = element.chars.find(c) != std::u32string::npos;
+		return found != element.negated;
+	}
+
+	static void ReadAffixes(const std::string& path, Affixes& affixes) {
+		std::ifstream aff(path, std::ios::binary);
+		std::string line;
+		while (std::getline(aff, line)) {
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+			std::stringstream in(line);
+			std::string key;
+			in >> key;
+			if (key == "SET") {
+				std::string set;
+				in >> set;
+				affixes.latin1 = set == "ISO8859-1" || set == "ISO-8859-1";
+			} else if (key == "FLAG") {
+				std::string mode;
+				in >> mode;
+				affixes.flagMode = mode == "long" ? FlagLong : mode == "num" ? FlagNum : FlagChar;
+			} else if (key == "NEEDAFFIX" || key == "PSEUDOROOT") {
+				in >> affixes.needAffix;
+			} else if (key == "FORBIDDENWORD") {
+				in >> affixes.forbidden;
+			} else if (key == "PFX" || key == "SFX") {
+				std::string flag, strip, add, condition;
+				if (!(in >> flag >> strip >> add)) continue;
+				auto found = affixes.classes.find(flag);
+				if (found == affixes.classes.end()) {
+					// The header comes first: "SFX flag cross-product count"
+					AffixClass& affixClass = affixes.classes[flag];
+					affixClass.prefix = key == "PFX";
+					affixClass.cross = strip == "Y";
+					continue;
+				}
+				AffixClass& affixClass = found->second;
+				if (!(in >> condition)) condition = ".";
+				if (affixes.latin1) {
+					strip = Latin1ToUtf8(strip);
+					add = Latin1ToUtf8(add);
+					condition = Latin1ToUtf8(condition);
+				}
+				// Continuation flags ("s/XY") would allow a second affix; not supported
+				add = add.substr(0, add.find('/'));
+				AffixRule rule;
+				rule.strip = strip == "0" ? std::u32string() : Decode(strip);
+				rule.add = add == "0" ? std::u32string() : Decode(add);
+				rule.condition = ParseCondition(Decode(condition));
+				affixClass.rules.push_back(rule);
+			}
+		}
+	}
+
+	static bool ApplyRule(const AffixRule& rule, bool prefix, const std::u32string& word, std::u32string& out) {
+		size_t n = rule.condition.size();
+		if (word.size() < n || word.size() <= rule.strip.size()) return false;
+		for (size_t i = 0; i < n; i++) {
+			char32_t c = prefix ? word[i] : word[word.size() - n + i];
+			if (!Matches(rule.condition[i], c)) return false;
+		}
+		if (prefix) {
+			if (word.compare(0, rule.strip.size(), rule.strip) != 0) return false;
+			out = rule.add + word.substr(rule.strip.size());
+		} else {
+			if (word.compare(word.size() - rule.strip.size(), rule.strip.size(), rule.strip) != 0) return false;
+			out = word.substr(0, word.size() - rule.strip.size()) + rule.add;
+		}
+		return true;
+	}
+
+	static void Expand(const std::string& word, const std::vector<std::string>& flags, const Affixes& affixes,
+		std::vector<std::string>& out) {
+		bool needAffix = false;
+		for (const std::string& flag : flags) {
+			if (flag == affixes.forbidden) return;
+			if (flag == affixes.needAffix) needAffix = true;
+		}
+		if (!needAffix) out.push_back(word);
+		if (flags.empty() || affixes.classes.empty()) return;
+
+		std::u32string chars = Decode(word);
+		std::vector<std::u32string> suffixed;  // forms that may also take a prefix
+		std::u32string form;
+		for (const std::string& flag : flags) {
+			auto found = affixes.classes.find(flag);
+			if (found == affixes.classes.end() || found->second.prefix) continue;
+			for (const AffixRule& rule : found->second.rules) {
+				if (!ApplyRule(rule, false, chars, form)) continue;
+				out.push_back(Encode(form));
+				if (found->second.cross) suffixed.push_back(form);
+			}
+		}
+		for (const std::string& flag : flags) {
+			auto found = affixes.classes.find(flag);
+			if (found == affixes.classes.end() || !found->second.prefix) continue;
+			for (const AffixRule& rule : found->second.rules) {
+				if (ApplyRule(rule, true, chars, form)) out.push_back(Encode(form));
+				if (!found->second.cross) continue;
+				for (const std::u32string& base : suffixed) {
+					if (ApplyRule(rule, true, base, form)) out.push_back(Encode(form));
+				}
+			}
+		}
+	}
+
+	// Packed edge: "target is final", "last edge of its node", and the index
+	// of the target's first edge (0: no edges). The label is m_labels at the
+	// same index, which leaves the target 30 bits, about a billion edges.
+	static const int kTargetShift = 2;
+	static const uint32_t kMaxTarget = (1u << (32 - kTargetShift)) - 1;
+
+	static bool IsFinal(uint32_t edge) { return (edge & 1) != 0; }
+	static bool IsLast(uint32_t edge) { return (edge & 2) != 0; }
+	static uint32_t Target(uint32_t edge) { return edge >> kTargetShift; }
+
+	struct BuildNode {
+		bool final;
+		std::vector<std::pair<unsigned char, uint32_t>> edges;
+	};
+
+	// Incremental construction from sorted words (Daciuk et al.): once a word
+	// no longer shares a node with the next one, that node's subtree is
+	// complete and is replaced by an identical one already registered.
+	bool BuildGraph(const std::vector<std::string>& words) {
+		std::vector<BuildNode> nodes(1, BuildNode{false, {}});
+		std::unordered_map<std::string, uint32_t> registry;
+		std::vector<uint32_t> path(1, 0);
+		std::string previous;
+
+		auto signature = [&](uint32_t node) {
+			std::string key(1, nodes[node].final ? '1' : '0');
+			for (const auto& edge : nodes[node].edges) {
+				key += (char)edge.first;
+				key.append((const char*)&edge.second, sizeof(edge.second));
+			}
+			return key;
+		};
+		auto minimize = [&](size_t depth) {
+			while (path.size() > depth + 1) {
+				uint32_t child = path.back();
+				path.pop_back();
+				auto found = registry.emplace(signature(child), child);
+				if (!found.second) nodes[path.back()].edges.back().second = found.first->second;
+			}
+		};
+
+		for (const std::string& word : words) {
+			size_t common = 0;
+			while (common < word.size() && common < previous.size() && word[common] == previous[common]) common++;
+			minimize(common);
+			for (size_t i = common; i < word.size(); i++) {
+				nodes.push_back(BuildNode{false, {}});
+				uint32_t node = (uint32_t)nodes.size() - 1;
+				nodes[path.back()].edges.emplace_back((unsigned char)word[i], node);
+				path.push_back(node);
+			}
+			nodes[path.back()].final = true;
+			previous = word;
+		}
+		minimize(0);
+
+		// Lay the reachable nodes out as runs of edges; index 0 is reserved
+		std::vector<uint32_t> start(nodes.size(), 0);
+		std::vector<uint32_t> order(1, 0);
+		uint32_t next = 1;
+		start[0] = next;
+		next += (uint32_t)nodes[0].edges.size();
+		for (size_t i = 0; i < order.size(); i++) {
+			for (const auto& edge : nodes[order[i]].edges) {
+				uint32_t target = edge.second;
+				if (start[target] != 0 || nodes[target].edges.empty()) continue;
+				start[target] = next;
+				next += (uint32_t)nodes[target].edges.size();
+				order.push_back(target);
+			}
+		}
+		if (next > kMaxTarget) return false;
+		m_edges.assign(next, 0);
+		m_labels.assign(next, 0);
+		for (uint32_t node : order) {
+			const std::vector<std::pair<unsigned char, uint32_t>>& edges = nodes[node].edges;
+			for (size_t k = 0; k < edges.size(); k++) {
+				uint32_t target = edges[k].second;
+				m_labels[start[node] + k] = edges[k].first;
+				m_edges[start[node] + k] = (nodes[target].final ? 1 : 0) | (k + 1 == edges.size() ? 2 : 0) |
+					(start[target] << kTargetShift);
+			}
+		}
+		if (nodes[0].edges.empty()) {
+			m_edges.push_back(2);
+			m_labels.push_back(0);
+		}
+		return true;
+	}
+
+	// About ten bits per word: roughly one misspelling in a hundred gets past
+	// the filter to the DAWG
+	static const int kBloomHashes = 6;
+
+	void BuildBloom(const std::vector<std::string>& words) {
+		size_t bits = std::max<size_t>(64, words.size() * 10);
+		m_bloom.assign((bits + 63) / 64, 0);
+		for (const std::string& word : words) {
+			uint64_t h1 = ContentHash(word.data(), word.size());
+			uint64_t h2 = ContentHash(word.data(), word.size(), h1) | 1;
+			for (int k = 0; k < kBloomHashes; k++) {
+				uint64_t bit = (h1 + k * h2) % (m_bloom.size() * 64);
+				m_bloom[bit / 64] |= 1ULL << (bit % 64);
+			}
+		}
+	}
+
+	bool MayContain(const char* word, size_t length) const {
+		uint64_t h1 = ContentHash(word, length);
+		uint64_t h2 = ContentHash(word, length, h1) | 1;
+		for (int k = 0; k < kBloomHashes; k++) {
+			uint64_t bit = (h1 + k * h2) % (m_bloom.size() * 64);
+			if (!(m_bloom[bit / 64] & (1ULL << (bit % 64)))) return false;
+		}
+		return true;
+	}
+
+	std::vector<uint32_t> m_edges;
+	std::vector<unsigned char> m_labels;
+	std::vector<uint64_t> m_bloom;
+	size_t m_words;
+};
+
+#endif // OBSIDIAN_SPELL_DICTIONARY_H
@@ -0,0 +1,298 @@
+// title_index.h - Note titles and aliases by prefix, most linked first
+//
+// A radix tree over lowercased titles: every node holds the edge label that
+// leads to it, the titles whose key ends there, and the highest score (link
+// count) anywhere below it. Complete() walks down to the node covering the
+// typed prefix and then expands nodes best first, ordered by that maximum and
+// by depth, so the first k titles taken from the queue are the k most linked
+// ones (shorter titles first among equals) after looking at roughly k nodes,
+// however many titles share the prefix.
+//
+// Scores change as links are saved. Links resolve by note name, so SetScore()
+// takes a LinkIndex key and updates the titles of every note with that name,
+// and the maxima on the way up to the root.
+#ifndef OBSIDIAN_TITLE_INDEX_H
+#define OBSIDIAN_TITLE_INDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "link_index.h"
+
+class TitleIndex {
+public:
+	struct Match {
+		std::string title;  // as written: the note's name or one of its aliases
+		std::string note;   // vault-relative path
+		bool alias;
+		int score;
+	};
+
+	TitleIndex() { Clear(); }
+
+	void Clear() {
+		m_nodes.assign(1, Node());
+		m_titles.clear();
+		m_freeTitles.clear();
+		m_freeNodes.clear();
+		m_byNote.clear();
+		m_byKey.clear();
+		m_count = 0;
+	}
+
+	size_t Count() const { return m_count; }
+
+	// Approximate bytes held
+	size_t MemoryUsage() const {
+		size_t bytes = sizeof(*this) + m_nodes.capacity() * sizeof(Node) + m_titles.capacity() * sizeof(Title) +
+			(m_freeNodes.capacity() + m_freeTitles.capacity()) * sizeof(int);
+		for (const Node& node : m_nodes) {
+			bytes += node.label.capacity() + (node.children.capacity() + node.titles.capacity()) * sizeof(int);
+		}
+		for (const Title& title : m_titles) bytes += title.title.capacity() + title.note.capacity() + title.key.capacity();
+		for (const auto* map : {&m_byNote, &m_byKey}) {
+			bytes += map->bucket_count() * sizeof(void*);
+			for (const auto& entry : *map) bytes += entry.first.capacity() + entry.second.capacity() * sizeof(int) + kNodeBytes;
+		}
+		return bytes;
+	}
+
+	// Add a title for `note`; all titles of a note should have the same score
+	void Add(const std::string& title, const std::string& note, bool alias, int score) {
+		if (title.empty()) return;
+		int id;
+		if (!m_freeTitles.empty()) {
+			id = m_freeTitles.back();
+			m_freeTitles.pop_back();
+		} else {
+			id = (int)m_titles.size();
+			m_titles.emplace_back();
+		}
+		Title& entry = m_titles[id];
+		entry.title = title;
+		entry.note = note;
+		entry.alias = alias;
+		entry.score = score;
+		entry.key = LinkIndex::NoteKey(note);
+		entry.node = Insert(LinkIndex::Lower(title));
+		m_nodes[entry.node].titles.push_back(id);
+		m_byNote[note].push_back(id);
+		m_byKey[entry.key].push_back(id);
+		m_count++;
+		Propagate(entry.node);
+	}
+
+	// Drop every title of `note`
+	void Remove(const std::string& note) {
+		auto found = m_byNote.find(note);
+		if (found == m_byNote.end()) return;
+		for (int id : found->second) {
+			Title& entry = m_titles[id];
+			std::vector<int>& titles = m_nodes[entry.node].titles;
+			titles.erase(std::find(titles.begin(), titles.end(), id));
+			auto sameKey = m_byKey.find(entry.key);
+			sameKey->second.erase(std::find(sameKey->second.begin(), sameKey->second.end(), id));
+			if (sameKey->second.empty()) m_byKey.erase(sameKey);
+			int node = entry.node;
+			entry = Title();
+			m_freeTitles.push_back(id);
+			m_count--;
+			Prune(node);
+		}
+		m_byNote.erase(found);
+	}
+
+	// Score of the notes named by the link key `key`
+	void SetScore(const std::string& key, int score) {
+		auto found = m_byKey.find(key);
+		if (found == m_byKey.end()) return;
+		for (int id : found->second) {
+			if (m_titles[id].score == score) continue;
+			m_titles[id].score = score;
+			Propagate(m_titles[id].node);
+		}
+	}
+
+	// Up to `limit` titles starting with `prefix` (ignoring ASCII case),
+	// highest score first
+	std::vector<Match> Complete(const std::string& prefix, size_t limit) const {
+		std::vector<Match> matches;
+		int node = Locate(LinkIndex::Lower(prefix));
+		if (node < 0 || limit == 0) return matches;
+
+		// Items are titles (id >= 0) or whole subtrees (~node), keyed by the
+		// best score they can still produce and then by depth
+		struct Item {
+			int score;
+			int depth;
+			int id;
+			bool operator<(const Item& other) const {
+				if (score != other.score) return score < other.score;
+				if (depth != other.depth) return depth > other.depth;
+				return id < other.id;
+			}
+		};
+		std::priority_queue<Item> queue;
+		queue.push({m_nodes[node].best, m_nodes[node].depth, ~node});
+		while (!queue.empty() && matches.size() < limit) {
+			Item item = queue.top();
+			queue.pop();
+			if (item.id >= 0) {
+				const Title& title = m_titles[item.id];
+				matches.push_back({title.title, title.note, title.alias, title.score});
+				continue;
+			}
+			const Node& at = m_nodes[~item.id];
+			for (int id : at.titles) queue.push({m_titles[id].score, at.depth, id});
+			for (int child : at.children) {
+				if (m_nodes[child].best != kEmpty) queue.push({m_nodes[child].best, m_nodes[child].depth, ~child});
+			}
+		}
+		return matches;
+	}
+
+private:
+	static const int kEmpty = -1;
+	static const size_t kNodeBytes = 48;  // rough cost of a hash map node
+
+	struct Node {
+		std::string label;          // edge from the parent
+		int parent = -1;
+		int depth = 0;              // key length at this node
+		int best = kEmpty;          // highest score at or below this node
+		std::vector<int> children;  // sorted by the first byte of their labels
+		std::vector<int> titles;
+	};
+
+	struct Title {
+		std::string title;
+		std::string note;
+		std::string key;  // the note's link key
+		bool alias = false;
+		int score = 0;
+		int node = -1;
+	};
+
+	int NewNode(const std::string& label, int parent) {
+		int id;
+		if (!m_freeNodes.empty()) {
+			id = m_freeNodes.back();
+			m_freeNodes.pop_back();
+			m_nodes[id] = Node();
+		} else {
+			id = (int)m_nodes.size();
+			m_nodes.emplace_back();
+		}
+		m_nodes[id].label = label;
+		m_nodes[id].parent = parent;
+		m_nodes[id].depth = m_nodes[parent].depth + (int)label.size();
+		return id;
+	}
+
+	// Child of `node` whose label starts with `c`, or the slot to insert it
+	std::vector<int>::const_iterator FindChild(int node, unsigned char c, bool& found) const {
+		const std::vector<int>& children = m_nodes[node].children;
+		auto at = std::lower_bound(children.begin(), children.end(), c, [this](int child, unsigned char key) {
+			return (unsigned char)m_nodes[child].label[0] < key;
+		});
+		found = at != children.end() && (unsigned char)m_nodes[*at].label[0] == c;
+		return at;
+	}
+
+	void AddChild(int node, int child) {
+		bool found;
+		auto at = FindChild(node, (unsigned char)m_nodes[child].label[0], found);
+		std::vector<int>& children = m_nodes[node].children;
+		children.insert(children.begin() + (at - children.cbegin()), child);
+	}
+
+	// Node for `key`, splitting an edge or adding a leaf as needed
+	int Insert(const std::string& key) {
+		int node = 0;
+		size_t pos = 0;
+		while (pos < key.size()) {
+			bool found;
+			auto at = FindChild(node, (unsigned char)key[pos], found);
+			if (!found) {
+				int leaf = NewNode(key.substr(pos), node);
+				AddChild(node, leaf);
+				return leaf;
+			}
+			int child = *at;
+			const std::string& label = m_nodes[child].label;
+			size_t common = 0;
+			while (common < label.size() && pos + common < key.size() && label[common] == key[pos + common]) common++;
+			if (common < label.size()) {
+				// Split the edge: node -> middle -> child
+				int middle = NewNode(label.substr(0, common), node);
+				std::vector<int>& siblings = m_nodes[node].children;
+				*std::find(siblings.begin(), siblings.end(), child) = middle;
+				m_nodes[child].label.erase(0, common);
+				m_nodes[child].parent = middle;
+				m_nodes[middle].children.push_back(child);
+				m_nodes[middle].best = m_nodes[child].best;
+				child = middle;
+			}
+			node = child;
+			pos += common;
+		}
+		return node;
+	}
+
+	// Node whose key starts with `prefix` and is closest to the root
+	int Locate(const std::string& prefix) const {
+		int node = 0;
+		size_t pos = 0;
+		while (pos < prefix.size()) {
+			bool found;
+			auto at = FindChild(node, (unsigned char)prefix[pos], found);
+			if (!found) return -1;
+			const std::string& label = m_nodes[*at].label;
+			size_t length = std::min(label.size(), prefix.size() - pos);
+			if (label.compare(0, length, prefix, pos, length) != 0) return -1;
+			node = *at;
+			pos += length;
+		}
+		return node;
+	}
+
+	// Recompute the maxima from `node` up, stopping once nothing changes
+	void Propagate(int node) {
+		while (node >= 0) {
+			const Node& at = m_nodes[node];
+			int best = kEmpty;
+			for (int id : at.titles) best = std::max(best, m_titles[id].score);
+			for (int child : at.children) best = std::max(best, m_nodes[child].best);
+			if (best == at.best && node != 0) return;
+			m_nodes[node].best = best;
+			node = at.parent;
+		}
+	}
+
+	// Unlink nodes left without titles or children, then fix the maxima
+	void Prune(int node) {
+		while (node > 0 && m_nodes[node].titles.empty() && m_nodes[node].children.empty()) {
+			int parent = m_nodes[node].parent;
+			std::vector<int>& siblings = m_nodes[parent].children;
+			siblings.erase(std::find(siblings.begin(), siblings.end(), node));
+			m_nodes[node] = Node();
+			m_freeNodes.push_back(node);
+			node = parent;
+		}
+		Propagate(node);
+	}
+
+	std::vector<Node> m_nodes;  // 0 is the root
+	std::vector<Title> m_titles;
+	std::vector<int> m_freeNodes;
+	std::vector<int> m_freeTitles;
+	std::unordered_map<std::string, std::vector<int>> m_byNote;
+	std::unordered_map<std::string, std::vector<int>> m_byKey;
+	size_t m_count;
+};
+
+#endif // OBSIDIAN_TITLE_INDEX_H
@@ -0,0 +1,253 @@
+// vault_rename.h - Rename/move notes and folders and rewrite links to them
+//
+// A rename runs in two phases, once the target is known to be free. First
+// every note that links to a renamed note is read, rewritten and written to a
+// temporary file next to it, in parallel on the shared task pool; if anything
+// fails nothing in the vault has changed. Then the temporaries
+// replace their originals and the note or folder itself is moved. If a step
+// of that commit fails, the files already replaced are restored from the
+// original contents kept in memory, so the vault is never left half renamed.
+#ifndef OBSIDIAN_VAULT_RENAME_H
+#define OBSIDIAN_VAULT_RENAME_H
+
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "../common/task_pool.h"
+#include "link_index.h"
+
+// Vault-relative note path before and after, with '/' separators and
+// without the ".md" extension. `namesakes` lists every note that had the old
+// name (this one included, in the same form), so that a bare [[Name]] is only
+// rewritten where it resolved to the renamed note.
+struct LinkRename {
+	std::string oldPath;
+	std::string newPath;
+	std::vector<std::string> namesakes;
+};
+
+class VaultRenamer {
+public:
+	struct Result {
+		bool ok = false;
+		std::string error;
+		// Final vault-relative path and new content of every rewritten note
+		std::vector<std::pair<std::string, std::string>> rewritten;
+	};
+
+	// Rewrite the targets of [[links]] in `content`, the note at `fromRel`,
+	// according to `renames`. Links written as a bare name are matched by name
+	// (and resolved among namesakes as seen from `fromRel`) and keep that
+	// form; links written with folders must match the whole path.
+	static bool RewriteLinks(const std::string& content, const std::string& fromRel,
+		const std::vector<LinkRename>& renames, std::string& out) {
+		out.clear();
+		out.reserve(content.size() + 64);
+		bool changed = false;
+		LinkIndex::Fence fence;
+		size_t pos = 0;
+
+		while (pos < content.size()) {
+			size_t eol = content.find('\n', pos);
+			size_t next = eol == std::string::npos ? content.size() : eol + 1;
+			if (eol == std::string::npos) eol = content.size();
+
+			// Links in code, fenced or inline, are left as written
+			size_t cursor = pos;
+			if (!fence.Toggles(content, pos, eol) && !fence.IsOpen()) {
+				LinkIndex::ForEachLink(content, pos, eol, [&](size_t open, size_t close) {
+					std::string inner = content.substr(open + 2, close - open - 2);
+					size_t targetEnd = inner.find_first_of("#|^");
+					if (targetEnd == std::string::npos) targetEnd = inner.size();
+					std::string replacement;
+					if (!RenameTarget(inner.substr(0, targetEnd), fromRel, renames, replacement)) return;
+					out.append(content, cursor, open + 2 - cursor);
+					out += replacement;
+					out.append(inner, targetEnd, std::string::npos);
+					out += "]]";
+					changed = true;
+					cursor = close + 2;
+				});
+			}
+			out.append(content, cursor, next - cursor);
+			pos = next;
+		}
+		return changed;
+	}
+
+	// Where `relPath` ends up when `fromRel` (a note or folder) moves to `toRel`
+	static std::string MapPath(const std::string& relPath, const std::string& fromRel,
+		const std::string& toRel) {
+		if (relPath == fromRel) return toRel;
+		if (relPath.size() > fromRel.size() && relPath.compare(0, fromRel.size(), fromRel) == 0 &&
+			relPath[fromRel.size()] == '/') {
+			return toRel + relPath.substr(fromRel.size());
+		}
+		return relPath;
+	}
+
+	// Move `fromRel` to `toRel` (both relative to `root`, with extension for
+	// notes) and rewrite links in `referrers`.
+	static Result Rename(const std::string& root, const std::string& fromRel, const std::string& toRel,
+		const std::vector<LinkRename>& renames, const std::vector<std::string>& referrers) {
+		namespace fs = std::filesystem;
+		Result result;
+
+		struct Pending {
+			std::string relPath;
+			std::string original;
+			std::string updated;
+			bool changed = false;
+		};
+		// Checked before anything is written. A case-only rename on a
+		// case-insensitive filesystem finds the source itself there.
+		std::error_code ec;
+		fs::path source = fs::u8path(root + "/" + fromRel);
+		fs::path target = fs::u8path(root + "/" + toRel);
+		if (fs::exists(target, ec) && !fs::equivalent(source, target, ec)) {
+			result.error = toRel + " already exists";
+			return result;
+		}
+
+		std::vector<Pending> pending(referrers.size());
+		for (size_t i = 0; i < referrers.size(); i++) pending[i].relPath = referrers[i];
+
+		// Phase 1: rewrite into temporary files, in parallel; the first
+		// failure cancels the notes not yet started
+		CancelToken failed;
+		std::mutex errorMutex;
+		TaskPool::Shared().ParallelFor(pending.size(), [&](size_t i) {
+			Pending& p = pending[i];
+			std::string path = root + "/" + p.relPath;
+			if (!LinkIndex::ReadFile(path, p.original)) {
+				Fail(failed, errorMutex, result.error, "Cannot read " + p.relPath);
+				return;
+			}
+			p.changed = RewriteLinks(p.original, p.relPath, renames, p.updated);
+			if (p.changed && !WriteReplacement(path, p.updated)) {
+				Fail(failed, errorMutex, result.error, "Cannot write " + p.relPath);
+			}
+		}, &failed);
+
+		if (failed.IsCancelled()) {
+			for (const Pending& p : pending) {
+				std::error_code ec;
+				if (p.changed) fs::remove(fs::u8path(TempPath(root + "/" + p.relPath)), ec);
+			}
+			return result;
+		}
+
+		// Phase 2: commit the rewritten notes, then move the entry itself
+		std::vector<const Pending*> committed;
+		for (const Pending& p : pending) {
+			if (!p.changed) continue;
+			std::string path = root + "/" + p.relPath;
+			std::error_code ec;
+			fs::rename(fs::u8path(TempPath(path)), fs::u8path(path), ec);
+			if (ec) {
+				result.error = "Cannot replace " + p.relPath + ": " + ec.message();
+				Rollback(root, pending, committed);
+				return result;
+			}
+			committed.push_back(&p);
+		}
+
+		fs::create_directories(target.parent_path(), ec);
+		fs::rename(source, target, ec);
+		if (ec) {
+			result.error = "Cannot move " + fromRel + ": " + ec.message();
+			Rollback(root, pending, committed);
+			return result;
+		}
+
+		for (const Pending* p : committed) {
+			result.rewritten.emplace_back(MapPath(p->relPath, fromRel, toRel), p->updated);
+		}
+		result.ok = true;
+		return result;
+	}
+
+private:
+	static std::string TempPath(const std::string& path) { return path + ".rename-tmp"; }
+
+	// Write `content` to the temporary beside `path`, with the permissions
+	// of `path`, which it is about to replace
+	static bool WriteReplacement(const std::string& path, const std::string& content) {
+		namespace fs = std::filesystem;
+		std::string temp = TempPath(path);
+		std::ofstream file(fs::u8path(temp), std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) return false;
+		file.write(content.data(), (std::streamsize)content.size());
+		file.close();
+		if (file.fail()) return false;
+		std::error_code ec;
+		fs::file_status status = fs::status(fs::u8path(path), ec);
+		if (!ec) fs::permissions(fs::u8path(temp), status.permissions(), ec);
+		return true;
+	}
+
+	static void Fail(const CancelToken& failed, std::mutex& mutex, std::string& error,
+		const std::string& message) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!failed.IsCancelled()) error = message;
+		failed.Cancel();
+	}
+
+	template <typename PendingT>
+	static void Rollback(const std::string& root, const std::vector<PendingT>& pending,
+		const std::vector<const PendingT*>& committed) {
+		namespace fs = std::filesystem;
+		for (const PendingT* p : committed) {
+			std::string path = root + "/" + p->relPath;
+			if (WriteReplacement(path, p->original)) {
+				std::error_code ec;
+				fs::rename(fs::u8path(TempPath(path)), fs::u8path(path), ec);
+			}
+		}
+		for (const PendingT& p : pending) {
+			std::error_code ec;
+			if (p.changed) fs::remove(fs::u8path(TempPath(root + "/" + p.relPath)), ec);
+		}
+	}
+
+	// Blanks around the target, as in [[ Name ]], are matched past and kept
+	static bool RenameTarget(const std::string& target, const std::string& fromRel,
+		const std::vector<LinkRename>& renames, std::string& replacement) {
+		size_t first = target.find_first_not_of(' ');
+		if (first == std::string::npos) return false;
+		size_t last = target.find_last_not_of(' ');
+		std::string trimmed = target.substr(first, last - first + 1);
+
+		bool hasExtension = trimmed.size() > 3 &&
+			LinkIndex::Lower(trimmed.substr(trimmed.size() - 3)) == ".md";
+		std::string bare = hasExtension ? trimmed.substr(0, trimmed.size() - 3) : trimmed;
+		std::string lower = LinkIndex::Lower(bare);
+		bool pathForm = bare.find('/') != std::string::npos;
+
+		for (const LinkRename& rename : renames) {
+			std::string newValue;
+			if (pathForm) {
+				if (lower != LinkIndex::Lower(rename.oldPath)) continue;
+				newValue = rename.newPath;
+			} else {
+				if (lower != LinkIndex::NoteKey(rename.oldPath)) continue;
+				if (rename.namesakes.size() > 1 &&
+					LinkIndex::ResolveName(rename.namesakes, fromRel) != rename.oldPath) continue;
+				size_t slash = rename.newPath.find_last_of('/');
+				newValue = slash == std::string::npos ? rename.newPath : rename.newPath.substr(slash + 1);
+			}
+			if (hasExtension) newValue += ".md";
+			if (newValue == trimmed) return false;
+			replacement = target.substr(0, first) + newValue + target.substr(last + 1);
+			return true;
+		}
+		return false;
+	}
+};
+
+#endif // OBSIDIAN_VAULT_RENAME_H
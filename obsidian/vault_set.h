@@ -0,0 +1,171 @@
+// vault_set.h - Vaults open side by side under one memory budget
+//
+// Every open vault keeps its own store, link and title indexes, history and
+// search index, and runs its own rescans and indexing jobs, all on the shared
+// task pool. One vault is shown at a time; showing another one uses what it
+// already holds and only rescans it in the background.
+//
+// Search indexes are by far the biggest of these caches, so they are what the
+// budget counts (with store images that could not be mapped). When the open
+// vaults together exceed it, the indexes of the vaults shown least recently
+// are spilled: written to a snapshot beside the vault's store if they changed
+// since the last one, then dropped. The shown vault is never spilled. Showing
+// a spilled vault loads its snapshot on the pool and re-indexes only the notes
+// whose content no longer matches the store (SearchIndex::Differences).
+#ifndef OBSIDIAN_VAULT_SET_H
+#define OBSIDIAN_VAULT_SET_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../common/task_pool.h"
+#include "link_index.h"
+#include "note_history.h"
+#include "search_index.h"
+#include "title_index.h"
+#include "vault_store.h"
+
+struct Vault {
+	Vault(const std::string& root, const std::string& storeFile)
+		: root(root), storeFile(storeFile), searchFile(SearchFile(storeFile)),
+		historyJob(TaskPool::Shared(), TaskPriority::Low), scanJob(TaskPool::Shared(), TaskPriority::Low),
+		searchJob(TaskPool::Shared(), TaskPriority::Low) {}
+
+	Vault(const Vault&) = delete;
+	Vault& operator=(const Vault&) = delete;
+
+	// "<name>.store" -> "<name>.search"
+	static std::string SearchFile(const std::string& storeFile) {
+		size_t dot = storeFile.find_last_of('.');
+		return (dot == std::string::npos ? storeFile : storeFile.substr(0, dot)) + ".search";
+	}
+
+	// Bytes held that count against the budget
+	size_t Resident() const { return (search ? searchBytes : 0) + (store.IsMapped() ? 0 : store.Bytes()); }
+
+	std::string root;        // absolute path, UTF-8
+	std::string storeFile;
+	std::string searchFile;  // snapshot of the search index
+
+	VaultStore store;  // only read while scanJob runs
+	LinkIndex links;
+	TitleIndex titles;
+	NoteHistory history;
+	// The history pack is scanned on historyJob; saves and moves meanwhile
+	// wait in historyPending
+	TaskGroup historyJob;
+	bool historyLoading = false;
+	std::vector<std::function<void(NoteHistory&)>> historyPending;
+	TaskGroup scanJob;
+
+	// The search index, or null while it is built, loaded, updated or spilled. A
+	// job on searchJob may replace or update it; notes saved meanwhile are
+	// in searchStale and indexed again once it lands, and a rescan landing
+	// meanwhile sets searchRecheck.
+	std::shared_ptr<SearchIndex> search;
+	std::weak_ptr<SearchIndex> spilling;  // the spilled index, while its snapshot is written
+	std::shared_ptr<SearchIndex> searchReclaim;  // taken back once its snapshot is written
+	CancelToken spillReport;              // drops the report of that write, not the write
+	std::shared_ptr<SearchIndex> searchUpdating;  // the index an update on searchJob changes
+	size_t searchBytes = 0;               // MemoryUsage() when it last landed
+	size_t searchTableBytes = 0;          // the same without postings, which count themselves
+	bool searchSaved = false;             // the snapshot holds what `search` does
+	TaskGroup searchJob;
+	bool searchBuilding = false;
+	bool searchRecheck = false;
+	std::set<std::string> searchStale;
+
+	std::string openNote;   // vault-relative note shown when the vault was last left
+	uint64_t lastShown = 0;
+};
+
+class VaultSet {
+public:
+	VaultSet() : m_budget((size_t)1024 * 1024 * 1024), m_tick(0) {}
+
+	const std::vector<std::unique_ptr<Vault>>& Vaults() const { return m_vaults; }
+
+	Vault* Find(const std::string& root) const {
+		for (const std::unique_ptr<Vault>& vault : m_vaults) {
+			if (vault->root == root) return vault.get();
+		}
+		return nullptr;
+	}
+
+	Vault* Add(const std::string& root, const std::string& storeFile) {
+		m_vaults.push_back(std::unique_ptr<Vault>(new Vault(root, storeFile)));
+		return m_vaults.back().get();
+	}
+
+	// Take `vault` out of the set. Its jobs may still be running; the caller
+	// frees it once they have finished.
+	std::unique_ptr<Vault> Remove(Vault* vault) {
+		std::unique_ptr<Vault> removed;
+		for (size_t i = 0; i < m_vaults.size(); i++) {
+			if (m_vaults[i].get() != vault) continue;
+			removed = std::move(m_vaults[i]);
+			m_vaults.erase(m_vaults.begin() + i);
+			break;
+		}
+		return removed;
+	}
+
+	// Mark `vault` as the one shown, the last to be spilled
+	void Shown(Vault* vault) { vault->lastShown = ++m_tick; }
+
+	size_t Budget() const { return m_budget; }
+	void SetBudget(size_t bytes) { m_budget = bytes; }
+
+	size_t Resident() const {
+		size_t bytes = 0;
+		for (const std::unique_ptr<Vault>& vault : m_vaults) bytes += vault->Resident();
+		return bytes;
+	}
+
+	// Vaults to spill, least recently shown first, until the rest fit the
+	// budget. Vaults with a search job in flight are left alone.
+	std::vector<Vault*> OverBudget(const Vault* shown) const {
+		std::vector<Vault*> candidates;
+		for (const std::unique_ptr<Vault>& vault : m_vaults) {
+			if (vault.get() != shown && vault->search && !vault->searchBuilding) candidates.push_back(vault.get());
+		}
+		std::sort(candidates.begin(), candidates.end(),
+			[](const Vault* a, const Vault* b) { return a->lastShown < b->lastShown; });
+		std::vector<Vault*> spill;
+		size_t resident = Resident();
+		for (Vault* vault : candidates) {
+			if (resident <= m_budget) break;
+			resident -= vault->searchBytes;
+			spill.push_back(vault);
+		}
+		return spill;
+	}
+
+	// Drop a vault's search index, writing its snapshot on the pool first
+	// if the snapshot is behind; `onSaved` reports on that job
+	static void Spill(Vault& vault, TaskGroup::Reporter onSaved = TaskGroup::Reporter()) {
+		std::shared_ptr<SearchIndex> index = std::move(vault.search);
+		if (!index) return;
+		if (!vault.searchSaved) {
+			vault.spilling = index;
+			vault.searchJob = TaskGroup(TaskPool::Shared(), TaskPriority::Low);
+			if (onSaved) vault.searchJob.SetReporter(onSaved);
+			std::string file = vault.searchFile;
+			vault.searchJob.Run([index, file](const CancelToken&) { index->Save(file); });
+			vault.searchJob.Close();
+		}
+	}
+
+private:
+	std::vector<std::unique_ptr<Vault>> m_vaults;  // in the order they were opened
+	size_t m_budget;
+	uint64_t m_tick;
+};
+
+#endif // OBSIDIAN_VAULT_SET_H
@@ -0,0 +1,627 @@
+// vault_store.h - Memory-mapped metadata store for every entry of a vault
+//
+// The store is one binary file laid out as flat arrays:
+//
+//   header | entries[] | tag refs[] | link refs[] | alias refs[] | string pool
+//
+// Entries are fixed-size records in tree order (each folder is followed by its
+// files, then its subfolders), so a folder's contents are the range
+// [index + 1, end). Names, tags, link keys and front matter aliases are
+// interned once in the string pool and referred to by offset; an entry's tags,
+// links and aliases are the runs of refs between its own offset and the next
+// entry's. Nothing is parsed when the store is opened: the file is mapped and
+// read in place, once every offset in it has been checked against its bounds.
+//
+// Update() rescans the vault, re-reads only notes whose size or mtime changed,
+// and swaps in the new file. If the cache file cannot be written the store is
+// kept in memory instead. The rescan (Scan) only reads the current store, so
+// it can run on a worker while the UI keeps using it; Commit() then swaps the
+// result in on the thread that owns the store.
+#ifndef OBSIDIAN_VAULT_STORE_H
+#define OBSIDIAN_VAULT_STORE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "../common/task_pool.h"
+#include "content_hash.h"
+#include "link_index.h"
+
+struct VaultStoreHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t tagRefCount;
+	uint32_t linkRefCount;
+	uint32_t stringBytes;
+	uint32_t aliasRefCount;
+};
+
+struct VaultStoreEntry {
+	uint64_t size;
+	int64_t mtime;    // file clock ticks, only compared for equality
+	uint64_t hash;    // ContentHash of a note's bytes, 0 for other entries
+	uint32_t parent;  // folder entry, VaultStore::kNone for the vault root
+	uint32_t name;    // string pool offset
+	uint32_t end;     // one past the last entry inside a folder; index + 1 for files
+	uint32_t flags;
+	uint32_t tags;    // first tag ref
+	uint32_t links;   // first link ref
+	uint32_t aliases; // first alias ref
+	uint32_t reserved;
+};
+
+static_assert(sizeof(VaultStoreHeader) == 32, "store header layout");
+static_assert(sizeof(VaultStoreEntry) == 56, "store entry layout");
+
+class VaultStore {
+public:
+	static const uint32_t kNone = 0xffffffffu;
+	static const uint32_t kVersion = 2;
+
+	enum EntryFlags {
+		ENTRY_FOLDER = 1,
+		ENTRY_NOTE = 2
+	};
+
+	VaultStore() = default;
+	VaultStore(const VaultStore&) = delete;
+	VaultStore& operator=(const VaultStore&) = delete;
+	~VaultStore() { Close(); }
+
+	// Map an existing store file. Fails on missing, truncated or foreign files.
+	bool Open(const std::string& file) {
+		Close();
+		if (!Map(file)) return false;
+		if (!Validate()) {
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void Close() {
+		Unmap();
+		m_buffer.clear();
+		m_buffer.shrink_to_fit();
+		m_data = nullptr;
+		m_size = 0;
+	}
+
+	bool IsOpen() const { return m_data != nullptr; }
+	bool IsMapped() const { return IsOpen() && m_buffer.empty(); }
+	size_t Bytes() const { return m_size; }
+
+	uint32_t Count() const { return IsOpen() ? Header().entryCount : 0; }
+	const VaultStoreEntry& Entry(uint32_t i) const { return Entries()[i]; }
+	bool IsFolder(uint32_t i) const { return (Entry(i).flags & ENTRY_FOLDER) != 0; }
+	bool IsNote(uint32_t i) const { return (Entry(i).flags & ENTRY_NOTE) != 0; }
+
+	const char* String(uint32_t offset) const { return Strings() + offset; }
+	const char* Name(uint32_t i) const { return String(Entry(i).name); }
+
+	// Vault-relative path with '/' separators; empty for the root
+	std::string Path(uint32_t i) const {
+		std::vector<uint32_t> chain;
+		for (uint32_t at = i; at != 0 && at != kNone; at = Entry(at).parent) chain.push_back(at);
+		std::string path;
+		for (size_t k = chain.size(); k-- > 0;) {
+			if (!path.empty()) path += '/';
+			path += Name(chain[k]);
+		}
+		return path;
+	}
+
+	uint32_t TagCount(uint32_t i) const { return RefEnd(i, &VaultStoreEntry::tags, Header().tagRefCount) - Entry(i).tags; }
+	const char* Tag(uint32_t i, uint32_t k) const { return String(TagRefs()[Entry(i).tags + k]); }
+	uint32_t LinkCount(uint32_t i) const { return RefEnd(i, &VaultStoreEntry::links, Header().linkRefCount) - Entry(i).links; }
+	const char* Link(uint32_t i, uint32_t k) const { return String(LinkRefs()[Entry(i).links + k]); }
+	uint32_t AliasCount(uint32_t i) const { return RefEnd(i, &VaultStoreEntry::aliases, Header().aliasRefCount) - Entry(i).aliases; }
+	const char* Alias(uint32_t i, uint32_t k) const { return String(AliasRefs()[Entry(i).aliases + k]); }
+
+	// Entry for a vault-relative path, walking down from the root
+	uint32_t Find(const std::string& relPath) const {
+		if (!IsOpen()) return kNone;
+		uint32_t at = 0;
+		size_t pos = 0;
+		while (pos < relPath.size()) {
+			size_t slash = relPath.find('/', pos);
+			if (slash == std::string::npos) slash = relPath.size();
+			std::string part = relPath.substr(pos, slash - pos);
+			uint32_t child = at + 1;
+			uint32_t end = Entry(at).end;
+			while (child < end && part != Name(child)) child = Entry(child).end;
+			if (child >= end) return kNone;
+			at = child;
+			pos = slash + 1;
+		}
+		return at;
+	}
+
+	// Rescan `root` and replace the store with the result, saved to `file`
+	bool Update(const std::string& root, const std::string& file) {
+		std::vector<char> image;
+		if (!Scan(root, image)) return false;
+		Commit(file, std::move(image));
+		return true;
+	}
+
+	// Rescan `root` into a new store image. Notes whose size and mtime are
+	// unchanged keep their hash, tags, links and aliases from the current store; the
+	// others are read in parallel on the task pool. With a `job`, reading
+	// stops when it is cancelled (Scan then fails) and advances its progress
+	// once per note read.
+	bool Scan(const std::string& root, std::vector<char>& image, TaskGroup* job = nullptr) const {
+		return BuildImage(root, job, image);
+	}
+
+	// Replace the store with a scanned image, saved to `file`
+	void Commit(const std::string& file, std::vector<char> image) {
+		// Release the old mapping before replacing the file it maps
+		Close();
+		std::string temp = file + ".tmp";
+		std::error_code ec;
+		std::filesystem::create_directories(std::filesystem::u8path(file).parent_path(), ec);
+		if (WriteFile(temp, image)) {
+			std::filesystem::rename(std::filesystem::u8path(temp), std::filesystem::u8path(file), ec);
+			if (!ec && Open(file)) return;
+			std::filesystem::remove(std::filesystem::u8path(temp), ec);
+		}
+		m_buffer = std::move(image);
+		m_data = m_buffer.data();
+		m_size = m_buffer.size();
+	}
+
+	// Inline #tags and frontmatter `tags:`, lowercased, outside fenced code
+	static std::vector<std::string> ExtractTags(const std::string& content) {
+		std::vector<std::string> tags;
+		bool inFence = false;
+		bool inFrontmatter = false;
+		bool inTagList = false;
+		size_t pos = 0;
+		int line = 0;
+		while (pos < content.size()) {
+			size_t eol = content.find('\n', pos);
+			if (eol == std::string::npos) eol = content.size();
+			std::string text = content.substr(pos, eol - pos);
+			if (!text.empty() && text.back() == '\r') text.pop_back();
+			pos = eol + 1;
+
+			if (line++ == 0 && text == "---") {
+				inFrontmatter = true;
+				continue;
+			}
+			if (inFrontmatter) {
+				if (text == "---" || text == "...") {
+					inFrontmatter = false;
+				} else if (text.compare(0, 5, "tags:") == 0) {
+					AddTagList(text.substr(5), tags);
+					inTagList = text.find_first_not_of(" \t", 5) == std::string::npos;
+				} else if (inTagList && text.find_first_not_of(" \t") != std::string::npos &&
+					text[text.find_first_not_of(" \t")] == '-') {
+					AddTagList(text.substr(text.find('-') + 1), tags);
+				} else {
+					inTagList = false;
+				}
+				continue;
+			}
+
+			size_t start = text.find_first_not_of(" \t");
+			if (start != std::string::npos &&
+				(text.compare(start, 3, "```") == 0 || text.compare(start, 3, "~~~") == 0)) {
+				inFence = !inFence;
+				continue;
+			}
+			if (inFence) continue;
+
+			bool inCode = false;
+			for (size_t i = 0; i < text.size(); i++) {
+				if (text[i] == '`') inCode = !inCode;
+				if (inCode || text[i] != '#') continue;
+				if (i > 0 && text[i - 1] != ' ' && text[i - 1] != '\t' && text[i - 1] != '(') continue;
+				size_t end = i + 1;
+				bool hasLetter = false;
+				while (end < text.size() && IsTagChar(text[end])) {
+					if (text[end] < '0' || text[end] > '9') hasLetter = true;
+					end++;
+				}
+				if (end > i + 1 && hasLetter) tags.push_back(LinkIndex::Lower(text.substr(i + 1, end - i - 1)));
+				i = end - 1;
+			}
+		}
+		std::sort(tags.begin(), tags.end());
+		tags.erase(std::unique(tags.begin(), tags.end()), tags.end());
+		return tags;
+	}
+
+	// Frontmatter `aliases:` (or `alias:`), as written: another name a note
+	// can be linked and found by
+	static std::vector<std::string> ExtractAliases(const std::string& content) {
+		std::vector<std::string> aliases;
+		bool inAliasList = false;
+		size_t pos = 0;
+		int line = 0;
+		while (pos < content.size()) {
+			size_t eol = content.find('\n', pos);
+			if (eol == std::string::npos) eol = content.size();
+			std::string text = content.substr(pos, eol - pos);
+			if (!text.empty() && text.back() == '\r') text.pop_back();
+			pos = eol + 1;
+
+			if (line++ == 0) {
+				if (text != "---") break;
+				continue;
+			}
+			if (text == "---" || text == "...") break;
+			size_t start = text.find_first_not_of(" \t");
+			if (text.compare(0, 8, "aliases:") == 0 || text.compare(0, 6, "alias:") == 0) {
+				size_t colon = text.find(':');
+				AddAliasList(text.substr(colon + 1), aliases);
+				inAliasList = text.find_first_not_of(" \t", colon + 1) == std::string::npos;
+			} else if (inAliasList && start != std::string::npos && text[start] == '-') {
+				AddAlias(text.substr(start + 1), aliases);
+			} else {
+				inAliasList = false;
+			}
+		}
+		std::sort(aliases.begin(), aliases.end());
+		aliases.erase(std::unique(aliases.begin(), aliases.end()), aliases.end());
+		return aliases;
+	}
+
+private:
+	// Entry as collected while scanning, before it is packed into the image
+	struct ScanEntry {
+		std::string name;
+		uint32_t parent = kNone;
+		uint32_t end = 0;
+		uint32_t flags = 0;
+		uint64_t size = 0;
+		int64_t mtime = 0;
+		uint64_t hash = 0;
+		std::vector<std::string> tags;
+		std::vector<std::string> links;
+		std::vector<std::string> aliases;
+		bool fresh = false;  // must be read from disk
+	};
+
+	const VaultStoreHeader& Header() const { return *(const VaultStoreHeader*)m_data; }
+	const VaultStoreEntry* Entries() const {
+		return (const VaultStoreEntry*)(m_data + sizeof(VaultStoreHeader));
+	}
+	const uint32_t* TagRefs() const { return (const uint32_t*)(Entries() + Header().entryCount); }
+	const uint32_t* LinkRefs() const { return TagRefs() + Header().tagRefCount; }
+	const uint32_t* AliasRefs() const { return LinkRefs() + Header().linkRefCount; }
+	const char* Strings() const { return (const char*)(AliasRefs() + Header().aliasRefCount); }
+
+	uint32_t RefEnd(uint32_t i, uint32_t VaultStoreEntry::*field, uint32_t total) const {
+		return i + 1 < Count() ? Entry(i + 1).*field : total;
+	}
+
+	bool Validate() const {
+		if (m_size < sizeof(VaultStoreHeader)) return false;
+		const VaultStoreHeader& header = Header();
+		if (memcmp(header.magic, "OBSVAULT", 8) != 0 || header.version != kVersion) return false;
+		uint64_t expected = sizeof(VaultStoreHeader) + (uint64_t)header.entryCount * sizeof(VaultStoreEntry) +
+			((uint64_t)header.tagRefCount + header.linkRefCount + header.aliasRefCount) * sizeof(uint32_t) +
+			header.stringBytes;
+		if (expected != m_size || header.entryCount == 0 || header.stringBytes == 0) return false;
+		if (Strings()[header.stringBytes - 1] != '\0') return false;
+
+		// Every offset is read in place later, so a damaged or foreign file
+		// must not get as far as the accessors. Strings end at the pool's final
+		// NUL; entries nest inside their parent folder and ref runs never go
+		// backwards.
+		const uint32_t count = header.entryCount;
+		const VaultStoreEntry* entries = Entries();
+		if (entries[0].parent != kNone || entries[0].end != count || !(entries[0].flags & ENTRY_FOLDER)) return false;
+		for (uint32_t i = 0; i < count; i++) {
+			const VaultStoreEntry& entry = entries[i];
+			if (entry.name >= header.stringBytes) return false;
+			if (entry.end <= i || entry.end > count) return false;
+			if (!(entry.flags & ENTRY_FOLDER) && entry.end != i + 1) return false;
+			if (i > 0) {
+				if (entry.parent >= i || !(entries[entry.parent].flags & ENTRY_FOLDER)) return false;
+				if (entry.end > entries[entry.parent].end) return false;
+			}
+			const VaultStoreEntry* next = i + 1 < count ? &entries[i + 1] : nullptr;
+			if (entry.tags > (next ? next->tags : header.tagRefCount)) return false;
+			if (entry.links > (next ? next->links : header.linkRefCount)) return false;
+			if (entry.aliases > (next ? next->aliases : header.aliasRefCount)) return false;
+		}
+		const uint32_t* refs = TagRefs();
+		uint64_t refCount = (uint64_t)header.tagRefCount + header.linkRefCount + header.aliasRefCount;
+		for (uint64_t k = 0; k < refCount; k++) {
+			if (refs[k] >= header.stringBytes) return false;
+		}
+		return true;
+	}
+
+	static bool IsTagChar(char c) {
+		return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+			c == '_' || c == '-' || c == '/' || (unsigned char)c >= 0x80;
+	}
+
+	static void AddTagList(std::string value, std::vector<std::string>& tags) {
+		for (char& c : value) {
+			if (c == '[' || c == ']' || c == ',' || c == '"' || c == '\'') c = ' ';
+		}
+		size_t pos = 0;
+		while ((pos = value.find_first_not_of(" \t#", pos)) != std::string::npos) {
+			size_t end = value.find_first_of(" \t", pos);
+			if (end == std::string::npos) end = value.size();
+			tags.push_back(LinkIndex::Lower(value.substr(pos, end - pos)));
+			pos = end;
+		}
+	}
+
+	// "[One, "Two words"]" or a single unbracketed list
+	static void AddAliasList(std::string value, std::vector<std::string>& aliases) {
+		size_t first = value.find_first_not_of(" \t");
+		size_t last = value.find_last_not_of(" \t");
+		if (first == std::string::npos) return;
+		value = value.substr(first, last - first + 1);
+		if (value.size() >= 2 && value.front() == '[' && value.back() == ']') value = value.substr(1, value.size() - 2);
+		size_t pos = 0;
+		while (pos <= value.size()) {
+			size_t comma = value.find(',', pos);
+			if (comma == std::string::npos) comma = value.size();
+			AddAlias(value.substr(pos, comma - pos), aliases);
+			pos = comma + 1;
+		}
+	}
+
+	static void AddAlias(std::string value, std::vector<std::string>& aliases) {
+		size_t first = value.find_first_not_of(" \t");
+		size_t last = value.find_last_not_of(" \t");
+		if (first == std::string::npos) return;
+		value = value.substr(first, last - first + 1);
+		if (value.size() >= 2 && (value.front() == '"' || value.front() == '\'') && value.back() == value.front()) {
+			value = value.substr(1, value.size() - 2);
+		}
+		if (!value.empty()) aliases.push_back(value);
+	}
+
+	// Walk `dir` into `out` in tree order: files first, then subfolders,
+	// each sorted by name. Hidden entries (.obsidian, .git, ...) are skipped.
+	static void ScanFolder(const std::filesystem::path& dir, uint32_t self, std::vector<ScanEntry>& out) {
+		namespace fs = std::filesystem;
+		std::vector<std::pair<std::string, fs::directory_entry>> files, folders;
+		std::error_code ec;
+		for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+			std::string name = it->path().filename().u8string();
+			if (name.empty() || name[0] == '.') continue;
+			std::error_code typeEc;
+			if (it->is_directory(typeEc)) {
+				folders.emplace_back(name, *it);
+			} else if (it->is_regular_file(typeEc)) {
+				files.emplace_back(name, *it);
+			}
+		}
+		std::sort(files.begin(), files.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+		std::sort(folders.begin(), folders.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+		for (const auto& file : files) {
+			ScanEntry entry;
+			entry.name = file.first;
+			entry.parent = self;
+			entry.end = (uint32_t)out.size() + 1;
+			entry.size = file.second.file_size(ec);
+			entry.mtime = (int64_t)file.second.last_write_time(ec).time_since_epoch().count();
+			size_t len = entry.name.size();
+			if (len > 3 && LinkIndex::Lower(entry.name.substr(len - 3)) == ".md") entry.flags = ENTRY_NOTE;
+			out.push_back(std::move(entry));
+		}
+		for (const auto& folder : folders) {
+			uint32_t index = (uint32_t)out.size();
+			ScanEntry entry;
+			entry.name = folder.first;
+			entry.parent = self;
+			entry.flags = ENTRY_FOLDER;
+			out.push_back(std::move(entry));
+			ScanFolder(folder.second.path(), index, out);
+			out[index].end = (uint32_t)out.size();
+		}
+	}
+
+	bool BuildImage(const std::string& root, TaskGroup* job, std::vector<char>& image) const {
+		namespace fs = std::filesystem;
+		std::error_code ec;
+		fs::path rootPath = fs::u8path(root);
+		if (!fs::is_directory(rootPath, ec)) return false;
+
+		std::vector<ScanEntry> entries(1);
+		entries[0].flags = ENTRY_FOLDER;
+		ScanFolder(rootPath, 0, entries);
+		entries[0].end = (uint32_t)entries.size();
+
+		// Carry over what is known about unchanged notes
+		std::unordered_map<std::string, uint32_t> previous;
+		if (IsOpen()) {
+			previous.reserve(Count());
+			for (uint32_t i = 0; i < Count(); i++) {
+				if (IsNote(i)) previous.emplace(Path(i), i);
+			}
+		}
+		std::vector<uint32_t> stale;
+		std::vector<std::string> paths(entries.size());
+		for (uint32_t i = 1; i < entries.size(); i++) {
+			paths[i] = entries[i].parent == 0 ? entries[i].name : paths[entries[i].parent] + "/" + entries[i].name;
+			if (!(entries[i].flags & ENTRY_NOTE)) continue;
+			auto found = previous.find(paths[i]);
+			const VaultStoreEntry* old = found == previous.end() ? nullptr : &Entry(found->second);
+			if (old && old->size == entries[i].size && old->mtime == entries[i].mtime) {
+				entries[i].hash = old->hash;
+				for (uint32_t k = 0; k < TagCount(found->second); k++) entries[i].tags.push_back(Tag(found->second, k));
+				for (uint32_t k = 0; k < LinkCount(found->second); k++) entries[i].links.push_back(Link(found->second, k));
+				for (uint32_t k = 0; k < AliasCount(found->second); k++) entries[i].aliases.push_back(Alias(found->second, k));
+			} else {
+				stale.push_back(i);
+			}
+		}
+
+		// Read changed notes in parallel
+		TaskPool& tasks = job ? job->Pool() : TaskPool::Shared();
+		if (job) job->SetTotal((int64_t)stale.size());
+		tasks.ParallelFor(stale.size(), [&](size_t k) {
+			ScanEntry& entry = entries[stale[k]];
+			std::string content;
+			if (LinkIndex::ReadFile(root + "/" + paths[stale[k]], content)) {
+				entry.hash = ContentHash(content.data(), content.size());
+				entry.tags = ExtractTags(content);
+				entry.links = LinkIndex::ExtractTargets(content);
+				entry.aliases = ExtractAliases(content);
+			}
+			if (job) job->Advance();
+		}, job ? &job->Token() : nullptr, job ? job->Priority() : TaskPriority::Normal);
+		if (job && job->IsCancelled()) return false;
+
+		// Pack: intern strings, then lay out the arrays back to back
+		std::string pool(1, '\0');
+		std::unordered_map<std::string, uint32_t> interned;
+		auto intern = [&](const std::string& text) {
+			auto found = interned.find(text);
+			if (found != interned.end()) return found->second;
+			uint32_t offset = (uint32_t)pool.size();
+			pool.append(text).push_back('\0');
+			interned.emplace(text, offset);
+			return offset;
+		};
+
+		std::vector<VaultStoreEntry> packed(entries.size());
+		std::vector<uint32_t> tagRefs, linkRefs, aliasRefs;
+		for (size_t i = 0; i < entries.size(); i++) {
+			const ScanEntry& from = entries[i];
+			VaultStoreEntry& to = packed[i];
+			to.size = from.size;
+			to.mtime = from.mtime;
+			to.hash = from.hash;
+			to.parent = from.parent;
+			to.name = intern(from.name);
+			to.end = from.end;
+			to.flags = from.flags;
+			to.tags = (uint32_t)tagRefs.size();
+			to.links = (uint32_t)linkRefs.size();
+			to.aliases = (uint32_t)aliasRefs.size();
+			to.reserved = 0;
+			for (const std::string& tag : from.tags) tagRefs.push_back(intern(tag));
+			for (const std::string& link : from.links) linkRefs.push_back(intern(link));
+			for (const std::string& alias : from.aliases) aliasRefs.push_back(intern(alias));
+		}
+
+		VaultStoreHeader header = {};
+		memcpy(header.magic, "OBSVAULT", 8);
+		header.version = kVersion;
+		header.entryCount = (uint32_t)packed.size();
+		header.tagRefCount = (uint32_t)tagRefs.size();
+		header.linkRefCount = (uint32_t)linkRefs.size();
+		header.stringBytes = (uint32_t)pool.size();
+		header.aliasRefCount = (uint32_t)aliasRefs.size();
+
+		image.clear();
+		image.reserve(sizeof(header) + packed.size() * sizeof(VaultStoreEntry) +
+			(tagRefs.size() + linkRefs.size() + aliasRefs.size()) * sizeof(uint32_t) + pool.size());
+		Append(image, &header, sizeof(header));
+		Append(image, packed.data(), packed.size() * sizeof(VaultStoreEntry));
+		Append(image, tagRefs.data(), tagRefs.size() * sizeof(uint32_t));
+		Append(image, linkRefs.data(), linkRefs.size() * sizeof(uint32_t));
+		Append(image, aliasRefs.data(), aliasRefs.size() * sizeof(uint32_t));
+		Append(image, pool.data(), pool.size());
+		return true;
+	}
+
+	static void Append(std::vector<char>& image, const void* data, size_t bytes) {
+		const char* p = (const char*)data;
+		image.insert(image.end(), p, p + bytes);
+	}
+
+	static bool WriteFile(const std::string& path, const std::vector<char>& image) {
+		std::ofstream file(std::filesystem::u8path(path), std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) return false;
+		file.write(image.data(), (std::streamsize)image.size());
+		file.close();
+		return !file.fail();
+	}
+
+#ifdef _WIN32
+	bool Map(const std::string& file) {
+		m_file = CreateFileW(std::filesystem::u8path(file).wstring().c_str(), GENERIC_READ,
+			FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (m_file == INVALID_HANDLE_VALUE) return false;
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) {
+			Unmap();
+			return false;
+		}
+		m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!m_mapping) {
+			Unmap();
+			return false;
+		}
+		m_data = (const char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!m_data) {
+			Unmap();
+			return false;
+		}
+		m_size = (size_t)size.QuadPart;
+		return true;
+	}
+
+	void Unmap() {
+		if (m_data && m_buffer.empty()) UnmapViewOfFile(m_data);
+		if (m_mapping) CloseHandle(m_mapping);
+		if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+		m_mapping = nullptr;
+		m_file = INVALID_HANDLE_VALUE;
+	}
+
+	HANDLE m_file = INVALID_HANDLE_VALUE;
+	HANDLE m_mapping = nullptr;
+#else
+	bool Map(const std::string& file) {
+		int fd = open(file.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0) {
+			close(fd);
+			return false;
+		}
+		void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (data == MAP_FAILED) return false;
+		m_data = (const char*)data;
+		m_size = (size_t)info.st_size;
+		return true;
+	}
+
+	void Unmap() {
+		if (m_data && m_buffer.empty()) munmap((void*)m_data, m_size);
+	}
+#endif
+
+	const char* m_data = nullptr;
+	size_t m_size = 0;
+	// Fallback when the store could not be written to disk
+	std::vector<char> m_buffer;
+};
+
+#endif // OBSIDIAN_VAULT_STORE_H
@@ -0,0 +1,83 @@
+// code_highlight_test.cpp - CodeHighlighter tokens and the state carried between lines
+//
+// Build and run from the repository root:
+//   g++ -std=c++17 -O2 -pthread -I. tests/code_highlight_test.cpp -o code_highlight_test && ./code_highlight_test
+
+#include "obsidian/code_highlight.h"
+#include <cstdio>
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } \
+} while (0)
+
+// One letter per byte of each line: p(lain), k(eyword), s(tring), n(umber),
+// c(omment), d(irective), K(ey), v(ariable)
+static std::vector<std::string> Tokens(int lang, const std::vector<std::string>& lines) {
+	static const char letters[] = "pksncdKv";
+	std::vector<std::string> result;
+	std::vector<uint8_t> tokens;
+	int state = 0;
+	for (const std::string& line : lines) {
+		state = CodeHighlighter::HighlightLine(lang, line.data(), line.size(), state, tokens);
+		std::string letter;
+		for (uint8_t token : tokens) letter += letters[token];
+		result.push_back(letter);
+	}
+	return result;
+}
+
+static std::string LineTokens(int lang, const std::string& line) { return Tokens(lang, std::vector<std::string>{line})[0]; }
+
+static void TestCpp() {
+	CHECK(LineTokens(MD_LANG_CPP, "#include <x>") == "dddddddddddd");
+	CHECK(LineTokens(MD_LANG_CPP, "int x = 42; // n") == "kkkpppppnnppcccc");
+	CHECK(LineTokens(MD_LANG_CPP, "s = \"a\\\"b\";") == "ppppssssssp");
+	CHECK((Tokens(MD_LANG_CPP, {"a /* one", "two */ b"}) == std::vector<std::string>{"ppcccccc", "ccccccpp"}));
+}
+
+static void TestPython() {
+	CHECK(LineTokens(MD_LANG_PYTHON, "x = '' + \"\"") == "ppppsspppss");
+	CHECK(LineTokens(MD_LANG_PYTHON, "def f(): # c") == "kkkppppppccc");
+	// Triple-quoted strings run on into the next lines, and one or two quotes
+	// inside them do not close them
+	CHECK((Tokens(MD_LANG_PYTHON, {"\"\"\"doc", "say \"hi\" ''", "more\"\"\" if"}) ==
+		std::vector<std::string>{"ssssss", "sssssssssss", "ssssssspkk"}));
+	CHECK((Tokens(MD_LANG_PYTHON, {"x = '''a", "b''' + 'c'"}) ==
+		std::vector<std::string>{"ppppssss", "sssspppsss"}));
+	CHECK((Tokens(MD_LANG_PYTHON, {"'''\\'''", "still'''"}) ==
+		std::vector<std::string>{"sssssss", "ssssssss"}));
+}
+
+static void TestYaml() {
+	CHECK(LineTokens(MD_LANG_YAML, "name: 'quoted'") == "KKKKppssssssss");
+	// A quote inside a plain scalar is just a character
+	CHECK(LineTokens(MD_LANG_YAML, "name: don't panic") == "KKKKppppppppppppp");
+	CHECK(LineTokens(MD_LANG_YAML, "title: say \"hi\" # c") == "KKKKKpppppppppppccc");
+	CHECK(LineTokens(MD_LANG_YAML, "- \"a\"") == "ppsss");
+	CHECK(LineTokens(MD_LANG_YAML, "tags: [a, 'b c']") == "KKKKppppppsssssp");
+	CHECK(LineTokens(MD_LANG_YAML, "\"key\": true") == "KKKKKppkkkk");
+	// Nothing carries into the next line
+	CHECK((Tokens(MD_LANG_YAML, {"a: don't", "b: 'x'"}) == std::vector<std::string>{"Kppppppp", "Kppsss"}));
+}
+
+static void TestRuns() {
+	CodeHighlighter::Lines runs = CodeHighlighter::Highlight(MD_LANG_PYTHON, {"\"\"\"a", "b\"\"\" x"});
+	CHECK(runs.size() == 2);
+	CHECK(runs[1].size() == 2 && runs[1][0].token == CODE_STRING && runs[1][0].length == 4 && runs[1][1].start == 4);
+	CHECK(!CodeHighlighter::Supports(MD_LANG_OTHER) && CodeHighlighter::Supports(MD_LANG_YAML));
+}
+
+int main() {
+	TestCpp();
+	TestPython();
+	TestYaml();
+	TestRuns();
+	if (failures) {
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+	std::printf("code_highlight_test: all passed\n");
+	return 0;
+}
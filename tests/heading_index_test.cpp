@@ -0,0 +1,164 @@
+// heading_index_test.cpp - HeadingIndex headings, incremental edits and changed lines
+//
+// Build and run from the repository root:
+//   g++ -std=c++17 -O2 -pthread -I. tests/heading_index_test.cpp -o heading_index_test && ./heading_index_test
+
+#include "obsidian/heading_index.h"
+#include <cstdio>
+#include <random>
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } \
+} while (0)
+
+static std::string Join(const std::vector<std::string>& lines) {
+	std::string text;
+	for (size_t i = 0; i < lines.size(); i++) text += (i ? "\n" : "") + lines[i];
+	return text;
+}
+
+static HeadingIndex Built(const std::vector<std::string>& lines) {
+	HeadingIndex index;
+	std::string text = Join(lines);
+	index.Rebuild(text.data(), text.size());
+	return index;
+}
+
+// "line:level:title" for each heading
+static std::string Describe(const HeadingIndex& index) {
+	std::string out;
+	for (const Heading& heading : index.Headings()) {
+		out += std::to_string(heading.line) + ":" + std::to_string(heading.level) + ":" + heading.title + " ";
+	}
+	return out;
+}
+
+// Replace `removed` lines at `line` with `added`, reported as the editor
+// does: a deletion, then an insertion
+static void Replace(HeadingIndex& index, std::vector<std::string>& lines, int line, int removed,
+	const std::vector<std::string>& added) {
+	auto read = [&](int at) { return at < (int)lines.size() ? lines[at] : std::string(); };
+	if (removed > 0) {
+		lines.erase(lines.begin() + line, lines.begin() + line + removed);
+		index.Edit(line, -removed, read);
+	}
+	if (!added.empty()) {
+		lines.insert(lines.begin() + line, added.begin(), added.end());
+		index.Edit(line, (int)added.size(), read);
+	}
+}
+
+static void TestHeadings() {
+	HeadingIndex index = Built({"# One ##", "text", "  ## Two", "####### seven", "#nospace", "### Three #"});
+	CHECK(Describe(index) == "0:1:One 2:2:Two 5:3:Three ");
+	CHECK(index.HeadingAt(1) == 0 && index.HeadingAt(4) == 1 && index.HeadingAt(9) == 2);
+	CHECK(Built({"text", "# A"}).HeadingAt(0) == -1);
+}
+
+static void TestFences() {
+	CHECK(Describe(Built({"```", "# not", "```", "# yes"})) == "3:1:yes ");
+	// A shorter or different fence does not close the block
+	CHECK(Describe(Built({"````", "```", "~~~", "# not", "````", "# yes"})) == "5:1:yes ");
+	// A backtick fence with a backtick in its info string is not a fence
+	CHECK(Describe(Built({"``` a`b", "# yes"})) == "1:1:yes ");
+}
+
+static void TestFrontmatter() {
+	CHECK(Describe(Built({"---", "# not", "---", "# yes"})) == "3:1:yes ");
+	CHECK(Describe(Built({"---", "# not", "...", "# yes"})) == "3:1:yes ");
+	// Unclosed, or closed past the limit, "---" is a rule
+	CHECK(Describe(Built({"---", "# yes"})) == "1:1:yes ");
+	std::vector<std::string> lines = {"---", "# yes"};
+	lines.resize(MarkdownLexer::kFrontmatterMaxLines + 1);
+	lines.push_back("---");
+	CHECK(Describe(Built(lines)) == "1:1:yes ");
+	// Only on line 0
+	CHECK(Describe(Built({"", "---", "# yes", "---"})) == "2:1:yes ");
+}
+
+static void TestEdits() {
+	std::vector<std::string> lines = {"# A", "a", "## B", "b", "# C"};
+	HeadingIndex index = Built(lines);
+	uint64_t version = index.Version();
+
+	// Typing in a paragraph leaves the headings and the version alone
+	lines[1] = "ab";
+	index.Edit(1, 0, [&](int at) { return lines[at]; });
+	CHECK(Describe(index) == "0:1:A 2:2:B 4:1:C ");
+	CHECK(index.Version() == version);
+	int first, last;
+	index.ChangedLines(first, last);
+	CHECK(first == 1 && last == 1);
+
+	// Inserted lines move the headings below without a new version
+	Replace(index, lines, 1, 1, {"x", "y", "z"});
+	CHECK(Describe(index) == "0:1:A 4:2:B 6:1:C ");
+	CHECK(index.Version() == version);
+
+	// A new level changes the sections down to the next unchanged heading
+	lines[4] = "### B";
+	index.Edit(4, 0, [&](int at) { return lines[at]; });
+	CHECK(Describe(index) == "0:1:A 4:3:B 6:1:C ");
+	CHECK(index.Version() != version);
+	index.ChangedLines(first, last);
+	CHECK(first == 4 && last == 5);
+
+	// Opening a fence hides every heading after it
+	Replace(index, lines, 1, 0, {"```"});
+	CHECK(Describe(index) == "0:1:A ");
+	index.ChangedLines(first, last);
+	CHECK(first == 1 && last >= (int)lines.size() - 1);
+
+	// Closing "---" after a "---" typed on line 0 turns the top into frontmatter
+	Replace(index, lines, 1, 1, {});
+	Replace(index, lines, 0, 0, {"---"});
+	CHECK(Describe(index) == "1:1:A 5:3:B 7:1:C ");
+	Replace(index, lines, 2, 0, {"---"});
+	CHECK(Describe(index) == "6:3:B 8:1:C ");
+
+	// A "---" that moves up onto line 0 opens frontmatter too
+	lines = {"x", "---", "# A", "---", "# B"};
+	index = Built(lines);
+	CHECK(Describe(index) == "2:1:A 4:1:B ");
+	Replace(index, lines, 0, 1, {});
+	CHECK(Describe(index) == "3:1:B ");
+}
+
+// Random edits must leave the index as a rebuild would make it
+static void TestRandomEdits() {
+	static const char* pool[] = {"# H1", "## H2", "### H3", "text", "", "```", "~~~", "````", "---", "...", "#x"};
+	std::mt19937 random(7);
+	std::vector<std::string> lines = {"text"};
+	HeadingIndex index = Built(lines);
+	for (int step = 0; step < 2000; step++) {
+		int line = (int)(random() % lines.size());
+		int removed = (int)(random() % std::min<size_t>(3, lines.size() - line));
+		std::vector<std::string> added;
+		for (int k = (int)(random() % 3); k > 0; k--) added.push_back(pool[random() % (sizeof(pool) / sizeof(pool[0]))]);
+		// A document always has a line
+		if (removed == (int)lines.size() && added.empty()) added.push_back("");
+		Replace(index, lines, line, removed, added);
+		HeadingIndex fresh = Built(lines);
+		if (Describe(index) != Describe(fresh)) {
+			std::printf("step %d: \"%s\" but rebuilt \"%s\"\n", step, Describe(index).c_str(), Describe(fresh).c_str());
+			failures++;
+			return;
+		}
+	}
+}
+
+int main() {
+	TestHeadings();
+	TestFences();
+	TestFrontmatter();
+	TestEdits();
+	TestRandomEdits();
+	if (failures) {
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+	std::printf("heading_index_test: all passed\n");
+	return 0;
+}
@@ -0,0 +1,121 @@
+// line_diff_test.cpp - LineDiff hunks on small, random and very long texts
+//
+// Build and run from the repository root:
+//   g++ -std=c++17 -O2 -pthread -I. tests/line_diff_test.cpp -o line_diff_test && ./line_diff_test
+
+#include "obsidian/line_diff.h"
+#include <cstdio>
+#include <random>
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } \
+} while (0)
+
+static std::vector<std::string> Lines(const std::string& text) {
+	std::vector<std::string> lines;
+	std::vector<size_t> offsets = SplitLineOffsets(text);
+	for (size_t i = 0; i + 1 < offsets.size(); i++) {
+		std::string line = text.substr(offsets[i], offsets[i + 1] - offsets[i]);
+		while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) line.pop_back();
+		lines.push_back(line);
+	}
+	return lines;
+}
+
+// Hunks must cover both texts in order, and equal hunks hold equal lines
+static bool Valid(const std::string& a, const std::string& b, const std::vector<DiffHunk>& hunks, int* equal = nullptr) {
+	std::vector<std::string> la = Lines(a), lb = Lines(b);
+	int i = 0, j = 0, same = 0;
+	for (const DiffHunk& hunk : hunks) {
+		if (hunk.aStart != i || hunk.bStart != j) return false;
+		if (hunk.kind == DiffHunk::EQUAL) {
+			if (hunk.aCount != hunk.bCount) return false;
+			for (int k = 0; k < hunk.aCount; k++) {
+				if (la[i + k] != lb[j + k]) return false;
+			}
+			same += hunk.aCount;
+		}
+		i += hunk.aCount;
+		j += hunk.bCount;
+	}
+	if (equal) *equal = same;
+	return i == (int)la.size() && j == (int)lb.size();
+}
+
+static void TestSmall() {
+	std::vector<DiffHunk> hunks;
+	CHECK(LineDiff::Diff("a\nb\nc\n", "a\nx\nc\n", hunks));
+	CHECK(hunks.size() == 3);
+	CHECK(hunks.size() == 3 && hunks[1].kind == DiffHunk::CHANGE && hunks[1].aStart == 1 && hunks[1].aCount == 1 &&
+		hunks[1].bStart == 1 && hunks[1].bCount == 1);
+	
+	CHECK(LineDiff::Diff("", "", hunks) && hunks.empty());
+	CHECK(LineDiff::Diff("", "one\ntwo\n", hunks) && hunks.size() == 1 && hunks[0].bCount == 2);
+	// Line breaks do not count, so CRLF and LF texts are equal
+	CHECK(LineDiff::Diff("a\r\nb\r\n", "a\nb\n", hunks) && hunks.size() == 1 && hunks[0].kind == DiffHunk::EQUAL);
+	
+	// A moved block keeps its lines matched rather than the blank lines around it
+	std::string a = "intro\n\nmoved one\nmoved two\n\nmiddle\n\nend\n";
+	std::string b = "intro\n\nmiddle\n\nmoved one\nmoved two\n\nend\n";
+	int equal = 0;
+	CHECK(LineDiff::Diff(a, b, hunks) && Valid(a, b, hunks, &equal));
+	CHECK(equal >= 6);
+	
+	std::atomic<bool> cancel(true);
+	CHECK(!LineDiff::Diff("a\nb\n", "b\na\n", hunks, &cancel));
+}
+
+static void TestRandom() {
+	std::mt19937 rng(7);
+	for (int round = 0; round < 2000; round++) {
+		// Few distinct lines, so most are repeated and anchors are scarce
+		int alphabet = 2 + (int)(rng() % 40);
+		std::string a, b;
+		int lines = (int)(rng() % 200);
+		for (int i = 0; i < lines; i++) {
+			std::string line = "l" + std::to_string(rng() % alphabet) + "\n";
+			a += line;
+			unsigned r = rng() % 10;
+			if (r == 0) continue;
+			if (r == 1) b += "new" + std::to_string(rng() % alphabet) + "\n";
+			b += line;
+		}
+		std::vector<DiffHunk> hunks;
+		CHECK(LineDiff::Diff(a, b, hunks));
+		CHECK(Valid(a, b, hunks));
+	}
+}
+
+static void TestLong() {
+	// Every other line changed: each split lands at the region's edge, which
+	// once made the diff quadratic and its recursion as deep as the file
+	std::string a, b;
+	for (int i = 0; i < 200000; i++) {
+		std::string line = "line " + std::to_string(i) + "\n";
+		a += line;
+		b += i % 2 ? line : "changed " + std::to_string(i) + "\n";
+	}
+	std::vector<DiffHunk> hunks;
+	int equal = 0;
+	CHECK(LineDiff::Diff(a, b, hunks));
+	CHECK(Valid(a, b, hunks, &equal));
+	CHECK(equal == 100000);
+	
+	// A long text diffed against itself with one line added at each end
+	CHECK(LineDiff::Diff(a, "first\n" + a + "last\n", hunks));
+	CHECK(hunks.size() == 3 && hunks[1].kind == DiffHunk::EQUAL && hunks[1].aCount == 200000);
+}
+
+int main() {
+	TestSmall();
+	TestRandom();
+	TestLong();
+	if (failures) {
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+	std::printf("line_diff_test: all passed\n");
+	return 0;
+}
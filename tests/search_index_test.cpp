@@ -0,0 +1,107 @@
+// search_index_test.cpp - SearchIndex ranking, compaction and snapshots
+//
+// Build and run from the repository root:
+//   g++ -std=c++17 -O2 -pthread -I. tests/search_index_test.cpp -o search_index_test && ./search_index_test
+
+#include "obsidian/search_index.h"
+#include <cstdio>
+#include <set>
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } \
+} while (0)
+
+static std::string NoteName(int i) { return "notes/n" + std::to_string(i) + ".md"; }
+
+// Notes divisible by `every` mention beta; all mention alpha
+static std::string NoteText(int i, int every) {
+	std::string text = "# Note " + std::to_string(i) + "\nalpha gamma" + std::to_string(i % 7);
+	if (i % every == 0) text += " beta";
+	return text + "\n";
+}
+
+static std::set<std::string> Notes(const std::vector<SearchIndex::Result>& results) {
+	std::set<std::string> notes;
+	for (const SearchIndex::Result& result : results) notes.insert(result.note);
+	return notes;
+}
+
+static std::set<std::string> Expected(int count, int every) {
+	std::set<std::string> notes;
+	for (int i = 0; i < count; i++) {
+		if (i % every == 0) notes.insert(NoteName(i));
+	}
+	return notes;
+}
+
+static void TestRanking() {
+	SearchIndex index;
+	index.Add(SearchIndex::Analyze("short.md", "kettle", 0));
+	index.Add(SearchIndex::Analyze("long.md", "kettle and a great many other words besides the kettle", 0));
+	index.Add(SearchIndex::Analyze("kettle.md", "nothing here", 0));
+	std::vector<SearchIndex::Result> results = index.Search("kettle", 10);
+	CHECK(results.size() == 3);
+	// The title weighs more than the body, and a short body more than a long one
+	CHECK(!results.empty() && results[0].note == "kettle.md");
+	CHECK(results.size() == 3 && results[1].note == "short.md");
+	CHECK(index.Search("\"great many\"", 10).size() == 1);
+	CHECK(index.Search("kettle -besides", 10).size() == 2);
+}
+
+static void TestCompact() {
+	// Saving every note again retires its old postings until Compact drops them
+	const int count = 3000;
+	SearchIndex index;
+	for (int i = 0; i < count; i++) index.Add(SearchIndex::Analyze(NoteName(i), NoteText(i, 3), 0));
+	CHECK(!index.WantsCompact());
+	for (int i = 0; i < count; i++) index.Add(SearchIndex::Analyze(NoteName(i), NoteText(i, 5), 0));
+	CHECK(index.WantsCompact());
+	CHECK(Notes(index.Search("beta", count)) == Expected(count, 5));
+	
+	index.Compact();
+	CHECK(!index.WantsCompact());
+	CHECK(index.NoteCount() == (size_t)count);
+	// Every word is still found after compaction, including ones added since
+	CHECK(Notes(index.Search("beta", count)) == Expected(count, 5));
+	CHECK(index.Search("alpha", count).size() == (size_t)count);
+	CHECK(index.Search("gamma3", count).size() == (size_t)(count / 7 + 1));
+	index.Add(SearchIndex::Analyze("late.md", "beta delta", 0));
+	CHECK(index.Search("delta", 10).size() == 1);
+	CHECK(index.Search("beta", count).size() == (size_t)(count / 5 + 1));
+	
+	// And the snapshot of a compacted index reads back the same
+	std::string file = "search_index_test.snapshot";
+	CHECK(index.Save(file));
+	SearchIndex loaded;
+	CHECK(loaded.Load(file));
+	std::remove(file.c_str());
+	CHECK(loaded.NoteCount() == index.NoteCount());
+	CHECK(Notes(loaded.Search("beta", count)) == Notes(index.Search("beta", count)));
+	CHECK(loaded.Search("delta", 10).size() == 1);
+}
+
+static void TestRemove() {
+	SearchIndex index;
+	for (int i = 0; i < 2000; i++) index.Add(SearchIndex::Analyze(NoteName(i), NoteText(i, 2), 0));
+	for (int i = 0; i < 2000; i += 4) index.Remove(NoteName(i));
+	CHECK(index.NoteCount() == 1500);
+	std::set<std::string> expected;
+	for (int i = 2; i < 2000; i += 4) expected.insert(NoteName(i));
+	CHECK(Notes(index.Search("beta", 2000)) == expected);
+	index.Compact();
+	CHECK(Notes(index.Search("beta", 2000)) == expected);
+}
+
+int main() {
+	TestRanking();
+	TestCompact();
+	TestRemove();
+	if (failures) {
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+	std::printf("search_index_test: all passed\n");
+	return 0;
+}